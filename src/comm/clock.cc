@@ -0,0 +1,149 @@
+#include <time.h>
+#include "src/comm/clock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TINYRPC_CLOCK_TSC 1
+#endif
+
+namespace tinyrpc{
+
+// 本线程缓存的时间，reactor每轮循环刷新
+static thread_local bool t_cache_enable = false;
+static thread_local int64_t t_mono_us = 0;
+static thread_local int64_t t_wall_us = 0;
+
+// 校准时间，足够让clock_gettime的误差小于十万分之一
+static const int64_t TSC_CALIBRATE_NS = 2000000;
+
+static int64_t readClockNs(clockid_t id)
+{
+    timespec ts;
+    clock_gettime(id, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef TINYRPC_CLOCK_TSC
+// TSC频率对单调时钟校准一次，之后换算不再读时钟
+struct TscCalibration{
+    bool usable {false};
+    double ns_per_cycle {1.0};
+    uint64_t base_cycles {0};
+    int64_t base_ns {0};
+
+    TscCalibration()
+    {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        // 0x80000007 EDX bit 8：不变TSC
+        if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 || !(edx & (1u << 8)))
+        {
+            return;
+        }
+        int64_t begin_ns = readClockNs(CLOCK_MONOTONIC);
+        uint64_t begin_cycles = __rdtsc();
+        int64_t end_ns = begin_ns;
+        while(end_ns - begin_ns < TSC_CALIBRATE_NS)
+        {
+            end_ns = readClockNs(CLOCK_MONOTONIC);
+        }
+        uint64_t end_cycles = __rdtsc();
+        if(end_cycles <= begin_cycles)
+        {
+            return;
+        }
+        ns_per_cycle = static_cast<double>(end_ns - begin_ns) / (end_cycles - begin_cycles);
+        base_cycles = end_cycles;
+        base_ns = end_ns;
+        usable = true;
+    }
+};
+
+static const TscCalibration& getTscCalibration()
+{
+    static TscCalibration calibration;
+    return calibration;
+}
+#endif
+
+int64_t Clock::nowMs()
+{
+    return nowUs() / 1000;
+}
+
+int64_t Clock::nowUs()
+{
+    if(t_cache_enable)
+    {
+        return t_mono_us;
+    }
+    return readClockNs(CLOCK_MONOTONIC) / 1000;
+}
+
+int64_t Clock::wallUs()
+{
+    if(t_cache_enable)
+    {
+        return t_wall_us;
+    }
+    return readClockNs(CLOCK_REALTIME) / 1000;
+}
+
+int64_t Clock::preciseNs()
+{
+#ifdef TINYRPC_CLOCK_TSC
+    const TscCalibration& calibration = getTscCalibration();
+    if(calibration.usable)
+    {
+        int64_t delta = static_cast<int64_t>(__rdtsc() - calibration.base_cycles);
+        return calibration.base_ns + static_cast<int64_t>(delta * calibration.ns_per_cycle);
+    }
+#endif
+    return readClockNs(CLOCK_MONOTONIC);
+}
+
+uint64_t Clock::cycles()
+{
+#ifdef TINYRPC_CLOCK_TSC
+    if(getTscCalibration().usable)
+    {
+        return __rdtsc();
+    }
+#endif
+    return static_cast<uint64_t>(readClockNs(CLOCK_MONOTONIC));
+}
+
+int64_t Clock::cyclesToNs(uint64_t cycles)
+{
+#ifdef TINYRPC_CLOCK_TSC
+    const TscCalibration& calibration = getTscCalibration();
+    if(calibration.usable)
+    {
+        return static_cast<int64_t>(cycles * calibration.ns_per_cycle);
+    }
+#endif
+    return static_cast<int64_t>(cycles);
+}
+
+bool Clock::isTscSupport()
+{
+#ifdef TINYRPC_CLOCK_TSC
+    return getTscCalibration().usable;
+#else
+    return false;
+#endif
+}
+
+void Clock::refresh()
+{
+    t_mono_us = readClockNs(CLOCK_MONOTONIC) / 1000;
+    t_wall_us = readClockNs(CLOCK_REALTIME) / 1000;
+    t_cache_enable = true;
+}
+
+void Clock::stopCache()
+{
+    t_cache_enable = false;
+}
+
+} // namespace tinyrpc
@@ -0,0 +1,45 @@
+#ifndef SRC_COMM_CLOCK_H
+#define SRC_COMM_CLOCK_H
+
+#include <stdint.h>
+
+/*
+
+    时钟，所有取时间的地方都走这里
+    1. 粗粒度时钟：reactor每轮循环epoll_wait返回之后刷新一次本线程的缓存，循环里取时间不再读时钟
+       单调时钟给定时器和计算间隔用，墙上时间给日志用。不在reactor循环里的线程每次直接读时钟
+       缓存最多落后一轮循环，只能用在ms级别的超时、统计上
+    2. 高精度时钟：CPU有不变TSC(频率固定、深度睡眠不停)的时候用rdtsc，第一次使用的时候对单调时钟校准一次
+       没有的话退回clock_gettime(CLOCK_MONOTONIC)。用来测一轮循环之内的耗时
+
+*/
+
+namespace tinyrpc{
+
+class Clock{
+public:
+    // 粗粒度单调时钟
+    static int64_t nowMs();
+    static int64_t nowUs();
+
+    // 粗粒度墙上时间(从1970年开始)，微秒
+    static int64_t wallUs();
+
+    // 高精度单调时钟，纳秒，只用来计算间隔，不要和nowUs()比较
+    static int64_t preciseNs();
+
+    // 原始TSC计数，不支持的时候是纳秒，只用来计算差值
+    static uint64_t cycles();
+    static int64_t cyclesToNs(uint64_t cycles);
+
+    static bool isTscSupport();
+
+    // reactor每轮循环调用，刷新并启用本线程的缓存
+    static void refresh();
+    // reactor退出循环的时候调用，本线程之后每次直接读时钟
+    static void stopCache();
+};
+
+} // namespace tinyrpc
+
+#endif
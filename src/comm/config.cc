@@ -6,6 +6,7 @@
 #include "src/comm/log.h"
 #include "src/net/tcp/tcp_server.h"
 #include "src/net/net_address.h"
+#include "src/coroutine/coroutine_hook.h"
 #include <tinyxml/tinyxml.h>
 #include "config.h"
 
@@ -79,6 +80,32 @@ void Config::readConf()
     m_cor_stack_size = 1024 * cor_stack_size; // 申请的是bit，需要的是byte 1byte=1024bit
     m_cor_pool_size = std::atoi(coroutine_node->FirstChildElement("coroutine_pool_size")->GetText());
 
+    // coroutine_warm_stacks：可选，空闲的栈超过这个数就释放物理内存
+    TiXmlElement* warm_stacks_node = coroutine_node->FirstChildElement("coroutine_warm_stacks");
+    if (warm_stacks_node && warm_stacks_node->GetText())
+    {
+        m_cor_warm_stacks = std::atoi(warm_stacks_node->GetText());
+    }
+
+    // connection_share_stack：可选，服务端连接的协程使用共享栈，挂起的时候只保存用到的那段栈，适合大量空闲的长连接
+    TiXmlElement* share_stack_node = coroutine_node->FirstChildElement("connection_share_stack");
+    if (share_stack_node && share_stack_node->GetText())
+    {
+        std::string share_stack = std::string(share_stack_node->GetText());
+        std::transform(share_stack.begin(), share_stack.end(), share_stack.begin(), toupper);
+        m_conn_share_stack = (share_stack == "TRUE" || share_stack == "1");
+    }
+    TiXmlElement* share_stack_count_node = coroutine_node->FirstChildElement("share_stack_count");
+    if (share_stack_count_node && share_stack_count_node->GetText())
+    {
+        m_share_stack_count = std::atoi(share_stack_count_node->GetText());
+    }
+    if (m_share_stack_count <= 0)
+    {
+        printf("start tinyrpc server error! read config file [%s] error, invalid [coroutine.share_stack_count] = %d\n", m_file_path.c_str(), m_share_stack_count);
+        exit(0);
+    }
+
 
     // msg_req_len
     TiXmlElement* msg_req_len_node = root->FirstChildElement("msg_req_len");
@@ -111,6 +138,18 @@ void Config::readConf()
 
     m_iothread_num = std::atoi(root->FirstChildElement("iothread_num")->GetText());
 
+    // worker_thread_num：可选，注册成在工作线程执行的rpc方法用的线程数，0表示还是在io协程里执行
+    TiXmlElement* worker_thread_num_node = root->FirstChildElement("worker_thread_num");
+    if (worker_thread_num_node && worker_thread_num_node->GetText())
+    {
+        m_worker_thread_num = std::atoi(worker_thread_num_node->GetText());
+    }
+    if (m_worker_thread_num < 0)
+    {
+        printf("start tinyrpc server error! read config file [%s] error, invalid [worker_thread_num] = %d\n", m_file_path.c_str(), m_worker_thread_num);
+        exit(0);
+    }
+
     // 时间轮配置：bucket_num和inteval
     TiXmlElement* time_wheel_node = root->FirstChildElement("time_wheel");
     if (!time_wheel_node) 
@@ -133,6 +172,119 @@ void Config::readConf()
     m_timewheel_bucket_num = std::atoi(time_wheel_node->FirstChildElement("bucket_num")->GetText());
     m_timewheel_inteval = std::atoi(time_wheel_node->FirstChildElement("inteval")->GetText());
 
+    // checksum：可选，crc32c表示发送的包带CRC32C校验，不配置或者none则不校验(兼容老版本)
+    TiXmlElement* checksum_node = root->FirstChildElement("checksum");
+    if (checksum_node && checksum_node->GetText())
+    {
+        std::string checksum = std::string(checksum_node->GetText());
+        std::transform(checksum.begin(), checksum.end(), checksum.begin(), toupper);
+        if (checksum == "CRC32C")
+        {
+            m_checksum_enable = true;
+        }
+        else if (checksum != "NONE")
+        {
+            printf("start tinyrpc server error! read config file [%s] error, unknown [checksum] = %s\n", m_file_path.c_str(), checksum.c_str());
+            exit(0);
+        }
+    }
+
+
+    // pipeline：可选，回复合并发送的字节上限和时间上限，都为0表示每个回复单独发送
+    TiXmlElement* pipeline_node = root->FirstChildElement("pipeline");
+    if (pipeline_node)
+    {
+        TiXmlElement* node = pipeline_node->FirstChildElement("coalesce_max_bytes");
+        if (node && node->GetText())
+        {
+            m_coalesce_max_bytes = std::atoi(node->GetText());
+        }
+        node = pipeline_node->FirstChildElement("coalesce_max_delay");
+        if (node && node->GetText())
+        {
+            m_coalesce_max_delay = std::atoi(node->GetText());
+        }
+    }
+
+    // client_pool：可选，客户端连接池每个地址的连接上限和空闲超时
+    TiXmlElement* client_pool_node = root->FirstChildElement("client_pool");
+    if (client_pool_node)
+    {
+        TiXmlElement* node = client_pool_node->FirstChildElement("max_per_host");
+        if (node && node->GetText())
+        {
+            m_client_pool_max_per_host = std::atoi(node->GetText());
+        }
+        node = client_pool_node->FirstChildElement("max_idle_time");
+        if (node && node->GetText())
+        {
+            m_client_pool_max_idle_time = std::atoi(node->GetText());
+        }
+    }
+
+    // reactor：可选，epoll_wait的事件数组大小，以及是否根据负载自动调整
+    TiXmlElement* reactor_node = root->FirstChildElement("reactor");
+    if (reactor_node)
+    {
+        TiXmlElement* node = reactor_node->FirstChildElement("max_events");
+        if (node && node->GetText())
+        {
+            m_reactor_max_events = std::atoi(node->GetText());
+        }
+        node = reactor_node->FirstChildElement("adaptive_events");
+        if (node && node->GetText())
+        {
+            std::string adaptive = std::string(node->GetText());
+            std::transform(adaptive.begin(), adaptive.end(), adaptive.begin(), toupper);
+            m_reactor_adaptive_events = (adaptive == "TRUE" || adaptive == "1");
+        }
+        node = reactor_node->FirstChildElement("edge_triggered");
+        if (node && node->GetText())
+        {
+            std::string edge_triggered = std::string(node->GetText());
+            std::transform(edge_triggered.begin(), edge_triggered.end(), edge_triggered.begin(), toupper);
+            m_reactor_edge_triggered = (edge_triggered == "TRUE" || edge_triggered == "1");
+        }
+        setEdgeTriggered(m_reactor_edge_triggered);
+        node = reactor_node->FirstChildElement("max_events_limit");
+        if (node && node->GetText())
+        {
+            m_reactor_max_events_limit = std::atoi(node->GetText());
+        }
+        if (m_reactor_max_events <= 0 || m_reactor_max_events_limit < m_reactor_max_events)
+        {
+            printf("start tinyrpc server error! read config file [%s] error, invalid [reactor] max_events = %d, max_events_limit = %d\n", m_file_path.c_str(), m_reactor_max_events, m_reactor_max_events_limit);
+            exit(0);
+        }
+
+        node = reactor_node->FirstChildElement("backend");
+        if (node && node->GetText())
+        {
+            std::string backend = std::string(node->GetText());
+            std::transform(backend.begin(), backend.end(), backend.begin(), toupper);
+            m_reactor_io_uring = (backend == "IO_URING");
+        }
+        node = reactor_node->FirstChildElement("io_uring_entries");
+        if (node && node->GetText())
+        {
+            m_io_uring_entries = std::atoi(node->GetText());
+        }
+        node = reactor_node->FirstChildElement("io_uring_buf_count");
+        if (node && node->GetText())
+        {
+            m_io_uring_buf_count = std::atoi(node->GetText());
+        }
+        node = reactor_node->FirstChildElement("io_uring_buf_size");
+        if (node && node->GetText())
+        {
+            m_io_uring_buf_size = std::atoi(node->GetText());
+        }
+        if (m_io_uring_entries <= 0 || m_io_uring_buf_count <= 0 || m_io_uring_buf_count > 32768 || m_io_uring_buf_size <= 0)
+        {
+            printf("start tinyrpc server error! read config file [%s] error, invalid [reactor] io_uring_entries = %d, io_uring_buf_count = %d, io_uring_buf_size = %d\n", m_file_path.c_str(), m_io_uring_entries, m_io_uring_buf_count, m_io_uring_buf_size);
+            exit(0);
+        }
+    }
 
     // server ： 服务端使用ip,port, protocal
     TiXmlElement* server_node = root->FirstChildElement("server");
@@ -157,6 +309,14 @@ void Config::readConf()
     std::string protocal = std::string(server_node->FirstChildElement("protocal")->GetText());
     std::transform(protocal.begin(), protocal.end(), protocal.begin(), toupper); // 给定范围，将字母变成大写，存回去
 
+    TiXmlElement* reuse_port_node = server_node->FirstChildElement("reuse_port");
+    if (reuse_port_node && reuse_port_node->GetText())
+    {
+        std::string reuse_port = std::string(reuse_port_node->GetText());
+        std::transform(reuse_port.begin(), reuse_port.end(), reuse_port.begin(), toupper);
+        m_server_reuse_port = (reuse_port == "TRUE" || reuse_port == "1");
+    }
+
     tinyrpc::IPAddress::ptr addr = std::make_shared<tinyrpc::IPAddress>(ip ,port);
     if(protocal == "HTTP")
     {
@@ -167,14 +327,15 @@ void Config::readConf()
         gRpcServer = std::make_shared<TcpServer>(addr, TinyPb_Protocal);
     }
 
-    char buff[512];
-    sprintf(buff, "read config from file [%s]: [log_path: %s], [log_prefix: %s], [log_max_size: %d MB], [log_level: %s], " 
-        "[coroutine_stack_size: %d KB], [coroutine_pool_size: %d], "
+    char buff[2048];
+    sprintf(buff, "read config from file [%s]: [log_path: %s], [log_prefix: %s], [log_max_size: %d MB], [log_level: %s], [log_format: %s], [log_mmap: %d], " 
+        "[coroutine_stack_size: %d KB], [coroutine_pool_size: %d], [coroutine_warm_stacks: %d], [connection_share_stack: %d], [share_stack_count: %d], "
         "[msg_req_len: %d], [max_connect_timeout: %d s], "
-        "[iothread_num:%d], [timewheel_bucket_num: %d], [timewheel_inteval: %d s], [server_ip: %s], [server_Port: %d], [server_protocal: %s]\n",
+        "[iothread_num:%d], [worker_thread_num: %d], [timewheel_bucket_num: %d], [timewheel_inteval: %d s], [checksum: %s], [coalesce_max_bytes: %d], [coalesce_max_delay: %d us], [client_pool_max_per_host: %d], [client_pool_max_idle_time: %d ms], [reactor_max_events: %d%s], [reactor_edge_triggered: %d], [reactor_backend: %s], [server_ip: %s], [server_Port: %d], [server_protocal: %s], [server_reuse_port: %d]\n",
         m_file_path.c_str(), m_log_path.c_str(), m_log_prefix.c_str(), m_log_max_size / 1024 / 1024, 
-        levelToString(m_log_level).c_str(), cor_stack_size, m_cor_pool_size, m_msg_req_len,
-        max_connect_timeout, m_iothread_num, m_timewheel_bucket_num, m_timewheel_inteval, ip.c_str(), port, protocal.c_str()
+        levelToString(m_log_level).c_str(), m_log_binary ? "binary" : "text", m_log_mmap, cor_stack_size, m_cor_pool_size, m_cor_warm_stacks, m_conn_share_stack, m_share_stack_count, m_msg_req_len,
+        max_connect_timeout, m_iothread_num, m_worker_thread_num, m_timewheel_bucket_num, m_timewheel_inteval,
+        m_checksum_enable ? "crc32c" : "none", m_coalesce_max_bytes, m_coalesce_max_delay, m_client_pool_max_per_host, m_client_pool_max_idle_time, m_reactor_max_events, m_reactor_adaptive_events ? " adaptive" : "", m_reactor_edge_triggered, m_reactor_io_uring ? "io_uring" : "epoll", ip.c_str(), port, protocal.c_str(), m_server_reuse_port
     );
     
     std::string s(buff);
@@ -253,8 +414,34 @@ void Config::readLogConfig(TiXmlElement *log_node)
 
     m_log_sync_inteval = std::atoi(node->GetText());
 
+    // log_format：可选，binary写二进制日志(用tinyrpc_logcat解码)，不配置或者text写文本
+    node = log_node->FirstChildElement("log_format");
+    if(node && node->GetText())
+    {
+        std::string log_format = std::string(node->GetText());
+        std::transform(log_format.begin(), log_format.end(), log_format.begin(), toupper);
+        if(log_format == "BINARY")
+        {
+            m_log_binary = true;
+        }
+        else if(log_format != "TEXT")
+        {
+            printf("start tinyrpc server error! read config file [%s] error, unknown [log_format] = %s\n", m_file_path.c_str(), log_format.c_str());
+            exit(0);
+        }
+    }
+
+    // log_mmap：可选，日志文件预分配并mmap写入
+    node = log_node->FirstChildElement("log_mmap");
+    if(node && node->GetText())
+    {
+        std::string log_mmap = std::string(node->GetText());
+        std::transform(log_mmap.begin(), log_mmap.end(), log_mmap.begin(), toupper);
+        m_log_mmap = (log_mmap == "TRUE" || log_mmap == "1");
+    }
+
     gRpcLogger = std::make_shared<Logger>();
-    gRpcLogger->init(m_log_prefix.c_str(), m_log_path.c_str(), m_log_max_size, m_log_sync_inteval);
+    gRpcLogger->init(m_log_prefix.c_str(), m_log_path.c_str(), m_log_max_size, m_log_sync_inteval, m_log_binary, m_log_mmap);
 }
 TiXmlElement *Config::getXmlNode(const std::string &name)
 {
@@ -42,20 +42,51 @@ public:
     LogLevel m_log_level {LogLevel::DEBUG}; // 日志等级
     LogLevel m_app_log_level {LogLevel::DEBUG}; // app用户的日志等级
     int m_log_sync_inteval {500};  // log同步的间隔,ms
+    bool m_log_binary {false};  // 写二进制日志
+    bool m_log_mmap {false};    // 日志文件预分配并mmap写入
 
 public:
     // coroutine params
     int m_cor_stack_size {0};           // 协程栈大小
     int m_cor_pool_size {0};            // 协程池大小
+    int m_cor_warm_stacks {64};         // 空闲协程栈最多保留多少个不释放物理内存
+    bool m_conn_share_stack {false};    // 服务端连接的协程是否使用共享栈
+    int m_share_stack_count {4};        // 每个io线程的共享栈个数
 
     int m_msg_req_len {0};
 
     int m_max_connect_timeout {0};  // 最大的连接超时时间，用于注册连接超时的定时器间隔，
     int m_iothread_num {0};
+    int m_worker_thread_num {4};    // 工作线程数，执行注册成在工作线程执行的rpc方法
 
     int m_timewheel_bucket_num {0};
     int m_timewheel_inteval {0};
 
+    bool m_checksum_enable {false}; // TinyPB包是否带CRC32C校验
+
+    // 服务端回复合并发送，一次读到的多个请求的回复合并成一次writev
+    int m_coalesce_max_bytes {64 * 1024}; // 待发送的回复超过这个字节数就先发送
+    int m_coalesce_max_delay {1000};      // 一批请求处理超过这个时间(us)就先发送已有的回复
+
+    // 客户端连接池，每个线程一个，按对端地址分组
+    int m_client_pool_max_per_host {8};       // 每个地址最多保留的连接数(空闲 + 使用中)
+    int m_client_pool_max_idle_time {60000};  // 空闲超过这个时间(ms)的连接会被关闭
+
+    // reactor一次epoll_wait最多返回的事件数
+    int m_reactor_max_events {10};          // 初始值，不自适应的时候就是固定值
+    bool m_reactor_adaptive_events {false}; // 返回满了就翻倍，负载降下来再减半，不会小于初始值
+    int m_reactor_max_events_limit {4096};  // 自适应的上限
+    bool m_reactor_edge_triggered {false};  // 连接的fd只注册一次EPOLLET，读写返回EAGAIN才挂起协程
+
+    // reactor后端，io_uring不可用的时候自动退回epoll
+    bool m_reactor_io_uring {false};
+    int m_io_uring_entries {256};       // 提交队列大小
+    int m_io_uring_buf_count {1024};    // provided buffer个数，向上取整到2的幂
+    int m_io_uring_buf_size {4096};     // 每个provided buffer的大小
+
+    // 每个IO线程一个SO_REUSEPORT的listen fd，各自accept，不经过主reactor转交
+    bool m_server_reuse_port {false};
+
 private:
     std::string m_file_path;
 
@@ -0,0 +1,179 @@
+#include <string.h>
+#include "src/comm/crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define TINYRPC_CRC32C_X86 1
+#endif
+
+namespace tinyrpc{
+
+// CRC32C多项式(反转表示)
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+// slicing-by-8 需要的8张表，t[k][i]表示字节i后面再跟k个0字节的crc
+struct Crc32cTable{
+    uint32_t t[8][256];
+
+    Crc32cTable()
+    {
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for(int j = 0; j < 8; ++j)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : (crc >> 1);
+            }
+            t[0][i] = crc;
+        }
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            for(int k = 1; k < 8; ++k)
+            {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+static const Crc32cTable& getCrc32cTable()
+{
+    static Crc32cTable table;
+    return table;
+}
+
+uint32_t Crc32cUtil::crc32cSoftware(const void* data, size_t len, uint32_t crc)
+{
+    const uint32_t (*t)[256] = getCrc32cTable().t;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+
+    // 先按字节对齐到8
+    while(len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+    {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        --len;
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // 一次处理8个字节
+    while(len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        v ^= crc;
+        crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff]
+            ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff]
+            ^ t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff]
+            ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+#endif
+
+    while(len > 0)
+    {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        --len;
+    }
+    return ~crc;
+}
+
+#ifdef TINYRPC_CRC32C_X86
+
+// 只有这个函数使用SSE4.2指令，其余代码不需要-msse4.2编译
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(const void* data, size_t len, uint32_t crc)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t c = ~crc;
+
+    while(len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+    {
+        c = _mm_crc32_u8(c, *p++);
+        --len;
+    }
+
+#ifdef __x86_64__
+    uint64_t c64 = c;
+    while(len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c64 = _mm_crc32_u64(c64, v);
+        p += 8;
+        len -= 8;
+    }
+    c = static_cast<uint32_t>(c64);
+#endif
+
+    while(len >= 4)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u32(c, v);
+        p += 4;
+        len -= 4;
+    }
+
+    while(len > 0)
+    {
+        c = _mm_crc32_u8(c, *p++);
+        --len;
+    }
+    return ~c;
+}
+
+#endif
+
+static bool checkSse42()
+{
+#ifdef TINYRPC_CRC32C_X86
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return (ecx & bit_SSE4_2) != 0;
+    }
+#endif
+    return false;
+}
+
+// CPUID在虚拟机里很慢，只执行一次
+bool Crc32cUtil::isHardwareSupport()
+{
+    static const bool support = checkSse42();
+    return support;
+}
+
+uint32_t Crc32cUtil::crc32cHardware(const void* data, size_t len, uint32_t crc)
+{
+#ifdef TINYRPC_CRC32C_X86
+    if(isHardwareSupport())
+    {
+        return crc32cSse42(data, len, crc);
+    }
+#endif
+    return crc32cSoftware(data, len, crc);
+}
+
+typedef uint32_t (*crc32c_fun_ptr_t)(const void* data, size_t len, uint32_t crc);
+
+static crc32c_fun_ptr_t chooseCrc32cFun()
+{
+#ifdef TINYRPC_CRC32C_X86
+    if(Crc32cUtil::isHardwareSupport())
+    {
+        return crc32cSse42;
+    }
+#endif
+    return Crc32cUtil::crc32cSoftware;
+}
+
+uint32_t Crc32cUtil::crc32c(const void* data, size_t len, uint32_t crc)
+{
+    static const crc32c_fun_ptr_t fun = chooseCrc32cFun();
+    return fun(data, len, crc);
+}
+
+} // namespace tinyrpc
@@ -0,0 +1,36 @@
+#ifndef SRC_COMM_CRC32C_H
+#define SRC_COMM_CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+
+    CRC32C(Castagnoli)校验
+    CPU支持SSE4.2的时候使用crc32指令，否则使用查表法(slicing-by-8)
+    第一次调用的时候通过CPUID选择，之后不再判断
+
+    crc参数是上一段的结果，可以分段计算：
+    crc32c(b, len_b, crc32c(a, len_a)) == crc32c(a + b, len_a + len_b)
+
+*/
+
+namespace tinyrpc{
+
+class Crc32cUtil{
+public:
+    static uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0);
+
+    static bool isHardwareSupport();
+
+    // 下面两个直接指定实现，测试和基准使用
+    static uint32_t crc32cSoftware(const void* data, size_t len, uint32_t crc = 0);
+
+    // 不支持SSE4.2的机器上调用结果和crc32cSoftware一样
+    static uint32_t crc32cHardware(const void* data, size_t len, uint32_t crc = 0);
+};
+
+} // namespace tinyrpc
+
+
+#endif
@@ -29,6 +29,7 @@ const int ERROR_METHOD_NOT_FOUND = SYS_ERROR_PREFIX(0009);    // not found metho
 const int ERROR_PARSE_SERVICE_NAME = SYS_ERROR_PREFIX(0010);    // not found service name
 const int ERROR_NOT_SET_ASYNC_PRE_CALL = SYS_ERROR_PREFIX(0011);            // you didn't set some nessary param before call async rpc
 const int ERROR_CONNECT_SYS_ERR = SYS_ERROR_PREFIX(0012);           // connect sys error
+const int ERROR_CHANNEL_FULL = SYS_ERROR_PREFIX(0013);           // too many inflight calls on async channel
  
 } // namespace tinyrpc 
 
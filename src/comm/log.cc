@@ -7,10 +7,16 @@
 #include <errno.h>
 #include <time.h> // gettimeofday()
 #include <signal.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <algorithm>
 
 
 #include "src/comm/log.h"
 #include "src/comm/config.h"
+#include "src/comm/clock.h"
+#include "src/comm/log_ring.h"
 #include "src/coroutine/coroutine.h"
 #include "src/net/timer.h"
 
@@ -36,6 +42,10 @@ void CoredumpHandler(int signal_no)
 static thread_local pid_t t_thread_id = 0;
 static pid_t g_pid = 0;
 
+// 本线程上一次格式化的日志时间(秒)
+static thread_local time_t t_format_sec = -1;
+static thread_local char t_format_buf[128];
+
 // --------------- 辅助函数
 // 获取线程id
 pid_t gettid()
@@ -74,12 +84,16 @@ std::string levelToString(LogLevel level)
             break;
         case INFO:
             re = "INFO";
+            break;
         case WARN:
             re = "WARN";
+            break;
         case ERROR:
             re = "ERROR";
+            break;
         case NONE:
             re = "NONE";
+            break;
         default:
             break;
     }
@@ -119,6 +133,133 @@ std::string logTypeToString(LogType type)
         return "";
     }
 }
+
+// 二进制日志的调用点，下标+1是id，只增加
+static Mutex g_log_site_mutex;
+static std::vector<LogSite*> g_log_sites;
+
+uint32_t registerLogSite(LogSite* site)
+{
+    Mutex::Lock lock(g_log_site_mutex);
+    uint32_t id = site->id.load(std::memory_order_relaxed);
+    if(id == 0)
+    {
+        g_log_sites.push_back(site);
+        id = static_cast<uint32_t>(g_log_sites.size());
+        site->id.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+// 写一个u16长度的字符串，超长截断
+static char* putStr16(char* p, const char* str, size_t len)
+{
+    uint16_t n = static_cast<uint16_t>(std::min<size_t>(len, UINT16_MAX));
+    p = logPut<uint16_t>(p, n);
+    memcpy(p, str, n);
+    return p + n;
+}
+
+size_t appendLogSites(std::string* out, size_t from)
+{
+    Mutex::Lock lock(g_log_site_mutex);
+    for(size_t i = from; i < g_log_sites.size(); ++i)
+    {
+        LogSite* site = g_log_sites[i];
+        const char* fmt = site->fmt ? site->fmt : "";
+        size_t file_len = std::min<size_t>(strlen(site->file_name), UINT16_MAX);
+        size_t fmt_len = std::min<size_t>(strlen(fmt), UINT16_MAX);
+        uint32_t len = LOG_RECORD_HEADER_SIZE + 4 + 1 + 1 + 1 + 4 + 2 + file_len + 2 + fmt_len;
+
+        size_t pos = out->size();
+        out->resize(pos + len);
+        char* p = &(*out)[pos];
+        p = logPut<uint32_t>(p, len);
+        p = logPut<uint8_t>(p, LOG_RECORD_SITE);
+        p = logPut<uint32_t>(p, i + 1);
+        p = logPut<uint8_t>(p, site->level);
+        p = logPut<uint8_t>(p, site->type);
+        p = logPut<uint8_t>(p, site->kind);
+        p = logPut<uint32_t>(p, site->line);
+        p = putStr16(p, site->file_name, file_len);
+        putStr16(p, fmt, fmt_len);
+    }
+    return g_log_sites.size();
+}
+/*
+
+
+************** LogStream成员函数 **************
+
+
+*/ 
+
+// 一般的日志一行放得下，长的日志扩容之后一直复用
+static const size_t LOG_LINE_INIT_SIZE = 1024;
+
+LogStreamBuf::LogStreamBuf()
+{
+    m_storage.resize(LOG_LINE_INIT_SIZE);
+    reset();
+}
+
+void LogStreamBuf::reset()
+{
+    setp(&m_storage[0], &m_storage[0] + m_storage.size());
+}
+
+void LogStreamBuf::grow(size_t need)
+{
+    size_t used = size();
+    size_t cap = m_storage.size();
+    while(cap - used < need)
+    {
+        cap *= 2;
+    }
+    m_storage.resize(cap);
+    setp(&m_storage[0], &m_storage[0] + cap);
+    pbump(static_cast<int>(used));
+}
+
+char* LogStreamBuf::reserve(size_t n)
+{
+    if(static_cast<size_t>(epptr() - pptr()) < n)
+    {
+        grow(n);
+    }
+    return pptr();
+}
+
+int LogStreamBuf::overflow(int c)
+{
+    if(c == traits_type::eof())
+    {
+        return traits_type::not_eof(c);
+    }
+    grow(1);
+    *pptr() = static_cast<char>(c);
+    pbump(1);
+    return c;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n)
+{
+    memcpy(reserve(n), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+}
+
+LogStream::LogStream()
+: std::ostream(nullptr)
+{
+    rdbuf(&m_buf);
+}
+
+// 本线程复用的格式化缓冲，t_log_stream_busy表示正在用(写日志的表达式里又写了日志)
+static thread_local LogStream* t_log_stream = nullptr;
+static thread_local bool t_log_stream_busy = false;
+
+
 /*
 
 
@@ -129,19 +270,21 @@ std::string logTypeToString(LogType type)
 
 
 
-LogTmp::LogTmp(LogEvent::ptr event)
-: m_event(event)
+LogTmp::LogTmp(LogSite* site, const char* func_name)
+: m_event(site, func_name),
+  m_file_name(site->file_name),
+  m_line(site->line)
 {
 
 }
 LogTmp::~LogTmp()
 {
-    m_event->log();
+    m_event.log();
 }
 
-std::stringstream& LogTmp::getStringStream()
+std::ostream& LogTmp::getStringStream()
 {
-    return m_event->getStringStream();
+    return m_event.getStringStream();
 }
 
 
@@ -153,39 +296,101 @@ std::stringstream& LogTmp::getStringStream()
 
 */ 
 
- 
-// logEvent构造
-LogEvent::LogEvent(LogLevel level, const char* file_name, int line, const char* func_name, LogType type)
-    :m_level(level),
-     m_fileName(file_name),
-     m_line(line),
+LogEvent::LogEvent(LogSite* site, const char* func_name)
+    :m_level(site->level),
+     m_fileName(site->file_name),
+     m_line(site->line),
      m_funcName(func_name),
-     m_type(type)
-{}
+     m_type(site->type),
+     m_site(site),
+     m_binary(gRpcLogger->isBinary())
+{
+    if(!t_log_stream_busy)
+    {
+        if(!t_log_stream)
+            t_log_stream = new LogStream();  // 线程退出不释放，只有一个
+        m_stream = t_log_stream;
+        t_log_stream_busy = true;
+    }
+    else
+    {
+        m_stream = new LogStream();
+        m_own_stream = true;
+    }
+    m_stream->reset();
+}
 // 析构
 LogEvent::~LogEvent()
-{}
+{
+    if(m_own_stream)
+        delete m_stream;
+    else
+        t_log_stream_busy = false;
+}
 
-// 1. 把日志信息传输到成员m_ss，一个stringstream流对象
-std::stringstream& LogEvent::getStringStream()
+// 二进制日志的记录头，记录长度在log()的时候回填
+static void appendBinaryHeader(LogStream& ss, LogSite* site, int cor_id)
 {
-    // 1.1 获取时间戳，计算从1970年1月1号00:00（UTC）到当前的时间跨度,头文件<time.h>
-    gettimeofday(&m_timeVal, nullptr);
+    uint32_t id = site->id.load(std::memory_order_acquire);
+    if(id == 0)
+        id = registerLogSite(site);
+
+    ss.appendValue<uint32_t>(0);
+    ss.appendValue<uint8_t>(LOG_RECORD_EVENT);
+    ss.appendValue<uint32_t>(id);
+    ss.appendValue<int64_t>(Clock::wallUs());
+    ss.appendValue<uint32_t>(gettid());
+    ss.appendValue<int32_t>(cor_id);
+
+    const std::string* strs[2] = {nullptr, nullptr};
+    RunTime* runtime = getCurrentRunTime();
+    if(runtime)
+    {
+        strs[0] = &runtime->m_msg_no;
+        strs[1] = &runtime->m_interface_name;
+    }
+    for(int i = 0; i < 2; ++i)
+    {
+        uint16_t len = strs[i] ? static_cast<uint16_t>(std::min<size_t>(strs[i]->size(), UINT16_MAX)) : 0;
+        ss.appendValue<uint16_t>(len);
+        if(len > 0)
+            ss.appendRaw(strs[i]->data(), len);
+    }
+}
+
+// 1. 把日志头写入格式化缓冲
+std::ostream& LogEvent::getStringStream()
+{
+    LogStream& ss = *m_stream;
+    if(m_binary)
+    {
+        // 二进制日志不格式化，时间、线程、协程原样写入
+        appendBinaryHeader(ss, m_site, Coroutine::getCurrentCoroutine()->getCorId());
+        return ss;
+    }
 
-    struct tm time;
-    localtime_r(&(m_timeVal.tv_sec), &time);  // 时间戳放在tv_sec中。_r是线程安全可重入函数
+    // 1.1 获取时间戳，计算从1970年1月1号00:00（UTC）到当前的时间跨度
+    // reactor线程里是本轮循环缓存的时间，不再每行读一次时钟
+    int64_t now_us = Clock::wallUs();
+    m_timeVal.tv_sec = now_us / 1000000;
+    m_timeVal.tv_usec = now_us % 1000000;
 
-    // 1.2 格式化时间
-    const char* format = "%Y-%m-%d %H:%M:%S";
-    char buf[128];
-    strftime(buf, sizeof(buf), format, &time); // 作用就是指定时间格式，把time转换为字符串存到buf中
+    // 1.2 格式化时间，同一秒内的日志复用上一次的结果
+    if(m_timeVal.tv_sec != t_format_sec)
+    {
+        struct tm time;
+        localtime_r(&(m_timeVal.tv_sec), &time);  // 时间戳放在tv_sec中。_r是线程安全可重入函数
+
+        const char* format = "%Y-%m-%d %H:%M:%S";
+        strftime(t_format_buf, sizeof(t_format_buf), format, &time); // 作用就是指定时间格式，把time转换为字符串存到buf中
+        t_format_sec = m_timeVal.tv_sec;
+    }
 
     // 1.3 日志信息写入流
         // 1.3.1 写入时间 [xxxx-xx-xx xx:xx:xx]
-    m_ss << "[" << buf << "." << m_timeVal.tv_usec << "]\t";
+    ss << "[" << t_format_buf << "." << m_timeVal.tv_usec << "]\t";
         // 1.3.2 写入日志等级
-    std::string s_level = levelToString(m_level);
-    m_ss << "[" << s_level << "]\t";
+    ss << "[" << levelToString(m_level) << "]\t";
         // 1.3.3 写入文件名，线程id，进程id，行号
     if(g_pid == 0)
         g_pid = getpid();  // 是父进程
@@ -200,7 +405,7 @@ std::stringstream& LogEvent::getStringStream()
     // 协程id
     m_cor_id = Coroutine::getCurrentCoroutine()->getCorId();
 
-    m_ss << "[" << m_pid  << "]\t"
+    ss << "[" << m_pid  << "]\t"
         << "[" << m_tid << "]\t"
         << "[" << m_cor_id << "]\t"
         << "[" << m_fileName << ":" << m_line << "]\t";
@@ -209,33 +414,35 @@ std::stringstream& LogEvent::getStringStream()
     RunTime* runtime = getCurrentRunTime();
     if(runtime)
     {
-        std::string msgno = runtime->m_msg_no;
+        const std::string& msgno = runtime->m_msg_no;
         if(!msgno.empty())
-            m_ss << "[" << msgno << "]\t";
+            ss << "[" << msgno << "]\t";
         
-        std::string interface_name = runtime->m_interface_name;
+        const std::string& interface_name = runtime->m_interface_name;
         if(!interface_name.empty())
-            m_ss << "[" << interface_name << "]\t";
+            ss << "[" << interface_name << "]\t";
     }
 
-    return m_ss;
-}
-
-// stringstream流转string
-std::string LogEvent::toString()
-{
-    return getStringStream().str();
+    return ss;
 }
 
-// 日志事件启动加入用户buffer
+// 日志事件启动加入本线程的环形缓冲
 void LogEvent::log()
 {
-    m_ss << "\n";
+    if(m_binary)
+    {
+        uint32_t len = static_cast<uint32_t>(m_stream->size());
+        m_stream->patch(0, &len, sizeof(len));
+    }
+    else
+    {
+        *m_stream << "\n";
+    }
     // 如果当前日志的等级大于需要写入的等级并且对应相应的PRC or APP类型，就对应写入。
     if(m_level >= gRpcConfig->m_log_level && m_type == RPC_LOG)
-        gRpcLogger->pushRpcLog(m_ss.str());
+        gRpcLogger->pushLog(RPC_LOG, m_stream->data(), m_stream->size());
     else if(m_level >= gRpcConfig->m_app_log_level && m_type == APP_LOG)
-        gRpcLogger->pushAppLog(m_ss.str());
+        gRpcLogger->pushLog(APP_LOG, m_stream->data(), m_stream->size());
 }
 
 
@@ -247,6 +454,25 @@ void LogEvent::log()
 
 */ 
 
+// 每个线程每种日志的环形缓冲大小
+static const size_t LOG_RING_SIZE = 1 << 20;
+
+// 本线程的环形缓冲，第一次写这种日志的时候创建，线程退出的时候交给异步线程取完释放
+struct ThreadLogRings{
+    LogRing* rings[2] {nullptr, nullptr};
+
+    ~ThreadLogRings()
+    {
+        for(int i = 0; i < 2; ++i)
+        {
+            if(rings[i])
+                rings[i]->m_closed.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local ThreadLogRings t_log_rings;
+
 Logger::Logger(){}
 Logger::~Logger()
 {
@@ -263,22 +489,17 @@ Logger* Logger::getLogger()
 }
 
 // 初始化日志
-void Logger::init(const char* file_name, const char* file_path, int max_size, int sync_inteval)
+void Logger::init(const char* file_name, const char* file_path, int max_size, int sync_inteval, bool binary, bool mmap)
 {
     // 判断是否日志初始化
     if(!m_is_init)
     {
         m_sync_inteval = sync_inteval;
-        // 初始化100万个buffer
-        for(int i = 0 ; i < 1000000; ++i)
-        {
-            m_buffer.emplace_back("");
-            m_app_buffer.emplace_back("");
-        }
+        m_binary = binary;
 
-        // 指针初始化
-        m_async_rpc_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, RPC_LOG);
-        m_async_app_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, APP_LOG);
+        // 指针初始化，异步线程自己按sync_inteval定时取日志
+        m_async_rpc_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, RPC_LOG, sync_inteval, binary, mmap);
+        m_async_app_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, APP_LOG, sync_inteval, binary, mmap);
 
         // 出现以下信号表示突然程序中断，这时要保存中断的日志，需要一个Coredump处理函数
         signal(SIGSEGV, CoredumpHandler);   // 建立core文件，段非法错误
@@ -294,72 +515,49 @@ void Logger::init(const char* file_name, const char* file_path, int max_size, in
     }
 }
 
-// 启动日志
-void Logger::start()
+// 写入本线程的环形缓冲，不加锁
+void Logger::pushLog(LogType type, const char* data, size_t len)
 {
-    // 框架搭建好进行启动
-    // 启动就是将循环loopFunc()函数添加到定时器中，设置一个定时间隔，不断启动
-    // 设置重复定时，每隔一段时间就会把存的日志加入待写队列中。
-    TimerEvent::ptr event = std::make_shared<TimerEvent>(m_sync_inteval, true, std::bind(&Logger::loopFunc, this));
-    Reactor::getReactor()->getTimer()->addTimerEvent(event);
-}
+    int index = (type == RPC_LOG) ? 0 : 1;
+    AsyncLogger* async_logger = (type == RPC_LOG) ? m_async_rpc_logger.get() : m_async_app_logger.get();
 
+    LogRing* ring = t_log_rings.rings[index];
+    if(!ring)
+    {
+        ring = new LogRing(LOG_RING_SIZE);
+        t_log_rings.rings[index] = ring;
+        async_logger->addRing(ring);
+    }
 
-// 把buffer替换出来，然后重新加入任务
-void Logger::loopFunc()
-{
-    std::vector<std::string> app_tmp;
-    // 上app buffer锁
-    Mutex::Lock lock1(m_app_buffer_mutex);
-    app_tmp.swap(m_app_buffer);
-    // 解锁
-    lock1.unlock();
-
-    std::vector<std::string> tmp;
-    // 上buffer锁
-    Mutex::Lock lock2(m_buffer_mutex);
-    tmp.swap(m_buffer);
-    // 解锁
-    lock2.unlock();
-
-    // 加入日志任务AsyncLogger类的task
-    m_async_rpc_logger->push(tmp);
-    m_async_app_logger->push(app_tmp);
-}
-
+    // 比整个缓冲还长的日志截断，二进制记录截断之后解不出来，直接丢掉
+    if(len > ring->capacity())
+    {
+        if(m_binary)
+        {
+            ring->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        len = ring->capacity();
+    }
 
-// 写入PRC类型日志
-void Logger::pushRpcLog(const std::string& msg)
-{
-    // 上锁
-    Mutex::Lock lock(m_buffer_mutex);
-    m_buffer.emplace_back(std::move(msg)); // push_back(std::move(msg))一样都是移动拷贝构造T&&
-    // 解锁
-    lock.unlock();
-}
+    // 满了不等异步线程取走，写日志的多半是io线程，等的话这个线程上所有连接都停住
+    // 直接记为丢弃，异步线程取的时候写一条丢了多少行的记录
+    if(!ring->write(data, len))
+    {
+        ring->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        async_logger->notify();
+        return;
+    }
 
-// 写入APP类型日志
-void Logger::pushAppLog(const std::string& msg)
-{
-    // 上锁 防止多个协程程同时写入，就乱了
-    Mutex::Lock lock(m_app_buffer_mutex);
-    m_app_buffer.emplace_back(std::move(msg));
-    // 解锁
-    lock.unlock();
+    if(ring->overHalf())
+        async_logger->notify();
 }
 
-// 刷新
+// 刷新，取完所有日志之后异步线程退出
 void Logger::flush()
 {
-    // 置换缓冲区
-    loopFunc();
-    // 刷新
     m_async_rpc_logger->stop();
-    m_async_rpc_logger->flush();
-
     m_async_app_logger->stop();
-    m_async_app_logger->flush();
-    
 }
 
 
@@ -370,11 +568,14 @@ void Logger::flush()
 ************** AsyncLogger成员函数 **************
 
 */ 
-AsyncLogger::AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logType)
+AsyncLogger::AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logType, int sync_inteval, bool binary, bool mmap)
 : m_fileName(file_name),
   m_filePath(file_path),
   m_maxSize(max_size),
-  m_logType(logType)
+  m_logType(logType),
+  m_sync_inteval(sync_inteval > 0 ? sync_inteval : 500),
+  m_binary(binary),
+  m_mmap(mmap)
 {
     // 初始化信号量
     /*
@@ -401,154 +602,391 @@ AsyncLogger::~AsyncLogger()
 
 }
 
-void* AsyncLogger::exeute(void* arg)
+void AsyncLogger::addRing(LogRing* ring)
 {
-    /*
-    1. 取任务队列的一个日志vector<string>
-    2. 打开文件写入
-    3. 限制单个文件的大小，超过就把编号++，写入新的文件。
-    */
+    Mutex::Lock lock(m_mutex);
+    m_rings.push_back(ring);
+}
 
-    // 为什么类指针转换不用static_cast<>
-    AsyncLogger* ptr = reinterpret_cast<AsyncLogger*>(arg);
+void AsyncLogger::notify()
+{
+    // 已经通知过还没取就不再signal
+    if(m_notified.exchange(true, std::memory_order_acq_rel))
+        return;
+    // 拿着锁signal，不然可能落在异步线程检查m_notified之后、进入timedwait之前，要等一个同步间隔才刷
+    Mutex::Lock lock(m_mutex);
+    pthread_cond_signal(&m_condition);
+}
 
-    // 初始化pthread_cond_t 的条件变量
-    int rt = pthread_cond_init(&ptr->m_condition, NULL);
-    assert(rt == 0);
+// 当前文件放不下incoming字节，要换下一个文件
+// mmap的文件是按最大值预分配的，放不下这一批就换；writev的文件写超过最大值之后再换
+bool AsyncLogger::isFull(size_t incoming) const
+{
+    if(m_mmap)
+        return m_file_size > 0 && m_file_size + static_cast<int64_t>(incoming) > m_maxSize;
+    return m_file_size > m_maxSize;
+}
 
-    rt = sem_post(&ptr->m_semaphore); // V操作
-    assert(rt == 0);
+// 打开当前日期和编号的日志文件，跨天或者超过大小换下一个文件，incoming是这一批要写的字节数
+bool AsyncLogger::openFile(size_t incoming)
+{
+    int64_t now_us = Clock::wallUs();
+    time_t now_sec = now_us / 1000000;
+    struct tm now_time;
+    localtime_r(&now_sec, &now_time);
+
+    const char* format = "%Y%m%d";
+    char date[32];
+        // 格式化时间
+    strftime(date, sizeof(date), format, &now_time);
+    if(m_date != std::string(date))  // 保存的时间不对等，换最新获取的时间
+    {
+        // cross day
+        // reset m_no m_date
+        m_no = 0;
+        m_date = std::string(date);
+        m_need_reopen = true;  // 时间改了要打开过文件
+    }
+
+    // 当前文件的大小大于设置的单个日志最大值，处理到下一个文件中。
+    if(m_fd != -1 && isFull(incoming))
+    {
+        m_no++;
+        m_need_reopen = true;
+    }
+
+    if(m_fd == -1)  // 文件没有打开初始化
+        m_need_reopen = true;
+
+    if(!m_need_reopen)
+        return false;
+
+    closeFile();
 
-    // 循环执行
     while(true)
     {
-        // 每次拿任务信息是原子的，需要上锁，
-        Mutex::Lock lock(ptr->m_mutex);
+        std::stringstream ss;  // 日志文件名
+        ss << m_filePath << m_fileName << "_" << m_date << "_" << logTypeToString(m_logType)
+            << "_" << m_no << (m_binary ? ".blog" : ".log");
+        std::string full_file_name = ss.str();
 
-        // 任务队列是空的，并且还没有暂停写日志，就等待条件变量wait阻塞，并且需要上锁
-        while(ptr->m_tasks.empty() && !ptr->m_stop)
+        // 附加形式打开，如果打开出错错误自动保存在errno。mmap自己记写到哪里，不用O_APPEND
+        int flags = m_mmap ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC);
+        m_fd = open(full_file_name.c_str(), flags, 0644);
+        m_file_size = 0;
+        if(m_fd == -1)
         {
-            pthread_cond_wait(&(ptr->m_condition), ptr->m_mutex.getMutex());
+            printf("file %s open fail errno = %d reason = %s \n",full_file_name.c_str(), errno, strerror(errno));
+            break;
         }
 
-        std::vector<std::string> tmp;
-        tmp.swap(ptr->m_tasks.front());
-        ptr->m_tasks.pop();
-        bool is_stop = ptr->m_stop;
-        
-        // 解锁
-        lock.unlock();
+        struct stat st;
+        if(fstat(m_fd, &st) == 0)
+            m_file_size = st.st_size;
+
+        // 已经写满的文件(包括异常退出没有截掉预分配部分的文件)不再追加，换下一个
+        if(m_mmap && isFull(incoming))
+        {
+            close(m_fd);
+            m_fd = -1;
+            m_no++;
+            continue;
+        }
+        if(m_mmap)
+            mapFile(std::max<int64_t>(m_maxSize, m_file_size + incoming));
+        break;
+    }
+    m_need_reopen = false;
+    return true;
+}
 
+// 文件预分配到size字节，整个映射进来，之后写日志只是拷贝
+// 预分配或者映射失败就退回writev
+void AsyncLogger::mapFile(int64_t size)
+{
+    if(fallocate(m_fd, 0, 0, size) != 0 && ftruncate(m_fd, size) != 0)
+    {
+        printf("log file allocate fail errno = %d reason = %s \n", errno, strerror(errno));
+    }
+    else
+    {
+        // 映射的时候就把页建好，写日志的时候不再缺页
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, 0);
+        if(addr != MAP_FAILED)
+        {
+            m_map = static_cast<char*>(addr);
+            m_map_size = size;
+            m_synced_size = m_file_size;
+            return;
+        }
+        printf("log file mmap fail errno = %d reason = %s \n", errno, strerror(errno));
+        ftruncate(m_fd, m_file_size);
+    }
+    lseek(m_fd, m_file_size, SEEK_SET);
+}
 
-        // 获取当前时间和时间戳
-        timeval now;
-        gettimeofday(&now, nullptr);
+void AsyncLogger::closeFile()
+{
+    if(m_fd == -1)
+        return;
+    if(m_map)
+    {
+        munmap(m_map, m_map_size);
+        m_map = nullptr;
+        m_map_size = 0;
+        // 截掉预分配没用到的部分
+        ftruncate(m_fd, m_file_size);
+    }
+    close(m_fd);
+    m_fd = -1;
+}
 
-        struct tm now_time;
-        localtime_r(&(now.tv_sec), &now_time);
+// 写入当前文件，mmap的时候直接拷贝到映射区，一批比预分配的剩余空间大就扩大映射
+void AsyncLogger::writeFile(std::vector<struct iovec>& iovs)
+{
+    if(m_map)
+    {
+        int64_t len = 0;
+        for(size_t i = 0; i < iovs.size(); ++i)
+            len += iovs[i].iov_len;
 
-        const char* format = "%Y%m%d";
-        char date[32];
-            // 格式化时间
-        strftime(date, sizeof(date), format, &now_time);
-        if(ptr->m_date != std::string(date))  // 保存的时间不对等，换最新获取的时间
+        if(m_file_size + len > m_map_size)
         {
-            // cross day
-            // reset m_no m_date
-            ptr->m_no = 0;
-            ptr->m_date = std::string(date);
-            ptr->m_need_reopen = true;  // 时间改了要打开过文件
+            int64_t size = std::max(m_map_size * 2, m_file_size + len);
+            munmap(m_map, m_map_size);
+            m_map = nullptr;
+            m_map_size = 0;
+            mapFile(size);
         }
 
-        if(!ptr->m_fileHandle)  // 文件没有打开初始化
+        if(m_map)
         {
-            ptr->m_need_reopen = true;
+            for(size_t i = 0; i < iovs.size(); ++i)
+            {
+                memcpy(m_map + m_file_size, iovs[i].iov_base, iovs[i].iov_len);
+                m_file_size += iovs[i].iov_len;
+            }
+            return;
         }
+    }
 
-        std::stringstream ss;  // 日志文件名
-        ss << ptr->m_filePath << ptr->m_fileName << "_" << ptr->m_date << "_" << logTypeToString(ptr->m_logType)
-            << "_" << ptr->m_no << ".log";
-        std::string full_file_name = ss.str();
-
-            // 文件需要重新打开
-        if(ptr->m_need_reopen)
+    size_t pos = 0;
+    while(m_fd != -1 && pos < iovs.size())
+    {
+        int cnt = std::min<size_t>(iovs.size() - pos, IOV_MAX);
+        ssize_t rt = writev(m_fd, &iovs[pos], cnt);
+        if(rt < 0)
         {
-            if(ptr->m_fileHandle)
-                fclose(ptr->m_fileHandle);
+            if(errno == EINTR)
+                continue;
+            printf("write log file error, errno = %d reason = %s \n", errno, strerror(errno));
+            break;
+        }
+        m_file_size += rt;
+        // 跳过已经写完的段，写了一部分的段调整起点
+        while(pos < iovs.size() && static_cast<size_t>(rt) >= iovs[pos].iov_len)
+        {
+            rt -= iovs[pos].iov_len;
+            ++pos;
+        }
+        if(pos < iovs.size())
+        {
+            iovs[pos].iov_base = static_cast<char*>(iovs[pos].iov_base) + rt;
+            iovs[pos].iov_len -= rt;
+        }
+    }
+}
 
-            // 重新打开, 附加形式, 如果打开出错错误自动保存在errno
-            ptr->m_fileHandle = fopen(full_file_name.c_str(), "a");
-            if(!ptr->m_fileHandle)
-                printf("file %s open fail errno = %d reason = %s \n",full_file_name.c_str(), errno, strerror(errno));
+// mmap写的部分每隔sync_inteval交给内核开始回写，不等写完
+void AsyncLogger::syncFile()
+{
+    if(!m_map || m_file_size == m_synced_size)
+        return;
+    int64_t now = Clock::nowMs();
+    if(now - m_last_sync_ms < m_sync_inteval)
+        return;
+    sync_file_range(m_fd, m_synced_size, m_file_size - m_synced_size, SYNC_FILE_RANGE_WRITE);
+    m_synced_size = m_file_size;
+    m_last_sync_ms = now;
+}
 
-            ptr->m_need_reopen = false;
-        }
+// 二进制日志文件头，时区偏移给tinyrpc_logcat还原本地时间
+static void appendHead(std::string* out)
+{
+    time_t now_sec = Clock::wallUs() / 1000000;
+    struct tm now_time;
+    localtime_r(&now_sec, &now_time);
+
+    uint32_t len = LOG_RECORD_HEADER_SIZE + sizeof(LOG_BINARY_MAGIC) + 4 + 4 + 4;
+    size_t pos = out->size();
+    out->resize(pos + len);
+    char* p = &(*out)[pos];
+    p = logPut<uint32_t>(p, len);
+    p = logPut<uint8_t>(p, LOG_RECORD_HEAD);
+    memcpy(p, LOG_BINARY_MAGIC, sizeof(LOG_BINARY_MAGIC));
+    p += sizeof(LOG_BINARY_MAGIC);
+    p = logPut<uint32_t>(p, LOG_BINARY_VERSION);
+    p = logPut<uint32_t>(p, getpid());
+    logPut<int32_t>(p, now_time.tm_gmtoff);
+}
+
+size_t AsyncLogger::drain()
+{
+    Mutex::Lock lock(m_mutex);
+    std::vector<LogRing*> rings = m_rings;
+    lock.unlock();
 
-        // 当前文件流的位置大于设置的单个日志最大值，处理到下一个文件中。
-        if(ftell(ptr->m_fileHandle) > ptr->m_maxSize)
+    // 每个环形缓冲最多两段，加上丢日志的提示，一次writev
+    std::vector<struct iovec> iovs;
+    std::vector<size_t> lens(rings.size(), 0);
+    std::vector<std::string> notes;
+    iovs.reserve(rings.size() * 3);
+    notes.reserve(rings.size());
+    size_t total = 0;
+    for(size_t i = 0; i < rings.size(); ++i)
+    {
+        uint64_t dropped = rings[i]->m_dropped.exchange(0, std::memory_order_relaxed);
+        if(dropped > 0)
         {
-            fclose(ptr->m_fileHandle);
-
-            // 1. 单个日志超过最大值
-            ptr->m_no++; // 编号++
-            std::stringstream ss2;  // 因为编号变了，所以需要写过文件名
-            ss2 << ptr->m_filePath << ptr->m_fileName << "_" << ptr->m_date << "_" << logTypeToString(ptr->m_logType)
-                << "_" << ptr->m_no << ".log";
-            full_file_name = ss2.str();
-            // 2. 创建打开一个新文件
-            ptr->m_fileHandle = fopen(full_file_name.c_str(), "a");
-            ptr->m_need_reopen = false;
+            if(m_binary)
+            {
+                notes.emplace_back(LOG_RECORD_HEADER_SIZE + sizeof(uint64_t), '\0');
+                char* p = &notes.back()[0];
+                p = logPut<uint32_t>(p, notes.back().size());
+                p = logPut<uint8_t>(p, LOG_RECORD_DROPPED);
+                logPut<uint64_t>(p, dropped);
+            }
+            else
+            {
+                notes.emplace_back("[log ring full, dropped " + std::to_string(dropped) + " log lines]\n");
+            }
+            struct iovec note;
+            note.iov_base = &notes.back()[0];
+            note.iov_len = notes.back().size();
+            iovs.push_back(note);
+            total += note.iov_len;
         }
-            // 总体判断下文件是否打开
-        if(!ptr->m_fileHandle)
-            printf("file %s open fail errno = %d reason = %s \n",full_file_name.c_str(), errno, strerror(errno));
-
+        struct iovec iov[2];
+        int cnt = rings[i]->peek(iov, &lens[i]);
+        for(int j = 0; j < cnt; ++j)
+            iovs.push_back(iov[j]);
+        total += lens[i];
+    }
 
-        // tmp是一个用户的vector<string>日志向量
-        for(auto str : tmp)
+    std::string meta;
+    if(total > 0)
+    {
+        bool reopen = openFile(total);
+        if(m_binary)
         {
-            // 日志写入文件
-            if(!str.empty()) 
-                // char[], sizeof(char), size , FILE*
-                fwrite(str.c_str(), 1, str.size(), ptr->m_fileHandle);
+            // 新文件先写HEAD，再补上这一批日志可能用到的调用点(注册在写入环形缓冲之前，上面peek到的都在里面)
+            if(reopen)
+            {
+                appendHead(&meta);
+                m_sites_written = 0;
+            }
+            m_sites_written = appendLogSites(&meta, m_sites_written);
+            if(!meta.empty())
+            {
+                struct iovec iov;
+                iov.iov_base = &meta[0];
+                iov.iov_len = meta.size();
+                iovs.insert(iovs.begin(), iov);
+            }
         }
-        tmp.clear();
-        fflush(ptr->m_fileHandle);
-        if(is_stop)  // 暂停了就跳出while(true)
-            break;
+
+        writeFile(iovs);
     }
 
-    if(!ptr->m_fileHandle)
-        fclose(ptr->m_fileHandle);
+    // 写失败也释放，避免生产者一直满
+    std::vector<LogRing*> closed;
+    for(size_t i = 0; i < rings.size(); ++i)
+    {
+        if(lens[i] > 0)
+            rings[i]->consume(lens[i]);
+        if(rings[i]->m_closed.load(std::memory_order_acquire) && rings[i]->empty())
+            closed.push_back(rings[i]);
+    }
 
-    return nullptr;
+    if(!closed.empty())
+    {
+        lock.lock();
+        for(size_t i = 0; i < closed.size(); ++i)
+        {
+            m_rings.erase(std::find(m_rings.begin(), m_rings.end(), closed[i]));
+            delete closed[i];
+        }
+        lock.unlock();
+    }
+    return total;
 }
 
-// 异步日志加入队列
-void AsyncLogger::push(std::vector<std::string>& buffer)
+void* AsyncLogger::exeute(void* arg)
 {
-    if(!buffer.empty())
+    /*
+    1. 等到定时或者被唤醒，取出所有线程环形缓冲里的日志
+    2. 打开文件writev写入
+    3. 限制单个文件的大小，超过就把编号++，写入新的文件。
+    */
+
+    // 为什么类指针转换不用static_cast<>
+    AsyncLogger* ptr = reinterpret_cast<AsyncLogger*>(arg);
+
+    // 初始化pthread_cond_t 的条件变量，定时等待用单调时钟
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int rt = pthread_cond_init(&ptr->m_condition, &attr);
+    assert(rt == 0);
+    pthread_condattr_destroy(&attr);
+
+    rt = sem_post(&ptr->m_semaphore); // V操作
+    assert(rt == 0);
+
+    // 循环执行
+    while(true)
     {
-        // 上锁
-        Mutex::Lock lock(m_mutex);
-        m_tasks.push(buffer);
+        Mutex::Lock lock(ptr->m_mutex);
+
+        // 没有被通知并且还没有暂停写日志，就等一个同步间隔
+        if(!ptr->m_notified.load(std::memory_order_acquire) && !ptr->m_stop)
+        {
+            timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += ptr->m_sync_inteval / 1000;
+            deadline.tv_nsec += (ptr->m_sync_inteval % 1000) * 1000000;
+            if(deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&(ptr->m_condition), ptr->m_mutex.getMutex(), &deadline);
+        }
+        ptr->m_notified.store(false, std::memory_order_release);
+        bool is_stop = ptr->m_stop;
+
         // 解锁
         lock.unlock();
-        // 唤醒等待的条件变量，也就是执行函数里面的等待的条件变量。
-        pthread_cond_signal(&m_condition);
+
+        // 暂停的时候取到取不出来为止
+        while(ptr->drain() > 0 && is_stop)
+        {
+        }
+        ptr->syncFile();
+
+        if(is_stop)  // 暂停了就跳出while(true)
+            break;
     }
-} 
 
-// 刷新文件指针
-void AsyncLogger::flush()
-{
-    if(m_fileHandle)
-        fflush(m_fileHandle);
+    ptr->closeFile();
+
+    return nullptr;
 }
 
 // 暂停写入
 void AsyncLogger::stop()
 {
+    Mutex::Lock lock(m_mutex);
     if(!m_stop)
     {
         m_stop = true;
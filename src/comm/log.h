@@ -15,14 +15,26 @@
 
 #include <sstream> // stringstream
 #include <memory> // shared_ptr
+#include <atomic>
+#include <type_traits>
 
 
 #include "src/comm/config.h"
+#include "src/comm/log_binary.h"
 #include "src/net/mutex.h"
 /*
 class Logger : 处理单个用户的日志string写入buffer(vector)
 class AsyncLogger : 处理整个日志队列的写入文件，每次处理一个用户的日志
 class LoggerEvent : 被Logger调用，实现日志字符的组织，日志等级等等。
+
+写日志不加锁、不申请内存：
+    1. 每个线程一个复用的格式化缓冲(LogStream)，一条日志格式化完整条拷贝到本线程这种日志的环形缓冲(LogRing)
+    2. 每种日志一个异步线程，每隔sync_inteval或者有环形缓冲超过一半的时候，取出所有线程的缓冲，一次writev写文件
+    3. 环形缓冲满了不等待，丢掉这条并且计数，唤醒异步线程，异步线程在文件里记一行丢了多少条
+    4. 配置log_mmap的时候日志文件按最大值预分配并映射，异步线程直接拷贝到映射区，不再每批调writev
+       每隔sync_inteval用sync_file_range让内核开始回写，换文件的时候截掉没用到的部分
+    5. 配置log_format为binary的时候写二进制日志(格式见log_binary.h)，不格式化日志头，app日志只记参数不调snprintf
+       用tools/tinyrpc_logcat还原成文本
 */
 
 namespace tinyrpc{
@@ -57,61 +69,48 @@ enum LogType{
 --------------RPC LOG加入buffer
 
 */
-// 使用LogEvent对象进行日志写入stringstram流，之后LogTmp析构之后加入buffer
-#define DebugLog \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_log_level) \
-        tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::DEBUG, __FILE__, __LINE__, __func__, \
-        tinyrpc::LogType::RPC_LOG))).getStringStream()
-
-#define InfoLog \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::INFO >= tinyrpc::gRpcConfig->m_log_level) \
-        tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::INFO, __FILE__, __LINE__, __func__, \
-        tinyrpc::LogType::RPC_LOG))).getStringStream()
-
-#define WarnLog \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::WARN >= tinyrpc::gRpcConfig->m_log_level) \
-        tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::WARN, __FILE__, __LINE__, __func__, \
-        tinyrpc::LogType::RPC_LOG))).getStringStream()
-
-#define ErrorLog \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::ERROR >= tinyrpc::gRpcConfig->m_log_level) \
-        tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::ERROR, __FILE__, __LINE__, __func__, \
-        tinyrpc::LogType::RPC_LOG))).getStringStream()
+// 编译期最低日志等级(LogLevel的值)，由cmake的TINYRPC_MIN_LOG_LEVEL设置
+// 低于这个等级的日志语句条件是常量false，整条语句连同参数一起被编译器删掉
+#ifndef TINYRPC_MIN_LOG_LEVEL
+#define TINYRPC_MIN_LOG_LEVEL 1
+#endif
+
+// 先比较编译期等级，再看日志有没有打开和运行时等级，都是短路求值，关闭的时候后面<<的参数不会计算
+#define TINYRPC_LOG_ENABLED(level, conf_level) \
+    ((level) >= TINYRPC_MIN_LOG_LEVEL && tinyrpc::OpenLog() && (level) >= (conf_level))
+
+// 每个写日志的地方一个静态的LogSite，常量初始化，不需要线程安全的初始化检查
+// 二进制日志第一次用到的时候注册拿到id，文件里只记一次文件名、行号和格式串
+#define TINYRPC_LOG_SITE(level, type, kind, fmt) \
+    []() -> tinyrpc::LogSite* { static tinyrpc::LogSite site = {level, type, kind, __FILE__, __LINE__, fmt, {0}}; return &site; }()
+
+// LogTmp是栈上的临时对象，日志写入本线程复用的格式化缓冲，语句结束LogTmp析构的时候整条拷贝到本线程的环形缓冲
+// 写成 if(!enabled) {} else ... 的形式，调用处外面的else不会和宏里面的if配对
+#define RPC_LOG_IMPL(level) \
+    if(!TINYRPC_LOG_ENABLED(level, tinyrpc::gRpcConfig->m_log_level)) {} \
+    else tinyrpc::LogTmp(TINYRPC_LOG_SITE(level, tinyrpc::LogType::RPC_LOG, tinyrpc::LOG_SITE_STREAM, nullptr), __func__).getStringStream()
+
+#define DebugLog RPC_LOG_IMPL(tinyrpc::LogLevel::DEBUG)
+#define InfoLog RPC_LOG_IMPL(tinyrpc::LogLevel::INFO)
+#define WarnLog RPC_LOG_IMPL(tinyrpc::LogLevel::WARN)
+#define ErrorLog RPC_LOG_IMPL(tinyrpc::LogLevel::ERROR)
 
 /*
 
 --------------APP LOG加入buffer
 
 宏定义 ... 和 ##__VA_ARGS__配套使用，可变参数，之后传入可变模版参数进行解析
+格式串要是字符串字面量("" str拼接检查)，二进制日志只在调用点记一次
 */
 
-#define AppDebugLog(str, ...) \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_app_log_level) \
-    { \
-       tinyrpc::Logger::getLogger()->pushAppLog(tinyrpc::LogEvent(tinyrpc::LogLevel::DEBUG, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).toString() \
-        + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + tinyrpc::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define AppInfoLog(str, ...) \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::INFO >= tinyrpc::gRpcConfig->m_app_log_level) \
-    { \
-       tinyrpc::Logger::getLogger()->pushAppLog(tinyrpc::LogEvent(tinyrpc::LogLevel::INFO, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).toString() \
-        + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + tinyrpc::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define AppWarnLog(str, ...) \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::WARN >= tinyrpc::gRpcConfig->m_app_log_level) \
-    { \
-       tinyrpc::Logger::getLogger()->pushAppLog(tinyrpc::LogEvent(tinyrpc::LogLevel::WARN, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).toString() \
-        + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + tinyrpc::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define AppErrorLog(str, ...) \
-    if(tinyrpc::OpenLog() && tinyrpc::LogLevel::ERROR >= tinyrpc::gRpcConfig->m_app_log_level) \
-    { \
-       tinyrpc::Logger::getLogger()->pushAppLog(tinyrpc::LogEvent(tinyrpc::LogLevel::ERROR, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).toString() \
-        + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + tinyrpc::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
+#define APP_LOG_IMPL(level, str, ...) \
+    if(!TINYRPC_LOG_ENABLED(level, tinyrpc::gRpcConfig->m_app_log_level)) {} \
+    else tinyrpc::LogTmp(TINYRPC_LOG_SITE(level, tinyrpc::LogType::APP_LOG, tinyrpc::LOG_SITE_PRINTF, "" str), __func__).format(str, ##__VA_ARGS__)
+
+#define AppDebugLog(str, ...) APP_LOG_IMPL(tinyrpc::LogLevel::DEBUG, str, ##__VA_ARGS__)
+#define AppInfoLog(str, ...) APP_LOG_IMPL(tinyrpc::LogLevel::INFO, str, ##__VA_ARGS__)
+#define AppWarnLog(str, ...) APP_LOG_IMPL(tinyrpc::LogLevel::WARN, str, ##__VA_ARGS__)
+#define AppErrorLog(str, ...) APP_LOG_IMPL(tinyrpc::LogLevel::ERROR, str, ##__VA_ARGS__)
 
 
 /*
@@ -128,19 +127,164 @@ std::string levelToString(LogLevel level);
 std::string logTypeToString(LogType type);
 bool OpenLog();
 
+// 一个写日志的地方
+struct LogSite{
+    LogLevel level;
+    LogType type;
+    LogSiteKind kind;
+    const char* file_name;
+    int line;
+    const char* fmt;            // app日志的格式串，rpc日志是nullptr
+    std::atomic<uint32_t> id;   // 二进制日志的调用点id，0表示还没注册
+};
+
+// 注册调用点，返回id(从1开始)，同一个调用点只注册一次
+uint32_t registerLogSite(LogSite* site);
+// 把[from, 当前已注册数)的调用点按LOG_RECORD_SITE追加到out，返回当前已注册数
+size_t appendLogSites(std::string* out, size_t from);
+
+
+
+// *********************日志格式化缓冲*********************
+// 一条日志的格式化缓冲，std::string保存内容，只增长不缩小，每个线程复用一个，之后不再申请内存
+class LogStreamBuf : public std::streambuf{
+public:
+    LogStreamBuf();
+
+    const char* data() const { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+    void reset();
+    // 保证后面至少还有n字节可写，返回写入位置
+    char* reserve(size_t n);
+    // reserve之后写入了n字节
+    void commit(size_t n) { pbump(static_cast<int>(n)); }
+
+protected:
+    int overflow(int c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+private:
+    void grow(size_t need);
+
+private:
+    std::string m_storage;
+};
+
+class LogStream : public std::ostream{
+public:
+    LogStream();
+
+    const char* data() const { return m_buf.data(); }
+    size_t size() const { return m_buf.size(); }
+    void reset() { m_buf.reset(); clear(); }
+
+    // 二进制日志用，直接追加字节
+    void appendRaw(const void* p, size_t n)
+    {
+        memcpy(m_buf.reserve(n), p, n);
+        m_buf.commit(n);
+    }
+    template<typename T>
+    void appendValue(T v)
+    {
+        appendRaw(&v, sizeof(T));
+    }
+    // 改写已经写入的字节，用来回填记录长度
+    void patch(size_t pos, const void* p, size_t n)
+    {
+        memcpy(const_cast<char*>(m_buf.data()) + pos, p, n);
+    }
+
+    // app日志的参数，二进制日志按类型原样写入，格式化留给tinyrpc_logcat
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type appendArg(T v)
+    {
+        appendValue<uint8_t>(LOG_ARG_INT);
+        appendValue<int64_t>(v);
+    }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type appendArg(T v)
+    {
+        appendValue<uint8_t>(LOG_ARG_UINT);
+        appendValue<uint64_t>(v);
+    }
+    template<typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type appendArg(T v)
+    {
+        appendValue<uint8_t>(LOG_ARG_INT);
+        appendValue<int64_t>(static_cast<int64_t>(v));
+    }
+    template<typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type appendArg(T v)
+    {
+        appendValue<uint8_t>(LOG_ARG_DOUBLE);
+        appendValue<double>(v);
+    }
+    template<typename T>
+    void appendArg(T* p)
+    {
+        appendValue<uint8_t>(LOG_ARG_PTR);
+        appendValue<uint64_t>(reinterpret_cast<uintptr_t>(p));
+    }
+    void appendArg(const char* str)
+    {
+        appendStrArg(str ? str : "(null)", str ? strlen(str) : 6);
+    }
+    void appendArg(char* str)
+    {
+        appendArg(static_cast<const char*>(str));
+    }
+    void appendArg(const std::string& str)
+    {
+        appendStrArg(str.data(), str.size());
+    }
+
+private:
+    void appendStrArg(const char* str, size_t len)
+    {
+        appendValue<uint8_t>(LOG_ARG_STR);
+        appendValue<uint32_t>(len);
+        appendRaw(str, len);
+    }
+
+public:
+
+    // 按printf格式追加，参数和snprintf一样
+    template<typename... Args>
+    void appendFormat(const char* str, Args&&... args)
+    {
+        char* p = m_buf.reserve(256);
+        int size = snprintf(p, 256, str, args...);
+        if(size < 0)
+            return;
+        if(size >= 256)
+        {
+            p = m_buf.reserve(size + 1);
+            snprintf(p, size + 1, str, args...);
+        }
+        m_buf.commit(size);
+    }
+
+private:
+    LogStreamBuf m_buf;
+};
 
 
 // *********************日志事件类*********************
 class LogEvent{
 public:
     typedef std::shared_ptr<LogEvent> ptr;
-    LogEvent(LogLevel level, const char* file_name, int line, const char* func_name, LogType type);
+    LogEvent(LogSite* site, const char* func_name);
 
     ~LogEvent();
 
-    std::string toString();
-    // 日志都放在stringstream内，最后进行拿出来打印
-    std::stringstream& getStringStream();
+    LogEvent(const LogEvent&) = delete;
+    LogEvent& operator=(const LogEvent&) = delete;
+
+    // 写入日志头(时间、等级、线程、协程、文件行号、msgno)，返回格式化缓冲，后面接着写日志内容
+    std::ostream& getStringStream();
+    LogStream& getLogStream() { return *m_stream; }
+    bool isBinary() const { return m_binary; }
     // LogTemp析构的时候被调用加入到Logger中
     void log();
     
@@ -156,58 +300,99 @@ private:
     int m_line{0};   // 打印的行数
     const char* m_funcName; // 日志打印的函数名
     LogType m_type; // 日志类型
-    std::string m_msgNo; // 消息体
+    LogSite* m_site;
+    bool m_binary {false};  // 写二进制记录
 
-    std::stringstream m_ss; // 存储整个日志的流
+    LogStream* m_stream {nullptr}; // 本线程的格式化缓冲，嵌套写日志的时候是新申请的
+    bool m_own_stream {false};
 };
 
 // *********************日志打印辅助类*********************
 class LogTmp{
 public:
-    explicit LogTmp(LogEvent::ptr event);
+    LogTmp(LogSite* site, const char* func_name);
     ~LogTmp();
     
     // 调用LogEvent的getStringStream
-    std::stringstream& getStringStream();
+    std::ostream& getStringStream();
+
+    // app日志，日志头后面是[文件:行号]和printf格式的内容
+    template<typename... Args>
+    void format(const char* str, Args&&... args)
+    {
+        m_event.getStringStream();
+        LogStream& ss = m_event.getLogStream();
+        if(m_event.isBinary())
+        {
+            // 只写参数，格式串在调用点里
+            int expand[] = {0, (ss.appendArg(args), 0)...};
+            (void)expand;
+            return;
+        }
+        ss.appendFormat("[%s:%d]\t", m_file_name, m_line);
+        ss.appendFormat(str, args...);
+    }
 
 private:
-    LogEvent::ptr m_event;
+    LogEvent m_event;
+    const char* m_file_name;
+    int m_line;
 };
 
+class LogRing;
+
 // *********************异步日志类*********************
 class AsyncLogger{
 public:
     typedef std::shared_ptr<AsyncLogger> ptr;
 
-    AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logType);
+    AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logType, int sync_inteval, bool binary, bool mmap);
     ~AsyncLogger();
 
-    // 传入本次日志的buffer，加入到异步队列中等待打印
-    void push(std::vector<std::string>& buffer);
-    // 刷新buffer
-    void flush();
+    // 加入一个线程的环形缓冲，之后由异步线程取
+    void addRing(LogRing* ring);
+    // 有环形缓冲快满了，马上唤醒异步线程
+    void notify();
     // 开始异步执行，构造创建了一个线程没有join执行，当最后调用最后面的Exit()之后，join这个线程，就异步的将buffer中的内容写入文本
     static void* exeute(void*);
 
     void stop();
 
-public:
-    // 每个用户都使用一个vector保存每个用户的str日志
-    std::queue<std::vector<std::string>> m_tasks;  // 异步日志队列
+private:
+    // 取出所有环形缓冲写文件，返回写了多少字节
+    size_t drain();
+    // 按日期和大小切换文件，incoming是这一批要写的字节数，返回是否打开了新文件
+    bool openFile(size_t incoming);
+    bool isFull(size_t incoming) const;
+    void mapFile(int64_t size);
+    void closeFile();
+    void writeFile(std::vector<struct iovec>& iovs);
+    void syncFile();
 
 private:
     const char* m_fileName;
     const char* m_filePath;
     int m_maxSize{0};   // 单个日志文件的最大写入数，限定一个日志文件的长度，分成多个日志文件
     LogType m_logType;
+    int m_sync_inteval {500};  // 没有通知的时候多久取一次，ms
+    bool m_binary {false};
+    size_t m_sites_written {0};     // 二进制日志当前文件已经写过的调用点数
+    bool m_mmap {false};
+    char* m_map {nullptr};          // 映射的整个文件，m_file_size之后是预分配的部分
+    int64_t m_map_size {0};
+    int64_t m_synced_size {0};      // 已经交给内核回写的位置
+    int64_t m_last_sync_ms {0};
     int m_no{0};  // 标识当前的日志文件的编号，也就是第几个日志文件
     bool m_need_reopen {false};   // 是否需要重新打开，更新数据等等会重新打开文件， fileHandle没有初始化也会
-    FILE* m_fileHandle {nullptr};
+    int m_fd {-1};
+    int64_t m_file_size {0};
     std::string m_date;
 
-    Mutex m_mutex;  // 异步锁
+    Mutex m_mutex;  // 异步锁，保护m_rings和条件变量
     pthread_cond_t m_condition; // 条件变量
     bool m_stop {false};
+    std::atomic<bool> m_notified {false};
+    std::vector<LogRing*> m_rings;   // 所有线程的环形缓冲
 
 public:
     pthread_t m_thread; // 异步使用一个线程进行异步打印
@@ -226,16 +411,12 @@ public:
     Logger();
     ~Logger();
 
-    void init(const char* file_name, const char* file_path, int max_size, int sync_inteval);
-    // 加入不同的日志类型。
-    // 在LogTemp析构的时候调用LogEvent的log，将ss流中的字符串Push到buffer中
-    void pushRpcLog(const std::string& log_msg);
-    void pushAppLog(const std::string& log_msg);
-    // 这个函数由一个定时器使用，定时把buffer的内容加入到AsynLogger中
-    void loopFunc();
+    void init(const char* file_name, const char* file_path, int max_size, int sync_inteval, bool binary = false, bool mmap = false);
+    // 在LogTemp析构的时候调用LogEvent的log，把整条日志拷贝到本线程这种日志的环形缓冲
+    void pushLog(LogType type, const char* data, size_t len);
+    bool isBinary() const { return m_binary; }
 
     void flush();
-    void start();
 
 public:
     AsyncLogger::ptr getAsyncLogger()
@@ -247,15 +428,9 @@ public:
         return m_async_app_logger;
     }
 
-public:
-    std::vector<std::string> m_buffer;    // rpc日志buffer
-    std::vector<std::string> m_app_buffer; // app日志buffer
-
 private:
-    Mutex m_app_buffer_mutex;
-    Mutex m_buffer_mutex;
-
     bool m_is_init {false};
+    bool m_binary {false};
     AsyncLogger::ptr m_async_rpc_logger;
     AsyncLogger::ptr m_async_app_logger;
 
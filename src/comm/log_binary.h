@@ -0,0 +1,72 @@
+#ifndef SRC_COMM_LOG_BINARY_H
+#define SRC_COMM_LOG_BINARY_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+
+    二进制日志格式，日志库写，tools/tinyrpc_logcat读，两边只依赖这个头文件
+    文件由一条条记录组成，每条记录开头是 u32 整条记录的长度(包括这4字节) + u8 记录类型，整数都是本机字节序
+
+    LOG_RECORD_HEAD     每次打开文件写一条，后面的调用点id只在下一个HEAD之前有效
+                        magic[8] + u32 版本 + u32 pid + i32 时区偏移(秒)
+    LOG_RECORD_SITE     调用点，每个写日志的地方注册一次，每个文件里在第一次用到之前写一条
+                        u32 id + u8 等级 + u8 日志类型 + u8 参数形式 + u32 行号 + str 文件名 + str 格式串
+    LOG_RECORD_EVENT    一条日志
+                        u32 调用点id + i64 时间(us) + u32 线程id + i32 协程id + str msgno + str 接口名 + 内容
+                        LOG_SITE_STREAM的内容是<<写进去的文本，LOG_SITE_PRINTF的内容是一个个参数(u8 类型 + 值)
+    LOG_RECORD_DROPPED  环形缓冲满了丢掉的条数，u64
+
+    str是 u16 长度 + 内容，参数里的字符串是 u32 长度 + 内容
+
+*/
+
+namespace tinyrpc{
+
+static const char LOG_BINARY_MAGIC[8] = {'T', 'R', 'P', 'C', 'B', 'L', 'O', 'G'};
+static const uint32_t LOG_BINARY_VERSION = 1;
+
+enum LogRecordType{
+    LOG_RECORD_HEAD = 1,
+    LOG_RECORD_SITE = 2,
+    LOG_RECORD_EVENT = 3,
+    LOG_RECORD_DROPPED = 4
+};
+
+// 调用点的内容形式
+enum LogSiteKind{
+    LOG_SITE_STREAM = 0,    // rpc日志，DebugLog << ...
+    LOG_SITE_PRINTF = 1     // app日志，AppDebugLog(fmt, ...)
+};
+
+// printf参数的类型
+enum LogArgType{
+    LOG_ARG_INT = 1,        // i64
+    LOG_ARG_UINT = 2,       // u64
+    LOG_ARG_DOUBLE = 3,     // double
+    LOG_ARG_STR = 4,        // u32长度 + 内容
+    LOG_ARG_PTR = 5         // u64
+};
+
+// 记录长度 + 类型
+static const size_t LOG_RECORD_HEADER_SIZE = 5;
+
+// 按本机字节序读写定长整数，不要求对齐
+template<typename T>
+inline char* logPut(char* p, T v)
+{
+    memcpy(p, &v, sizeof(T));
+    return p + sizeof(T);
+}
+
+template<typename T>
+inline const char* logGet(const char* p, T* v)
+{
+    memcpy(v, p, sizeof(T));
+    return p + sizeof(T);
+}
+
+} // namespace tinyrpc
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SRC_COMM_LOG_RING_H
+#define SRC_COMM_LOG_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <atomic>
+
+/*
+
+    日志用的单生产者单消费者字节环形缓冲，无锁
+    1. 生产者是写日志的线程，每次写入一整条格式化好的日志，空间不够就整条不写
+    2. 消费者是异步日志线程，一次取出所有可读的数据(最多两段，直接给writev)，写完再释放
+    3. head只有生产者写，tail只有消费者写，各占一个缓存行，生产者缓存一份tail，空间够的时候不读消费者的缓存行
+
+*/
+
+namespace tinyrpc{
+
+class LogRing{
+
+public:
+    // size向上取整到2的幂
+    explicit LogRing(size_t size)
+    {
+        size_t cap = 4096;
+        while(cap < size)
+        {
+            cap <<= 1;
+        }
+        m_size = cap;
+        m_buf = new char[cap];
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    ~LogRing()
+    {
+        delete[] m_buf;
+    }
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+public:
+    // 生产者调用，空间不够返回false
+    bool write(const char* data, size_t len)
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if(head + len - m_cached_tail > m_size)
+        {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if(head + len - m_cached_tail > m_size)
+            {
+                return false;
+            }
+        }
+
+        size_t pos = head & (m_size - 1);
+        size_t first = len < m_size - pos ? len : m_size - pos;
+        memcpy(m_buf + pos, data, first);
+        memcpy(m_buf, data + first, len - first);
+        m_head.store(head + len, std::memory_order_release);
+        return true;
+    }
+
+    // 生产者调用，写入之后超过一半就应该通知消费者
+    bool overHalf() const
+    {
+        return m_head.load(std::memory_order_relaxed) - m_cached_tail > m_size / 2;
+    }
+
+    // 消费者调用，可读数据放到iov(至少2个)，返回段数，len是总长度
+    int peek(struct iovec* iov, size_t* len) const
+    {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        *len = head - tail;
+        if(head == tail)
+        {
+            return 0;
+        }
+
+        size_t pos = tail & (m_size - 1);
+        size_t first = *len < m_size - pos ? *len : m_size - pos;
+        iov[0].iov_base = m_buf + pos;
+        iov[0].iov_len = first;
+        if(first == *len)
+        {
+            return 1;
+        }
+        iov[1].iov_base = m_buf;
+        iov[1].iov_len = *len - first;
+        return 2;
+    }
+
+    // 消费者调用，释放peek出来的len字节
+    void consume(size_t len)
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const
+    {
+        return m_size;
+    }
+
+public:
+    std::atomic<bool> m_closed {false};      // 所属线程已经退出，消费者取完就释放
+    std::atomic<uint64_t> m_dropped {0};     // 满了丢掉的日志条数
+
+private:
+    char* m_buf {nullptr};
+    size_t m_size {0};
+
+    char m_pad0[64];
+    std::atomic<uint64_t> m_head;   // 生产者写
+    uint64_t m_cached_tail {0};     // 生产者看到的tail
+    char m_pad1[64];
+    std::atomic<uint64_t> m_tail;   // 消费者写
+    char m_pad2[64];
+};
+
+} // namespace tinyrpc
+
+#endif
@@ -31,7 +31,6 @@ TcpServer::ptr getServer()
 
 void startRpcServer() 
 {
-    gRpcLogger->start();
     gRpcServer->start();
 }
 
@@ -25,6 +25,16 @@ namespace tinyrpc {
     } \
     } while(0)\
 
+// 后面跟方法名，这些方法放到工作线程执行，io协程挂起等待，方法里能做什么见WorkerThreadPool
+// REGISTER_SERVICE_WITH_WORKER(QueryServiceImpl, "query_age");
+#define REGISTER_SERVICE_WITH_WORKER(service, ...) \
+    do { \
+    if (!tinyrpc::getServer()->registerService(std::make_shared<service>(), {__VA_ARGS__})) { \
+        printf("Start TinyRPC server error, because register protobuf service error, please look up rpc log get more details!\n"); \
+        tinyrpc::Exit(0); \
+    } \
+    } while(0)\
+
 
 
 void initConfig(const char* file);
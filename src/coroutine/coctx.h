@@ -3,18 +3,28 @@
 
 namespace tinyrpc{
 
+// coctx_swap是一次普通的函数调用，调用方已经按ABI把caller-saved寄存器(rax rcx rdx rsi rdi r8-r11)当成会被破坏的了，
+// 所以只需要保存callee-saved的rbx rbp r12-r15，加上rsp和返回地址
 enum{
-    kRBP = 6,           // 在regs寄存器数组中的位置，rbp是栈底指针，位置是regs[6]
-    kRDI = 7,           // rdi, 第一个参数的位置regs[7]
-    kRSI = 8,           // rsim 第二个参数的位置regs[8]
-    kRETAddr = 9,       // 下一个执行地址，会保存在rip中
-    kRSP = 13           // 栈顶指针
+    kRBX = 0,
+    kRBP = 1,           // rbp是栈底指针
+    kR12 = 2,
+    kR13 = 3,
+    kR14 = 4,
+    kR15 = 5,
+    kRSP = 6,           // 进入coctx_swap时的栈顶，指向返回地址
+    kRETAddr = 7,       // 切回来之后跳到的地址
+    kRDI = 8,           // 每次切进来都会装到rdi，第一次切进协程的时候就是协程函数的第一个参数
+    kFPUCW = 9          // 低4字节mxcsr，之后2字节x87控制字，编译时打开TINYRPC_COCTX_SAVE_FPU才保存恢复
 };
 
+// 新的上下文的浮点控制字：mxcsr和x87控制字的默认值，屏蔽所有浮点异常，就近舍入
+static const unsigned long kDefaultFPUCW = (0x037FUL << 32) | 0x1F80UL;
+
 // 协程上下文结构体
 struct coctx
 {
-    void* regs[14];
+    void* regs[10];
 };
 
 // 协程切换函数，协程切换实质上就是原协程栈保存，换成需要切换的协程栈，只是涉及一些寄存器的保存和切换，使用汇编
@@ -28,4 +38,4 @@ extern "C"{
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,7 @@
 #include <cstring>
 
 #include "src/coroutine/coroutine.h"
+#include "src/coroutine/share_stack.h"
 #include "src/comm/run_time.h"
 #include "src/comm/config.h"
 #include "src/comm/log.h"
@@ -99,6 +100,18 @@ Coroutine::Coroutine(int size, char* stack_ptr, std::function<void()> cb)
     t_coroutine_count++;
 }
 
+// 共享栈协程，栈在第一次唤醒的时候才绑定
+Coroutine::Coroutine(ShareStack* share_stack)
+: m_is_share_stack(true),
+  m_share_stack(share_stack)
+{
+    if(!t_main_coroutine)
+        t_main_coroutine = new Coroutine();
+
+    m_cor_id = t_cur_coroutine_id++;
+    t_coroutine_count++;
+}
+
 bool Coroutine::setCallBack(std::function<void()> cb)
 {
     // 主协程不负责执行回调函数任务
@@ -115,8 +128,26 @@ bool Coroutine::setCallBack(std::function<void()> cb)
     }
 
     m_call_back = cb;
+    m_can_resume = true; // 协程上下文设置好了，设置为可以唤醒
+
+    if(m_is_share_stack)
+    {
+        // 之前换出去的栈已经没用了
+        m_save_size = 0;
+        // 还没绑定共享栈，第一次唤醒的时候再设置上下文
+        if(m_share_index == -1)
+            return true;
+    }
+
+    initContext();
+    return true;
+}
+
+void Coroutine::initContext()
+{
     // 栈是自大到小地址的，而stack_sp分配的堆是自小到大的，所以要转换下，将top放到最高位，之后的汇编会一直往下走
-    char* top = m_stack_sp + m_stack_size;
+    // 保存的rsp指向返回地址，切进来的时候rsp是top + 8，和刚被call进来一样，留出一个指针的位置让它还在栈内
+    char* top = m_stack_sp + m_stack_size - sizeof(void*);
     // 内存对齐，在64位机器下每次存储8位，所以要8位对齐
     // -16LL其实就是低4位都是0，高位都是1的数，进行&操作top就最后4位都是0就是8的倍数了，进行了8的内存对齐
     top = reinterpret_cast<char*>((reinterpret_cast<unsigned long>(top)) & -16LL);
@@ -127,14 +158,71 @@ bool Coroutine::setCallBack(std::function<void()> cb)
     m_coctx.regs[kRBP] = top;
     m_coctx.regs[kRETAddr] = reinterpret_cast<char*>(CoFunction); // 切换下一个地址到执行协程调用回调函数的函数地址，下一次就进入了协程调度切换中
     m_coctx.regs[kRDI] = reinterpret_cast<char*>(this); // 第一个参数的位置，把this传入CoFunction调用成员cb函数
+    m_coctx.regs[kFPUCW] = reinterpret_cast<void*>(kDefaultFPUCW);
+}
 
-    m_can_resume = true; // 协程上下文设置好了，设置为可以唤醒
+// 在主协程里调用，这时候没有任何协程在共享栈上执行
+bool Coroutine::switchShareStack()
+{
+    if(m_share_index == -1)
+    {
+        if(!m_share_stack)
+            m_share_stack = ShareStack::getShareStack();
+        m_share_index = m_share_stack->alloc();
+        m_stack_size = m_share_stack->getStackSize();
+        m_stack_sp = m_share_stack->getStack(m_share_index);
+        initContext();
+    }
 
+    // 栈的地址是固定的，保存的栈里有指向栈内的指针，只能在同一个线程拷回原来的位置
+    if(!m_share_stack->isOwnerThread())
+    {
+        ErrorLog << "share stack coroutine[" << m_cor_id << "] can't resume in other thread";
+        return false;
+    }
+
+    Coroutine::ptr occupy = m_share_stack->getOccupy(m_share_index);
+    if(occupy.get() == this)
+        return true;
+
+    // 占着栈的协程执行完了栈就没用了，不用保存
+    if(occupy && occupy->m_is_in_cofunc)
+        occupy->saveStack();
+
+    m_share_stack->setOccupy(m_share_index, shared_from_this());
+    restoreStack();
     return true;
 }
 
+void Coroutine::saveStack()
+{
+    // 挂起时的rsp到栈顶就是用到的部分
+    char* sp = reinterpret_cast<char*>(m_coctx.regs[kRSP]);
+    int len = static_cast<int>(m_stack_sp + m_stack_size - sp);
+
+    // 按实际用到的大小申请，大小差太多了再重新申请
+    if(m_save_capacity < len || m_save_capacity > 2 * len)
+    {
+        free(m_save_buffer);
+        m_save_buffer = static_cast<char*>(malloc(len));
+        m_save_capacity = len;
+    }
+    memcpy(m_save_buffer, sp, len);
+    m_save_size = len;
+}
+
+void Coroutine::restoreStack()
+{
+    if(m_save_size > 0)
+    {
+        memcpy(m_stack_sp + m_stack_size - m_save_size, m_save_buffer, m_save_size);
+        m_save_size = 0;
+    }
+}
+
 Coroutine::~Coroutine()
 {
+    free(m_save_buffer);
     t_coroutine_count--; // 协程析构，协程池--
 }
 
@@ -226,6 +314,12 @@ void Coroutine::Resume(Coroutine* co)
         return;
     }
 
+    // 共享栈协程先把栈换成自己的
+    if(co->m_is_share_stack && !co->switchShareStack())
+    {
+        return;
+    }
+
     // 进行切换
     t_cur_coroutine = co;
     t_cur_run_time = co->getRunTime();
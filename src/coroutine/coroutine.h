@@ -17,8 +17,10 @@ RunTime* getCurrentRunTime();
 void setCurrentRunTime(RunTime* v);
 
 
+class ShareStack;
+
 // *********************协程类*********************
-class Coroutine{
+class Coroutine : public std::enable_shared_from_this<Coroutine>{
 public:
     typedef std::shared_ptr<Coroutine> ptr;
 
@@ -30,6 +32,9 @@ public:
 
     Coroutine(int size, char* stack_ptr, std::function<void()> cb);
 
+    // 共享栈协程，share_stack为空的时候第一次唤醒再绑定唤醒线程的共享栈
+    explicit Coroutine(ShareStack* share_stack);
+
     ~Coroutine();
 
 public:
@@ -91,6 +96,28 @@ public:
         m_can_resume = v;
     }
 
+    bool isShareStack() const
+    {
+        return m_is_share_stack;
+    }
+
+    // 固定在所在线程恢复，不放进会被别的线程窃取的队列
+    void setPinned(bool v)
+    {
+        m_is_pinned = v;
+    }
+
+    bool isPinned() const
+    {
+        return m_is_pinned;
+    }
+
+    // 共享栈协程换出去的时候保存栈用的堆内存大小
+    int getSaveCapacity() const
+    {
+        return m_save_capacity;
+    }
+
 public:
     // 挂起协程其实就是从当前协程切换到主协程，此时当前协程让出CPU，主协程抢占CPU，栈空间恢复为原来线程的栈，执行主协程的代码。
     // 目的就是为了切换回主协程
@@ -103,6 +130,15 @@ public:
     static Coroutine* getMainCoroutine();
 
 
+private:
+    // 设置从栈顶开始执行CoFunction的上下文
+    void initContext();
+    // 共享栈协程唤醒之前，把共享栈换成自己的
+    bool switchShareStack();
+    // 被换出去的时候保存用到的那段栈，唤醒的时候拷回去
+    void saveStack();
+    void restoreStack();
+
 public:
     std::function<void()> m_call_back;   // 回调函数
 
@@ -118,6 +154,15 @@ private:
     bool m_can_resume {true};  // 标识能够唤醒协程
 
     int m_index {-1};   // 当前协程在协程池中的index
+
+    bool m_is_pinned {false};   // 只能在所在线程唤醒
+
+    bool m_is_share_stack {false};          // 是否使用共享栈
+    ShareStack* m_share_stack {NULL};       // 绑定的共享栈
+    int m_share_index {-1};                 // 绑定的是共享栈中的哪一个，-1表示还没绑定
+    char* m_save_buffer {NULL};             // 换出去的时候保存栈的堆内存
+    int m_save_size {0};                    // 保存了多少字节，0表示栈上的就是自己的
+    int m_save_capacity {0};
 };
 
 }
@@ -8,6 +8,7 @@
 #include "src/coroutine/coroutine.h"
 #include "src/net/fd_event.h"
 #include "src/net/reactor.h"
+#include "src/net/io_uring.h"
 #include "src/net/timer.h"
 #include "src/comm/log.h"
 #include "src/comm/config.h"
@@ -33,6 +34,8 @@ https://blog.csdn.net/mijichui2153/article/details/109561978
 HOOK_SYS_FUNC(accept);
 HOOK_SYS_FUNC(read);  // g_sys_read_fun() 相当调用 系统read
 HOOK_SYS_FUNC(write);
+HOOK_SYS_FUNC(readv);
+HOOK_SYS_FUNC(writev);
 HOOK_SYS_FUNC(connect);
 HOOK_SYS_FUNC(sleep);
 
@@ -47,8 +50,94 @@ void setHook(bool value)
 {
     g_hook = value;
 }
+
+// 边缘触发开关，配置文件reactor.edge_triggered设置
+static bool g_edge_triggered = false;
+
+void setEdgeTriggered(bool value)
+{
+    g_edge_triggered = value;
+}
+
+bool isEdgeTriggered()
+{
+    return g_edge_triggered;
+}
+
+static size_t getIovLen(const struct iovec* iov, int iovcnt)
+{
+    size_t len = 0;
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+/*
+    边缘触发模式的读写：
+    1. fd每个方向第一次返回EAGAIN的时候加入EPOLLET注册，之后不再epoll_ctl
+    2. 已经知道不可读/写(上次EAGAIN或者没读满/写满)，直接挂起等待边缘事件，省掉一次必然失败的系统调用
+    3. 被就绪事件唤醒之后重试，再EAGAIN就继续等；不是就绪事件唤醒的(比如rpc超时的定时器)，把EAGAIN返回给调用者
+*/
+template<class IoFunc>
+static ssize_t edgeTriggeredIO(tinyrpc::FdEvent* fd_event, tinyrpc::IOEvent event, size_t request, IoFunc io)
+{
+    bool waited = false;
+    while(true)
+    {
+        if(fd_event->isReady(event))
+        {
+            ssize_t n = io();
+            if(n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                // 没读满说明接收缓冲区空了，没写完说明发送缓冲区满了
+                if(n >= 0 && static_cast<size_t>(n) < request)
+                {
+                    fd_event->clearReady(event);
+                }
+                return n;
+            }
+            fd_event->clearReady(event);
+        }
+        else if(waited)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        fd_event->registerEdgeTriggered(event);
+        fd_event->setCoroutine(tinyrpc::Coroutine::getCurrentCoroutine());
+        fd_event->setWaitEvents(event);
+
+        DebugLog << "fd:[" << fd_event->getFd() << "] wait edge triggered event " << event << ", yield";
+        tinyrpc::Coroutine::Yield();
+
+        fd_event->setWaitEvents(0);
+        fd_event->clearCoroutine();
+        waited = true;
+    }
+}
+// 当前线程的reactor启用了io_uring并且fd是socket才走io_uring
+// fd上已经有别的线程的ring的multishot，不能在这里读，退回epoll
+static tinyrpc::IoUring* getIoUring(tinyrpc::FdEvent* fd_event)
+{
+    tinyrpc::IoUring* io_uring = tinyrpc::Reactor::getReactor()->getIoUring();
+    if(!io_uring || !fd_event->isSocket())
+    {
+        return nullptr;
+    }
+    tinyrpc::IoUringOp* op = fd_event->getIoUringOp();
+    if(op && op->ring != io_uring)
+    {
+        ErrorLog << "fd[" << fd_event->getFd() << "] is owned by io_uring of other thread, use epoll";
+        return nullptr;
+    }
+    return io_uring;
+}
+
 // 传入fdEvent和读写事件，设置fdEvent中的读写事件和对应使用的协程
-void toEpoll(tinyrpc::FdEvent::ptr fd_event, int events)
+void toEpoll(tinyrpc::FdEvent* fd_event, int events)
 {
     tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::getCurrentCoroutine();
 
@@ -81,12 +170,22 @@ int accept_hook(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
         return g_sys_accept_fun(sockfd, addr, addrlen);
     }
 
-    tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::getFdContainer()->getFdEvent(sockfd);
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(sockfd);
+    if(!fd_event)
+    {
+        // fd超出FdEventContainer的范围，没有FdEvent可以挂起协程，直接调用系统函数
+        return g_sys_accept_fun(sockfd, addr, addrlen);
+    }
     if(fd_event->getReactor() == nullptr)
     {
         fd_event->setReactor(tinyrpc::Reactor::getReactor());
     }
 
+    if(tinyrpc::IoUring* io_uring = getIoUring(fd_event))
+    {
+        return io_uring->accept(fd_event, addr, addrlen);
+    }
+
     fd_event->setNonBlock();
 
     // accept成功返回客户端的fd, 表示现在有就直接返回，没有再进行挂起等待
@@ -122,12 +221,29 @@ ssize_t read_hook(int fd, void* buf, size_t count)
     // 是子协程，使用hook自定义的read
     // 这里已经是设置了fd对应的FdEvent对象，
     // 1. 取出FdEvent
-    tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::getFdContainer()->getFdEvent(fd);
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(fd);
+    if(!fd_event)
+    {
+        // 同accept_hook，超出范围直接调用系统函数
+        return g_sys_read_fun(fd, buf, count);
+    }
     if(fd_event->getReactor() == nullptr) // 没有设置reactor,将单例设置给它
         fd_event->setReactor(tinyrpc::Reactor::getReactor());
-    
+
+    if(tinyrpc::IoUring* io_uring = getIoUring(fd_event))
+    {
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = count;
+        return io_uring->readv(fd_event, &iov, 1);
+    }
+
     fd_event->setNonBlock();
 
+    if(g_edge_triggered)
+    {
+        return edgeTriggeredIO(fd_event, tinyrpc::IOEvent::READ, count, [&](){ return g_sys_read_fun(fd, buf, count); });
+    }
 
     /*
         读一次，如果直接读完了就不用注册读事件进行循环等待了
@@ -160,12 +276,31 @@ ssize_t write_hook(int fd, const void* buf, size_t count)
     }
 
     // 2. 拿出fdEnvent，进行设置
-    tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::getFdContainer()->getFdEvent(fd);
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(fd);
+    if(!fd_event)
+    {
+        // 同accept_hook，超出范围直接调用系统函数
+        return g_sys_write_fun(fd, buf, count);
+    }
     if(fd_event->getReactor() == nullptr)
     {
         fd_event->setReactor(tinyrpc::Reactor::getReactor());
     }
+
+    if(tinyrpc::IoUring* io_uring = getIoUring(fd_event))
+    {
+        struct iovec iov;
+        iov.iov_base = const_cast<void*>(buf);
+        iov.iov_len = count;
+        return io_uring->writev(fd, &iov, 1);
+    }
+
     fd_event->setNonBlock();
+
+    if(g_edge_triggered)
+    {
+        return edgeTriggeredIO(fd_event, tinyrpc::IOEvent::WRITE, count, [&](){ return g_sys_write_fun(fd, buf, count); });
+    }
     
     int n = g_sys_write_fun(fd, buf, count);
     if(n > 0)
@@ -184,6 +319,101 @@ ssize_t write_hook(int fd, const void* buf, size_t count)
     return g_sys_write_fun(fd, buf, count);
 }
 
+// 和read_hook一样，只是一次读到多个不连续的buffer中
+ssize_t readv_hook(int fd, const struct iovec* iov, int iovcnt)
+{
+    DebugLog << "this is hook readv";
+    if(tinyrpc::Coroutine::isMainCoroutine())
+    {
+        DebugLog << "hook disable, call sys readv func";
+        return g_sys_readv_fun(fd, iov, iovcnt);
+    }
+
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(fd);
+    if(!fd_event)
+    {
+        // 同accept_hook，超出范围直接调用系统函数
+        return g_sys_readv_fun(fd, iov, iovcnt);
+    }
+    if(fd_event->getReactor() == nullptr)
+        fd_event->setReactor(tinyrpc::Reactor::getReactor());
+
+    if(tinyrpc::IoUring* io_uring = getIoUring(fd_event))
+    {
+        return io_uring->readv(fd_event, iov, iovcnt);
+    }
+
+    fd_event->setNonBlock();
+
+    if(g_edge_triggered)
+    {
+        return edgeTriggeredIO(fd_event, tinyrpc::IOEvent::READ, getIovLen(iov, iovcnt), [&](){ return g_sys_readv_fun(fd, iov, iovcnt); });
+    }
+
+    ssize_t n = g_sys_readv_fun(fd, iov, iovcnt);
+    if(n > 0)
+        return n;
+
+    toEpoll(fd_event, tinyrpc::IOEvent::READ);
+
+    DebugLog << "readv func to yield";
+    tinyrpc::Coroutine::Yield();
+
+    fd_event->delListenEvents(tinyrpc::IOEvent::READ);
+    fd_event->clearCoroutine();
+
+    DebugLog << "readv func yield back, now to call sys readv";
+    return g_sys_readv_fun(fd, iov, iovcnt);
+}
+
+ssize_t writev_hook(int fd, const struct iovec* iov, int iovcnt)
+{
+    DebugLog << "this is hook writev";
+    if(tinyrpc::Coroutine::isMainCoroutine())
+    {
+        DebugLog << "hook disable, call sys writev func";
+        return g_sys_writev_fun(fd, iov, iovcnt);
+    }
+
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(fd);
+    if(!fd_event)
+    {
+        // 同accept_hook，超出范围直接调用系统函数
+        return g_sys_writev_fun(fd, iov, iovcnt);
+    }
+    if(fd_event->getReactor() == nullptr)
+    {
+        fd_event->setReactor(tinyrpc::Reactor::getReactor());
+    }
+
+    if(tinyrpc::IoUring* io_uring = getIoUring(fd_event))
+    {
+        return io_uring->writev(fd, iov, iovcnt);
+    }
+
+    fd_event->setNonBlock();
+
+    if(g_edge_triggered)
+    {
+        return edgeTriggeredIO(fd_event, tinyrpc::IOEvent::WRITE, getIovLen(iov, iovcnt), [&](){ return g_sys_writev_fun(fd, iov, iovcnt); });
+    }
+
+    ssize_t n = g_sys_writev_fun(fd, iov, iovcnt);
+    if(n > 0)
+        return n;
+
+    toEpoll(fd_event, tinyrpc::IOEvent::WRITE);
+
+    DebugLog << "writev func to yield";
+    tinyrpc::Coroutine::Yield();
+
+    fd_event->delListenEvents(tinyrpc::IOEvent::WRITE);
+    fd_event->clearCoroutine();
+
+    DebugLog << "writev func yield back, now to call sys writev";
+    return g_sys_writev_fun(fd, iov, iovcnt);
+}
+
 /*
 connect需要判断连接超时的问题，处理方法就是设置一个定时器，传入回调函数，函数内容是记录超时标志和唤醒协程进行后续处理。
 
@@ -202,11 +432,23 @@ int connect_hook(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
     // reactor
     tinyrpc::Reactor* reactor = tinyrpc::Reactor::getReactor();
 
-    tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::getFdContainer()->getFdEvent(sockfd);
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(sockfd);
+    if(!fd_event)
+    {
+        // 同accept_hook，超出范围直接调用系统函数
+        return g_sys_connect_fun(sockfd, addr, addrlen);
+    }
     if(fd_event->getReactor() == nullptr)
     {
         fd_event->setReactor(reactor);
     }
+
+    // 超时用链接在connect后面的LINK_TIMEOUT，不需要定时器
+    if(tinyrpc::IoUring* io_uring = getIoUring(fd_event))
+    {
+        return io_uring->connect(sockfd, addr, addrlen, gRpcConfig ? gRpcConfig->m_max_connect_timeout : 0);
+    }
+
     fd_event->setNonBlock();
     // currention coroutine
     tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::getCurrentCoroutine();
@@ -230,12 +472,13 @@ int connect_hook(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
     // connect是写事件
     toEpoll(fd_event, tinyrpc::IOEvent::WRITE);
 
-    bool is_timeout = false; // 判断连接是否超时
+    // 判断连接是否超时，超时回调在主协程里执行，协程栈可能已经被换出去了(共享栈)，标志放在堆上
+    std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
 
     // 超时函数句柄
-    auto timeout_cb = [&is_timeout, cur_cor](){
+    auto timeout_cb = [is_timeout, cur_cor](){
         // 设置超时标志，唤醒协程
-        is_timeout = true;
+        *is_timeout = true;
         tinyrpc::Coroutine::Resume(cur_cor);
     };
 
@@ -261,7 +504,7 @@ int connect_hook(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
 		return 0;
 	}
 
-    if (is_timeout)
+    if (*is_timeout)
     {
         ErrorLog << "connect error,  timeout[ " << gRpcConfig->m_max_connect_timeout << "ms]";
 		errno = ETIMEDOUT;
@@ -272,6 +515,24 @@ int connect_hook(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
     
 }
 
+// 不挂起协程的非阻塞读
+// io_uring模式下multishot recv已经把数据收到provided buffer里了，直接读socket会读到后面的数据，要先从buffer取
+ssize_t readvNoWait(int fd, const struct iovec* iov, int iovcnt)
+{
+    tinyrpc::FdEvent* fd_event = tinyrpc::FdEventContainer::getFdContainer()->getRawFdEvent(fd);
+    tinyrpc::IoUringOp* op = fd_event ? fd_event->getIoUringOp() : nullptr;
+    if(op && op->ring->isOwnerThread())
+    {
+        return op->ring->readvNoWait(fd_event, iov, iovcnt);
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+    return recvmsg(fd, &msg, MSG_DONTWAIT);
+}
+
 unsigned int sleep_hook(unsigned int seconds)
 {
     DebugLog << "this is hook sleep";
@@ -284,11 +545,11 @@ unsigned int sleep_hook(unsigned int seconds)
 
     tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::getCurrentCoroutine();
 
-    // 设置超时回调函数，加入定时器事件
-    bool is_timeout = false;
-    auto timeout_cb = [cur_cor, &is_timeout](){
+    // 设置超时回调函数，加入定时器事件，标志放在堆上，原因同connect_hook
+    std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
+    auto timeout_cb = [cur_cor, is_timeout](){
         DebugLog << "onTime, now resume sleep cor";
-        is_timeout = true;
+        *is_timeout = true;
         // 唤醒处理超时后续的事
         tinyrpc::Coroutine::Resume(cur_cor);
     };
@@ -300,7 +561,7 @@ unsigned int sleep_hook(unsigned int seconds)
     DebugLog << "now to yield sleep";
     // 因为读写事件都可能唤醒这个协程，所以当这个协程被重新唤醒的时候，必须检查是否超时，否则应该重新挂起协程
     // 因为这里设置的就是sleep协程，所以在这个协程唤醒的时候还在睡眠时间内，就不能使用协程进行读写，要重新挂起协程。
-    while(!is_timeout)
+    while(!*is_timeout)
     {
         tinyrpc::Coroutine::Yield();
     }
@@ -339,6 +600,24 @@ ssize_t write(int fd, const void *buf, size_t count)
 	}
 }
 
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+	if (!tinyrpc::g_hook) {
+		return g_sys_readv_fun(fd, iov, iovcnt);
+	} else {
+		return tinyrpc::readv_hook(fd, iov, iovcnt);
+	}
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	if (!tinyrpc::g_hook) {
+		return g_sys_writev_fun(fd, iov, iovcnt);
+	} else {
+		return tinyrpc::writev_hook(fd, iov, iovcnt);
+	}
+}
+
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) 
 {
 	if (!tinyrpc::g_hook) {
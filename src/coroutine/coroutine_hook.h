@@ -4,6 +4,7 @@
 #include <unistd.h> // read, write in linux
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <functional>
 
@@ -13,6 +14,10 @@ typedef ssize_t (*read_fun_ptr_t)(int fd, void *buf, size_t count);
 
 typedef ssize_t (*write_fun_ptr_t)(int fd, const void *buf, size_t count);
 
+typedef ssize_t (*readv_fun_ptr_t)(int fd, const struct iovec *iov, int iovcnt);
+
+typedef ssize_t (*writev_fun_ptr_t)(int fd, const struct iovec *iov, int iovcnt);
+
 typedef int (*connect_fun_ptr_t)(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 
 typedef int (*accept_fun_ptr_t)(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
@@ -42,12 +47,25 @@ ssize_t read_hook(int fd, void* buf, size_t count);
 
 ssize_t write_hook(int fd, const void* buf, size_t count);
 
+ssize_t readv_hook(int fd, const struct iovec* iov, int iovcnt);
+
+ssize_t writev_hook(int fd, const struct iovec* iov, int iovcnt);
+
 int connect_hook(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
 
 unsigned int sleep_hook(unsigned int seconds);
 
 void setHook(bool);
 
+// 边缘触发模式：读写的fd每个方向只注册一次EPOLLET，只有系统调用返回EAGAIN才挂起协程
+void setEdgeTriggered(bool);
+
+bool isEdgeTriggered();
+
+// 非阻塞读，不会挂起协程，没有数据返回-1，errno=EAGAIN
+// io_uring模式下会先取multishot recv已经收到的数据
+ssize_t readvNoWait(int fd, const struct iovec* iov, int iovcnt);
+
 
 extern "C"{
     int accept(int sockf, struct sockaddr* addr, socklen_t* addrlen);
@@ -56,6 +74,10 @@ extern "C"{
 
     ssize_t write(int fd, const void* buf, size_t count);
 
+    ssize_t readv(int fd, const struct iovec* iov, int iovcnt);
+
+    ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+
     int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
 
     unsigned int sleep(unsigned int seconds);
@@ -17,7 +17,7 @@ static CoroutinePool* t_coroutine_container_ptr = nullptr;
 CoroutinePool* getCoroutinePool()
 {
     if(!t_coroutine_container_ptr)
-        t_coroutine_container_ptr = new CoroutinePool(gRpcConfig->m_cor_pool_size, gRpcConfig->m_cor_stack_size);
+        t_coroutine_container_ptr = new CoroutinePool(gRpcConfig->m_cor_pool_size, gRpcConfig->m_cor_stack_size, gRpcConfig->m_cor_warm_stacks);
 
     return t_coroutine_container_ptr;
 }
@@ -29,64 +29,94 @@ CoroutinePool* getCoroutinePool()
 
 */
 // 初始化协程池，创建协程，并且给栈空间和sp指针
-CoroutinePool::CoroutinePool(int pool_size, int stack_size /*1024 * 128*/)
+CoroutinePool::CoroutinePool(int pool_size, int stack_size /*1024 * 128*/, int warm_stacks /*64*/)
 : m_pool_size(pool_size),
-  m_stack_size(stack_size)
+  m_stack_size(stack_size),
+  m_warm_stacks(warm_stacks),
+  m_free_cors(pool_size),
+  m_in_use(new std::atomic<bool>[pool_size])
 {
     // 设置主协程,函数里如果当前携程为空就创建一个空协程为主协程，设置为当前协程。
     Coroutine::getCurrentCoroutine(); 
 
     // 一个位置一条内存列表，整个vector就是内存池, pool_size就是块数量
-    m_memory_pool.push_back(std::make_shared<Memory>(stack_size, pool_size));
+    m_memory_pool.push_back(std::make_shared<Memory>(stack_size, pool_size, warm_stacks));
 
-    Memory::ptr tmp = m_memory_pool[0];  // 随便找的一个对象，为了调用
+    m_cor_memory = m_memory_pool[0];
+    Memory::ptr tmp = m_cor_memory;  // 随便找的一个对象，为了调用
 
+    m_cors.reserve(pool_size);
     for(int i = 0; i < pool_size; ++i)
     {
         // 给一个栈大小和栈指针，也就是获取的堆的指针
         Coroutine::ptr cor = std::make_shared<Coroutine>(stack_size, tmp->getBlock());
         cor->setIndex(i);  // 协程在协程池中的index
-        m_free_cors.push_back(std::make_pair(cor, false));  // false表示还未被使用
+        m_in_use[i].store(false, std::memory_order_relaxed);
+        m_cors.push_back(cor);  // 下标已经都在m_free_cors里，表示还未被使用
     }
 }
 
 CoroutinePool::~CoroutinePool(){}
 
 // 获取一个协程池的实例
-Coroutine::ptr CoroutinePool::getCoroutineInstanse()
+Coroutine::ptr CoroutinePool::getCoroutineInstanse(bool share_stack /*false*/)
 {
+    // 0. 共享栈协程不占内存池的栈，直接创建，第一次唤醒的时候绑定唤醒线程的共享栈
+    if(share_stack)
+    {
+        return std::make_shared<Coroutine>(static_cast<ShareStack*>(NULL));
+    }
+
+    // 1. 首先从空闲栈里弹出一个常驻的协程使用
+    int i = m_free_cors.pop();
+    if(i != -1)
+    {
+        m_cor_memory->useBlock(m_cors[i]->getStackPtr());
+        m_in_use[i].store(true, std::memory_order_relaxed);
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return m_cors[i];
+    }
+
+    // 2. 没有空闲的常驻协程，看看之前挂起的协程有没有已经退出协程函数的
+    // 挂起的协程大多永远不会再恢复，每次只轮流检查几个，不然每次都要扫一遍
     Mutex::Lock lock(m_mutex);
-    // 1. 首先找已经创建的但是处于睡眠的协程使用
-    // 因为已经使用过的协程是经过写入的，已经创建了
-    for(int i = 0; i < m_pool_size; ++i)
+    for(int n = 0; n < 8 && !m_parked_cors.empty(); ++n)
     {
-        // 找到一个不在协程调度的第二阶段也就是不在COFunc中的协程，并且未被使用的协程
-        if(!m_free_cors[i].first->getIsInCoFunc() && !m_free_cors[i].second)
+        if(m_parked_cursor >= m_parked_cors.size())
         {
-            m_free_cors[i].second = true;
-            Coroutine::ptr cor = m_free_cors[i].first;  // 取出这个协程，拿出使用
-            lock.unlock();
-
-            return cor;
+            m_parked_cursor = 0;
         }
+        i = m_parked_cors[m_parked_cursor];
+        if(!m_cors[i]->getIsInCoFunc())
+        {
+            m_parked_cors[m_parked_cursor] = m_parked_cors.back();
+            m_parked_cors.pop_back();
+            m_in_use[i].store(true, std::memory_order_relaxed);
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return m_cors[i];
+        }
+        ++m_parked_cursor;
     }
 
-    // 2. 如果没有已经创建使用过的协程，只能创建一个，指定栈空间
-    // 在内存池中找到第一个空闲的块，创建一个协程
-    // 之后创建的协程不加入free_cors。用完直接返还内存
+    // 3. 常驻的都不能用，只能创建一个，指定栈空间
+    // 在扩展的内存池中找到第一个空闲的块，创建一个协程
+    // 之后创建的协程不是常驻的。用完直接返还内存
+    m_misses.fetch_add(1, std::memory_order_relaxed);
     for(size_t i = 1; i < m_memory_pool.size(); ++i)
     {
         char* tmp = m_memory_pool[i]->getBlock();
         if(tmp)
         {
-            Coroutine::ptr cor = std::make_shared<Coroutine>(m_stack_size, tmp);
-            return cor;
+            return std::make_shared<Coroutine>(m_stack_size, tmp);
         }
     }
 
-    // 3. 如果分配的m_memory_pool已经满了，就再添加一个块
+    // 4. 如果分配的m_memory_pool已经满了，就再添加一个块
      // 返回最后一个新分配的块创建的协程栈的协程
-    m_memory_pool.push_back(std::make_shared<Memory>(m_stack_size, m_pool_size));
+    m_memory_pool.push_back(std::make_shared<Memory>(m_stack_size, m_pool_size, m_warm_stacks));
+    uint64_t expansions = m_expansions.fetch_add(1, std::memory_order_relaxed) + 1;
+    InfoLog << "coroutine pool expand to " << m_memory_pool.size() << " memory blocks, hits=" << m_hits.load(std::memory_order_relaxed)
+        << ", misses=" << m_misses.load(std::memory_order_relaxed) << ", expansions=" << expansions;
     return std::make_shared<Coroutine>(m_stack_size, m_memory_pool[m_memory_pool.size() - 1]->getBlock());
 }
 
@@ -94,25 +124,57 @@ Coroutine::ptr CoroutinePool::getCoroutineInstanse()
 void CoroutinePool::returnCoroutine(Coroutine::ptr cor)
 {
     // 协程index是在初始化协程池的时候创建了m_pool_size个协程的编号，pool_size就是一个Memory有多少块的数量
-    // 当时是加入到m_free_cors中的，设置false就能归还
+    // 常驻的协程下标压回空闲栈就能归还，还在协程函数里的先挂起来
+    // 共享栈协程没有从内存池拿栈，不用归还
+    if(cor->isShareStack())
+    {
+        return;
+    }
+
     int i = cor->getIndex();
-    // 如果是在
     if(i >= 0 && i < m_pool_size)
     {
-        m_free_cors[i].second = false;
+        if(!m_in_use[i].exchange(false, std::memory_order_relaxed))
+        {
+            ErrorLog << "coroutine[" << i << "] is already in pool, ignore return";
+            return;
+        }
+        cor->setPinned(false);
+        if(cor->getIsInCoFunc())
+        {
+            Mutex::Lock lock(m_mutex);
+            m_parked_cors.push_back(i);
+            return;
+        }
+        // 栈已经没用了，空闲驻留的太多就释放物理内存
+        m_cor_memory->idleBlock(cor->getStackPtr());
+        m_free_cors.push(i);
     }
     else
     {
-        // 不是在m_free_cors中的，也就是之后再创建但是没有加入到m_free_cors中的直接返还内存
+        // 不是常驻的，也就是之后再创建的直接返还内存
         // 也就是说常驻的协程池中的协程数量就是m_pool_size个，其他的都是用时创建，不用时直接归还。
+        Mutex::Lock lock(m_mutex);
         for(size_t i = 1; i < m_memory_pool.size(); ++i)
         {
             if(m_memory_pool[i]->hasBlock(cor->getStackPtr()))
             {
                 m_memory_pool[i]->backBlock(cor->getStackPtr());
+                break;
             }
         }
     }
 }
 
-}
\ No newline at end of file
+CoroutinePool::Stats CoroutinePool::getStats() const
+{
+    Stats stats;
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    stats.expansions = m_expansions.load(std::memory_order_relaxed);
+    stats.idle = m_free_cors.size();
+    stats.warm = m_cor_memory->getWarmCount();
+    return stats;
+}
+
+}
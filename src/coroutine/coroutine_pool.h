@@ -2,36 +2,63 @@
 #define SRC_COROUTINE_COROUTINE_POOL_H
 
 #include <vector>
+#include <atomic>
+#include <stdint.h>
 
 #include "src/coroutine/coroutine.h"
 #include "src/net/mutex.h"
 #include "src/coroutine/memory.h"
+#include "src/coroutine/free_list.h"
 
 
 namespace tinyrpc{
 
 // 协程池是所有线程共用的，也就是 m:n协程池模型，m个线程对n个协程自由调用
 // 如果使用1:n也就是每个线程使用单独的协程池，就会出现如果io处理时间过长，其他的请求阻塞，因为就一个线程
+// 常驻的pool_size个协程的空闲下标放在无锁栈里，取还O(1)不加锁；常驻的用完了才加锁从扩展的内存里临时创建
+// 归还的时候还在协程函数里的协程(连接关掉的时候协程还挂在读写上)不能复用，先放到m_parked_cors，取不到的时候再检查
 class CoroutinePool{
 public:
-    CoroutinePool(int pool_size, int stack_size = 1024 * 128);
+    // 统计
+    struct Stats{
+        uint64_t hits {0};          // 拿到常驻协程的次数
+        uint64_t misses {0};        // 常驻协程用完，临时创建的次数
+        uint64_t expansions {0};    // 扩展内存池的次数
+        int idle {0};               // 空闲的常驻协程数
+        int warm {0};               // 空闲并且物理内存没有释放的常驻协程栈数
+    };
+
+public:
+    CoroutinePool(int pool_size, int stack_size = 1024 * 128, int warm_stacks = 64);
     ~CoroutinePool();
 
-    Coroutine::ptr getCoroutineInstanse();  // 获取一个协程
+    Coroutine::ptr getCoroutineInstanse(bool share_stack = false);  // 获取一个协程，share_stack表示用共享栈
 
     void returnCoroutine(Coroutine::ptr cor);  // 归还一个协程
 
+    Stats getStats() const;
+
 private:
     int m_pool_size {0};
     int m_stack_size {0};
+    int m_warm_stacks {0};      // 每个Memory最多保留多少空闲的栈不释放
 
-    // bool 判断协程是否被使用
-    std::vector<std::pair<Coroutine::ptr, bool>> m_free_cors; // 协程池中的协程
+    std::vector<Coroutine::ptr> m_cors;     // 常驻的协程，下标就是协程的index
+    Memory::ptr m_cor_memory;               // 常驻协程的栈，也就是m_memory_pool[0]，取还的时候不用加锁访问m_memory_pool
+    IndexFreeList m_free_cors;              // 空闲的常驻协程的下标
+    std::unique_ptr<std::atomic<bool>[]> m_in_use;  // 常驻协程是否被拿走，重复归还的时候不能压两次
 
-    // 锁
+    // 锁，保护扩展的内存池和m_parked_cors
     Mutex m_mutex;
 
+    std::vector<int> m_parked_cors;         // 已经归还但是还在协程函数里的常驻协程下标
+    size_t m_parked_cursor {0};             // 下次从哪里开始检查m_parked_cors
+
     std::vector<Memory::ptr> m_memory_pool;
+
+    std::atomic<uint64_t> m_hits {0};
+    std::atomic<uint64_t> m_misses {0};
+    std::atomic<uint64_t> m_expansions {0};
 };
 
 CoroutinePool* getCoroutinePool();
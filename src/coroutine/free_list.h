@@ -0,0 +1,95 @@
+#ifndef SRC_COROUTINE_FREE_LIST_H
+#define SRC_COROUTINE_FREE_LIST_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+/*
+
+    空闲下标的无锁栈(Treiber栈)，Memory的块和CoroutinePool的协程都用它做空闲链表，取还都是O(1)
+    1. 每个下标一个next，栈顶head是 版本号(高32位) + 栈顶下标+1(低32位)，0表示空
+    2. 每次修改head版本号加1，一个下标被取走又放回来的时候别的线程手里的旧head比较不过，避免ABA
+    3. next用原子变量，别的线程拿着旧head读到已经被取走的下标的next也不是数据竞争，版本号不对CAS会失败
+
+*/
+
+namespace tinyrpc{
+
+class IndexFreeList{
+
+public:
+    // 开始的时候所有下标都空闲，按0, 1, 2 ...的顺序取出
+    explicit IndexFreeList(uint32_t count)
+    : m_next(new std::atomic<uint32_t>[count]),
+      m_count(count)
+    {
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            m_next[i].store(i + 1 < count ? i + 2 : 0, std::memory_order_relaxed);
+        }
+        m_head.store(count > 0 ? 1 : 0, std::memory_order_relaxed);
+        m_size.store(count, std::memory_order_relaxed);
+    }
+
+    IndexFreeList(const IndexFreeList&) = delete;
+    IndexFreeList& operator=(const IndexFreeList&) = delete;
+
+    // 取一个空闲下标，没有返回-1
+    int pop()
+    {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        while(true)
+        {
+            uint32_t top = static_cast<uint32_t>(head);
+            if(top == 0)
+            {
+                return -1;
+            }
+            uint32_t next = m_next[top - 1].load(std::memory_order_relaxed);
+            uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+            if(m_head.compare_exchange_weak(head, new_head, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                m_size.fetch_sub(1, std::memory_order_relaxed);
+                return static_cast<int>(top - 1);
+            }
+        }
+    }
+
+    // 放回一个下标，调用方保证它是pop出去的
+    void push(int index)
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        while(true)
+        {
+            m_next[index].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            uint64_t new_head = (((head >> 32) + 1) << 32) | static_cast<uint32_t>(index + 1);
+            if(m_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed))
+            {
+                m_size.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    // 大概的空闲数，只用来统计
+    uint32_t size() const
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    uint32_t capacity() const
+    {
+        return m_count;
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+    uint32_t m_count {0};
+    std::atomic<uint64_t> m_head {0};
+    std::atomic<uint32_t> m_size {0};
+};
+
+} // namespace tinyrpc
+
+#endif
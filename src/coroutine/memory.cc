@@ -1,47 +1,74 @@
 #include <memory>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 
 #include "src/comm/log.h"
 #include "src/coroutine/memory.h"
 
 /**
- * 整个内存块是用过malloc申请一大块内存
- *  1. 拿取：设置block大小，每次拿一块，标记每块使用情况，拿没使用的块
- *  2. 归还：计算归还指针的位置，设置为未使用即可
+ * 整个内存块是用mmap申请一大块内存
+ *  布局：[保护页][块0][保护页][块1]...，块按页对齐，栈从高地址往下长，溢出就碰到下面的保护页
+ *  1. 拿取：设置block大小，空闲块的下标放在无锁栈里，每次弹出一个
+ *  2. 归还：计算归还指针的位置，下标压回去，空闲驻留的块超过warm_limit就madvise释放物理内存，下次用到再按页分配
  * 
 */
 
 namespace tinyrpc{
 
-Memory::Memory(int block_size, int block_count)
+Memory::Memory(int block_size, int block_count, int warm_limit /*64*/)
 : m_block_size(block_size),
-  m_block_count(block_count)
+  m_block_count(block_count),
+  m_free_blocks(block_count),
+  m_warm_limit(warm_limit),
+  m_warm(new bool[block_count]())
 {
+    // 块大小按页对齐，每块下面一个保护页
+    m_guard_size = static_cast<int>(sysconf(_SC_PAGESIZE));
+    int block_pages = (m_block_size + m_guard_size - 1) / m_guard_size;
+    m_stride = m_guard_size + block_pages * m_guard_size;
+
     // 总量
-    m_size = m_block_size * m_block_count;
-    // malloc分配内存块，start指向开端
-    m_start = (char*)malloc(m_size);
-    assert(m_start != (void*)-1);
+    m_size = static_cast<size_t>(m_stride) * m_block_count;
+    // 只占地址空间，不预留swap，用到的页才分配物理内存
+    m_start = (char*)mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(m_start == MAP_FAILED)
+    {
+        ErrorLog << "mmap " << m_size << " bytes memory error, sys error=" << strerror(errno);
+    }
+    assert(m_start != MAP_FAILED);
 
-    InfoLog << "succ mmap" << m_size << " bytes memory";
+    for(int i = 0; i < m_block_count; ++i)
+    {
+        if(mprotect(m_start + static_cast<size_t>(i) * m_stride, m_guard_size, PROT_NONE) != 0)
+        {
+            ErrorLog << "mprotect guard page of block " << i << " error, sys error=" << strerror(errno);
+        }
+    }
 
-    m_end = m_start + m_size - 1; // 地址0开始
-    m_blocks.resize(m_block_count); 
+    InfoLog << "succ mmap " << m_size << " bytes memory, " << m_block_count << " blocks with guard page";
 
-    for(size_t i = 0; i < m_blocks.size(); ++i) 
+#ifndef NDEBUG
+    m_in_use.reset(new std::atomic<bool>[m_block_count]);
+    for(int i = 0; i < m_block_count; ++i)
     {
-        m_blocks[i] = false;
+        m_in_use[i].store(false, std::memory_order_relaxed);
     }
+#endif
+
+    m_end = m_start + m_size - 1; // 地址0开始
     m_ref_counts = 0; // 被引用的块数量为0
 }
 
 Memory::~Memory()
 {
     // 未分配或者分配失败
-    if(!m_start || m_start == (void*)-1)
+    if(!m_start || m_start == MAP_FAILED)
         return;
     
-    free(m_start);
+    munmap(m_start, m_size);
     InfoLog << "~succ free munmap " << m_size << " bytes memory";
     m_start = NULL;
     m_ref_counts = 0;
@@ -63,47 +90,49 @@ int Memory::getRefCount()
     return m_ref_counts;
 }
 
+int Memory::getWarmCount()
+{
+    return m_warm_count;
+}
+
 // 分配块出去
 char* Memory::getBlock()
 {
-    int t = -1;
-    // 上锁拿块，否则本协程准备拿i的块，但是没锁被其他 协程拿走了，两个协程都拿到了i块，出现数据错乱
-    Mutex::Lock lock(m_mutex);
-        // 拿取第一个没有被使用的块
-    for(size_t i = 0; i < m_blocks.size(); ++i)
-    {
-        if(m_blocks[i] == false)
-        {
-            m_blocks[i] = true;
-            t = i;
-            break;
-        }
-    }
-
-    lock.unlock();
+    // 无锁栈弹出保证一个块只会被一个线程拿到
+    int t = m_free_blocks.pop();
         // 没有空闲块
     if(t == -1)
         return NULL;
     
     m_ref_counts++;
-    // 返回第i块的首地址
-    return m_start + (t * m_block_size);
+#ifndef NDEBUG
+    m_in_use[t].store(true, std::memory_order_relaxed);
+#endif
+    // 返回第i块的首地址，在保护页上面
+    char* s = m_start + static_cast<size_t>(t) * m_stride + m_guard_size;
+    useBlock(s);
+    return s;
 }
 
 // 归还块
 void Memory::backBlock(char* s)
 {
-    if(s > m_end || s < m_start)
+    // 计算归还的块位置，怎么拿走的就怎么归还，里面数据不用清空，下次直接覆盖就行
+    int i = blockIndex(s);
+    if(i == -1)
     {
-        ErrorLog << "error, this block is not belong to this Memory";
         return;
     }
-
-    // 计算归还的块位置，怎么拿走的就怎么归还
-    int i = (s - m_start) / m_block_size;
-    Mutex::Lock lock(m_mutex);
-    m_blocks[i] = false; // 设置为未使用, 要上锁,设置未使用就用，里面数据不用清空，下次直接覆盖就行
-    lock.unlock();
+#ifndef NDEBUG
+    // 同一块压两次，之后会被两个协程同时拿去当栈
+    if(!m_in_use[i].exchange(false, std::memory_order_relaxed))
+    {
+        ErrorLog << "block " << i << " is already free, ignore return";
+        return;
+    }
+#endif
+    idleBlock(s);
+    m_free_blocks.push(i);
 
     m_ref_counts--;
 }
@@ -113,5 +142,56 @@ bool Memory::hasBlock(char* s)
     return ((s >= m_start) && (s <= m_end));
 }
 
+void Memory::useBlock(char* s)
+{
+    int i = blockIndex(s);
+    if(i != -1 && m_warm[i])
+    {
+        m_warm[i] = false;
+        m_warm_count--;
+    }
+}
+
+void Memory::idleBlock(char* s)
+{
+    int i = blockIndex(s);
+    if(i == -1 || m_warm[i])
+    {
+        return;
+    }
+
+    // 驻留的空闲块还没到上限就留着，下次拿走不用重新缺页
+    if(m_warm_count.fetch_add(1) < m_warm_limit)
+    {
+        m_warm[i] = true;
+        return;
+    }
+    m_warm_count--;
+
+    // 释放物理内存，映射还在，下次访问是新的零页
+    if(madvise(s, m_stride - m_guard_size, MADV_DONTNEED) != 0)
+    {
+        ErrorLog << "madvise block " << i << " error, sys error=" << strerror(errno);
+    }
+}
+
+// 块首地址对应的下标，不是块首地址返回-1
+int Memory::blockIndex(char* s)
+{
+    if(s > m_end || s < m_start)
+    {
+        ErrorLog << "error, this block is not belong to this Memory";
+        return -1;
+    }
+
+    size_t offset = s - m_start;
+    if(offset % m_stride != static_cast<size_t>(m_guard_size))
+    {
+        ErrorLog << "error, this block is not the start of a block";
+        return -1;
+    }
+    return static_cast<int>(offset / m_stride);
+}
+
 
 } // namespace tinyrp
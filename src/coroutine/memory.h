@@ -3,19 +3,22 @@
 
 #include <memory>
 #include <atomic>
-#include <vector>
 
-#include "src/net/mutex.h"
+#include "src/coroutine/free_list.h"
 
 
 namespace tinyrpc{
 
+// 协程栈的内存，一次mmap block_count块，每块栈下面(低地址)有一个PROT_NONE的保护页，栈溢出直接段错误，不会写坏相邻的栈
+// MAP_NORESERVE不预先占用物理内存，用到哪页才分配哪页
+// 空闲的栈只留warm_limit块驻留(刚还回来的下次最先被拿走)，多出来的空闲的时候madvise释放，RSS跟着活跃的协程数走
+// 常驻协程一直占着自己的块，不经过getBlock/backBlock，协程池取还的时候用useBlock/idleBlock
 class Memory{
 public:
     typedef std::shared_ptr<Memory> ptr;
 
 public:
-    Memory(int block_size, int block_count);
+    Memory(int block_size, int block_count, int warm_limit = 64);
     ~Memory();
 
 public:
@@ -31,18 +34,36 @@ public:
     void backBlock(char* s);
     //
     bool hasBlock(char* s);
+    // 块开始使用
+    void useBlock(char* s);
+    // 块空闲了，空闲驻留的块太多就释放掉物理内存
+    void idleBlock(char* s);
+    // 空闲并且驻留的块数
+    int getWarmCount();
+
+private:
+    int blockIndex(char* s);
 
 private:
     int m_block_size {0};           // 内存块大小
     int m_block_count {0};          // 内存块的总量
+    int m_guard_size {0};           // 每块下面保护页的大小
+    int m_stride {0};               // 保护页 + 按页对齐的块大小
 
-    int m_size {0};              // 总量大小 
+    size_t m_size {0};           // 总量大小
     char* m_start {NULL};       // 指向开始
     char* m_end {NULL};         // 指向结尾
 
     std::atomic<int> m_ref_counts {0};      // 内存块被引用的总量
-    std::vector<bool> m_blocks;             // 块被使用的标志，这个vector<bool>是否 有问题？
-    Mutex m_mutex;
+    IndexFreeList m_free_blocks;            // 空闲块的下标，无锁取还
+
+    int m_warm_limit {0};                   // 最多保留多少块空闲的栈不释放
+    std::atomic<int> m_warm_count {0};      // 空闲并且没有释放的块数
+    std::unique_ptr<bool[]> m_warm;         // 每块是否驻留，只有拿着这块的线程读写
+
+#ifndef NDEBUG
+    std::unique_ptr<std::atomic<bool>[]> m_in_use;  // 每块是否被getBlock拿走，调试版本检查重复归还
+#endif
 };
 
 
@@ -0,0 +1,79 @@
+#include "src/coroutine/share_stack.h"
+#include "src/comm/config.h"
+#include "src/comm/log.h"
+
+
+namespace tinyrpc{
+
+extern tinyrpc::Config::ptr gRpcConfig;
+
+// 每个线程自己的共享栈
+static thread_local ShareStack* t_share_stack = nullptr;
+
+ShareStack* ShareStack::getShareStack()
+{
+    if(!t_share_stack)
+        t_share_stack = new ShareStack(gRpcConfig->m_cor_stack_size, gRpcConfig->m_share_stack_count);
+
+    return t_share_stack;
+}
+
+ShareStack::ShareStack(int stack_size, int count)
+: m_stack_size(stack_size),
+  m_count(count),
+  m_tid(gettid())
+{
+    assert(m_count > 0);
+    // 共享栈一直有协程在用，不用释放物理内存
+    m_memory = std::make_shared<Memory>(m_stack_size, m_count, m_count);
+    for(int i = 0; i < m_count; ++i)
+    {
+        m_stacks.push_back(m_memory->getBlock());
+    }
+    m_occupy.resize(m_count);
+
+    InfoLog << "succ create " << m_count << " share stacks of " << m_stack_size << " bytes";
+}
+
+ShareStack::~ShareStack()
+{
+    m_occupy.clear();
+    for(size_t i = 0; i < m_stacks.size(); ++i)
+    {
+        m_memory->backBlock(m_stacks[i]);
+    }
+}
+
+int ShareStack::alloc()
+{
+    int index = m_next;
+    m_next = (m_next + 1) % m_count;
+    return index;
+}
+
+char* ShareStack::getStack(int index)
+{
+    return m_stacks[index];
+}
+
+int ShareStack::getStackSize()
+{
+    return m_stack_size;
+}
+
+Coroutine::ptr ShareStack::getOccupy(int index)
+{
+    return m_occupy[index];
+}
+
+void ShareStack::setOccupy(int index, Coroutine::ptr cor)
+{
+    m_occupy[index] = cor;
+}
+
+bool ShareStack::isOwnerThread()
+{
+    return m_tid == gettid();
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef SRC_COROUTINE_SHARE_STACK_H
+#define SRC_COROUTINE_SHARE_STACK_H
+
+#include <sys/types.h>
+#include <vector>
+#include <memory>
+
+#include "src/coroutine/coroutine.h"
+#include "src/coroutine/memory.h"
+
+/*
+
+    共享栈(参考libco)，连接数很多、大部分时间都在等数据的时候用，每个协程不再独占一个栈
+    1. 每个io线程几个大栈，共享栈协程第一次被唤醒的时候绑定到这个线程的其中一个(轮流分配)，之后只能在这个线程唤醒
+    2. 唤醒的时候栈被别的协程占着，先把占着的协程用到的那一段(挂起时的rsp到栈顶)拷贝到它自己的堆上，再把要唤醒的协程保存的那一段拷回去
+    3. 拷贝都在主协程里做(唤醒只能从主协程切过去)，不会在正在用的栈上拷贝
+    4. 挂起的协程的栈随时可能被换出去，不能让别的协程或者定时器回调通过指针写它栈上的变量
+
+*/
+
+namespace tinyrpc{
+
+class ShareStack{
+
+public:
+    typedef std::shared_ptr<ShareStack> ptr;
+
+    ShareStack(int stack_size, int count);
+    ~ShareStack();
+
+    ShareStack(const ShareStack&) = delete;
+    ShareStack& operator=(const ShareStack&) = delete;
+
+public:
+    // 轮流分配一个栈，返回下标
+    int alloc();
+
+    char* getStack(int index);
+
+    int getStackSize();
+
+    // 当前占着这个栈的协程
+    Coroutine::ptr getOccupy(int index);
+    void setOccupy(int index, Coroutine::ptr cor);
+
+    bool isOwnerThread();
+
+    // 本线程的共享栈，第一次调用的时候按配置创建
+    static ShareStack* getShareStack();
+
+private:
+    int m_stack_size {0};
+    int m_count {0};
+    int m_next {0};
+    pid_t m_tid {0};                        // 创建的线程，只能在这个线程使用
+
+    Memory::ptr m_memory;                   // 带保护页的栈内存
+    std::vector<char*> m_stacks;
+    // 占着栈的协程，持有引用，别的线程释放了协程也要等这里换下来才析构，不会在本线程正在用的时候析构
+    std::vector<Coroutine::ptr> m_occupy;
+};
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include "src/net/co_sync.h"
+#include "src/comm/log.h"
+
+
+namespace tinyrpc{
+
+// ----------- CoCondVar
+
+void CoCondVar::wait(CoroutineMutex& mutex)
+{
+    CoWaiter waiter = CoWaiter::current();
+    {
+        Mutex::Lock lock(m_mutex);
+        m_waiters.push(waiter);
+    }
+    // 先入队再释放mutex，notify在这之后才会发生，唤醒要等协程挂起之后才在本线程的reactor里执行
+    mutex.unlock();
+    waiter.wait();
+    mutex.lock();
+}
+
+void CoCondVar::notifyOne()
+{
+    Mutex::Lock lock(m_mutex);
+    if(m_waiters.empty())
+        return;
+    CoWaiter waiter = m_waiters.front();
+    m_waiters.pop();
+    lock.unlock();
+
+    waiter.wakeup();
+}
+
+void CoCondVar::notifyAll()
+{
+    std::queue<CoWaiter> waiters;
+    {
+        Mutex::Lock lock(m_mutex);
+        waiters.swap(m_waiters);
+    }
+    for(; !waiters.empty(); waiters.pop())
+        waiters.front().wakeup();
+}
+
+// ----------- CoSemaphore
+
+CoSemaphore::CoSemaphore(int count /*=0*/)
+: m_count(count)
+{
+}
+
+void CoSemaphore::wait()
+{
+    Mutex::Lock lock(m_mutex);
+    if(m_count > 0)
+    {
+        --m_count;
+        return;
+    }
+    CoWaiter waiter = CoWaiter::current();
+    m_waiters.push(waiter);
+    lock.unlock();
+
+    waiter.wait(); // 被唤醒的时候post已经把计数交给这个等待者了
+}
+
+bool CoSemaphore::tryWait()
+{
+    Mutex::Lock lock(m_mutex);
+    if(m_count <= 0)
+        return false;
+    --m_count;
+    return true;
+}
+
+void CoSemaphore::post()
+{
+    Mutex::Lock lock(m_mutex);
+    if(m_waiters.empty())
+    {
+        ++m_count;
+        return;
+    }
+    CoWaiter waiter = m_waiters.front();
+    m_waiters.pop();
+    lock.unlock();
+
+    waiter.wakeup();
+}
+
+int CoSemaphore::getCount()
+{
+    Mutex::Lock lock(m_mutex);
+    return m_count;
+}
+
+// ----------- CoRWMutex
+
+void CoRWMutex::rdlock()
+{
+    Mutex::Lock lock(m_mutex);
+    if(!m_writer && m_waiters.empty())
+    {
+        ++m_readers;
+        return;
+    }
+    Waiter waiter = {CoWaiter::current(), false};
+    m_waiters.push_back(waiter);
+    lock.unlock();
+
+    waiter.m_waiter.wait(); // 被唤醒的时候m_readers已经算上这个等待者了
+}
+
+void CoRWMutex::wrlock()
+{
+    Mutex::Lock lock(m_mutex);
+    if(!m_writer && m_readers == 0 && m_waiters.empty())
+    {
+        m_writer = true;
+        return;
+    }
+    Waiter waiter = {CoWaiter::current(), true};
+    m_waiters.push_back(waiter);
+    lock.unlock();
+
+    waiter.m_waiter.wait(); // 被唤醒的时候m_writer已经是这个等待者的了
+}
+
+void CoRWMutex::unlock()
+{
+    std::vector<CoWaiter> wakeups;
+    {
+        Mutex::Lock lock(m_mutex);
+        if(m_writer)
+        {
+            m_writer = false;
+        }
+        else if(m_readers > 0)
+        {
+            --m_readers;
+        }
+        else
+        {
+            return;
+        }
+
+        if(m_readers > 0 || m_waiters.empty())
+            return;
+
+        if(m_waiters.front().m_is_writer)
+        {
+            m_writer = true;
+            wakeups.push_back(m_waiters.front().m_waiter);
+            m_waiters.pop_front();
+        }
+        else
+        {
+            while(!m_waiters.empty() && !m_waiters.front().m_is_writer)
+            {
+                ++m_readers;
+                wakeups.push_back(m_waiters.front().m_waiter);
+                m_waiters.pop_front();
+            }
+        }
+    }
+
+    for(size_t i = 0; i < wakeups.size(); ++i)
+        wakeups[i].wakeup();
+}
+
+} // namespace tinyrpc
@@ -0,0 +1,269 @@
+#ifndef SRC_NET_CO_SYNC_H
+#define SRC_NET_CO_SYNC_H
+
+#include <memory>
+#include <queue>
+#include <deque>
+#include <vector>
+#include <utility>
+
+#include "src/coroutine/coroutine.h"
+#include "src/net/mutex.h"
+
+/*
+
+协程同步原语，等待的时候挂起协程而不是阻塞io线程，和CoroutineMutex一样
+1. 内部状态用一把很短的线程锁保护，可以跨io线程使用
+2. 挂起的协程记在CoWaiter里，唤醒的时候交给它原来的reactor恢复
+3. 不在协程里(工作线程池的线程、普通线程)调用会等待的接口，阻塞线程等待，和协程一起排队
+   io线程的主协程不要调用会等待的接口，会把整个io线程停住
+
+*/
+
+namespace tinyrpc{
+
+/*
+
+----------- 条件变量
+和std::condition_variable一样，wait要在拿着mutex的时候调用，被唤醒之后要重新检查条件
+
+*/
+class CoCondVar{
+public:
+    CoCondVar() = default;
+    CoCondVar(const CoCondVar&) = delete;
+    CoCondVar& operator=(const CoCondVar&) = delete;
+
+    // 释放mutex挂起，被唤醒之后重新拿到mutex再返回
+    void wait(CoroutineMutex& mutex);
+
+    template<class Predicate>
+    void wait(CoroutineMutex& mutex, Predicate pred)
+    {
+        while(!pred())
+        {
+            wait(mutex);
+        }
+    }
+
+    void notifyOne();
+    void notifyAll();
+
+private:
+    Mutex m_mutex;
+    std::queue<CoWaiter> m_waiters;
+};
+
+/*
+
+----------- 信号量
+post的时候有等待的协程就把计数直接交给队头的协程，计数不加
+
+*/
+class CoSemaphore{
+public:
+    explicit CoSemaphore(int count = 0);
+    CoSemaphore(const CoSemaphore&) = delete;
+    CoSemaphore& operator=(const CoSemaphore&) = delete;
+
+    void wait();
+    bool tryWait();
+    void post();
+    int getCount();
+
+private:
+    int m_count {0};
+    Mutex m_mutex;
+    std::queue<CoWaiter> m_waiters;
+};
+
+/*
+
+----------- 读写协程锁
+按到达顺序排队，有写锁在排队的时候后来的读锁也要排队，写锁不会饿死
+释放之后队头是写锁就交给它，是读锁就把队头连续的读锁一起放行
+
+*/
+class CoRWMutex{
+public:
+    typedef ReadScopedLockImpl<CoRWMutex> ReadLock;
+    typedef WriteScopedLockImpl<CoRWMutex> WriteLock;
+
+public:
+    CoRWMutex() = default;
+    CoRWMutex(const CoRWMutex&) = delete;
+    CoRWMutex& operator=(const CoRWMutex&) = delete;
+
+    void rdlock();
+    void wrlock();
+    void unlock();
+
+private:
+    struct Waiter{
+        CoWaiter m_waiter;
+        bool m_is_writer;
+    };
+
+    int m_readers {0};      // 拿着读锁的协程数
+    bool m_writer {false};  // 有协程拿着写锁
+    Mutex m_mutex;
+    std::deque<Waiter> m_waiters;
+};
+
+/*
+
+----------- 有界通道
+容量满了push挂起，空了pop挂起，capacity为0的时候按1处理
+close之后push都返回false，pop把剩下的取完之后返回false，挂起的协程全部唤醒
+被唤醒的协程重新检查状态，取走或者放入之后如果还能继续，再唤醒下一个同方向的协程，不会有协程一直睡着
+
+*/
+template<class T>
+class CoChannel{
+public:
+    typedef std::shared_ptr<CoChannel<T>> ptr;
+
+public:
+    explicit CoChannel(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    CoChannel(const CoChannel&) = delete;
+    CoChannel& operator=(const CoChannel&) = delete;
+
+    // 满了挂起，关闭了返回false
+    bool push(T value)
+    {
+        Mutex::Lock lock(m_mutex);
+        while(!m_closed && m_queue.size() >= m_capacity)
+        {
+            suspend(m_send_waiters, lock);
+        }
+        if(m_closed)
+            return false;
+        m_queue.push_back(std::move(value));
+        afterChange(lock);
+        return true;
+    }
+
+    // 空了挂起，关闭并且取完了返回false
+    bool pop(T* value)
+    {
+        Mutex::Lock lock(m_mutex);
+        while(!m_closed && m_queue.empty())
+        {
+            suspend(m_recv_waiters, lock);
+        }
+        if(m_queue.empty())
+            return false;
+        *value = std::move(m_queue.front());
+        m_queue.pop_front();
+        afterChange(lock);
+        return true;
+    }
+
+    // 不挂起，满了或者关闭了返回false
+    bool tryPush(T value)
+    {
+        Mutex::Lock lock(m_mutex);
+        if(m_closed || m_queue.size() >= m_capacity)
+            return false;
+        m_queue.push_back(std::move(value));
+        afterChange(lock);
+        return true;
+    }
+
+    // 不挂起，空了返回false
+    bool tryPop(T* value)
+    {
+        Mutex::Lock lock(m_mutex);
+        if(m_queue.empty())
+            return false;
+        *value = std::move(m_queue.front());
+        m_queue.pop_front();
+        afterChange(lock);
+        return true;
+    }
+
+    void close()
+    {
+        std::queue<CoWaiter> senders;
+        std::queue<CoWaiter> receivers;
+        {
+            Mutex::Lock lock(m_mutex);
+            if(m_closed)
+                return;
+            m_closed = true;
+            senders.swap(m_send_waiters);
+            receivers.swap(m_recv_waiters);
+        }
+        for(; !senders.empty(); senders.pop())
+            senders.front().wakeup();
+        for(; !receivers.empty(); receivers.pop())
+            receivers.front().wakeup();
+    }
+
+    bool isClosed()
+    {
+        Mutex::Lock lock(m_mutex);
+        return m_closed;
+    }
+
+    size_t size()
+    {
+        Mutex::Lock lock(m_mutex);
+        return m_queue.size();
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    // 排队挂起，醒来之后重新上锁
+    void suspend(std::queue<CoWaiter>& waiters, Mutex::Lock& lock)
+    {
+        CoWaiter waiter = CoWaiter::current();
+        waiters.push(waiter);
+        lock.unlock();
+        waiter.wait();
+        lock.lock();
+    }
+
+    // 放入或者取出之后，有数据就唤醒一个收的，有空位就唤醒一个发的
+    void afterChange(Mutex::Lock& lock)
+    {
+        CoWaiter receiver;
+        CoWaiter sender;
+        if(!m_queue.empty() && !m_recv_waiters.empty())
+        {
+            receiver = m_recv_waiters.front();
+            m_recv_waiters.pop();
+        }
+        if(m_queue.size() < m_capacity && !m_send_waiters.empty())
+        {
+            sender = m_send_waiters.front();
+            m_send_waiters.pop();
+        }
+        lock.unlock();
+
+        if(!receiver.empty())
+            receiver.wakeup();
+        if(!sender.empty())
+            sender.wakeup();
+    }
+
+private:
+    size_t m_capacity {1};
+    bool m_closed {false};
+    Mutex m_mutex;
+    std::deque<T> m_queue;
+    std::queue<CoWaiter> m_send_waiters;
+    std::queue<CoWaiter> m_recv_waiters;
+};
+
+} // namespace tinyrpc
+
+#endif
@@ -1,13 +1,16 @@
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <limits.h>
 #include "fd_event.h"
+#include "io_uring.h"
 
 
 
 namespace tinyrpc{
 
-static FdEventContainer* g_FdContainer = nullptr;
-
 FdEvent::FdEvent(tinyrpc::Reactor* reactor, int fd)
 : m_fd(fd),
   m_reactor(reactor)
@@ -113,6 +116,101 @@ void FdEvent::unregisterFromReactor()
     m_listen_events = 0;
     m_read_callback = nullptr;
     m_write_callback = nullptr;
+
+    // fd关闭之后号码会被复用，边缘触发的状态也要复原
+    m_edge_triggered = false;
+    m_ready_events = READ | WRITE;
+    m_wait_events = 0;
+    m_queued = false;
+
+    // multishot还在内核里会一直持有这个文件，关闭之前先取消
+    if(m_io_uring_op)
+    {
+        m_io_uring_op->ring->detach(m_io_uring_op);
+        m_io_uring_op = nullptr;
+    }
+    m_is_socket = -1;
+}
+
+// 边缘触发每个方向只注册一次，之后就绪状态由reactor记录
+// 写方向等到第一次写不进去才注册，否则每次发送完对端回ACK都会来一次EPOLLOUT，多一次epoll_wait
+// 注册到当前线程的reactor，协程只会在这个线程恢复
+void FdEvent::registerEdgeTriggered(IOEvent event)
+{
+    if(m_edge_triggered && (m_listen_events & event))
+        return;
+
+    if(!m_edge_triggered)
+    {
+        m_reactor = tinyrpc::Reactor::getReactor();
+        m_edge_triggered = true;
+        m_listen_events = ETModel;
+    }
+    m_listen_events |= event;
+    updateToReactor();
+}
+
+bool FdEvent::isEdgeTriggered() const
+{
+    return m_edge_triggered;
+}
+
+void FdEvent::setReady(int events)
+{
+    m_ready_events |= (events & (READ | WRITE));
+}
+
+void FdEvent::clearReady(int events)
+{
+    m_ready_events &= ~events;
+}
+
+bool FdEvent::isReady(IOEvent event) const
+{
+    return (m_ready_events & event) != 0;
+}
+
+void FdEvent::setWaitEvents(int events)
+{
+    m_wait_events = events;
+}
+
+int FdEvent::getWaitEvents() const
+{
+    return m_wait_events;
+}
+
+bool FdEvent::markQueued()
+{
+    if(m_queued)
+        return false;
+    m_queued = true;
+    return true;
+}
+
+void FdEvent::clearQueued()
+{
+    m_queued = false;
+}
+
+void FdEvent::setIoUringOp(IoUringOp* op)
+{
+    m_io_uring_op = op;
+}
+
+IoUringOp* FdEvent::getIoUringOp() const
+{
+    return m_io_uring_op;
+}
+
+bool FdEvent::isSocket()
+{
+    if(m_is_socket < 0)
+    {
+        struct stat st;
+        m_is_socket = (fstat(m_fd, &st) == 0 && S_ISSOCK(st.st_mode)) ? 1 : 0;
+    }
+    return m_is_socket == 1;
 }
 
 int FdEvent::getFd() const
@@ -153,6 +251,12 @@ void FdEvent::setNonBlock()
         return;
     }
 
+    // 边缘触发注册之前已经设置过了，每次读写都fcntl是多余的系统调用
+    if(m_edge_triggered)
+    {
+        return;
+    }
+
     int flag = fcntl(m_fd, F_GETFL, 0); // 拿取旧的flag
     if(flag & O_NONBLOCK)  // 已经设置非阻塞
     {
@@ -202,51 +306,123 @@ Coroutine* FdEvent::getCoroutine()
 -------------FdEventContainer
 
 */
-// 初始化size个FdEvent事件
+// 预先创建能放下size个fd的页
 FdEventContainer::FdEventContainer(int size) 
 {
-  for(int i = 0; i < size; ++i) 
-  {
-    m_fds.emplace_back(std::make_shared<FdEvent>(i));
-  }
+    m_max_pages = (getMaxFdCount() + PAGE_SIZE - 1) / PAGE_SIZE;
+    m_pages = new std::atomic<Page*>[m_max_pages];
+    for(int i = 0; i < m_max_pages; ++i)
+    {
+        m_pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+    DebugLog << "FdEventContainer max fd count=" << m_max_pages * PAGE_SIZE;
+    for(int fd = 0; fd < size; fd += PAGE_SIZE)
+    {
+        getPage(fd);
+    }
 }
 
-// 拿取指定fd的FdEvent
-FdEvent::ptr FdEventContainer::getFdEvent(int fd)
+FdEventContainer::~FdEventContainer()
 {
+    for(int i = 0; i < m_max_pages; ++i)
+    {
+        delete m_pages[i].load(std::memory_order_relaxed);
+    }
+    delete[] m_pages;
+}
+
+int FdEventContainer::getMaxFdCount()
+{
+    long long count = 0;
+    FILE* fp = fopen("/proc/sys/fs/nr_open", "r");
+    if(fp)
+    {
+        if(fscanf(fp, "%lld", &count) != 1)
+        {
+            count = 0;
+        }
+        fclose(fp);
+    }
+
+    if(count <= 0)
+    {
+        struct rlimit rl;
+        if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_max != RLIM_INFINITY)
+        {
+            count = static_cast<long long>(rl.rlim_max);
+        }
+    }
 
-    // 1. fd存在记录中
-    RWMutex::ReadLock rlock(m_mutex);
+    if(count <= 0)
+    {
+        count = DEFAULT_MAX_FD;
+    }
+    // 页号乘PAGE_SIZE不能溢出int
+    if(count > INT_MAX - PAGE_SIZE)
+    {
+        count = INT_MAX - PAGE_SIZE;
+    }
+    return static_cast<int>(count);
+}
 
-    if(fd < static_cast<int>(m_fds.size()))   
+// 页不存在就创建，多个线程同时创建的时候只有CAS成功的那个生效
+FdEventContainer::Page* FdEventContainer::getPage(int fd)
+{
+    if(fd < 0 || fd >= m_max_pages * PAGE_SIZE)
     {
-        tinyrpc::FdEvent::ptr re = m_fds[fd];
-        rlock.unlock();
-        return re;
+        ErrorLog << "fd[" << fd << "] out of range of FdEventContainer";
+        return nullptr;
     }
 
-    rlock.unlock();
+    std::atomic<Page*>& slot = m_pages[fd >> PAGE_BITS];
+    Page* page = slot.load(std::memory_order_acquire);
+    if(page)
+    {
+        return page;
+    }
 
-    // 2. 不在记录中，扩容，添加，拿出。
-    RWMutex::WriteLock wlock(m_mutex);
+    Page* new_page = new Page();
+    int base = fd & ~(PAGE_SIZE - 1);
+    for(int i = 0; i < PAGE_SIZE; ++i)
+    {
+        new_page->fds[i] = std::make_shared<FdEvent>(base + i);
+    }
+    if(slot.compare_exchange_strong(page, new_page, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+        return new_page;
+    }
+    // 别的线程先放进去了，page是它放的页
+    delete new_page;
+    return page;
+}
 
-    int n = (int)(fd * 1.5); // 增大1.5倍的fds容器，设置fd序号
-    for(size_t i = m_fds.size(); i < n; ++i)
+// 拿取指定fd的FdEvent
+FdEvent::ptr FdEventContainer::getFdEvent(int fd)
+{
+    Page* page = getPage(fd);
+    if(!page)
     {
-        m_fds.emplace_back(std::make_shared<FdEvent>(static_cast<int>(i)));
+        return nullptr;
     }
-    tinyrpc::FdEvent::ptr re = m_fds[fd];
-    wlock.unlock();
-    return re;
+    return page->fds[fd & (PAGE_SIZE - 1)];
+}
+
+FdEvent* FdEventContainer::getRawFdEvent(int fd)
+{
+    Page* page = getPage(fd);
+    if(!page)
+    {
+        return nullptr;
+    }
+    return page->fds[fd & (PAGE_SIZE - 1)].get();
 }
 
 FdEventContainer* FdEventContainer::getFdContainer() 
 {
-  if (g_FdContainer == nullptr) 
-  {
-    g_FdContainer = new FdEventContainer(1000); // 创建一个新容器，默认创建1000个FdEvent 
-  }
-  return g_FdContainer;
+    // 局部静态变量的初始化是线程安全的，默认创建1000个FdEvent
+    static FdEventContainer* container = new FdEventContainer(1000);
+    return container;
 }
+
     
 } // namespace tinyrpc
@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <memory>
+#include <atomic>
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <assert.h>
@@ -14,6 +15,7 @@
 namespace tinyrpc{
 
 class Reactor;
+struct IoUringOp;
 
 enum IOEvent{
     READ = EPOLLIN, // 0x001
@@ -81,6 +83,37 @@ public:
 
     void clearCoroutine();
 
+    // 边缘触发模式，只在fd所在reactor的线程中调用
+    // 每个方向第一次等待的时候加入EPOLLET注册，之后不再epoll_ctl，直到unregisterFromReactor
+    void registerEdgeTriggered(IOEvent event);
+
+    bool isEdgeTriggered() const;
+
+    // reactor收到边缘事件的时候设置，hook读写返回EAGAIN或者没读满/写满的时候清除
+    void setReady(int events);
+
+    void clearReady(int events);
+
+    bool isReady(IOEvent event) const;
+
+    // 协程在等待的事件，reactor只在有人等待的时候恢复协程
+    void setWaitEvents(int events);
+
+    int getWaitEvents() const;
+
+    // 放进reactor就绪列表的标志，防止一轮循环里重复放入
+    bool markQueued();
+
+    void clearQueued();
+
+    // io_uring模式下fd上的multishot操作，unregisterFromReactor的时候取消
+    void setIoUringOp(IoUringOp* op);
+
+    IoUringOp* getIoUringOp() const;
+
+    // multishot recv只能用在socket上，第一次调用的时候fstat，结果缓存到unregisterFromReactor
+    bool isSocket();
+
 public:
     Mutex m_mutex;
 
@@ -94,6 +127,14 @@ protected:
     Reactor* m_reactor {nullptr};  
 
     Coroutine* m_coroutine {nullptr};
+
+    bool m_edge_triggered {false};
+    int m_ready_events {READ | WRITE};  // 注册之前不知道状态，当作就绪，先直接读写一次
+    int m_wait_events {0};
+    bool m_queued {false};
+
+    IoUringOp* m_io_uring_op {nullptr};
+    int m_is_socket {-1};  // -1 还没检查
 };
 
 /**
@@ -101,20 +142,43 @@ protected:
  * 
  * ---------------- fd事件容器 
  * 
+ * 二级分页表，fd的高位是页号，低位是页内下标，一页放PAGE_SIZE个FdEvent
+ * 页创建之后不会移动也不会释放，查找只有一次原子读，不加锁；扩容只是CAS放一个新页，已有的FdEvent不受影响
+ * 页表的大小按进程能打开的最大fd数确定，超出范围的fd拿到nullptr
+ * 
 */
 
 class FdEventContainer{
 
 public:
-    FdEventContainer(int size);     // 初始化容器大小
-    FdEvent::ptr getFdEvent(int fd);  // 指定fd从容器中拿出FdEvent
+    FdEventContainer(int size);     // 预先创建能放下size个fd的页
+    ~FdEventContainer();
+
+    FdEvent::ptr getFdEvent(int fd);  // 指定fd从容器中拿出FdEvent，要持有FdEvent的地方使用
+
+    // hook等热路径使用，FdEvent不会被释放，不需要shared_ptr的引用计数，fd超出范围返回nullptr
+    FdEvent* getRawFdEvent(int fd);
 
 public:
     static FdEventContainer* getFdContainer();  // 单例模式，仅仅使用静态函数，不使用对象，使用这个对象调用静态函数 ，在内存中只有一个静态实例 
 
 private:
-    RWMutex m_mutex;
-    std::vector<FdEvent::ptr> m_fds;
+    static const int PAGE_BITS = 10;
+    static const int PAGE_SIZE = 1 << PAGE_BITS;
+    static const int DEFAULT_MAX_FD = 1024 * 1024;  // 读不到系统上限的时候用，和默认的nofile硬上限一样
+
+    struct Page{
+        FdEvent::ptr fds[PAGE_SIZE];
+    };
+
+    Page* getPage(int fd);
+
+    // 进程能打开的最大fd数，fs.nr_open是nofile硬上限能调到的最大值，读不到再用RLIMIT_NOFILE
+    static int getMaxFdCount();
+
+private:
+    int m_max_pages {0};
+    std::atomic<Page*>* m_pages {nullptr};  // 页表按系统上限一次分配好，之后不会变
 
 };
 
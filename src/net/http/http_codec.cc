@@ -41,7 +41,7 @@ void HttpCodeC::encode(TcpBuffer *buf, AbstractData *data)
     // 写入buf中等待发送
     buf->writeToBuffer(http_res.c_str(), http_res.length());
 
-    DebugLog << "succ encode and write to buffer, writeindex=" << buf->writeIndex();
+    DebugLog << "succ encode and write to buffer, readable=" << buf->readAble();
     response->encode_succ = true; // 编码成功
     DebugLog << "test encode end";
 
@@ -67,6 +67,13 @@ void HttpCodeC::decode(TcpBuffer *buf, AbstractData *data)
         return;
     }
 
+    // 请求头没有收全就不用拷贝整个buffer了，直接在分段buffer上查找空行
+    if(buf->find(g_CRLF_DOUBLE) == -1)
+    {
+        DebugLog << "need to read more data while parse request header";
+        return;
+    }
+
     strs = buf->getBufferString();
 
     bool is_parse_request_line = false;
@@ -0,0 +1,976 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+#include <deque>
+
+#include "src/net/io_uring.h"
+#include "src/net/reactor.h"
+#include "src/net/fd_event.h"
+#include "src/coroutine/coroutine.h"
+#include "src/comm/log.h"
+
+
+namespace tinyrpc{
+
+// provided buffer ring的组号，一个ring只有一组
+static const uint16_t BUF_GROUP_ID = 0;
+
+// 内核限制provided buffer ring最多32768项
+static const int MAX_BUF_COUNT = 32768;
+
+// 一次性的操作，放在协程栈上
+struct SingleOp : public IoUringOp{
+    SingleOp(IoUring* r, int f) : IoUringOp(SingleShot, r, f) {}
+
+    int res {0};
+    bool done {false};
+};
+
+// 连接上的multishot recv，收到的数据按顺序排队
+struct RecvOp : public IoUringOp{
+    RecvOp(IoUring* r, int f) : IoUringOp(MultiRecv, r, f) {}
+
+    struct Chunk{
+        uint16_t bid;
+        int len;
+        int offset;
+    };
+
+    std::deque<Chunk> chunks;
+    bool eof {false};
+    int error {0};
+    bool starved {false};
+};
+
+// listen fd上的multishot accept
+struct AcceptOp : public IoUringOp{
+    AcceptOp(IoUring* r, int f) : IoUringOp(MultiAccept, r, f) {}
+
+    std::deque<int> fds;
+    int error {0};
+};
+
+
+IoUring* IoUring::create(Reactor* reactor, int entries, int buf_count, int buf_size)
+{
+    IoUring* ring = new IoUring(reactor);
+    if(!ring->init(entries, buf_count, buf_size))
+    {
+        delete ring;
+        return nullptr;
+    }
+    return ring;
+}
+
+IoUring::IoUring(Reactor* reactor)
+: m_reactor(reactor), m_tid(gettid())
+{
+}
+
+IoUring::~IoUring()
+{
+    // 先关闭ring，内核取消还在进行的操作之后才会释放buffer的引用
+    if(m_ring_fd >= 0)
+    {
+        close(m_ring_fd);
+    }
+    if(m_sqes)
+    {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if(m_cq_ptr && m_cq_ptr != m_sq_ptr)
+    {
+        munmap(m_cq_ptr, m_cq_size);
+    }
+    if(m_sq_ptr)
+    {
+        munmap(m_sq_ptr, m_sq_size);
+    }
+    if(m_buf_ring)
+    {
+        munmap(m_buf_ring, m_buf_ring_size);
+    }
+    free(m_bufs);
+    delete m_epoll_op;
+}
+
+bool IoUring::init(int entries, int buf_count, int buf_size)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 只有reactor线程提交，内核的完成工作也推迟到io_uring_enter里做，不会打断正在跑的协程
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    m_ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(m_ring_fd < 0 && errno == EINVAL)
+    {
+        memset(&params, 0, sizeof(params));
+        m_ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if(m_ring_fd < 0)
+    {
+        ErrorLog << "io_uring_setup error, sys error=" << strerror(errno);
+        return false;
+    }
+    if(!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        ErrorLog << "io_uring_enter doesn't support timeout argument, kernel too old";
+        return false;
+    }
+
+    // 映射提交队列、完成队列和SQE数组
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap)
+    {
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    }
+
+    m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ptr == MAP_FAILED)
+    {
+        m_sq_ptr = nullptr;
+        ErrorLog << "mmap io_uring sq ring error, sys error=" << strerror(errno);
+        return false;
+    }
+    if(single_mmap)
+    {
+        m_cq_ptr = m_sq_ptr;
+    }
+    else
+    {
+        m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ptr == MAP_FAILED)
+        {
+            m_cq_ptr = nullptr;
+            ErrorLog << "mmap io_uring cq ring error, sys error=" << strerror(errno);
+            return false;
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        ErrorLog << "mmap io_uring sqes error, sys error=" << strerror(errno);
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sq_ptr);
+    m_sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+
+    // SQE下标和提交队列下标一一对应
+    unsigned int* sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    for(unsigned int i = 0; i < m_sq_entries; ++i)
+    {
+        sq_array[i] = i;
+    }
+
+    char* cq = static_cast<char*>(m_cq_ptr);
+    m_cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    if(!probe() || !setupBufferRing(buf_count, buf_size))
+    {
+        return false;
+    }
+
+    DebugLog << "io_uring init succ, ring fd=" << m_ring_fd << ", sq entries=" << params.sq_entries << ", cq entries=" << params.cq_entries
+        << ", buffers=" << m_buf_count << " * " << m_buf_size;
+    return true;
+}
+
+// 检查用到的操作内核是不是都支持
+bool IoUring::probe()
+{
+    size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    io_uring_probe* probe = static_cast<io_uring_probe*>(calloc(1, len));
+    if(syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        ErrorLog << "io_uring probe error, sys error=" << strerror(errno);
+        free(probe);
+        return false;
+    }
+
+    // multishot recv和SEND_ZC是同一个内核版本(6.0)加的，没有办法直接探测multishot，用SEND_ZC代替
+    static const int need_ops[] = {IORING_OP_RECV, IORING_OP_WRITEV, IORING_OP_ACCEPT, IORING_OP_CONNECT,
+        IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_LINK_TIMEOUT, IORING_OP_SEND_ZC};
+    bool succ = true;
+    for(size_t i = 0; i < sizeof(need_ops) / sizeof(need_ops[0]); ++i)
+    {
+        int op = need_ops[i];
+        if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            ErrorLog << "io_uring op " << op << " not supported by kernel";
+            succ = false;
+            break;
+        }
+    }
+    free(probe);
+    return succ;
+}
+
+bool IoUring::setupBufferRing(int buf_count, int buf_size)
+{
+    int count = 1;
+    while(count < buf_count && count < MAX_BUF_COUNT)
+    {
+        count <<= 1;
+    }
+    m_buf_count = count;
+    m_buf_size = buf_size;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    m_buf_ring_size = (count * sizeof(io_uring_buf) + page_size - 1) / page_size * page_size;
+    void* ring = mmap(nullptr, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED)
+    {
+        ErrorLog << "mmap provided buffer ring error, sys error=" << strerror(errno);
+        return false;
+    }
+    m_buf_ring = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_buf_ring);
+    reg.ring_entries = count;
+    reg.bgid = BUF_GROUP_ID;
+    if(syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        ErrorLog << "register provided buffer ring error, sys error=" << strerror(errno);
+        return false;
+    }
+
+    m_bufs = static_cast<char*>(malloc(static_cast<size_t>(count) * buf_size));
+    if(!m_bufs)
+    {
+        ErrorLog << "alloc " << count << " * " << buf_size << " bytes provided buffers failed";
+        return false;
+    }
+    for(int i = 0; i < count; ++i)
+    {
+        recycleBuffer(static_cast<uint16_t>(i));
+    }
+    return true;
+}
+
+Reactor* IoUring::getReactor() const
+{
+    return m_reactor;
+}
+
+bool IoUring::isOwnerThread() const
+{
+    return m_tid == gettid();
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    unsigned int head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if(m_sq_local_tail - head >= m_sq_entries)
+    {
+        // 一轮里提交的太多，先交给内核
+        publishSqes();
+        enter(m_sq_local_tail - head, 0, 0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if(m_sq_local_tail - head >= m_sq_entries)
+        {
+            ErrorLog << "io_uring submission queue is full";
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe* sqe = &m_sqes[m_sq_local_tail & m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++m_sq_local_tail;
+    return sqe;
+}
+
+void IoUring::publishSqes()
+{
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+}
+
+int IoUring::enter(unsigned int to_submit, unsigned int min_complete, int timeout_ms)
+{
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if(timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    // DEFER_TASKRUN模式下CQE只在带GETEVENTS的io_uring_enter里产生，所以每次都带上
+    unsigned int flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    return syscall(__NR_io_uring_enter, m_ring_fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+}
+
+void IoUring::watchEpoll(int epfd)
+{
+    if(!m_epoll_op)
+    {
+        m_epoll_op = new IoUringOp(IoUringOp::EpollPoll, this, epfd);
+    }
+}
+
+// epoll fd用一次性的poll，每轮重新提交，提交的时候epoll里还有就绪的fd会马上完成，和水平触发一样不会漏
+void IoUring::armEpoll()
+{
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_epoll_op->fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = reinterpret_cast<uint64_t>(m_epoll_op);
+    m_epoll_op->armed = true;
+}
+
+bool IoUring::wait(int timeout_ms)
+{
+    m_epoll_ready = false;
+    if(m_epoll_op && !m_epoll_op->armed)
+    {
+        armEpoll();
+    }
+
+    publishSqes();
+    unsigned int to_submit = m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    bool has_cqe = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) != *m_cq_head;
+
+    int rt = enter(to_submit, has_cqe ? 0 : 1, timeout_ms);
+    if(rt < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+        ErrorLog << "io_uring_enter error, sys error=" << strerror(errno);
+    }
+
+    reap();
+    return m_epoll_ready;
+}
+
+void IoUring::reap()
+{
+    unsigned int head = *m_cq_head;
+    unsigned int tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail)
+    {
+        io_uring_cqe* cqe = &m_cqes[head & m_cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        uint32_t flags = cqe->flags;
+
+        // 先把位置还给内核，处理的时候可能还会提交新的SQE
+        ++head;
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+
+        handleCqe(user_data, res, flags);
+    }
+}
+
+void IoUring::handleCqe(uint64_t user_data, int res, uint32_t flags)
+{
+    // 取消操作和LINK_TIMEOUT自己的CQE不关心
+    if(user_data == 0)
+    {
+        return;
+    }
+
+    IoUringOp* op = reinterpret_cast<IoUringOp*>(user_data);
+    bool more = flags & IORING_CQE_F_MORE;
+
+    switch(op->type)
+    {
+    case IoUringOp::EpollPoll:
+    {
+        op->armed = false;
+        if(res < 0 && res != -ECANCELED)
+        {
+            ErrorLog << "poll epoll fd error, sys error=" << strerror(-res);
+        }
+        m_epoll_ready = true;
+        break;
+    }
+    case IoUringOp::SingleShot:
+    {
+        SingleOp* single = static_cast<SingleOp*>(op);
+        single->res = res;
+        single->done = true;
+        queueWaiter(single);
+        break;
+    }
+    case IoUringOp::MultiRecv:
+    {
+        RecvOp* recv = static_cast<RecvOp*>(op);
+        if(flags & IORING_CQE_F_BUFFER)
+        {
+            uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            if(res > 0 && !recv->detached)
+            {
+                RecvOp::Chunk chunk;
+                chunk.bid = bid;
+                chunk.len = res;
+                chunk.offset = 0;
+                recv->chunks.push_back(chunk);
+            }
+            else
+            {
+                recycleBuffer(bid);
+            }
+        }
+
+        bool wake = true;
+        if(res == 0)
+        {
+            recv->eof = true;
+        }
+        else if(res == -ENOBUFS)
+        {
+            // 别的连接占着buffer还没取，等有buffer归还的时候再提交，不唤醒
+            if(!recv->detached)
+            {
+                recv->starved = true;
+                m_starved_ops.push_back(recv);
+            }
+            wake = false;
+        }
+        else if(res < 0 && res != -ECANCELED)
+        {
+            recv->error = -res;
+        }
+
+        if(!more)
+        {
+            recv->armed = false;
+        }
+        if(recv->detached)
+        {
+            maybeFree(recv);
+        }
+        else if(wake)
+        {
+            queueWaiter(recv);
+        }
+        break;
+    }
+    case IoUringOp::MultiAccept:
+    {
+        AcceptOp* acc = static_cast<AcceptOp*>(op);
+        if(res >= 0)
+        {
+            if(acc->detached)
+            {
+                close(res);
+            }
+            else
+            {
+                acc->fds.push_back(res);
+            }
+        }
+        else if(res != -ECANCELED)
+        {
+            acc->error = -res;
+        }
+
+        if(!more)
+        {
+            acc->armed = false;
+        }
+        if(acc->detached)
+        {
+            maybeFree(acc);
+        }
+        else
+        {
+            queueWaiter(acc);
+        }
+        break;
+    }
+    }
+}
+
+void IoUring::queueWaiter(IoUringOp* op)
+{
+    if(op->cor && !op->queued)
+    {
+        op->queued = true;
+        m_ready_ops.push_back(op);
+    }
+}
+
+void IoUring::resumeWaiters()
+{
+    if(m_ready_ops.empty())
+    {
+        return;
+    }
+
+    m_resume_ops.swap(m_ready_ops);
+    for(size_t i = 0; i < m_resume_ops.size(); ++i)
+    {
+        IoUringOp* op = m_resume_ops[i];
+        op->queued = false;
+        if(op->detached)
+        {
+            maybeFree(op);
+            continue;
+        }
+        // 放进列表之后协程可能已经被定时器唤醒，不再等待了
+        Coroutine* cor = op->cor;
+        if(cor)
+        {
+            op->cor = nullptr;
+            op->woken = true;
+            tinyrpc::Coroutine::Resume(cor);
+        }
+    }
+    m_resume_ops.clear();
+}
+
+bool IoUring::park(IoUringOp* op)
+{
+    op->cor = tinyrpc::Coroutine::getCurrentCoroutine();
+    op->woken = false;
+    tinyrpc::Coroutine::Yield();
+    op->cor = nullptr;
+    return op->woken;
+}
+
+// 一次性操作引用了协程栈上的内存，被别的原因唤醒也要等CQE回来才能返回
+int IoUring::waitSingle(IoUringOp* op)
+{
+    SingleOp* single = static_cast<SingleOp*>(op);
+    bool cancelled = false;
+    while(!single->done)
+    {
+        if(!park(single) && !single->done && !cancelled)
+        {
+            DebugLog << "io_uring op of fd[" << single->fd << "] wake up without completion, cancel it";
+            cancel(single);
+            cancelled = true;
+        }
+    }
+
+    // CQE已经到了但是协程先被别的原因唤醒，从待恢复列表里拿掉，栈上的op马上就失效了
+    if(single->queued)
+    {
+        m_ready_ops.erase(std::find(m_ready_ops.begin(), m_ready_ops.end(), op));
+        single->queued = false;
+    }
+    return single->res;
+}
+
+void IoUring::cancel(IoUringOp* op)
+{
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(op);
+    sqe->user_data = 0;
+}
+
+void IoUring::maybeFree(IoUringOp* op)
+{
+    if(op->detached && !op->armed && !op->queued)
+    {
+        delete op;
+    }
+}
+
+void IoUring::armRecv(IoUringOp* op)
+{
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = op->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP_ID;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+    op->armed = true;
+}
+
+void IoUring::armAccept(IoUringOp* op)
+{
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = op->fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+    op->armed = true;
+}
+
+// buffer还给内核，有因为ENOBUFS停下来的recv就重新提交
+void IoUring::recycleBuffer(uint16_t bid)
+{
+    // 头文件里的bufs是__DECLARE_FLEX_ARRAY，C++里前面的空结构体占了位置，偏移和内核不一致，直接按数组算
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(m_buf_ring) + (m_buf_tail & (m_buf_count - 1));
+    buf->addr = reinterpret_cast<uint64_t>(m_bufs + static_cast<size_t>(bid) * m_buf_size);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    ++m_buf_tail;
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+
+    if(!m_starved_ops.empty())
+    {
+        std::vector<IoUringOp*> starved;
+        starved.swap(m_starved_ops);
+        for(size_t i = 0; i < starved.size(); ++i)
+        {
+            RecvOp* recv = static_cast<RecvOp*>(starved[i]);
+            recv->starved = false;
+            if(!recv->armed)
+            {
+                armRecv(recv);
+            }
+        }
+    }
+}
+
+ssize_t IoUring::copyOut(IoUringOp* op, const struct iovec* iov, int iovcnt)
+{
+    RecvOp* recv = static_cast<RecvOp*>(op);
+    ssize_t total = 0;
+    int i = 0;
+    size_t iov_offset = 0;
+    while(i < iovcnt && !recv->chunks.empty())
+    {
+        RecvOp::Chunk& chunk = recv->chunks.front();
+        size_t n = std::min(iov[i].iov_len - iov_offset, static_cast<size_t>(chunk.len - chunk.offset));
+        memcpy(static_cast<char*>(iov[i].iov_base) + iov_offset, m_bufs + static_cast<size_t>(chunk.bid) * m_buf_size + chunk.offset, n);
+        total += n;
+        iov_offset += n;
+        chunk.offset += n;
+
+        if(chunk.offset == chunk.len)
+        {
+            uint16_t bid = chunk.bid;
+            recv->chunks.pop_front();
+            recycleBuffer(bid);
+        }
+        if(iov_offset == iov[i].iov_len)
+        {
+            ++i;
+            iov_offset = 0;
+        }
+    }
+    return total;
+}
+
+IoUringOp* IoUring::getRecvOp(FdEvent* fd_event)
+{
+    IoUringOp* op = fd_event->getIoUringOp();
+    if(!op)
+    {
+        op = new RecvOp(this, fd_event->getFd());
+        fd_event->setIoUringOp(op);
+    }
+    if(op->type != IoUringOp::MultiRecv)
+    {
+        ErrorLog << "fd[" << fd_event->getFd() << "] has other io_uring op, can't recv on it";
+        return nullptr;
+    }
+    return op;
+}
+
+IoUringOp* IoUring::getAcceptOp(FdEvent* fd_event)
+{
+    IoUringOp* op = fd_event->getIoUringOp();
+    if(!op)
+    {
+        op = new AcceptOp(this, fd_event->getFd());
+        fd_event->setIoUringOp(op);
+    }
+    if(op->type != IoUringOp::MultiAccept)
+    {
+        ErrorLog << "fd[" << fd_event->getFd() << "] has other io_uring op, can't accept on it";
+        return nullptr;
+    }
+    return op;
+}
+
+ssize_t IoUring::readv(FdEvent* fd_event, const struct iovec* iov, int iovcnt)
+{
+    RecvOp* recv = static_cast<RecvOp*>(getRecvOp(fd_event));
+    if(!recv)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    bool waited = false;
+    while(true)
+    {
+        if(!recv->chunks.empty())
+        {
+            return copyOut(recv, iov, iovcnt);
+        }
+        if(recv->eof)
+        {
+            return 0;
+        }
+        if(recv->error)
+        {
+            errno = recv->error;
+            return -1;
+        }
+        if(waited)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if(!recv->armed && !recv->starved)
+        {
+            armRecv(recv);
+        }
+        DebugLog << "fd:[" << recv->fd << "] wait io_uring recv, yield";
+        if(!park(recv))
+        {
+            waited = true;
+        }
+    }
+}
+
+ssize_t IoUring::readvNoWait(FdEvent* fd_event, const struct iovec* iov, int iovcnt)
+{
+    IoUringOp* op = fd_event->getIoUringOp();
+    if(!op)
+    {
+        // 还没有multishot recv，数据都在socket里
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = const_cast<struct iovec*>(iov);
+        msg.msg_iovlen = iovcnt;
+        return recvmsg(fd_event->getFd(), &msg, MSG_DONTWAIT);
+    }
+
+    RecvOp* recv = static_cast<RecvOp*>(getRecvOp(fd_event));
+    if(!recv)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(!recv->chunks.empty())
+    {
+        return copyOut(recv, iov, iovcnt);
+    }
+    if(recv->eof)
+    {
+        return 0;
+    }
+    errno = recv->error ? recv->error : EAGAIN;
+    return -1;
+}
+
+bool IoUring::hasInput(IoUringOp* op)
+{
+    if(!op || op->type != IoUringOp::MultiRecv)
+    {
+        return false;
+    }
+    RecvOp* recv = static_cast<RecvOp*>(op);
+    return !recv->chunks.empty() || recv->eof || recv->error != 0;
+}
+
+ssize_t IoUring::writev(int fd, const struct iovec* iov, int iovcnt)
+{
+    SingleOp op(this, fd);
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = iovcnt;
+    sqe->off = static_cast<uint64_t>(-1);   // 不是文件，用当前位置
+    sqe->user_data = reinterpret_cast<uint64_t>(&op);
+
+    int res = waitSingle(&op);
+    if(res >= 0)
+    {
+        return res;
+    }
+    errno = (res == -ECANCELED) ? EAGAIN : -res;
+    return -1;
+}
+
+int IoUring::accept(FdEvent* fd_event, struct sockaddr* addr, socklen_t* addrlen)
+{
+    AcceptOp* acc = static_cast<AcceptOp*>(getAcceptOp(fd_event));
+    if(!acc)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    bool waited = false;
+    while(true)
+    {
+        if(!acc->fds.empty())
+        {
+            int fd = acc->fds.front();
+            acc->fds.pop_front();
+            // multishot accept的地址参数所有连接共用，accept到之后再取
+            if(addr && addrlen && getpeername(fd, addr, addrlen) != 0)
+            {
+                ErrorLog << "getpeername of accepted fd[" << fd << "] error, sys error=" << strerror(errno);
+            }
+            return fd;
+        }
+        if(acc->error)
+        {
+            // 比如fd用完了，multishot已经停了，下次accept重新提交
+            errno = acc->error;
+            acc->error = 0;
+            return -1;
+        }
+        if(waited)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if(!acc->armed)
+        {
+            armAccept(acc);
+        }
+        DebugLog << "fd:[" << acc->fd << "] wait io_uring accept, yield";
+        if(!park(acc))
+        {
+            waited = true;
+        }
+    }
+}
+
+int IoUring::connect(int fd, const struct sockaddr* addr, socklen_t addrlen, int timeout_ms)
+{
+    // connect和LINK_TIMEOUT必须在同一批提交，先留够两个位置
+    if(m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) + 2 > m_sq_entries)
+    {
+        publishSqes();
+        enter(m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE), 0, 0);
+    }
+
+    SingleOp op(this, fd);
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(addr);
+    sqe->off = addrlen;
+    sqe->user_data = reinterpret_cast<uint64_t>(&op);
+
+    __kernel_timespec ts;
+    if(timeout_ms > 0)
+    {
+        io_uring_sqe* timeout_sqe = getSqe();
+        if(timeout_sqe)
+        {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+            sqe->flags |= IOSQE_IO_LINK;
+            timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout_sqe->fd = -1;
+            timeout_sqe->addr = reinterpret_cast<uint64_t>(&ts);
+            timeout_sqe->len = 1;
+            timeout_sqe->user_data = 0;
+        }
+    }
+
+    int res = waitSingle(&op);
+    if(res == 0)
+    {
+        DebugLog << "io_uring connect succ, fd=" << fd;
+        return 0;
+    }
+    if(res == -ECANCELED)
+    {
+        ErrorLog << "connect error, timeout[ " << timeout_ms << "ms]";
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    errno = -res;
+    DebugLog << "io_uring connect error, fd=" << fd << ", sys error=" << strerror(errno);
+    return -1;
+}
+
+void IoUring::detach(IoUringOp* op)
+{
+    if(!isOwnerThread())
+    {
+        IoUring* ring = this;
+        m_reactor->addTask([ring, op](){ ring->detach(op); });
+        return;
+    }
+
+    op->detached = true;
+    op->cor = nullptr;
+    if(op->type == IoUringOp::MultiRecv)
+    {
+        RecvOp* recv = static_cast<RecvOp*>(op);
+        while(!recv->chunks.empty())
+        {
+            uint16_t bid = recv->chunks.front().bid;
+            recv->chunks.pop_front();
+            recycleBuffer(bid);
+        }
+        if(recv->starved)
+        {
+            m_starved_ops.erase(std::remove(m_starved_ops.begin(), m_starved_ops.end(), op), m_starved_ops.end());
+            recv->starved = false;
+        }
+    }
+    else if(op->type == IoUringOp::MultiAccept)
+    {
+        AcceptOp* acc = static_cast<AcceptOp*>(op);
+        while(!acc->fds.empty())
+        {
+            close(acc->fds.front());
+            acc->fds.pop_front();
+        }
+    }
+
+    if(op->armed)
+    {
+        cancel(op);
+    }
+    maybeFree(op);
+}
+
+} // namespace tinyrpc
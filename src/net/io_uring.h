@@ -0,0 +1,178 @@
+#ifndef SRC_NET_IO_URING_H
+#define SRC_NET_IO_URING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+/*
+
+    io_uring后端，不依赖liburing，直接用io_uring_setup/io_uring_enter和mmap出来的共享队列
+    1. 每个reactor一个ring，只在reactor线程提交(SINGLE_ISSUER)，loop里一次io_uring_enter同时提交这一轮的SQE和等待CQE
+    2. hook的read/write/accept/connect提交SQE之后挂起协程，reactor收割CQE之后在本线程恢复，不进入窃取队列
+    3. 读：每个连接一个multishot recv，内核把数据放到provided buffer ring里，read/readv从里面拷贝出来，拷完的buffer还给ring
+    4. accept：listen fd一个multishot accept，accept到的fd先排队，accept_hook直接取
+    5. 写是一次性的SQE，connect带LINK_TIMEOUT，超时在内核里完成
+    6. epoll fd本身用POLL_ADD放进ring，定时器、唤醒fd和用回调的FdEvent还是走epoll，epoll fd就绪的时候再epoll_wait(0)取事件
+
+    不是CQE唤醒协程的(比如rpc超时的定时器)：一次性的SQE引用了协程栈上的内存，先取消，等CQE回来再返回；multishot的直接返回EAGAIN
+    fd关闭之前必须通过FdEvent::unregisterFromReactor取消multishot，否则ring一直持有这个文件，连接不会真正关闭
+
+*/
+
+namespace tinyrpc{
+
+class Coroutine;
+class FdEvent;
+class Reactor;
+class IoUring;
+
+// 提交到ring的操作，SQE的user_data就是它的地址
+struct IoUringOp{
+    enum OpType{
+        SingleShot = 1,     // 一次性的写、connect
+        MultiRecv = 2,      // 连接上的multishot recv
+        MultiAccept = 3,    // listen fd上的multishot accept
+        EpollPoll = 4       // reactor的epoll fd
+    };
+
+    IoUringOp(OpType t, IoUring* r, int f) : type(t), ring(r), fd(f) {}
+    virtual ~IoUringOp() {}
+
+    OpType type;
+    IoUring* ring {nullptr};
+    int fd {-1};
+    Coroutine* cor {nullptr};   // 挂起等待这个操作的协程
+    bool queued {false};        // 已经在待恢复列表中
+    bool woken {false};         // 上一次是被CQE恢复的
+    bool armed {false};         // multishot还在内核中
+    bool detached {false};      // fd已经关闭，等最后一个CQE回来释放
+};
+
+class IoUring{
+
+public:
+    // 内核不支持io_uring或者缺少需要的操作返回nullptr，调用者继续用epoll
+    // 在reactor线程中调用，buf_count向上取整到2的幂
+    static IoUring* create(Reactor* reactor, int entries, int buf_count, int buf_size);
+
+    ~IoUring();
+
+public:
+    // 下面几个只能在本ring所在reactor线程的子协程中调用，fd必须是socket
+
+    // 有收到的数据直接拷贝返回，没有就挂起等待；对端关闭返回0
+    ssize_t readv(FdEvent* fd_event, const struct iovec* iov, int iovcnt);
+
+    // 不挂起，只取已经收到的数据，没有返回-1，errno=EAGAIN
+    ssize_t readvNoWait(FdEvent* fd_event, const struct iovec* iov, int iovcnt);
+
+    ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+
+    int accept(FdEvent* fd_event, struct sockaddr* addr, socklen_t* addrlen);
+
+    // timeout_ms <= 0 表示不设超时
+    int connect(int fd, const struct sockaddr* addr, socklen_t addrlen, int timeout_ms);
+
+    // fd要关闭了，取消上面的multishot，可以在任意线程调用
+    void detach(IoUringOp* op);
+
+    // multishot recv里还有没取走的数据、EOF或者错误
+    static bool hasInput(IoUringOp* op);
+
+    bool isOwnerThread() const;
+
+public:
+    // 下面几个只在reactor的loop中调用
+
+    // epoll fd就绪的时候wait返回true
+    void watchEpoll(int epfd);
+
+    // 提交所有SQE，没有CQE的时候最多等timeout_ms，然后收割CQE
+    bool wait(int timeout_ms);
+
+    // 恢复CQE到达的协程
+    void resumeWaiters();
+
+    Reactor* getReactor() const;
+
+private:
+    IoUring(Reactor* reactor);
+
+    bool init(int entries, int buf_count, int buf_size);
+    bool probe();
+    bool setupBufferRing(int buf_count, int buf_size);
+
+    io_uring_sqe* getSqe();
+    void publishSqes();
+    int enter(unsigned int to_submit, unsigned int min_complete, int timeout_ms);
+    void reap();
+    void handleCqe(uint64_t user_data, int res, uint32_t flags);
+
+    void armRecv(IoUringOp* op);
+    void armAccept(IoUringOp* op);
+    void armEpoll();
+    void cancel(IoUringOp* op);
+    void maybeFree(IoUringOp* op);
+
+    void queueWaiter(IoUringOp* op);
+    // 挂起当前协程等这个操作，返回是否被CQE唤醒
+    bool park(IoUringOp* op);
+    int waitSingle(IoUringOp* op);
+
+    void recycleBuffer(uint16_t bid);
+    ssize_t copyOut(IoUringOp* op, const struct iovec* iov, int iovcnt);
+
+    IoUringOp* getRecvOp(FdEvent* fd_event);
+    IoUringOp* getAcceptOp(FdEvent* fd_event);
+
+private:
+    Reactor* m_reactor {nullptr};
+    pid_t m_tid {0};
+    int m_ring_fd {-1};
+
+    // 提交队列
+    void* m_sq_ptr {nullptr};
+    size_t m_sq_size {0};
+    unsigned int* m_sq_head {nullptr};
+    unsigned int* m_sq_tail {nullptr};
+    unsigned int m_sq_mask {0};
+    unsigned int m_sq_entries {0};
+    unsigned int m_sq_local_tail {0};   // 已经填好还没对内核发布的尾
+    io_uring_sqe* m_sqes {nullptr};
+    size_t m_sqes_size {0};
+
+    // 完成队列
+    void* m_cq_ptr {nullptr};
+    size_t m_cq_size {0};
+    unsigned int* m_cq_head {nullptr};
+    unsigned int* m_cq_tail {nullptr};
+    unsigned int m_cq_mask {0};
+    io_uring_cqe* m_cqes {nullptr};
+
+    // provided buffer ring，buffer id就是下标
+    io_uring_buf_ring* m_buf_ring {nullptr};
+    size_t m_buf_ring_size {0};
+    char* m_bufs {nullptr};
+    int m_buf_count {0};
+    int m_buf_size {0};
+    uint16_t m_buf_tail {0};
+
+    IoUringOp* m_epoll_op {nullptr};
+    bool m_epoll_ready {false};
+
+    std::vector<IoUringOp*> m_ready_ops;     // CQE到了，等着恢复协程
+    std::vector<IoUringOp*> m_resume_ops;
+    std::vector<IoUringOp*> m_starved_ops;   // buffer用完(ENOBUFS)停下来的recv，有buffer归还的时候重新提交
+};
+
+} // namespace tinyrpc
+
+
+#endif
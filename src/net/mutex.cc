@@ -4,78 +4,132 @@
 #include "src/coroutine/coroutine.h"
 #include "src/comm/log.h"
 #include "src/net/mutex.h"
+#include "src/net/reactor.h"
 
 
 namespace tinyrpc{
 
-CoroutineMutex::CoroutineMutex(){}
+CoWaiter::ThreadWaiter::ThreadWaiter()
+{
+    pthread_cond_init(&m_cond, nullptr);
+}
 
-CoroutineMutex::~CoroutineMutex()
+CoWaiter::ThreadWaiter::~ThreadWaiter()
 {
-    if(m_lock)
-        unlock();
+    pthread_cond_destroy(&m_cond);
 }
 
-void CoroutineMutex::lock()
-{   
-    // 主协程不能使用锁
+void CoWaiter::ThreadWaiter::wait()
+{
+    Mutex::Lock lock(m_mutex);
+    while(!m_notified)
+    {
+        pthread_cond_wait(&m_cond, m_mutex.getMutex());
+    }
+}
+
+void CoWaiter::ThreadWaiter::notify()
+{
+    Mutex::Lock lock(m_mutex);
+    m_notified = true;
+    pthread_cond_signal(&m_cond);
+}
+
+CoWaiter CoWaiter::current()
+{
+    CoWaiter waiter;
     if(Coroutine::isMainCoroutine())
     {
-        ErrorLog << "main coroutine can't use coroutine mutex";
+        waiter.m_thread_waiter = std::make_shared<ThreadWaiter>();
+        return waiter;
+    }
+    waiter.m_cor = Coroutine::getCurrentCoroutine()->shared_from_this();
+    waiter.m_reactor = Reactor::getReactor();
+    return waiter;
+}
+
+void CoWaiter::wait() const
+{
+    if(m_thread_waiter)
+    {
+        DebugLog << "not in coroutine, block thread until wakeup";
+        m_thread_waiter->wait();
+        return;
+    }
+    Coroutine::Yield();
+}
+
+void CoWaiter::wakeup() const
+{
+    if(m_thread_waiter)
+    {
+        m_thread_waiter->notify();
         return;
     }
+    DebugLog << "wakeup coroutine[" << m_cor->getCorId() << "] in reactor of thread[" << m_reactor->getTid() << "]";
+    m_reactor->addCoroutine(m_cor);
+}
 
-    Coroutine* cor = Coroutine::getCurrentCoroutine();
 
+CoroutineMutex::CoroutineMutex(){}
+
+CoroutineMutex::~CoroutineMutex()
+{
+    if(m_lock)
+        unlock();
+}
+
+void CoroutineMutex::lock()
+{
     Mutex::Lock lock(m_mutex);  // 创建对象构造函数已经上锁了
 
     if(!m_lock) // 改下上锁的状态
     {
         m_lock = true;
+        lock.unlock();
         DebugLog << "coroutine succ get coroutine mutex";
-        lock.unlock(); 
+        return;
     }
-    else
-    {
-        m_sleep_cors.push(cor);
-        auto tmp = m_sleep_cors;
-        lock.unlock();
 
-        DebugLog << "coroutine yield, pending coroutine mutex, current sleep queue exist ["
-            << tmp.size() << "] coroutines";
+    CoWaiter waiter = CoWaiter::current();
+    m_sleep_cors.push(waiter);
+    size_t size = m_sleep_cors.size();
+    lock.unlock();
 
-        Coroutine::Yield();  // 协程挂起
-    }
+    DebugLog << "coroutine yield, pending coroutine mutex, current sleep queue exist ["
+        << size << "] coroutines";
+
+    waiter.wait();  // 协程挂起或者线程阻塞，被唤醒的时候unlock已经把锁交给这个等待者了
+}
+
+bool CoroutineMutex::tryLock()
+{
+    Mutex::Lock lock(m_mutex);
+    if(m_lock)
+        return false;
+    m_lock = true;
+    return true;
 }
 
 void CoroutineMutex::unlock()
 {
-    if(Coroutine::isMainCoroutine())
-    {
-        ErrorLog << "main coroutine can't use coroutine mutex";
+    Mutex::Lock lock(m_mutex);
+    if(!m_lock)
         return;
-    }
 
-    Mutex::Lock lock(m_mutex);
-    if(m_lock)
+    if(m_sleep_cors.empty())
     {
         m_lock = false;
-        if(m_sleep_cors.empty())
-            return;
-        
-        Coroutine* cor = m_sleep_cors.front();
-        m_sleep_cors.pop();
-        lock.unlock();
-
-        if(cor)
-        {
-            // 唤醒睡眠队列中的第一个协程
-            DebugLog << "coroutine unlock, now to resume coroutine[" << cor->getCorId() << "]";
-
-            // Reactor框架加入到协程的任务，未实现
-        }
+        return;
     }
 
+    // 锁直接交给睡眠队列中的第一个协程，m_lock保持true
+    CoWaiter waiter = m_sleep_cors.front();
+    m_sleep_cors.pop();
+    lock.unlock();
+
+    DebugLog << "coroutine unlock, now to wakeup next waiter";
+    waiter.wakeup();
 }
-    
+
 } // namespace tinyrpc
@@ -227,9 +227,57 @@ private:
     pthread_rwlock_t m_lock;
 };
 
+class Reactor;
+
+/*
+
+----------- 等待中的协程
+协程同步原语挂起协程的时候记下协程和它所在线程的reactor
+唤醒的时候通过Reactor::addCoroutine交给原来的reactor恢复，不管是哪个线程唤醒的
+协程挂起之后才会被它自己的reactor恢复，所以先入队再挂起不会丢唤醒
+
+不在协程里(主协程，比如工作线程池的线程)没法挂起，就记下一个线程等待对象，wait的时候阻塞线程
+wakeup先于wait发生的时候标志已经置上，wait直接返回，也不会丢唤醒
+io线程的主协程阻塞会把整个io线程停住，等的锁要是被本线程的协程拿着就死锁了，io线程里只在协程中使用
+
+*/
+struct CoWaiter{
+    // 阻塞线程用的等待对象，只被唤醒一次
+    struct ThreadWaiter{
+        ThreadWaiter();
+        ~ThreadWaiter();
+
+        void wait();
+        void notify();
+
+        Mutex m_mutex;
+        pthread_cond_t m_cond;
+        bool m_notified {false};
+    };
+
+    Coroutine::ptr m_cor;
+    Reactor* m_reactor {nullptr};
+    std::shared_ptr<ThreadWaiter> m_thread_waiter;   // 不在协程里的时候才有
+
+    // 当前协程，主协程的时候是阻塞当前线程的等待对象
+    static CoWaiter current();
+    // 挂起协程或者阻塞线程直到wakeup，要在入队并且释放内部锁之后调用
+    void wait() const;
+    // 交给所在的reactor恢复，或者唤醒阻塞的线程
+    void wakeup() const;
+
+    bool empty() const
+    {
+        return !m_cor && !m_thread_waiter;
+    }
+};
+
 /*
 
------------ 读写协程锁
+----------- 协程锁
+拿不到锁的协程挂起，不阻塞io线程
+解锁的时候有等待的协程就直接把锁交给队头的协程(FIFO)，锁一直是上锁的状态，后来的协程插不了队
+不在协程里(工作线程)加锁拿不到就阻塞线程，和协程一起排队
 
 */
 class CoroutineMutex{
@@ -241,11 +289,14 @@ public:
     ~CoroutineMutex();
 
     void lock();
+    // 拿不到马上返回false
+    bool tryLock();
+    // 可以在主协程和其他线程调用，不要求是加锁的线程
     void unlock();
 private:
     bool m_lock {false};
     Mutex m_mutex;
-    std::queue<Coroutine*> m_sleep_cors; // 加入队列的都是等待唤醒的协程
+    std::queue<CoWaiter> m_sleep_cors; // 加入队列的都是等待唤醒的协程
 
 };
 
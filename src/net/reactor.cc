@@ -6,11 +6,14 @@
 #include <algorithm>
 
 #include "src/comm/log.h"
+#include "src/comm/config.h"
+#include "src/comm/clock.h"
 #include "src/coroutine/coroutine.h"
 #include "reactor.h"
 #include "mutex.h"
 #include "fd_event.h"
 #include "timer.h"
+#include "io_uring.h"
 #include "src/coroutine/coroutine.h"
 #include "src/coroutine/coroutine_hook.h"
 
@@ -20,10 +23,16 @@ extern write_fun_ptr_t g_sys_write_fun; // 系统write hook.h
 
 namespace tinyrpc{
 
+extern tinyrpc::Config::ptr gRpcConfig;
+
 static thread_local Reactor* t_reactor_ptr = nullptr;
 static thread_local int t_max_epoll_timeout = 10000; //ms
 
-static CoroutineTaskQueue* t_couroutine_task_queue = nullptr;
+// 一轮循环最多窃取的协程数，窃取太多会推迟自己的epoll_wait
+static const int MAX_STEAL_PER_LOOP = 16;
+
+// 自适应事件数组：连续这么多次epoll_wait返回不到四分之一才减半，避免负载抖动的时候反复申请
+static const int SHRINK_AFTER_LOW_WAITS = 16;
 
 Reactor::Reactor()
 {
@@ -76,6 +85,20 @@ write(): 设置counter的值。
 
     DebugLog << "wakefd = " << m_wake_fd;
     addWakeupFd();
+
+    if(gRpcConfig)
+    {
+        setMaxEvents(gRpcConfig->m_reactor_max_events, gRpcConfig->m_reactor_adaptive_events, gRpcConfig->m_reactor_max_events_limit);
+    }
+    else
+    {
+        setMaxEvents(m_min_events);
+    }
+
+    if(gRpcConfig && gRpcConfig->m_reactor_io_uring)
+    {
+        enableIoUring(gRpcConfig->m_io_uring_entries, gRpcConfig->m_io_uring_buf_count, gRpcConfig->m_io_uring_buf_size);
+    }
 }
 
 Reactor::~Reactor()
@@ -85,6 +108,11 @@ Reactor::~Reactor()
    // 3. t_reactor_ptr 置空
 
    DebugLog << "~Reactor";
+   if(m_io_uring != nullptr)
+   {
+        delete m_io_uring;
+        m_io_uring = nullptr;
+   }
    close(m_epfd);
    if(m_timer != nullptr)
    {
@@ -179,6 +207,17 @@ void Reactor::wakeup()
     // 没有在循环 
     if(!m_is_looping)
         return;
+
+    // loop线程自己加的任务(比如协程锁唤醒同线程的协程)，这时候不在epoll_wait里，不用写fd，下一次epoll_wait不阻塞就行
+    if(isLoopThread())
+    {
+        m_loop_wakeup = true;
+        return;
+    }
+
+    // 已经写过还没被loop读走，再写也只是多一次系统调用
+    if(m_wakeup_pending.exchange(true, std::memory_order_acq_rel))
+        return;
     
     uint64_t tmp = 1;
     uint64_t* p = &tmp;
@@ -274,12 +313,11 @@ void Reactor::loop()
     m_stop_flag = false;
 
     Coroutine* first_coroutine = nullptr; // epoll_wait的第一个协程
+    Clock::refresh();
+    m_stats_begin_ms = Clock::nowMs();
 
     while(!m_stop_flag)
     {
-        const int MAX_EVENTS = 10;
-        epoll_event re_events[MAX_EVENTS + 1];
-
         // 第一个协程有效唤醒
         if(first_coroutine)
         {
@@ -287,20 +325,29 @@ void Reactor::loop()
             first_coroutine = NULL;
         }
 
+        // 边缘触发的fd一直注册在本线程的epoll中，协程也只在本线程恢复
+        resumeEdgeTriggeredEvents();
+
         // 主协程不需要被唤醒，io协程才需要，全部唤醒，就是专门为子reacotr设置的，唤醒所有读写事件的协程进行处理。
+        // 先把自己队列里的协程全部唤醒，空了再去其他io线程的队列里窃取，窃取的协程在本线程恢复
         if(m_reactor_type != MainReactor)
         {
+            CoroutineTaskQueue* task_queue = CoroutineTaskQueue::getCoroutineTaskQueue();
             FdEvent* ptr = NULL;
-            while(1)  // 不断唤醒fdEvent的协程，直到全部唤醒返回nullptr跳出循环。
+            while((ptr = task_queue->popLocal()) != NULL)
             {
-                ptr = CoroutineTaskQueue::getCoroutineTaskQueue()->pop(); // 拿一个任务队列中的协程队列中的Fdevent，有就直接拿，没有new
-                if(ptr)
-                {
-                    ptr->setReactor(this);
-                    tinyrpc::Coroutine::Resume(ptr->getCoroutine());
-                }
-                else
+                ptr->setReactor(this);
+                tinyrpc::Coroutine::Resume(ptr->getCoroutine());
+            }
+
+            for(int i = 0; i < MAX_STEAL_PER_LOOP; ++i)
+            {
+                ptr = task_queue->steal();
+                if(!ptr)
                     break;
+                DebugLog << "steal fd[" << ptr->getFd() << "] from other io thread";
+                ptr->setReactor(this);
+                tinyrpc::Coroutine::Resume(ptr->getCoroutine());
             }
         }
 
@@ -312,15 +359,38 @@ void Reactor::loop()
         tmp_tasks.swap(m_pending_tasks);
         lock.unlock();
             // 执行回调函数
-        for(auto task : tmp_tasks)
+        for(auto& task : tmp_tasks)
         {
             if(task)
                 task();
         }
+        // 任务捕获的对象(比如shared_ptr)马上释放，不要拖到epoll_wait返回之后
+        tmp_tasks.clear();
 
 
         // 进入epoll_wait
-        int rt = epoll_wait(m_epfd, re_events, MAX_EVENTS, t_max_epoll_timeout);
+        // io_uring后端：一次io_uring_enter提交这一轮协程产生的SQE并等待CQE，epoll fd就绪了才去取epoll事件
+        int rt = 0;
+        bool epoll_polled = true;
+        int timeout = m_loop_wakeup ? 0 : t_max_epoll_timeout;
+        m_loop_wakeup = false;
+        if(m_io_uring)
+        {
+            epoll_polled = m_io_uring->wait(timeout);
+            // 唤醒协程之前刷新缓存的时间
+            Clock::refresh();
+            m_io_uring->resumeWaiters();
+            if(epoll_polled)
+            {
+                rt = epoll_wait(m_epfd, &m_events[0], static_cast<int>(m_events.size()), 0);
+            }
+        }
+        else
+        {
+            rt = epoll_wait(m_epfd, &m_events[0], static_cast<int>(m_events.size()), timeout);
+            // 这一轮后面取时间都用这个缓存
+            Clock::refresh();
+        }
 
         if(rt < 0)
         {
@@ -331,7 +401,7 @@ void Reactor::loop()
             // 1. 反复检查返回的事件个数，放在re_events
             for(int i = 0; i < rt; ++i)
             {
-                epoll_event one_event = re_events[i];
+                epoll_event one_event = m_events[i];
                 // 1. 1读事件, 唤醒事件，这是在唤醒reactor
                 if(one_event.data.fd == m_wake_fd && (one_event.events & READ))
                 {
@@ -342,6 +412,9 @@ void Reactor::loop()
                             break;
                         // 下一步就开始处理事件了,所以wakeup函数只是需要写入一个数据到wake_fd就能唤醒epoll
                     }
+                    // 先读空再清标记：清之前的wakeup看到标记没写fd，它的任务已经放进队列，下一轮开头就会执行
+                    // 清之后的wakeup会重新写fd。先清再读的话，读的过程中写进来的会被读掉，标记却一直是true，之后再也不写fd
+                    m_wakeup_pending.exchange(false, std::memory_order_acq_rel);
                 }
                 else
                 {
@@ -351,6 +424,13 @@ void Reactor::loop()
                     {
                         int fd = ptr->getFd();
 
+                        // 边缘触发的fd不删除epoll事件，记录就绪状态就行
+                        if(ptr->isEdgeTriggered())
+                        {
+                            onEdgeTriggeredEvent(ptr, one_event.events);
+                            continue;
+                        }
+
                         // 不是读写事件出现了错误
                         // 1. 判断是否是读写以外的事件，如果是就添加报错日志，删除这个无效fd，但是不影响正常运行
                         if((!(one_event.events & EPOLLIN)) && (!(one_event.events & EPOLLOUT)))
@@ -371,7 +451,8 @@ void Reactor::loop()
                                 }
                                 // 子协程，负责io,不加入循环中，而是加入到协程任务队列中。这个reactor loop是主协程用于处理连接的
                                 // 加入到协程任务队列中，在最前面会不断唤醒所有协程，在协程中执行子reactor进行io
-                                if(m_reactor_type == SubReactor)
+                                // 共享栈协程和固定线程的协程只能在本线程唤醒，不能放进会被别的线程窃取的队列
+                                if(m_reactor_type == SubReactor && !ptr->getCoroutine()->isShareStack() && !ptr->getCoroutine()->isPinned())
                                 {
                                     delEventInLoopThread(fd);
                                     ptr->setReactor(NULL);
@@ -379,7 +460,7 @@ void Reactor::loop()
                                 }
                                 else
                                 {
-                                    // 主reactor
+                                    // 主reactor，或者共享栈、固定线程的协程
                                     tinyrpc::Coroutine::Resume(ptr->getCoroutine());
                                     if(first_coroutine)
                                         first_coroutine = NULL;
@@ -417,6 +498,10 @@ void Reactor::loop()
                 }
             }// end for
 
+            // 事件都处理完了才能调整数组大小
+            if(epoll_polled)
+                updateEventsStats(rt);
+
             // 添加或者删除不是本线程（是第一次加入本线程，但是没有注册到recator的事件）的待定事件
             std::map<int, epoll_event> tmp_add;
             std::vector<int> tmp_del;
@@ -446,6 +531,7 @@ void Reactor::loop()
     } // end while(!m_stop_flag)
 
     DebugLog << "reactor loop end";
+    Clock::stopCache();
     m_is_looping = false;
 }
 
@@ -511,41 +597,281 @@ void Reactor::setReactorType(ReactorType type)
     m_reactor_type = type;
 }
 
+// 出错和对端关闭也当作可读可写，唤醒等待的协程，让读写返回错误
+void Reactor::onEdgeTriggeredEvent(FdEvent* fd_event, uint32_t events)
+{
+    int ready = 0;
+    if(events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+        ready |= READ;
+    if(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+        ready |= WRITE;
+
+    fd_event->setReady(ready);
+    if(fd_event->getCoroutine() && (fd_event->getWaitEvents() & ready) && fd_event->markQueued())
+    {
+        m_et_ready_events.push_back(fd_event);
+    }
+}
+
+void Reactor::resumeEdgeTriggeredEvents()
+{
+    if(m_et_ready_events.empty())
+        return;
+
+    m_et_resume_events.swap(m_et_ready_events);
+    for(size_t i = 0; i < m_et_resume_events.size(); ++i)
+    {
+        FdEvent* fd_event = m_et_resume_events[i];
+        fd_event->clearQueued();
+        // 放进列表之后协程可能已经被定时器唤醒，不再等待了
+        Coroutine* cor = fd_event->getCoroutine();
+        if(cor && fd_event->getWaitEvents())
+        {
+            tinyrpc::Coroutine::Resume(cor);
+        }
+    }
+    m_et_resume_events.clear();
+}
+
+void Reactor::setMaxEvents(int max_events, bool adaptive /*=false*/, int limit /*=4096*/)
+{
+    if(max_events <= 0)
+    {
+        max_events = 1;
+    }
+    m_min_events = max_events;
+    m_adaptive_events = adaptive;
+    m_max_events_limit = adaptive ? std::max(limit, max_events) : max_events;
+    m_low_load_waits = 0;
+
+    m_events.resize(max_events);
+    m_cur_max_events.store(max_events, std::memory_order_relaxed);
+}
+
+bool Reactor::enableIoUring(int entries, int buf_count, int buf_size)
+{
+    assert(isLoopThread());
+    if(m_io_uring)
+        return true;
+
+    m_io_uring = IoUring::create(this, entries, buf_count, buf_size);
+    if(!m_io_uring)
+    {
+        ErrorLog << "thread[" << m_tid << "] io_uring not available, fall back to epoll";
+        return false;
+    }
+    m_io_uring->watchEpoll(m_epfd);
+    InfoLog << "thread[" << m_tid << "] reactor use io_uring backend";
+    return true;
+}
+
+IoUring* Reactor::getIoUring() const
+{
+    return m_io_uring;
+}
+
+ReactorStats Reactor::getStats() const
+{
+    ReactorStats stats;
+    stats.wait_count = m_wait_count.load(std::memory_order_relaxed);
+    stats.event_count = m_event_count.load(std::memory_order_relaxed);
+    stats.max_events = m_cur_max_events.load(std::memory_order_relaxed);
+    stats.waits_per_second = m_waits_per_second.load(std::memory_order_relaxed);
+    stats.events_per_wait = m_events_per_wait.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// 每次epoll_wait之后调用：更新统计，自适应模式下调整事件数组大小
+void Reactor::updateEventsStats(int event_num)
+{
+    uint64_t waits = m_wait_count.load(std::memory_order_relaxed) + 1;
+    uint64_t events = m_event_count.load(std::memory_order_relaxed) + event_num;
+    m_wait_count.store(waits, std::memory_order_relaxed);
+    m_event_count.store(events, std::memory_order_relaxed);
+
+    int64_t now = Clock::nowMs();
+    if(now - m_stats_begin_ms >= 1000)
+    {
+        uint64_t period_waits = waits - m_stats_begin_waits;
+        uint64_t period_events = events - m_stats_begin_events;
+        m_waits_per_second.store(period_waits * 1000.0 / (now - m_stats_begin_ms), std::memory_order_relaxed);
+        m_events_per_wait.store(period_waits > 0 ? (double)period_events / period_waits : 0, std::memory_order_relaxed);
+        m_stats_begin_ms = now;
+        m_stats_begin_waits = waits;
+        m_stats_begin_events = events;
+    }
+
+    if(!m_adaptive_events)
+    {
+        return;
+    }
+
+    int size = static_cast<int>(m_events.size());
+    if(event_num >= size && size < m_max_events_limit)
+    {
+        // 数组满了，说明还有就绪的fd没取出来
+        size = std::min(size * 2, m_max_events_limit);
+        m_events.resize(size);
+        m_low_load_waits = 0;
+        DebugLog << "epoll_wait returns full array, grow max events to " << size;
+    }
+    else if(event_num < size / 4 && size > m_min_events)
+    {
+        if(++m_low_load_waits >= SHRINK_AFTER_LOW_WAITS)
+        {
+            size = std::max(size / 2, m_min_events);
+            m_events.resize(size);
+            m_events.shrink_to_fit();
+            m_low_load_waits = 0;
+            DebugLog << "low load, shrink max events to " << size;
+        }
+    }
+    else
+    {
+        m_low_load_waits = 0;
+    }
+    m_cur_max_events.store(size, std::memory_order_relaxed);
+}
+
 /*
 ------------------------CoroutineTaskQueue----------------------
 */
 
+// 所有io线程同时启动，用局部静态变量保证只创建一个
 CoroutineTaskQueue* CoroutineTaskQueue::getCoroutineTaskQueue() 
 {
-    if(t_couroutine_task_queue)
-        return t_couroutine_task_queue;
-    
-    t_couroutine_task_queue = new CoroutineTaskQueue();
-    return t_couroutine_task_queue;
+    static CoroutineTaskQueue* task_queue = new CoroutineTaskQueue();
+    return task_queue;
+}
+
+// 线程自己的队列，线程退出的时候析构，把队列交还
+struct LocalQueueHolder{
+    CoroutineTaskQueue::LocalQueue* m_queue {nullptr};
+    int m_index {-1};
+    unsigned int m_steal_seed {0};  // 窃取的起始位置，错开不同的线程
+
+    ~LocalQueueHolder()
+    {
+        if(m_index >= 0)
+        {
+            CoroutineTaskQueue::getCoroutineTaskQueue()->releaseQueue(m_index);
+        }
+    }
+};
+
+static thread_local LocalQueueHolder t_local_queue;
+
+int CoroutineTaskQueue::acquireQueue()
+{
+    // 1. 先接管退出线程留下的队列
+    int count = m_slot_count.load(std::memory_order_acquire);
+    for(int i = 0; i < count && i < MAX_QUEUE_COUNT; ++i)
+    {
+        bool owned = false;
+        if(m_slots[i].m_queue.load(std::memory_order_acquire) != nullptr
+            && m_slots[i].m_owned.compare_exchange_strong(owned, true, std::memory_order_acq_rel))
+        {
+            return i;
+        }
+    }
+
+    // 2. 新建一个
+    int index = m_slot_count.fetch_add(1, std::memory_order_acq_rel);
+    if(index >= MAX_QUEUE_COUNT)
+    {
+        m_slot_count.fetch_sub(1, std::memory_order_acq_rel);
+        return -1;
+    }
+    m_slots[index].m_owned.store(true, std::memory_order_relaxed);
+    m_slots[index].m_queue.store(new LocalQueue(), std::memory_order_release);
+    return index;
+}
+
+void CoroutineTaskQueue::releaseQueue(int index)
+{
+    m_slots[index].m_owned.store(false, std::memory_order_release);
+}
+
+CoroutineTaskQueue::LocalQueue* CoroutineTaskQueue::getLocalQueue()
+{
+    if(t_local_queue.m_queue)
+    {
+        return t_local_queue.m_queue;
+    }
+
+    int index = acquireQueue();
+    if(index < 0)
+    {
+        // 线程数超过上限，用一个不注册的队列，只有自己能拿，不会被窃取
+        ErrorLog << "too many threads use CoroutineTaskQueue, max=" << MAX_QUEUE_COUNT << ", this thread's queue can't be stolen";
+        t_local_queue.m_queue = new LocalQueue();
+    }
+    else
+    {
+        t_local_queue.m_queue = m_slots[index].m_queue.load(std::memory_order_acquire);
+        t_local_queue.m_index = index;
+    }
+    t_local_queue.m_steal_seed = static_cast<unsigned int>(index < 0 ? 0 : index);
+    return t_local_queue.m_queue;
 }
 
-// fd事件放入协程队列
+// fd事件放入当前线程的队列，无锁
 void CoroutineTaskQueue::push(FdEvent* cor)
 {
-    Mutex::Lock lock(m_mutex);
-    m_task.push(cor);
-    lock.unlock();
+    getLocalQueue()->push(cor);
 }
 
-// 拿出一个fd事件
+// 拿出一个fd事件，自己的优先，没有了再窃取
 FdEvent* CoroutineTaskQueue::pop()
+{
+    FdEvent* re = popLocal();
+    if(re == nullptr)
+    {
+        re = steal();
+    }
+    return re;
+}
+
+FdEvent* CoroutineTaskQueue::popLocal()
 {
     FdEvent* re = nullptr;
+    if(getLocalQueue()->pop(re))
+    {
+        return re;
+    }
+    return nullptr;
+}
 
-    Mutex::Lock lock(m_mutex);
-    
-    if(m_task.size() >= 1)
+// 从下一个线程开始轮一圈，每次起点后移，避免所有线程都去偷同一个队列
+FdEvent* CoroutineTaskQueue::steal()
+{
+    LocalQueue* self = getLocalQueue();
+    int count = std::min(m_slot_count.load(std::memory_order_acquire), static_cast<int>(MAX_QUEUE_COUNT));
+    if(count <= 1)
     {
-        re = m_task.front();
-        m_task.pop();
+        return nullptr;
     }
 
-    lock.unlock();
+    unsigned int begin = ++t_local_queue.m_steal_seed;
+    for(int i = 0; i < count; ++i)
+    {
+        LocalQueue* victim = m_slots[(begin + i) % count].m_queue.load(std::memory_order_acquire);
+        if(victim == nullptr || victim == self)
+        {
+            continue;
+        }
+        FdEvent* re = nullptr;
+        if(victim->steal(re))
+        {
+            return re;
+        }
+    }
+    return nullptr;
+}
+
+int CoroutineTaskQueue::getQueueCount() const
+{
+    return std::min(m_slot_count.load(std::memory_order_acquire), static_cast<int>(MAX_QUEUE_COUNT));
 }
     
 } // namespace tinyrpc
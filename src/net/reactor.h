@@ -12,6 +12,7 @@
 
 
 #include "src/coroutine/coroutine.h"
+#include "src/net/work_stealing_queue.h"
 #include "mutex.h"
 
 /*
@@ -32,6 +33,16 @@ enum ReactorType{
 
 class FdEvent;
 class Timer;
+class IoUring;
+
+// epoll_wait的统计，计数是累计值，速率是最近一个统计周期(1s)的值
+struct ReactorStats{
+    uint64_t wait_count {0};       // epoll_wait次数
+    uint64_t event_count {0};      // 返回的事件总数
+    int max_events {0};            // 当前事件数组大小
+    double waits_per_second {0};
+    double events_per_wait {0};
+};
 
 /*
 
@@ -69,6 +80,15 @@ public:
     pid_t getTid();
     // 设置本reactor的主从类型
     void setReactorType(ReactorType type);
+    // 设置epoll_wait事件数组大小，adaptive为true时在[max_events, limit]之间自动调整
+    // 在loop之前或者loop线程中调用
+    void setMaxEvents(int max_events, bool adaptive = false, int limit = 4096);
+    // 可以在任意线程调用
+    ReactorStats getStats() const;
+    // 切换到io_uring后端，内核不支持返回false，继续用epoll。在loop之前并且在loop线程中调用
+    bool enableIoUring(int entries, int buf_count, int buf_size);
+    // 没有启用返回nullptr
+    IoUring* getIoUring() const;
 
 public:
     static Reactor* getReactor();
@@ -78,6 +98,9 @@ private:
     bool isLoopThread() const;
     void addEventInLoopThread(int fd, epoll_event event);
     void delEventInLoopThread(int fd);
+    void updateEventsStats(int event_num);
+    void onEdgeTriggeredEvent(FdEvent* fd_event, uint32_t events);
+    void resumeEdgeTriggeredEvents();
 
 private:
     int m_epfd {-1}; // epoll的返回fd
@@ -86,6 +109,8 @@ private:
     bool m_stop_flag {false};
     bool m_is_looping {false};
     bool m_is_init_timer {false};
+    bool m_loop_wakeup {false};  // loop线程自己调了wakeup，下一次epoll_wait不阻塞
+    std::atomic<bool> m_wakeup_pending {false};  // 其他线程写了wakeup fd，loop还没读
     pid_t m_tid {0};     // 线程id
 
     Mutex m_mutex;
@@ -104,6 +129,30 @@ private:
     Timer* m_timer {nullptr}; // 事件定时器
 
     ReactorType m_reactor_type {SubReactor};
+
+    // 边缘触发模式下就绪并且有协程在等的fd，下一轮循环开头在本线程恢复，不进入窃取队列
+    std::vector<FdEvent*> m_et_ready_events;
+    std::vector<FdEvent*> m_et_resume_events;
+
+    // io_uring后端，hook的socket读写在这里提交，epoll fd也放进ring里等待
+    IoUring* m_io_uring {nullptr};
+
+    // epoll_wait事件数组，只在loop线程访问
+    std::vector<epoll_event> m_events;
+    int m_min_events {10};             // 配置的大小，自适应缩小的下限
+    int m_max_events_limit {10};       // 自适应扩大的上限
+    bool m_adaptive_events {false};
+    int m_low_load_waits {0};          // 连续低负载的epoll_wait次数
+
+    // 统计，loop线程写，其他线程读
+    std::atomic<uint64_t> m_wait_count {0};
+    std::atomic<uint64_t> m_event_count {0};
+    std::atomic<int> m_cur_max_events {10};
+    std::atomic<double> m_waits_per_second {0};
+    std::atomic<double> m_events_per_wait {0};
+    int64_t m_stats_begin_ms {0};          // 本统计周期开始时间
+    uint64_t m_stats_begin_waits {0};
+    uint64_t m_stats_begin_events {0};
 };
 
 
@@ -111,6 +160,12 @@ private:
 
 ---------------------CoroutineTaskQueue 类
 
+    原来是所有从reactor共用一个加锁的std::queue，io线程多了之后锁竞争严重
+    现在每个线程一个Chase-Lev无锁双端队列：
+    1. 从reactor把就绪的FdEvent放到自己线程的队列，优先恢复自己队列里的协程
+    2. 自己的队列空了才去其他线程的队列顶部窃取，被窃取的协程在窃取线程恢复，还是m:n模型
+    3. 线程第一次push/pop的时候注册队列，线程退出之后队列留给后面新建的线程接管，里面剩下的FdEvent不会丢
+
 */
 
 class CoroutineTaskQueue
@@ -118,13 +173,43 @@ class CoroutineTaskQueue
 public:
     static CoroutineTaskQueue* getCoroutineTaskQueue();
 
+    // 放入当前线程的队列
     void push(FdEvent* fd);
 
+    // 先拿当前线程的队列，空了再窃取，都没有返回nullptr
     FdEvent* pop();
 
+    // 只拿当前线程的队列
+    FdEvent* popLocal();
+
+    // 从其他线程的队列窃取一个
+    FdEvent* steal();
+
+    // 已经注册的队列数
+    int getQueueCount() const;
+
+public:
+    typedef WorkStealingQueue<FdEvent*> LocalQueue;
+
+    static const int MAX_QUEUE_COUNT = 1024;
+
+    // 注册/接管一个队列给当前线程，返回下标
+    int acquireQueue();
+
+    // 线程退出，队列变成无主的
+    void releaseQueue(int index);
+
 private:
-    std::queue<FdEvent*> m_task;
-    Mutex m_mutex;
+    LocalQueue* getLocalQueue();
+
+private:
+    struct QueueSlot{
+        std::atomic<LocalQueue*> m_queue {nullptr};
+        std::atomic<bool> m_owned {false};
+    };
+
+    QueueSlot m_slots[MAX_QUEUE_COUNT];
+    std::atomic<int> m_slot_count {0};  // 用到的最大下标 + 1
 };
 
 
@@ -153,13 +153,11 @@ void IOThreadPool::start()
     }
 }
 
-// 拿一个没用过的线程
+// 轮流拿线程，之前m_index没有递增，连接全都给了第一个线程
 IOThread* IOThreadPool::getIOThread()
 {
-    if(m_index == m_size || m_index == -1)
-        m_index = 0;
-    
-    return m_io_threads[m_index].get();
+    unsigned int index = static_cast<unsigned int>(++m_index);
+    return m_io_threads[index % m_size].get();
 }
 
 int IOThreadPool::getIOThreadPoolSize() 
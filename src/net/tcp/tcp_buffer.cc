@@ -1,93 +1,230 @@
 #include <cstring>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
 #include <unistd.h>
 #include "src/net/tcp/tcp_buffer.h"
 #include "src/comm/log.h"
-#include "tcp_buffer.h"
 
-tinyrpc::TcpBuffer::TcpBuffer(int size)
+namespace tinyrpc{
+
+// 每个线程最多缓存的slab数量，超过的直接free
+static const int MAX_CACHED_SLABS = 256;
+
+static thread_local BufferSlabPool* t_slab_pool = nullptr;
+
+static BufferSlab* newSlab(int size)
 {
-    m_buffer.resize(size);
+    void* mem = malloc(sizeof(BufferSlab) + size);
+    BufferSlab* slab = new (mem) BufferSlab();
+    slab->m_ref.store(1, std::memory_order_relaxed);
+    slab->m_size = size;
+    return slab;
 }
 
-tinyrpc::TcpBuffer::~TcpBuffer()
+// 每个线程一个池子，和reactor一样懒加载，线程退出也不释放
+BufferSlabPool* BufferSlabPool::getPool()
 {
-    clearBuffer();
+    if(t_slab_pool == nullptr)
+    {
+        t_slab_pool = new BufferSlabPool();
+    }
+    return t_slab_pool;
 }
 
-int tinyrpc::TcpBuffer::readAble()
+BufferSlab* BufferSlabPool::getSlab()
 {
-    return m_writeIndex - m_readIndex;
+    if(!m_free_slabs.empty())
+    {
+        BufferSlab* slab = m_free_slabs.back();
+        m_free_slabs.pop_back();
+        slab->m_ref.store(1, std::memory_order_relaxed);
+        return slab;
+    }
+    return newSlab(TcpBuffer::SLAB_SIZE);
 }
 
-int tinyrpc::TcpBuffer::writeAble()
+BufferSlab* BufferSlabPool::getLargeSlab(int size)
 {
-    return (int)m_buffer.size() - m_writeIndex;
+    if(size <= TcpBuffer::SLAB_SIZE)
+    {
+        return getSlab();
+    }
+    return newSlab(size);
 }
 
-int tinyrpc::TcpBuffer::readIndex() const
+// 可能是别的线程申请的slab，归还到当前线程的池子
+void BufferSlabPool::backSlab(BufferSlab* slab)
 {
-    return m_readIndex;
+    if(slab->m_size == TcpBuffer::SLAB_SIZE && (int)m_free_slabs.size() < MAX_CACHED_SLABS)
+    {
+        m_free_slabs.push_back(slab);
+        return;
+    }
+    slab->~BufferSlab();
+    free(slab);
 }
 
-int tinyrpc::TcpBuffer::writeIndex() const
+TcpBuffer::TcpBuffer(int size)
 {
-    return m_writeIndex;
+    // slab按需申请，size只是兼容原来的构造参数
+    (void)size;
 }
 
+TcpBuffer::~TcpBuffer()
+{
+    clearBuffer();
+}
 
-void tinyrpc::TcpBuffer::resizeBuffer(int size)
+void TcpBuffer::releaseSlab(BufferSlab* slab)
 {
-    std::vector<char> tmp(size);
+    if(slab->m_ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        BufferSlabPool::getPool()->backSlab(slab);
+    }
+}
 
-    int idx = std::min(size, readAble());
-    // 可读部分移动到头部
-    memcpy(&tmp[0], &m_buffer[m_readIndex], idx);
+void TcpBuffer::appendSegment(BufferSlab* slab, int begin, int end)
+{
+    Segment seg;
+    seg.slab = slab;
+    seg.begin = begin;
+    seg.end = end;
+    seg.cap = slab->m_size;
+    m_segments.push_back(seg);
+}
 
-    m_buffer.swap(tmp);
-    m_readIndex = 0;
-    m_writeIndex = idx;
+// 下一个可写的段
+// 从尾部往前跳过空的独占段，最后一个有数据的段如果独占并且还有空间，就从它开始写
+int TcpBuffer::firstWritable()
+{
+    int i = (int)m_segments.size() - 1;
+    while(i >= 0 && m_segments[i].begin == m_segments[i].end
+        && m_segments[i].slab->m_ref.load(std::memory_order_acquire) == 1)
+    {
+        --i;
+    }
+
+    if(i >= 0 && m_segments[i].slab->m_ref.load(std::memory_order_acquire) == 1
+        && m_segments[i].end < m_segments[i].cap)
+    {
+        return i;
+    }
+    return i + 1;
+}
+
+int TcpBuffer::readAble()
+{
+    return m_readable;
+}
+
+int TcpBuffer::writeAble()
+{
+    int count = 0;
+    for(int i = firstWritable(); i < (int)m_segments.size(); ++i)
+    {
+        count += m_segments[i].cap - m_segments[i].end;
+    }
+    return count;
 }
 
-void tinyrpc::TcpBuffer::clearBuffer()
+void TcpBuffer::clearBuffer()
 {
-    m_buffer.clear();
-    m_readIndex = 0;
-    m_writeIndex = 0;
+    for(auto& seg : m_segments)
+    {
+        releaseSlab(seg.slab);
+    }
+    m_segments.clear();
+    m_readable = 0;
 }
-int tinyrpc::TcpBuffer::getSize()
+
+int TcpBuffer::getSize()
 {
-    return (int)m_buffer.size();
+    int size = 0;
+    for(auto& seg : m_segments)
+    {
+        size += seg.slab->m_size;
+    }
+    return size;
 }
 
-std::vector<char> tinyrpc::TcpBuffer::getBufferVector()
+std::vector<char> TcpBuffer::getBufferVector()
 {
-    return m_buffer;
+    std::vector<char> tmp(m_readable);
+    if(m_readable > 0)
+    {
+        peek(0, &tmp[0], m_readable);
+    }
+    return tmp;
 }
 
-std::string tinyrpc::TcpBuffer::getBufferString()
+std::string TcpBuffer::getBufferString()
 {
-    std::string tmp(readAble(), '0');
-    memcpy(&tmp[0], &m_buffer[m_readIndex], readAble());
+    std::string tmp(m_readable, '0');
+    if(m_readable > 0)
+    {
+        peek(0, &tmp[0], m_readable);
+    }
     return tmp;
 }
 
+// 写入到buffer，空间不够就追加slab
+void TcpBuffer::writeToBuffer(const char *buf, int size)
+{
+    while(size > 0)
+    {
+        int idx = firstWritable();
+        if(idx == (int)m_segments.size())
+        {
+            appendSegment(BufferSlabPool::getPool()->getSlab(), 0, 0);
+            continue;
+        }
 
-// 写入到buffer
-void tinyrpc::TcpBuffer::writeToBuffer(const char *buf, int size)
+        Segment& seg = m_segments[idx];
+        int n = std::min(size, seg.cap - seg.end);
+        memcpy(seg.slab->data() + seg.end, buf, n);
+        seg.end += n;
+        m_readable += n;
+        buf += n;
+        size -= n;
+    }
+}
+
+char* TcpBuffer::reserveWrite(int len)
 {
-    // 容量不够，扩容
-    if(size > writeAble())
+    while(true)
     {
-        // 扩容到1.5倍
-        int newSize = (int)(1.5 * (writeAble() + size));
-        resizeBuffer(newSize);
+        int idx = firstWritable();
+        if(idx == (int)m_segments.size())
+        {
+            appendSegment(BufferSlabPool::getPool()->getLargeSlab(len), 0, 0);
+            continue;
+        }
+
+        Segment& seg = m_segments[idx];
+        if(seg.cap - seg.end >= len)
+        {
+            return seg.slab->data() + seg.end;
+        }
+
+        if(seg.begin == seg.end)
+        {
+            // 尾部空闲的slab放不下，全部还回去，重新申请
+            while(!m_segments.empty() && m_segments.back().begin == m_segments.back().end)
+            {
+                releaseSlab(m_segments.back().slab);
+                m_segments.pop_back();
+            }
+        }
+        else
+        {
+            // 封口，剩下的空间不再使用，保证预留的空间是连续的
+            seg.cap = seg.end;
+        }
     }
-    // 可写index后面加入写入的部分
-    memcpy(&m_buffer[m_writeIndex], buf, size);
-    m_writeIndex += size;
 }
 
-void tinyrpc::TcpBuffer::readFromBuffer(std::vector<char> &re, int size)
+void TcpBuffer::readFromBuffer(std::vector<char> &re, int size)
 {
     if(readAble() <= 0)
     {
@@ -95,51 +232,289 @@ void tinyrpc::TcpBuffer::readFromBuffer(std::vector<char> &re, int size)
         return;
     }
 
-    memcpy(&re[0], &m_buffer[m_readIndex], size);
-    m_readIndex += size;
-    adjustBuffer();
+    size = std::min(size, readAble());
+    peek(0, &re[0], size);
+    recycleRead(size);
 }
 
+int TcpBuffer::peek(int offset, char* dst, int len)
+{
+    int copied = 0;
+    for(auto it = m_segments.begin(); it != m_segments.end() && copied < len; ++it)
+    {
+        int seg_len = it->end - it->begin;
+        if(offset >= seg_len)
+        {
+            offset -= seg_len;
+            continue;
+        }
+        int n = std::min(seg_len - offset, len - copied);
+        memcpy(dst + copied, it->slab->data() + it->begin + offset, n);
+        copied += n;
+        offset = 0;
+    }
+    return copied;
+}
 
-void tinyrpc::TcpBuffer::recycleRead(int index)
+char TcpBuffer::at(int offset)
 {
-    int j = m_readIndex + index;
-    if (j > (int)m_buffer.size()) 
+    for(auto& seg : m_segments)
     {
-        ErrorLog << "recycleRead error";
+        int seg_len = seg.end - seg.begin;
+        if(offset < seg_len)
+        {
+            return seg.slab->data()[seg.begin + offset];
+        }
+        offset -= seg_len;
+    }
+    ErrorLog << "TcpBuffer::at out of range";
+    return 0;
+}
+
+int TcpBuffer::find(char c, int offset)
+{
+    int base = 0;
+    for(auto& seg : m_segments)
+    {
+        int seg_len = seg.end - seg.begin;
+        if(offset < base + seg_len)
+        {
+            int skip = std::max(offset - base, 0);
+            const char* start = seg.slab->data() + seg.begin;
+            const void* p = memchr(start + skip, c, seg_len - skip);
+            if(p)
+            {
+                return base + (int)(static_cast<const char*>(p) - start);
+            }
+        }
+        base += seg_len;
+    }
+    return -1;
+}
+
+int TcpBuffer::find(const std::string& str, int offset)
+{
+    if(str.empty())
+    {
+        return offset <= m_readable ? offset : -1;
+    }
+
+    int len = (int)str.length();
+    std::string tmp(len, '0');
+    int pos = find(str[0], offset);
+    while(pos != -1 && pos + len <= m_readable)
+    {
+        peek(pos, &tmp[0], len);
+        if(tmp == str)
+        {
+            return pos;
+        }
+        pos = find(str[0], pos + 1);
+    }
+    return -1;
+}
+
+void TcpBuffer::append(TcpBuffer* other)
+{
+    if(other->readAble() > 0)
+    {
+        other->slice(0, other->readAble(), this);
+    }
+}
+
+void TcpBuffer::slice(int offset, int len, TcpBuffer* out)
+{
+    if(out == nullptr || out == this)
+    {
+        ErrorLog << "slice to self is not supported";
         return;
     }
-    m_readIndex = j;
-    adjustBuffer();
+    if(offset < 0 || len <= 0 || offset + len > m_readable)
+    {
+        ErrorLog << "slice out of range, offset=" << offset << ", len=" << len << ", readable=" << m_readable;
+        return;
+    }
+
+    // 尾部空的slab去掉，保证追加的数据紧跟在可读数据后面
+    while(!out->m_segments.empty() && out->m_segments.back().begin == out->m_segments.back().end)
+    {
+        releaseSlab(out->m_segments.back().slab);
+        out->m_segments.pop_back();
+    }
+
+    for(auto& seg : m_segments)
+    {
+        if(len <= 0)
+        {
+            break;
+        }
+        int seg_len = seg.end - seg.begin;
+        if(offset >= seg_len)
+        {
+            offset -= seg_len;
+            continue;
+        }
+        int n = std::min(seg_len - offset, len);
+        seg.slab->m_ref.fetch_add(1, std::memory_order_relaxed);
+        out->appendSegment(seg.slab, seg.begin + offset, seg.begin + offset + n);
+        out->m_readable += n;
+        len -= n;
+        offset = 0;
+    }
+}
+
+int TcpBuffer::getWriteVecs(struct iovec* vecs, int max_count, int min_size)
+{
+    while(writeAble() < min_size)
+    {
+        appendSegment(BufferSlabPool::getPool()->getSlab(), 0, 0);
+    }
+
+    int count = 0;
+    for(int i = firstWritable(); i < (int)m_segments.size() && count < max_count; ++i)
+    {
+        Segment& seg = m_segments[i];
+        vecs[count].iov_base = seg.slab->data() + seg.end;
+        vecs[count].iov_len = seg.cap - seg.end;
+        ++count;
+    }
+    return count;
+}
+
+int TcpBuffer::getReadVecs(struct iovec* vecs, int max_count)
+{
+    return getReadVecs(vecs, max_count, 0, m_readable);
+}
+
+int TcpBuffer::getReadVecs(struct iovec* vecs, int max_count, int offset, int len)
+{
+    int count = 0;
+    for(auto it = m_segments.begin(); it != m_segments.end() && count < max_count && len > 0; ++it)
+    {
+        int seg_len = it->end - it->begin;
+        if(offset >= seg_len)
+        {
+            offset -= seg_len;
+            continue;
+        }
+        int n = std::min(seg_len - offset, len);
+        vecs[count].iov_base = it->slab->data() + it->begin + offset;
+        vecs[count].iov_len = n;
+        ++count;
+        len -= n;
+        offset = 0;
+    }
+    return count;
 }
 
-void tinyrpc::TcpBuffer::recucleWrite(int index)
+// 读完的slab直接归还，不需要移动剩余数据
+void TcpBuffer::recycleRead(int index)
 {
-    int j = m_writeIndex + index;
-    if (j > (int)m_buffer.size()) 
+    if(index > m_readable)
     {
         ErrorLog << "recycleRead error";
         return;
     }
-    m_writeIndex = j;
-    adjustBuffer();
+
+    m_readable -= index;
+    while(!m_segments.empty())
+    {
+        Segment& seg = m_segments.front();
+        int n = std::min(index, seg.end - seg.begin);
+        seg.begin += n;
+        index -= n;
+
+        if(seg.begin != seg.end)
+        {
+            break;
+        }
+
+        // 全部读完了，独占的slab直接复用
+        if(index == 0 && m_readable == 0 && seg.slab->m_ref.load(std::memory_order_acquire) == 1)
+        {
+            seg.begin = 0;
+            seg.end = 0;
+            seg.cap = seg.slab->m_size;
+            break;
+        }
+        releaseSlab(seg.slab);
+        m_segments.pop_front();
+        if(index == 0 && m_readable == 0)
+        {
+            break;
+        }
+    }
 }
 
-// 把可读字符移动到readINdex之前的位置，
-void tinyrpc::TcpBuffer::adjustBuffer()
+void TcpBuffer::recucleWrite(int index)
 {
-    // 用超过1/3的容量，就往前把空白的地方填充
+    int i = firstWritable();
+    while(index > 0 && i < (int)m_segments.size())
+    {
+        Segment& seg = m_segments[i];
+        int n = std::min(index, seg.cap - seg.end);
+        seg.end += n;
+        m_readable += n;
+        index -= n;
+        ++i;
+    }
 
-    if(m_readIndex > static_cast<int>(m_buffer.size() / 3))
+    if(index > 0)
     {
-        std::vector<char> tmp(m_buffer.size());
+        ErrorLog << "recucleWrite error, " << index << " bytes out of writable space";
+    }
+}
 
-        int count = readAble();
-        // 移动到前面
-        memcpy(&tmp[0], &m_buffer[m_readIndex], count);
+TcpBufferView::TcpBufferView(TcpBuffer* buf, int offset, int len)
+: m_buf(buf), m_offset(offset), m_len(len)
+{
+}
+
+int TcpBufferView::size() const
+{
+    return m_len;
+}
 
-        m_buffer.swap(tmp);
-        m_readIndex = 0;
-        m_writeIndex = count;
+char TcpBufferView::at(int index) const
+{
+    return m_buf->at(m_offset + index);
+}
+
+int TcpBufferView::peek(int index, char* dst, int len) const
+{
+    if(index < 0 || index >= m_len)
+    {
+        return 0;
+    }
+    return m_buf->peek(m_offset + index, dst, std::min(len, m_len - index));
+}
+
+TcpBufferView TcpBufferView::subView(int index, int len) const
+{
+    index = std::max(0, std::min(index, m_len));
+    len = std::max(0, std::min(len, m_len - index));
+    return TcpBufferView(m_buf, m_offset + index, len);
+}
+
+void TcpBufferView::copyTo(std::string& out) const
+{
+    out.resize(m_len);
+    if(m_len > 0)
+    {
+        m_buf->peek(m_offset, &out[0], m_len);
     }
 }
+
+std::string TcpBufferView::toString() const
+{
+    std::string tmp;
+    copyTo(tmp);
+    return tmp;
+}
+
+int TcpBufferView::getVecs(struct iovec* vecs, int max_count) const
+{
+    return m_buf->getReadVecs(vecs, max_count, m_offset, m_len);
+}
+
+} // namespace tinyrpc
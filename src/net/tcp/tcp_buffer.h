@@ -1,61 +1,153 @@
 #ifndef SRC_NET_TCP_TCP_BUFFER_H
 #define SRC_NET_TCP_TCP_BUFFER_H
 
+#include <sys/uio.h>
+#include <atomic>
+#include <deque>
 #include <vector>
+#include <string>
 #include <memory>
 
 /*
 
-    vector作为一个buffer
-    read_index作为读位置
-    write_index作为写位置
+    分段buffer：由若干固定大小的slab链接而成
+    1. slab从每个线程自己的slab池中申请，归还也是归还到当前线程的池子，不需要加锁
+    2. 读写都使用readv/writev，跨多个slab一次系统调用完成，不再有扩容和memmove
+    3. slab带引用计数，slice/append只增加引用，已经收到的字节不会再拷贝
+    4. 不再提供连续的vector，编解码通过peek/at/find按偏移访问可读区域
+
+    每一段Segment表示某个slab中[begin, end)的数据，可读区域就是所有段顺序拼接起来
 
 */
 
 namespace tinyrpc{
 
+// slab头部，数据紧跟在头部后面
+struct BufferSlab{
+    std::atomic<int> m_ref; // 引用计数，被多个buffer共享时大于1，此时不能再往里面写
+    int m_size;             // 数据区大小
+
+    char* data()
+    {
+        return reinterpret_cast<char*>(this + 1);
+    }
+};
+
+// 线程私有的slab池，只缓存标准大小的slab
+class BufferSlabPool{
+public:
+    static BufferSlabPool* getPool();
+
+    BufferSlab* getSlab();
+
+    BufferSlab* getLargeSlab(int size); // 超过标准大小的slab，不进池子，直接malloc
+
+    void backSlab(BufferSlab* slab);
+
+private:
+    std::vector<BufferSlab*> m_free_slabs;
+};
+
 class TcpBuffer{
 public:
     typedef std::shared_ptr<TcpBuffer> ptr;
 
+    static const int SLAB_SIZE = 4096;  // 标准slab大小
+
 public:
+    // size是预留容量，第一次写入的时候才申请slab，空闲连接不占内存
     TcpBuffer(int size);
     ~TcpBuffer();
 
+    TcpBuffer(const TcpBuffer&) = delete;
+    TcpBuffer& operator=(const TcpBuffer&) = delete;
+
 public:
     int readAble();  // 可读数
-    int writeAble(); // 可写数
-
-    int readIndex() const;
-    int writeIndex() const;
+    int writeAble(); // 已经申请还没写的空间
 
     void writeToBuffer(const char* buf, int size);
+    // 预留len字节的连续可写空间，返回起始地址，写完之后用recucleWrite(len)确认
+    // 当前slab剩余空间不够就封口，换一个能放下len的slab
+    char* reserveWrite(int len);
     void readFromBuffer(std::vector<char>& re, int size);
 
-    void resizeBuffer(int size);
+    // 可读区域内偏移offset开始的len字节拷贝出来，返回实际拷贝数
+    int peek(int offset, char* dst, int len);
+    // 可读区域内偏移offset的字节
+    char at(int offset);
+    // 从offset开始查找字符c，找不到返回-1
+    int find(char c, int offset = 0);
+    // 从offset开始查找字符串，找不到返回-1
+    int find(const std::string& str, int offset = 0);
+
+    // 共享other的全部可读数据追加到后面，不拷贝字节
+    void append(TcpBuffer* other);
+    // 把可读区域[offset, offset + len)共享给out，不拷贝字节
+    void slice(int offset, int len, TcpBuffer* out);
+
+    // 填充iovec，返回使用的iovec数量
+    // 读fd之前调用，保证至少有min_size的可写空间
+    int getWriteVecs(struct iovec* vecs, int max_count, int min_size);
+    // 写fd之前调用，每个iovec对应一段可读数据
+    int getReadVecs(struct iovec* vecs, int max_count);
+    // 可读区域[offset, offset + len)对应的各段数据，不拷贝
+    int getReadVecs(struct iovec* vecs, int max_count, int offset, int len);
 
     void clearBuffer();
-    int getSize();
+    int getSize();  // 已经申请的slab总容量
 
-    std::vector<char> getBufferVector();
+    std::vector<char> getBufferVector(); // 可读区域的拷贝
     std::string getBufferString();
 
-    void recycleRead(int index);
-    void recucleWrite(int index);
+    void recycleRead(int index);   // 消费index个可读字节
+    void recucleWrite(int index);  // 确认写入了index个字节
+
+private:
+    struct Segment{
+        BufferSlab* slab;
+        int begin;
+        int end;
+        int cap;    // 这一段最多写到哪里，封口之后等于end
+    };
 
-    void adjustBuffer();
+    static void releaseSlab(BufferSlab* slab);
 
+    int firstWritable();
+    void appendSegment(BufferSlab* slab, int begin, int end);
+
+private:
+    std::deque<Segment> m_segments;
+    int m_readable {0};
+};
 
+
+// 可读区域上的一段只读视图，类似string_view，不拥有也不拷贝数据
+// 数据可能跨多个slab，访问都转发给TcpBuffer按偏移查找
+// buffer被recycleRead之后视图失效，所以只在一次解码的过程中使用
+class TcpBufferView{
 public:
-    std::vector<char> m_buffer;
+    TcpBufferView(TcpBuffer* buf, int offset, int len);
+
+    int size() const;
+    char at(int index) const;
+    int peek(int index, char* dst, int len) const;
+
+    TcpBufferView subView(int index, int len) const;
+
+    void copyTo(std::string& out) const; // 只在需要落地成string的时候拷贝一次
+    std::string toString() const;
+
+    int getVecs(struct iovec* vecs, int max_count) const;
+
 private:
-    int m_readIndex {0};
-    int m_writeIndex {0};
+    TcpBuffer* m_buf {nullptr};
+    int m_offset {0};
+    int m_len {0};
 };
 
-    
 } // namespace tinyrpc
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -77,14 +77,15 @@ void TcpClient::resetFd()
 // 使用协程进行收发,发送的是远程调用，接受的是回复的结果包
 int TcpClient::sendAndRecvTinyPb(const std::string &msg_no, TinyPbStruct::pb_ptr &res)
 {
-    bool is_timeout = false;
+    // 超时回调在主协程里执行，协程栈可能已经被换出去了(共享栈)，标志放在堆上
+    std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
     // 拿出当前客户端使用的协程，设置回调函数，加入到超时事件中，如果时间到了触发读写事件，执行回调函数唤醒协程
     tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::getCurrentCoroutine();
 
-    auto timer_cb = [this, &is_timeout, cur_cor]()
+    auto timer_cb = [this, is_timeout, cur_cor]()
     {
         InfoLog << "TcpClient timer out event occur";
-        is_timeout = true;
+        *is_timeout = true;
         this->m_connection->setOverTimeFlag(true);
         tinyrpc::Coroutine::Resume(cur_cor);
     };
@@ -93,51 +94,28 @@ int TcpClient::sendAndRecvTinyPb(const std::string &msg_no, TinyPbStruct::pb_ptr
     m_reactor->getTimer()->addTimerEvent(event);
     DebugLog << "add rpc timer event, timeout on " << event->m_arrive_time;
 
-    // 执行，直到超时或者连接出错
-    while(!is_timeout)
+    // 执行，直到超时或者连接出错，从连接池拿到的连接已经是连接状态，直接跳过
+    while(!*is_timeout)
     {
         DebugLog << "begin to connect";
-        // 进行connect，使用前判断状态，并且使用hook
-        if(m_connection->getState() != Connected)
+        int rt = connect();
+        if(rt == 0)
         {
-            int rt = connect_hook(m_fd, reinterpret_cast<sockaddr*>(m_peer_addr->getSockAddr()), m_peer_addr->getSockLen());
-            if(rt == 0) // 没有阻塞，直接连接成功了
-            {
-                DebugLog << "connect [" << m_peer_addr->toString() << "] succ!";
-                m_connection->setUpClient(); // 设置已连接状态
-                break;
-            }
-
-            // 下面是阻塞状态，没有连接成功
-            resetFd(); // 失败关闭，重新创建
-            if(is_timeout) // 连接超时，goto跳转
-            {
-                InfoLog << "connect timeout, break";
-                goto err_deal;
-            }
-            if(errno == ECONNREFUSED) // 拒绝连接，可能地址啥的错了
-            {
-                std::stringstream ss;
-                ss << "connect error, peer[ " << m_peer_addr->toString() << "] closed";
-                m_err_info = ss.str();
-                ErrorLog << "cancle overtime event, err info=" << m_err_info;
-                // 出错了，删除之前的event
-                m_reactor->getTimer()->delTimerEvent(event);
-                return ERROR_PEER_CLOSED;
-            }
-            if(errno == EAFNOSUPPORT) // 使用了和定义的协议不相同的地址，比如ipv4用到了ipv6地址
-            {
-                std::stringstream ss;
-                ss << "connect cur sys ror, errinfo is " << std::string(strerror(errno)) <<  " ] closed.";
-                m_err_info = ss.str();
-                ErrorLog << "cancle overtime event, err info=" << m_err_info;
-                m_reactor->getTimer()->delTimerEvent(event);
-                return ERROR_CONNECT_SYS_ERR;
-            }
+            break;
         }
-        else // 已经连接，跳出
+
+        if(*is_timeout) // 连接超时，goto跳转
         {
-            break;
+            InfoLog << "connect timeout, break";
+            goto err_deal;
+        }
+        // 拒绝连接或者地址错误，不用再重试了
+        if(rt == ERROR_PEER_CLOSED || rt == ERROR_CONNECT_SYS_ERR)
+        {
+            ErrorLog << "cancle overtime event, err info=" << m_err_info;
+            // 出错了，删除之前的event
+            m_reactor->getTimer()->delTimerEvent(event);
+            return rt;
         }
     }
 
@@ -161,7 +139,7 @@ int TcpClient::sendAndRecvTinyPb(const std::string &msg_no, TinyPbStruct::pb_ptr
     if (m_connection->getOverTimerFlag()) 
     {
         InfoLog << "send data over time";
-        is_timeout = true;
+        *is_timeout = true;
         goto err_deal;
     }
 
@@ -173,7 +151,7 @@ int TcpClient::sendAndRecvTinyPb(const std::string &msg_no, TinyPbStruct::pb_ptr
         if(m_connection->getOverTimerFlag())
         {
             InfoLog << "read data over time";
-            is_timeout = true;
+            *is_timeout = true;
             goto err_deal;
         }
 
@@ -199,7 +177,7 @@ err_deal:
 
     m_fd = socket(AF_INET, SOCK_STREAM, 0);
     std::stringstream ss;
-    if(is_timeout) // 是因为超时链接失败的
+    if(*is_timeout) // 是因为超时链接失败的
     {
         ss << "call rpc falied , over " << m_max_timeout << "ms";
         m_err_info = ss.str();
@@ -216,6 +194,47 @@ err_deal:
     
 }
 
+// 连接对端，已经连接直接返回0
+// 失败会重新创建socket，返回错误码，错误信息在m_err_info
+int TcpClient::connect()
+{
+    if(getConnection()->getState() == Connected)
+    {
+        return 0;
+    }
+
+    int rt = connect_hook(m_fd, reinterpret_cast<sockaddr*>(m_peer_addr->getSockAddr()), m_peer_addr->getSockLen());
+    if(rt == 0) // 没有阻塞，直接连接成功了
+    {
+        DebugLog << "connect [" << m_peer_addr->toString() << "] succ!";
+        m_connection->setUpClient(); // 设置已连接状态
+        m_connect_suncc = true;
+        return 0;
+    }
+
+    // 下面是阻塞状态，没有连接成功，resetFd会改掉errno，先保存
+    int err = errno;
+    resetFd(); // 失败关闭，重新创建
+
+    std::stringstream ss;
+    if(err == ECONNREFUSED) // 拒绝连接，可能地址啥的错了
+    {
+        ss << "connect error, peer[ " << m_peer_addr->toString() << "] closed";
+        m_err_info = ss.str();
+        return ERROR_PEER_CLOSED;
+    }
+    if(err == EAFNOSUPPORT) // 使用了和定义的协议不相同的地址，比如ipv4用到了ipv6地址
+    {
+        ss << "connect cur sys ror, errinfo is " << std::string(strerror(err)) <<  " ] closed.";
+        m_err_info = ss.str();
+        return ERROR_CONNECT_SYS_ERR;
+    }
+
+    ss << "connect peer addr[" << m_peer_addr->toString() << "] error. sys error=" << strerror(err);
+    m_err_info = ss.str();
+    return ERROR_FAILED_CONNECT;
+}
+
 void TcpClient::stop()
 {
     if(!m_is_stop)
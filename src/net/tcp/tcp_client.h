@@ -29,6 +29,9 @@ public:
 
     void resetFd();
 
+    // 连接对端，已经连接直接返回0
+    int connect();
+
     int sendAndRecvTinyPb(const std::string& msg_no, TinyPbStruct::pb_ptr& res);
 
     void stop();
@@ -65,6 +68,11 @@ public:
         return m_codec;
     }
 
+    int getFd() const
+    {
+        return m_fd;
+    }
+
 
 private:
     int m_family {0};  // socket使用的协议族
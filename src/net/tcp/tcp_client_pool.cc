@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <sys/socket.h>
+#include "src/net/tcp/tcp_client_pool.h"
+#include "src/net/tcp/tcp_connection.h"
+#include "src/net/reactor.h"
+#include "src/net/fd_event.h"
+#include "src/net/io_uring.h"
+#include "src/comm/config.h"
+#include "src/comm/clock.h"
+#include "src/comm/log.h"
+
+
+namespace tinyrpc{
+
+extern tinyrpc::Config::ptr gRpcConfig;
+
+// 每个线程自己的连接池，连接上的FdEvent也只在本线程的reactor中使用
+static thread_local TcpClientPool* t_client_pool_ptr = nullptr;
+
+TcpClientPool* getTcpClientPool()
+{
+    if(!t_client_pool_ptr)
+    {
+        // 客户端程序可以不加载配置，使用默认值
+        if(gRpcConfig)
+        {
+            t_client_pool_ptr = new TcpClientPool(gRpcConfig->m_client_pool_max_per_host, gRpcConfig->m_client_pool_max_idle_time);
+        }
+        else
+        {
+            t_client_pool_ptr = new TcpClientPool(8, 60000);
+        }
+    }
+    return t_client_pool_ptr;
+}
+
+
+TcpClientPool::TcpClientPool(int max_per_host, int max_idle_time)
+: m_max_per_host(max_per_host), m_max_idle_time(max_idle_time)
+{
+}
+
+TcpClientPool::~TcpClientPool()
+{
+    if(m_evict_event)
+    {
+        Reactor::getReactor()->getTimer()->delTimerEvent(m_evict_event);
+    }
+}
+
+TcpClient::ptr TcpClientPool::lease(NetAddress::ptr addr)
+{
+    HostEntry& entry = m_hosts[addr->toString()];
+    int64_t now = Clock::nowMs();
+
+    // 从最近归还的开始拿，前面的空闲更久，最先过期
+    while(!entry.idle.empty())
+    {
+        IdleClient idle_client = entry.idle.back();
+        entry.idle.pop_back();
+
+        if(!isExpired(idle_client, now) && isHealthy(idle_client.client))
+        {
+            ++entry.leased;
+            DebugLog << "lease pooled client, fd=" << idle_client.client->getFd() << ", peer=" << addr->toString();
+            return idle_client.client;
+        }
+        DebugLog << "drop pooled client, fd=" << idle_client.client->getFd() << ", peer=" << addr->toString();
+    }
+
+    // 没有可用的空闲连接，新建，第一次发送的时候再连接
+    ++entry.leased;
+    return std::make_shared<TcpClient>(addr);
+}
+
+void TcpClientPool::release(TcpClient::ptr client, bool reusable)
+{
+    auto it = m_hosts.find(client->getPeerAddr()->toString());
+    if(it == m_hosts.end())
+    {
+        ErrorLog << "release client not leased from this pool, peer=" << client->getPeerAddr()->toString();
+        return;
+    }
+
+    HostEntry& entry = it->second;
+    if(entry.leased > 0)
+    {
+        --entry.leased;
+    }
+
+    // client析构的时候关闭fd
+    if(!reusable || client->getConnection()->getState() != Connected)
+    {
+        DebugLog << "client not reusable, close it, fd=" << client->getFd();
+        return;
+    }
+    addIdle(entry, client);
+}
+
+int TcpClientPool::warmUp(NetAddress::ptr addr, int count)
+{
+    HostEntry& entry = m_hosts[addr->toString()];
+    int succ = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        if(static_cast<int>(entry.idle.size()) + entry.leased >= m_max_per_host)
+        {
+            break;
+        }
+
+        TcpClient::ptr client = std::make_shared<TcpClient>(addr);
+        int rt = client->connect();
+        if(rt != 0)
+        {
+            ErrorLog << "warm up connection failed, peer=" << addr->toString() << ", err info=" << client->getErrInfo();
+            break;
+        }
+        addIdle(entry, client);
+        ++succ;
+    }
+
+    InfoLog << "warm up " << succ << " connections to " << addr->toString();
+    return succ;
+}
+
+void TcpClientPool::evictIdle()
+{
+    int64_t now = Clock::nowMs();
+    for(auto it = m_hosts.begin(); it != m_hosts.end();)
+    {
+        std::vector<IdleClient>& idle = it->second.idle;
+
+        // 按归还时间排序的，过期的都在前面
+        size_t expired = 0;
+        while(expired < idle.size() && isExpired(idle[expired], now))
+        {
+            ++expired;
+        }
+        if(expired > 0)
+        {
+            DebugLog << "evict " << expired << " idle clients, peer=" << it->first;
+            idle.erase(idle.begin(), idle.begin() + expired);
+        }
+
+        if(idle.empty() && it->second.leased == 0)
+        {
+            it = m_hosts.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+int TcpClientPool::getIdleCount(NetAddress::ptr addr)
+{
+    auto it = m_hosts.find(addr->toString());
+    return it == m_hosts.end() ? 0 : static_cast<int>(it->second.idle.size());
+}
+
+int TcpClientPool::getLeasedCount(NetAddress::ptr addr)
+{
+    auto it = m_hosts.find(addr->toString());
+    return it == m_hosts.end() ? 0 : it->second.leased;
+}
+
+// 空闲连接不在epoll中，对端关闭或者发来了多余的数据(比如超时调用的迟到回复)，都只能通过非阻塞的peek发现
+bool TcpClientPool::isHealthy(TcpClient::ptr client)
+{
+    if(client->getFd() < 0 || client->getConnection()->getState() != Connected)
+    {
+        return false;
+    }
+
+    // io_uring模式下multishot recv一直挂着，多余的数据和EOF已经被收到provided buffer里了
+    FdEvent::ptr fd_event = FdEventContainer::getFdContainer()->getFdEvent(client->getFd());
+    if(IoUring::hasInput(fd_event->getIoUringOp()))
+    {
+        return false;
+    }
+
+    char c;
+    int rt = recv(client->getFd(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if(rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return true;
+    }
+    // rt == 0 对端已经关闭，rt > 0 有不属于任何调用的数据
+    return false;
+}
+
+bool TcpClientPool::isExpired(const IdleClient& idle_client, int64_t now)
+{
+    return m_max_idle_time > 0 && now - idle_client.idle_since >= m_max_idle_time;
+}
+
+void TcpClientPool::addIdle(HostEntry& entry, TcpClient::ptr client)
+{
+    if(static_cast<int>(entry.idle.size()) + entry.leased >= m_max_per_host)
+    {
+        DebugLog << "pool of " << client->getPeerAddr()->toString() << " is full, close client, fd=" << client->getFd();
+        return;
+    }
+    IdleClient idle_client;
+    idle_client.client = client;
+    idle_client.idle_since = Clock::nowMs();
+    entry.idle.push_back(idle_client);
+
+    // 周期性清理，间隔是空闲超时的一半，连接最多多存活半个周期
+    if(!m_evict_event && m_max_idle_time > 0)
+    {
+        int64_t interval = m_max_idle_time / 2 > 0 ? m_max_idle_time / 2 : 1;
+        m_evict_event = std::make_shared<TimerEvent>(interval, true, std::bind(&TcpClientPool::evictIdle, this));
+        Reactor::getReactor()->getTimer()->addTimerEvent(m_evict_event);
+    }
+}
+
+} // namespace tinyrpc
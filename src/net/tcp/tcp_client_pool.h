@@ -0,0 +1,84 @@
+// 客户端连接池，复用到同一个地址的TcpClient
+#ifndef SRC_NET_TCP_TCP_CLIENT_POOL_H
+#define SRC_NET_TCP_TCP_CLIENT_POOL_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "src/net/net_address.h"
+#include "src/net/timer.h"
+#include "src/net/tcp/tcp_client.h"
+
+/*
+
+    每个线程一个连接池，只在本线程使用，不需要加锁
+    1. 按NetAddress::toString()分组，lease优先拿最近归还的空闲连接(LIFO)，没有就新建一个TcpClient
+    2. lease的时候做健康检查：连接状态不是Connected，或者非阻塞MSG_PEEK读到了EOF/多余数据，直接丢弃
+    3. 空闲超过max_idle_time的连接在lease的时候丢弃，另外reactor定时器周期性清理
+    4. 每个地址保留的连接数(空闲 + 使用中)不超过max_per_host，超过的部分用完直接关闭
+    5. warmUp在启动的时候预先建立连接，第一次调用不需要等connect
+
+    调用失败(超时、对端关闭、解码出错)的连接状态不确定，release的时候reusable传false，直接关闭
+
+*/
+
+namespace tinyrpc{
+
+class TcpClientPool{
+
+public:
+    // max_per_host <= 0 表示不缓存连接，max_idle_time <= 0 表示空闲连接不过期
+    TcpClientPool(int max_per_host, int max_idle_time);
+    ~TcpClientPool();
+
+public:
+    // 拿一个到addr的客户端，可能还没有连接，sendAndRecvTinyPb里面会连接
+    TcpClient::ptr lease(NetAddress::ptr addr);
+
+    // 归还，reusable为false或者超过上限就关闭
+    void release(TcpClient::ptr client, bool reusable);
+
+    // 预先建立count个连接放到空闲列表，返回成功建立的个数
+    int warmUp(NetAddress::ptr addr, int count);
+
+    // 关闭空闲超时的连接，定时器调用
+    void evictIdle();
+
+    int getIdleCount(NetAddress::ptr addr);
+
+    int getLeasedCount(NetAddress::ptr addr);
+
+private:
+    struct IdleClient{
+        TcpClient::ptr client;
+        int64_t idle_since {0};  // 归还的时间, ms
+    };
+
+    struct HostEntry{
+        std::vector<IdleClient> idle;  // 尾部是最近归还的
+        int leased {0};                // 借出去还没归还的
+    };
+
+    bool isHealthy(TcpClient::ptr client);
+
+    bool isExpired(const IdleClient& idle_client, int64_t now);
+
+    void addIdle(HostEntry& entry, TcpClient::ptr client);
+
+private:
+    int m_max_per_host {0};
+    int m_max_idle_time {0};  // ms
+
+    std::map<std::string, HostEntry> m_hosts;
+
+    TimerEvent::ptr m_evict_event {nullptr};  // 第一次有空闲连接的时候才注册
+};
+
+// 当前线程的连接池
+TcpClientPool* getTcpClientPool();
+
+} // namespace tinyrpc
+
+
+#endif
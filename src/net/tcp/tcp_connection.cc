@@ -1,6 +1,10 @@
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 #include "src/net/tcp/tcp_connection.h"
 #include "src/net/tcp/tcp_server.h"
 #include "src/net/tcp/tcp_client.h"
@@ -11,11 +15,18 @@
 #include "src/net/tcp/tcp_connection_time_wheel.h"
 #include "src/net/tcp/abstract_slot.h"
 #include "src/net/timer.h"
+#include "src/comm/config.h"
+#include "src/comm/clock.h"
 #include "tcp_connection.h"
 
 
 namespace tinyrpc{
 
+extern tinyrpc::Config::ptr gRpcConfig;
+
+// 一次readv/writev最多使用的iovec数量
+static const int MAX_IOVEC_COUNT = 64;
+
 // 服务端初始化tcp连接，需要创建一个新的Reactor，从线程池中拿出来的
 tinyrpc::TcpConnection::TcpConnection(tinyrpc::TcpServer *tcp_svr, tinyrpc::IOThread *io_thread, int fd, int buff_size, NetAddress::ptr peer_addr)
 :m_io_thread(io_thread), m_fd(fd), m_state(Connected), m_connection_type(ServerConnection), m_peer_addr(peer_addr)
@@ -35,8 +46,24 @@ tinyrpc::TcpConnection::TcpConnection(tinyrpc::TcpServer *tcp_svr, tinyrpc::IOTh
     // buffer初始化，设置初始化大小
     initBuffer(buff_size);
 
+    if(gRpcConfig)
+    {
+        m_coalesce_max_bytes = gRpcConfig->m_coalesce_max_bytes;
+        m_coalesce_max_delay = gRpcConfig->m_coalesce_max_delay;
+        m_fresh_inteval = static_cast<int64_t>(gRpcConfig->m_timewheel_inteval) * 1000;
+    }
+
+    // 回复已经在execute中合并了，关闭Nagle，否则提前发送之后剩下的回复要等对端的ACK
+    int flag = 1;
+    if(setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0)
+    {
+        ErrorLog << "set TCP_NODELAY error, fd=" << m_fd << ", sys error=" << strerror(errno);
+    }
+
     // 3.设置循环协程，这个协程的作用是进行rpc内容的传输和读取，同步写法异步调用，具体看流程图
-    m_loop_cor = getCoroutinePool()->getCoroutineInstanse();
+    // 配置了共享栈就用共享栈，io_uring的写和连接把请求放在协程栈上等完成，栈不能被换出去，不用共享栈
+    bool share_stack = gRpcConfig && gRpcConfig->m_conn_share_stack && !gRpcConfig->m_reactor_io_uring;
+    m_loop_cor = getCoroutinePool()->getCoroutineInstanse(share_stack);
 
     DebugLog << "succ create tcp connection[" << m_state << "], fd=" << fd;
 }
@@ -154,25 +181,49 @@ void TcpConnection::input()
     int count = 0;
     while(!read_all)
     {
-        // 1. 读buffer不够，扩容2倍
-        if(m_read_buffer->writeAble() == 0)
+        // 1. 保证至少有一个slab的可写空间，readv一次读到多个slab中，不需要扩容
+        struct iovec vecs[MAX_IOVEC_COUNT];
+        int vec_count = m_read_buffer->getWriteVecs(vecs, MAX_IOVEC_COUNT, TcpBuffer::SLAB_SIZE);
+        int read_count = 0;
+        for(int i = 0; i < vec_count; ++i)
         {
-            m_read_buffer->resizeBuffer(2 * m_read_buffer->getSize());
+            read_count += vecs[i].iov_len;
         }
 
-        int read_count = m_read_buffer->writeAble();
-        int write_index = m_read_buffer->writeIndex();
-
-        DebugLog << "m_read_buffer size=" << m_read_buffer->getBufferVector().size() << "rd=" << m_read_buffer->readIndex() << "wd=" << m_read_buffer->writeIndex();
-        // 2. 使用read_hook，尝试读一遍，读不完就进行协程yield()
-        int rt = read_hook(m_fd, &(m_read_buffer->m_buffer[write_index]), read_count);
-            // 有数据返回，将缓冲区调整一下，利用没有用的空间
-        // std::cout << "input::read = " << rt << std::endl; 可以读取
+        DebugLog << "m_read_buffer size=" << m_read_buffer->getSize() << ", readable=" << m_read_buffer->readAble() << ", writeable=" << read_count;
+        // 2. 第一次使用readv_hook，没有数据就进行协程yield()
+        // 之后是上一次把缓冲区读满了，socket里面不一定还有数据，直接非阻塞读
+        // 不能再yield等待，流水线的客户端要等回复之后才会继续发送
+        int rt = 0;
+        if(count == 0)
+        {
+            rt = readv_hook(m_fd, vecs, vec_count);
+        }
+        else
+        {
+            // 客户端在主线程中使用的时候fd是阻塞的，用MSG_DONTWAIT保证这里不会阻塞
+            // io_uring模式下先取multishot recv已经收到的数据
+            rt = readvNoWait(m_fd, vecs, vec_count);
+            if(rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                DebugLog << "no more data in socket buffer";
+                m_fd_event->clearReady(READ); // 边缘触发模式下次直接等待可读事件
+                read_all = true;
+                break;
+            }
+        }
+        if(count == 0 && rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // 协程不是因为可读被唤醒的(io_uring下被定时器唤醒也是这样)，连接没有问题，下次再读
+            DebugLog << "wake up without data, fd=" << m_fd;
+            read_all = true;
+            break;
+        }
         if(rt > 0)
         {
             m_read_buffer->recucleWrite(rt);
         }
-        DebugLog << "m_read_buffer size=" << m_read_buffer->getBufferVector().size() << "rd=" << m_read_buffer->readIndex() << "wd=" << m_read_buffer->writeIndex();
+        DebugLog << "m_read_buffer size=" << m_read_buffer->getSize() << ", readable=" << m_read_buffer->readAble();
 
         DebugLog << "read data back, fd=" << m_fd;
         count += rt;
@@ -191,7 +242,7 @@ void TcpConnection::input()
             close_flag = true;
             break;
         } 
-        else if(rt == read_count)  // 这次读缓冲区全部读满了，不能判断是不是后面还有数据，需要再次循环，开头会进行扩容
+        else if(rt == read_count)  // 这次读缓冲区全部读满了，不能判断是不是后面还有数据，需要再次循环，开头会申请新的slab
         {
             DebugLog << "read_count == rt";
             // this is possible read more data, should continue read
@@ -225,12 +276,15 @@ void TcpConnection::input()
     }
     InfoLog << "recv [" << count << "] bytes data from [" << m_peer_addr->toString() << "], fd [" << m_fd << "]";
 
-    if(m_connection_type == ServerConnection)
+    // 刷新时间轮要唤醒主reactor，时间轮的精度就是一个inteval，一个inteval内刷新一次就够了
+    int64_t now = Clock::nowMs();
+    if(m_connection_type == ServerConnection && now - m_last_fresh_time >= m_fresh_inteval)
     {
         // 刷新时间轮，也就是给链接添加一个新的时间
         TcpTimeWheel::TcpConnectionSlot::ptr tmp = m_weak_slot.lock(); // 升级成shard_ptr
         if(tmp)
         {
+            m_last_fresh_time = now;
             m_tcp_svr->freshTcpConnection(tmp);
         }
     }
@@ -238,8 +292,13 @@ void TcpConnection::input()
 
 // rpc内容解码
 // 分为两种解码方式，也分为服务端和客户端
+// 一次input()可能读到客户端流水线发来的多个请求，这里全部解码分发
+// 回复都编码到m_write_buffer中，最后由output()一次writev发出去
+// 待发送的回复太多，或者这一批处理太久，就提前发送一次，避免前面的回复等待太久
 void TcpConnection::execute()
 {
+    int64_t batch_begin = 0; // 这一批还没发送的回复中，第一个请求开始处理的时间，ns，一轮循环内的间隔要用高精度时钟
+
     // 1. 有内容读才进行解析
     while(m_read_buffer->readAble() > 0)
     {
@@ -253,18 +312,47 @@ void TcpConnection::execute()
         }
             
         
+        TinyPbStruct* pb_data = dynamic_cast<TinyPbStruct*>(data.get());
+        if(pb_data)
+        {
+            pb_data->use_checksum = m_checksum_negotiated;
+        }
+
         // 3. 解码
+        int readable = m_read_buffer->readAble();
         m_codec->decode(m_read_buffer.get(), data.get());
         if(!data->decode_succ)
         {
             ErrorLog << "it parse request error of fd " << m_fd;
+            // 损坏的包已经被丢弃了，继续解析后面的包；没有消费说明包还没收完整
+            if(m_read_buffer->readAble() < readable)
+            {
+                continue;
+            }
             break;
         }
 
+        if(pb_data && pb_data->use_checksum)
+        {
+            m_checksum_negotiated = true;
+        }
+
         // 4. 判断客户端和服务端
         if(m_connection_type == ServerConnection)
         {
+            if(batch_begin == 0)
+            {
+                batch_begin = Clock::preciseNs();
+            }
             m_tcp_svr->getDispatcher()->dispatcher(data.get(), this); // 分发处理客户端请求，使用本conn发送出去
+
+            if(m_write_buffer->readAble() >= m_coalesce_max_bytes
+                || Clock::preciseNs() - batch_begin >= m_coalesce_max_delay * 1000)
+            {
+                DebugLog << "coalesced reply reach limit, flush " << m_write_buffer->readAble() << " bytes";
+                output();
+                batch_begin = 0;
+            }
         }
         else if(m_connection_type == ClientConnection)
         {
@@ -300,20 +388,21 @@ void TcpConnection::output()
             break;
         }
 
-        int total_size = m_write_buffer->readAble();
-        int read_index = m_write_buffer->readIndex();
-        // 3. 使用write_hook使用协程异步
-        int rt = write_hook(m_fd, &(m_write_buffer->m_buffer[read_index]), total_size);
+        // 3. 可读数据分布在多个slab中，使用writev_hook一次发送
+        struct iovec vecs[MAX_IOVEC_COUNT];
+        int vec_count = m_write_buffer->getReadVecs(vecs, MAX_IOVEC_COUNT);
+        int rt = writev_hook(m_fd, vecs, vec_count);
         // 写出错
         if(rt <= 0)
         {
             ErrorLog << "write empty, error=" << strerror(errno);
+            break;
         }
 
-        // 写成功，调整缓冲区
+        // 写成功，发送完的slab直接归还
         DebugLog << "succ write " << rt << " bytes";
         m_write_buffer->recycleRead(rt);
-        DebugLog << "recycle write index =" << m_write_buffer->writeIndex() << ", read_index =" << m_write_buffer->readIndex() << "readable = " << m_write_buffer->readAble();
+        DebugLog << "readable = " << m_write_buffer->readAble();
         InfoLog << "send[" << rt << "] bytes data to [" << m_peer_addr->toString() << "], fd [" << m_fd << "]";
         // 判断是不是全部发送完了，没有发送完可读数据应该还有
         if(m_write_buffer->readAble() <= 0)
@@ -347,6 +436,19 @@ void TcpConnection::clearClient()
     // 主循环函数暂停
     m_stop = true;
 
+    // 服务端的连接在自己的协程里关闭，fd号关闭之后马上会被accept复用，addClient和clearClientTimerFunc会析构这个连接、
+    // 把协程还给协程池给新连接用，但是这个协程还没有yield。所以等回到reactor的loop里再关闭fd、设置Closed
+    if(m_connection_type == ServerConnection)
+    {
+        TcpConnection::ptr self = shared_from_this();
+        m_reactor->addTask([self]()
+        {
+            close(self->m_fd_event->getFd());
+            self->setState(Closed);
+        }, false);
+        return;
+    }
+
     //关闭fd
     close(m_fd_event->getFd());
     setState(Closed);
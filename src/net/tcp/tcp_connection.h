@@ -136,6 +136,14 @@ private:
 
     bool m_is_over_time {false};
 
+    bool m_checksum_negotiated {false}; // 收到过CRC32C校验通过的包，之后的包都必须校验
+
+    int m_coalesce_max_bytes {64 * 1024}; // 回复合并发送的字节上限
+    int64_t m_coalesce_max_delay {1000};  // 回复合并发送的时间上限，us
+
+    int64_t m_fresh_inteval {0};     // 两次刷新时间轮的最小间隔，ms
+    int64_t m_last_fresh_time {0};   // 上次刷新时间轮的时间，ms
+
     std::map<std::string, std::shared_ptr<TinyPbStruct>> m_reply_datas; // 通过本地rpc事务操作获得的远程函数调用的结果，通过output发送
 
     std::weak_ptr<AbstractSlot<TcpConnection>> m_weak_slot; //一个tcp连接抽象槽，目的是为了实现时间轮，共享指针引用计数，每次有新连接就升级成shard_ptr加入槽
@@ -28,7 +28,7 @@ TcpAcceptor::TcpAcceptor(NetAddress::ptr net_addr)
 }
 
 // socket , bind, listen
-void TcpAcceptor::init()
+void TcpAcceptor::init(bool reuse_port /*=false*/)
 {
     // 1. 创建socket fd
     m_fd = socket(m_local_addr->getFamily(), SOCK_STREAM, 0);
@@ -48,6 +48,13 @@ void TcpAcceptor::init()
         ErrorLog << "set REUSEADDR error!";
     }
 
+    // 多个listen fd绑定同一个地址，每个IO线程一个，内核按四元组hash分配新连接
+    if(reuse_port && setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) < 0)
+    {
+        ErrorLog << "start server error. set REUSEPORT error, sys error=" << strerror(errno);
+        Exit(0);
+    }
+
     // 3. bind 正确返回0  传入地址和地址长度
     socklen_t len = m_local_addr->getSockLen();
     int rt = bind(m_fd, m_local_addr->getSockAddr(), len);
@@ -60,7 +67,8 @@ void TcpAcceptor::init()
     DebugLog << "set REUSEADDR succ";
 
     // 4. listen 设置监听数，但只是建议的数量，实际会多点
-    rt = listen(m_fd, 10);
+    // 连接风暴的时候10太小，半连接和全连接队列满了客户端就要重传SYN
+    rt = listen(m_fd, SOMAXCONN);
     if (rt != 0) 
     {
         ErrorLog << "start server error. listen error, fd= " << m_fd << ", errno=" << errno << ", error=" << strerror(errno);
@@ -157,6 +165,8 @@ TcpServer::TcpServer(NetAddress::ptr addr, ProtocalType type /*= TinyPb_Protocal
     m_main_reactor = tinyrpc::Reactor::getReactor();
     m_main_reactor->setReactorType(MainReactor);
 
+    m_reuse_port = gRpcConfig->m_server_reuse_port;
+
 
     // 设置时间轮，在reactor上运行，设置槽数和删除间隔
     m_time_wheel = std::make_shared<TcpTimeWheel>(m_main_reactor, gRpcConfig->m_timewheel_bucket_num, gRpcConfig->m_timewheel_inteval); // 连接时间轮
@@ -170,16 +180,51 @@ TcpServer::TcpServer(NetAddress::ptr addr, ProtocalType type /*= TinyPb_Protocal
 
 void TcpServer::start()
 {
-    m_acceptor.reset(new TcpAcceptor(m_addr));
-    // 初始化，socket,bind,listen
-    m_acceptor->init();
-    // 设置任务协程
-    m_accept_cor = getCoroutinePool()->getCoroutineInstanse();
-    m_accept_cor->setCallBack(std::bind(&TcpServer::mainAcceptCorFunc, this));
+    if(m_reuse_port)
+    {
+        // 每个IO线程一个listen fd，先在这里全部listen，线程启动之后各自accept，不经过主reactor转交
+        for(int i = 0; i < m_io_pool->getIOThreadPoolSize(); ++i)
+        {
+            TcpAcceptor::ptr acceptor = std::make_shared<TcpAcceptor>(m_addr);
+            acceptor->init(true);
+            m_io_acceptors.push_back(acceptor);
+        }
+        m_io_pool->addCoroutineToEachThread(std::bind(&TcpServer::ioAcceptCorFunc, this));
+
+        InfoLog << "accept on " << m_io_acceptors.size() << " io threads with SO_REUSEPORT";
+    }
+    else
+    {
+        m_acceptor.reset(new TcpAcceptor(m_addr));
+        // 初始化，socket,bind,listen
+        m_acceptor->init();
+        // 设置任务协程
+        m_accept_cor = getCoroutinePool()->getCoroutineInstanse();
+        m_accept_cor->setCallBack(std::bind(&TcpServer::mainAcceptCorFunc, this));
 
-    InfoLog << "resume accept coroutine";
+        InfoLog << "resume accept coroutine";
+
+        tinyrpc::Coroutine::Resume(m_accept_cor.get()); // 直接执行
+    }
+    // 有方法注册成在工作线程执行才创建工作线程池
+    TinyPbRpcDispacther* dispatcher = dynamic_cast<TinyPbRpcDispacther*>(m_dispatcher.get());
+    if(dispatcher && dispatcher->hasWorkerMethod())
+    {
+        if(gRpcConfig->m_worker_thread_num > 0)
+        {
+            m_worker_pool = std::make_shared<WorkerThreadPool>(gRpcConfig->m_worker_thread_num);
+            m_worker_pool->start();
+            dispatcher->setWorkerThreadPool(m_worker_pool);
+
+            m_worker_stats_timer_event = std::make_shared<TimerEvent>(10000, true, std::bind(&TcpServer::workerStatsTimerFunc, this));
+            m_main_reactor->getTimer()->addTimerEvent(m_worker_stats_timer_event);
+        }
+        else
+        {
+            InfoLog << "worker_thread_num is 0, worker methods run in io coroutine";
+        }
+    }
 
-    tinyrpc::Coroutine::Resume(m_accept_cor.get()); // 直接执行
     //唤醒start信号量，执行子reactor的loop。负责连接
     m_io_pool->start();
     // 执行主reactor的loop，只负责监听
@@ -189,7 +234,8 @@ void TcpServer::start()
 TcpServer::~TcpServer()
 {
     // 归还accept协程
-    getCoroutinePool()->returnCoroutine(m_accept_cor);
+    if(m_accept_cor)
+        getCoroutinePool()->returnCoroutine(m_accept_cor);
     DebugLog << "~TcpServer";
 }
 
@@ -205,8 +251,9 @@ void TcpServer::freshTcpConnection(TcpTimeWheel::TcpConnectionSlot::ptr slot)
 }
 
 // 添加客户端分为两步：1、之前连接过的客户端，取消链接，建立新链接，2、新的就直接创建连接
-TcpConnection::ptr TcpServer::addClient(IOThread *io_thread, int fd)
+TcpConnection::ptr TcpServer::addClient(IOThread *io_thread, int fd, NetAddress::ptr peer_addr)
 {
+    Mutex::Lock lock(m_clients_mutex);
     //1 .查找客户端是否存在，存在就取消之前的连接，创建新链接
     auto it = m_clients.find(fd);
     if(it != m_clients.end())
@@ -215,7 +262,7 @@ TcpConnection::ptr TcpServer::addClient(IOThread *io_thread, int fd)
         it->second.reset();
         // 设置新连接
         DebugLog << "fd" << fd << "have exist, reset it";
-        it->second = std::make_shared<TcpConnection>(this, io_thread, fd, 128, getPeerAddr()); // 在tcpconnection构造中，使用io_thread拿出一个reactor，每个线程都管理一个
+        it->second = std::make_shared<TcpConnection>(this, io_thread, fd, 128, peer_addr); // 在tcpconnection构造中，使用io_thread拿出一个reactor，每个线程都管理一个
         //返回新连接
         return it->second;
     }
@@ -223,7 +270,7 @@ TcpConnection::ptr TcpServer::addClient(IOThread *io_thread, int fd)
     {
         // 2. 不存在旧的，创建新连接
         DebugLog << "fd " << fd << "did't exist, new it";
-        TcpConnection::ptr conn = std::make_shared<TcpConnection>(this, io_thread, fd, 128, getPeerAddr());
+        TcpConnection::ptr conn = std::make_shared<TcpConnection>(this, io_thread, fd, 128, peer_addr);
         m_clients[fd] = conn;
         return conn;
     }
@@ -242,6 +289,9 @@ TcpTimeWheel::ptr TcpServer::getTimeWheel()
 
 NetAddress::ptr TcpServer::getPeerAddr()
 {
+    // reuse_port模式下没有主acceptor，对端地址在各个IO线程的acceptor里
+    if(!m_acceptor)
+        return nullptr;
     return m_acceptor->getPeerAddr();
 }
 
@@ -255,6 +305,11 @@ IOThreadPool::ptr TcpServer::getIOThreadPool()
     return m_io_pool;
 }
 
+WorkerThreadPool::ptr TcpServer::getWorkerThreadPool()
+{
+    return m_worker_pool;
+}
+
 AbstractDispatcher::ptr TcpServer::getDispatcher()
 {
     return m_dispatcher;
@@ -276,7 +331,7 @@ void TcpServer::mainAcceptCorFunc()
     
         // 拿出线程，一个线程处理一个连接，协程协助连接，每个线程都管理一个reactor
         IOThread *io_thread = m_io_pool->getIOThread();
-        TcpConnection::ptr conn = addClient(io_thread, fd);
+        TcpConnection::ptr conn = addClient(io_thread, fd, m_acceptor->getPeerAddr());
         conn->initServer();
         DebugLog << "tcpconnection address is " << conn.get() << ", and fd is" << fd;
         io_thread->getReactor()->addCoroutine(conn->getCoroutine());  // 每个reactor设置一个协程
@@ -286,10 +341,38 @@ void TcpServer::mainAcceptCorFunc()
     
 }
 
+// 和mainAcceptCorFunc一样，只是连接直接放到本线程的reactor，不需要跨线程唤醒
+void TcpServer::ioAcceptCorFunc()
+{
+    // accept协程固定在本线程，被别的IO线程窃取的话io_thread和listen fd就对不上了
+    Coroutine::getCurrentCoroutine()->setPinned(true);
+    IOThread* io_thread = IOThread::getCurrentIOThread();
+    TcpAcceptor::ptr acceptor = m_io_acceptors[io_thread->getThreadIndex()];
+
+    while (!m_is_stop_accept)
+    {
+        int fd = acceptor->toAccept();
+        if(fd == -1)
+        {
+            ErrorLog << "accept ret -1 error, return, to yield";
+            Coroutine::Yield();
+            continue;
+        }
+
+        TcpConnection::ptr conn = addClient(io_thread, fd, acceptor->getPeerAddr());
+        conn->initServer();
+        DebugLog << "tcpconnection address is " << conn.get() << ", and fd is" << fd;
+        io_thread->getReactor()->addCoroutine(conn->getCoroutine(), false);
+        m_tcp_counts++;
+        DebugLog << "current tcp connection count is [" << m_tcp_counts << "]";
+    }
+}
+
 
 void TcpServer::clearClientTimerFunc()
 {
     // 到时清理所有已经关闭连接的客户端
+    Mutex::Lock lock(m_clients_mutex);
     for(auto &it : m_clients)
     {
         if(it.second.use_count() > 0 && it.second->getState() == Closed)
@@ -300,6 +383,26 @@ void TcpServer::clearClientTimerFunc()
     }
 }
 
+void TcpServer::workerStatsTimerFunc()
+{
+    // 输出这个周期内的任务数、平均等待和执行时间，最大值取完清零
+    WorkerThreadPool::Stats stats = m_worker_pool->getStats(true);
+    uint64_t tasks = stats.tasks - m_last_worker_stats.tasks;
+    int64_t avg_wait_us = 0;
+    int64_t avg_run_us = 0;
+    if(tasks > 0)
+    {
+        avg_wait_us = (stats.total_wait_ns - m_last_worker_stats.total_wait_ns) / static_cast<int64_t>(tasks) / 1000;
+        avg_run_us = (stats.total_run_ns - m_last_worker_stats.total_run_ns) / static_cast<int64_t>(tasks) / 1000;
+    }
+    m_last_worker_stats = stats;
+
+    InfoLog << "worker thread pool [threads=" << stats.threads << "] [tasks=" << tasks
+        << "] [queue_depth=" << stats.queue_depth << "] [max_queue_depth=" << stats.max_queue_depth
+        << "] [avg_wait_us=" << avg_wait_us << "] [max_wait_us=" << stats.max_wait_ns / 1000
+        << "] [avg_run_us=" << avg_run_us << "]";
+}
+
 void TcpServer::addCoroutine(Coroutine::ptr cor)
 {
     m_main_reactor->addCoroutine(cor);
@@ -307,10 +410,10 @@ void TcpServer::addCoroutine(Coroutine::ptr cor)
 
 
 //******************** RPC的服务注册阶段
-bool TcpServer::registerService(std::shared_ptr<google::protobuf::Service> service) {
+bool TcpServer::registerService(std::shared_ptr<google::protobuf::Service> service, const std::vector<std::string>& worker_methods /*= std::vector<std::string>()*/) {
     if (m_protocal_type == TinyPb_Protocal) {
         if (service) {
-            dynamic_cast<TinyPbRpcDispacther*>(m_dispatcher.get())->registerService(service);
+            return dynamic_cast<TinyPbRpcDispacther*>(m_dispatcher.get())->registerService(service, worker_methods);
         } else {
             ErrorLog << "register service error, service ptr is nullptr";
             return false;
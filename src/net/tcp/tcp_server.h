@@ -2,15 +2,19 @@
 #define SRC_NET_TCP_TCP_SERVER_H
 
 #include <map>
+#include <vector>
+#include <atomic>
 #include <google/protobuf/service.h>
 #include "src/net/reactor.h"
 #include "src/net/fd_event.h"
 #include "src/net/timer.h"
+#include "src/net/mutex.h"
 #include "src/net/net_address.h"
 #include "src/net/abstract_codec.h"
 #include "src/net/abstract_dispatcher.h"
 #include "src/net/tcp/io_thread.h"
 #include "src/net/tcp/tcp_connection_time_wheel.h"
+#include "src/net/tcp/worker_thread_pool.h"
 #include "src/net/timer.h"
 
 
@@ -29,7 +33,8 @@ public:
 
 public:
     // 创建socket , bind, listen
-    void init();
+    // reuse_port: 设置SO_REUSEPORT，多个acceptor可以监听同一个地址，内核把新连接分给它们
+    void init(bool reuse_port = false);
     // 调用accept_hook()获取新连接，注册到epoll，等待新连接唤醒协程
     int toAccept();
 
@@ -68,14 +73,16 @@ public:
     // 连接之后需要一个协程执行io操作
     void addCoroutine(tinyrpc::Coroutine::ptr cor);
 
-    bool registerService(std::shared_ptr<google::protobuf::Service> service);
+    // worker_methods: 这个服务里要放到工作线程执行的方法名(CPU密集或者会阻塞线程的)
+    // 这些方法不在协程里执行，限制见WorkerThreadPool
+    bool registerService(std::shared_ptr<google::protobuf::Service> service, const std::vector<std::string>& worker_methods = std::vector<std::string>());
 
     // bool registerHttpServlet(const std::string& url_path, HttpServlet::ptr servlet);  // http协议不是rpc
 
     void freshTcpConnection(TcpTimeWheel::TcpConnectionSlot::ptr slot);
 
-    // 连接之后添加客户端
-    TcpConnection::ptr addClient(IOThread* io_thread, int fd);
+    // 连接之后添加客户端，可能在多个IO线程中同时调用
+    TcpConnection::ptr addClient(IOThread* io_thread, int fd, NetAddress::ptr peer_addr);
 
 public:
     AbstractCodeC::ptr getCodec();
@@ -90,17 +97,30 @@ public:
 
     AbstractDispatcher::ptr getDispatcher();
 
+    // 没有方法放到工作线程的时候是nullptr
+    WorkerThreadPool::ptr getWorkerThreadPool();
+
 private:
     void mainAcceptCorFunc();
 
+    // SO_REUSEPORT模式下每个IO线程里的accept协程，连接留在本线程
+    void ioAcceptCorFunc();
+
     void clearClientTimerFunc();
 
+    // 定时输出工作线程池的排队和等待时间
+    void workerStatsTimerFunc();
+
 private:
     NetAddress::ptr m_addr;     // 连接地址
 
     TcpAcceptor::ptr m_acceptor;// 接受处理
 
-    int m_tcp_counts {0};     // 连接个数
+    bool m_reuse_port {false};  // 每个IO线程一个SO_REUSEPORT的listen fd，各自accept
+
+    std::vector<TcpAcceptor::ptr> m_io_acceptors; // 下标是IO线程的index
+
+    std::atomic<int> m_tcp_counts {0};     // 连接个数
 
     Reactor* m_main_reactor {nullptr}; // 一个主reactor负责监听
 
@@ -122,6 +142,14 @@ private:
 
     std::map<int , std::shared_ptr<TcpConnection>> m_clients; // 客户端连接存储
 
+    Mutex m_clients_mutex;  // reuse_port模式下IO线程各自addClient
+
+    WorkerThreadPool::ptr m_worker_pool; // 执行注册成工作线程方法的线程池
+
+    TimerEvent::ptr m_worker_stats_timer_event {nullptr};
+
+    WorkerThreadPool::Stats m_last_worker_stats; // 上一次输出时的累计值，用来算区间内的平均值
+
 };
 
 
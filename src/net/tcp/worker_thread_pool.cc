@@ -0,0 +1,166 @@
+#include <pthread.h>
+#include <assert.h>
+
+#include "src/coroutine/coroutine.h"
+#include "src/comm/clock.h"
+#include "src/comm/log.h"
+#include "src/net/tcp/worker_thread_pool.h"
+
+
+namespace tinyrpc{
+
+// 原子变量取最大值
+template<typename T>
+static void updateMax(std::atomic<T>& max, T value)
+{
+    T cur = max.load(std::memory_order_relaxed);
+    while(value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+WorkerThreadPool::WorkerThreadPool(int size)
+: m_size(size)
+{
+    int rt = pthread_cond_init(&m_cond, nullptr);
+    assert(rt == 0);
+}
+
+WorkerThreadPool::~WorkerThreadPool()
+{
+    stop();
+    pthread_cond_destroy(&m_cond);
+}
+
+void WorkerThreadPool::start()
+{
+    if(m_is_started)
+        return;
+
+    m_is_started = true;
+    m_threads.resize(m_size);
+    for(int i = 0; i < m_size; ++i)
+    {
+        pthread_create(&m_threads[i], nullptr, &WorkerThreadPool::main, this);
+    }
+    InfoLog << "worker thread pool start, size=" << m_size;
+}
+
+void WorkerThreadPool::stop()
+{
+    if(!m_is_started)
+        return;
+
+    {
+        Mutex::Lock lock(m_mutex);
+        m_stop = true;
+        pthread_cond_broadcast(&m_cond);
+    }
+    for(size_t i = 0; i < m_threads.size(); ++i)
+    {
+        pthread_join(m_threads[i], nullptr);
+    }
+    m_threads.clear();
+    m_is_started = false;
+}
+
+void WorkerThreadPool::runAndWait(std::function<void()> task)
+{
+    // 不在协程里没法挂起，线程池没有启动也没有线程执行
+    if(Coroutine::isMainCoroutine() || !m_is_started)
+    {
+        task();
+        return;
+    }
+
+    Task item;
+    item.m_func = std::move(task);
+    item.m_waiter = CoWaiter::current();
+    item.m_run_time = getCurrentRunTime();
+    item.m_enqueue_ns = Clock::preciseNs();
+
+    int depth = 0;
+    {
+        Mutex::Lock lock(m_mutex);
+        m_tasks.push_back(std::move(item));
+        depth = static_cast<int>(m_tasks.size());
+        pthread_cond_signal(&m_cond);
+    }
+    updateMax(m_max_queue_depth, depth);
+
+    DebugLog << "coroutine yield, wait worker thread, queue depth=" << depth;
+    // 工作线程执行完之后把协程交给本线程的reactor恢复，这时候协程已经挂起了
+    Coroutine::Yield();
+}
+
+int WorkerThreadPool::getSize() const
+{
+    return m_size;
+}
+
+WorkerThreadPool::Stats WorkerThreadPool::getStats(bool reset_max /*=false*/)
+{
+    Stats stats;
+    stats.threads = m_size;
+    {
+        Mutex::Lock lock(m_mutex);
+        stats.queue_depth = static_cast<int>(m_tasks.size());
+    }
+    stats.tasks = m_done_tasks.load(std::memory_order_relaxed);
+    stats.total_wait_ns = m_total_wait_ns.load(std::memory_order_relaxed);
+    stats.total_run_ns = m_total_run_ns.load(std::memory_order_relaxed);
+    if(reset_max)
+    {
+        stats.max_queue_depth = m_max_queue_depth.exchange(0, std::memory_order_relaxed);
+        stats.max_wait_ns = m_max_wait_ns.exchange(0, std::memory_order_relaxed);
+    }
+    else
+    {
+        stats.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+        stats.max_wait_ns = m_max_wait_ns.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void* WorkerThreadPool::main(void* arg)
+{
+    WorkerThreadPool* pool = static_cast<WorkerThreadPool*>(arg);
+    // 工作线程只有主协程，任务里hook的函数直接调用系统函数
+    Coroutine::getCurrentCoroutine();
+    pool->loop();
+    return nullptr;
+}
+
+void WorkerThreadPool::loop()
+{
+    while(true)
+    {
+        Mutex::Lock lock(m_mutex);
+        while(!m_stop && m_tasks.empty())
+        {
+            pthread_cond_wait(&m_cond, m_mutex.getMutex());
+        }
+        if(m_tasks.empty())
+            return;
+
+        Task item = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        lock.unlock();
+
+        int64_t begin = Clock::preciseNs();
+        setCurrentRunTime(item.m_run_time);
+        item.m_func();
+        setCurrentRunTime(nullptr);
+        int64_t end = Clock::preciseNs();
+
+        int64_t wait = begin - item.m_enqueue_ns;
+        m_total_wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        m_total_run_ns.fetch_add(end - begin, std::memory_order_relaxed);
+        updateMax(m_max_wait_ns, wait);
+        m_done_tasks.fetch_add(1, std::memory_order_relaxed);
+
+        item.m_waiter.wakeup();
+    }
+}
+
+} // namespace tinyrpc
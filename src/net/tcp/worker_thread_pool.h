@@ -0,0 +1,99 @@
+#ifndef SRC_NET_TCP_WORKER_THREAD_POOL_H
+#define SRC_NET_TCP_WORKER_THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <functional>
+
+#include "src/net/mutex.h"
+#include "src/comm/run_time.h"
+
+/*
+
+工作线程池，执行CPU密集或者会阻塞线程的rpc方法，不占用io线程
+1. io协程调用runAndWait，任务放进队列之后协程挂起，io线程继续处理其他连接
+2. 工作线程执行完任务，通过CoWaiter把协程交回原来的io线程恢复，之后在io线程编码回复
+3. 任务在工作线程执行的时候协程是挂起的，任务里用到的东西不能放在协程栈上(共享栈的协程挂起之后栈会被别的协程覆盖)
+4. 统计排队长度、排队等待时间和执行时间，最大值可以按统计周期重置
+
+任务在工作线程的主协程里执行，没有reactor：
+1. hook的read/write/connect/sleep直接调用系统函数，阻塞的是工作线程
+2. CoroutineMutex、CoCondVar、CoSemaphore、CoRWMutex、CoChannel等不到就阻塞工作线程，和io协程一起排队，拿到之后和协程一样互斥
+3. 等待的东西要靠同一个工作线程之后的任务才能完成的话会死锁，工作线程数不要小于这样互相等待的任务数
+
+*/
+
+namespace tinyrpc{
+
+class WorkerThreadPool{
+public:
+    typedef std::shared_ptr<WorkerThreadPool> ptr;
+
+    // 计数和总时间是累计值，最大值是上次重置之后的
+    struct Stats{
+        int threads {0};
+        int queue_depth {0};           // 当前排队的任务数
+        int max_queue_depth {0};
+        uint64_t tasks {0};            // 执行完的任务数
+        int64_t total_wait_ns {0};     // 入队到开始执行
+        int64_t max_wait_ns {0};
+        int64_t total_run_ns {0};
+    };
+
+public:
+    explicit WorkerThreadPool(int size);
+    ~WorkerThreadPool();
+
+    WorkerThreadPool(const WorkerThreadPool&) = delete;
+    WorkerThreadPool& operator=(const WorkerThreadPool&) = delete;
+
+public:
+    void start();
+
+    // 停止之后队列里剩下的任务还会执行完
+    void stop();
+
+    // 在协程里调用：交给工作线程执行，协程挂起直到执行完。主协程里调用直接执行
+    void runAndWait(std::function<void()> task);
+
+    int getSize() const;
+
+    // reset_max为true的时候取完把最大值清零
+    Stats getStats(bool reset_max = false);
+
+private:
+    struct Task{
+        std::function<void()> m_func;
+        CoWaiter m_waiter;
+        RunTime* m_run_time {nullptr};  // 协程的RunTime，工作线程的日志带上msgno和接口名
+        int64_t m_enqueue_ns {0};
+    };
+
+    static void* main(void* arg);
+
+    void loop();
+
+private:
+    int m_size {0};
+    bool m_is_started {false};
+    bool m_stop {false};
+    std::vector<pthread_t> m_threads;
+
+    Mutex m_mutex;
+    pthread_cond_t m_cond;
+    std::deque<Task> m_tasks;
+
+    std::atomic<int> m_max_queue_depth {0};
+    std::atomic<uint64_t> m_done_tasks {0};
+    std::atomic<int64_t> m_total_wait_ns {0};
+    std::atomic<int64_t> m_max_wait_ns {0};
+    std::atomic<int64_t> m_total_run_ns {0};
+};
+
+} // namespace tinyrpc
+
+#endif
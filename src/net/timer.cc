@@ -3,12 +3,10 @@
 #include <time.h>
 #include <string.h>
 #include <vector>
-#include <sys/time.h>
+#include <algorithm>
 #include <functional>
-#include <map>
 #include "../comm/log.h"
 #include "timer.h"
-#include "mutex.h"
 #include "fd_event.h"
 #include "../coroutine/coroutine_hook.h"
 
@@ -16,16 +14,6 @@ extern read_fun_ptr_t g_sys_read_fun; // sys read func
 
 namespace tinyrpc{
 
-int64_t getNowMs()
-{
-    timeval val;
-    gettimeofday(&val, nullptr);
-    // tv_sec : second   tv_usec : ms
-    int64_t re = val.tv_sec * 1000 + val.tv_usec / 1000;
-    return re;
-}
-
-
 Timer::Timer(tinyrpc::Reactor* reactor)
 : FdEvent(reactor)
 {
@@ -46,6 +34,12 @@ Timer::Timer(tinyrpc::Reactor* reactor)
     {
         DebugLog << "timerfd_create error";
     }
+
+    m_tid = reactor->getTid();
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_bitmap, 0, sizeof(m_bitmap));
+    m_next_tick = Clock::nowMs();
+
     // std::bind绑定成员函数必须后面加对象
     m_read_callback = std::bind(&Timer::onTimer, this);
     addListenEvents(tinyrpc::IOEvent::READ);  // 都是继承FDEvent的
@@ -56,112 +50,321 @@ Timer::~Timer()
 {
     unregisterFromReactor();
     close(m_fd);
+
+    // 释放时间轮持有的事件
+    for(int i = 0; i < SLOT_COUNT; ++i)
+    {
+        TimerEvent* event = m_slots[i];
+        m_slots[i] = nullptr;
+        while(event)
+        {
+            TimerEvent* next = event->m_next;
+            event->m_prev = event->m_next = nullptr;
+            event->m_slot = -1;
+            event->m_self.reset();
+            event = next;
+        }
+    }
+}
+
+bool Timer::isOwnerThread() const
+{
+    return m_tid == gettid();
 }
 
 void Timer::addTimerEvent(TimerEvent::ptr event, bool need_reset)
 {
-    RWMutex::WriteLock lock(m_event_mutex);
-    bool is_reset = false;
+    if(!isOwnerThread())
+    {
+        // 投递到所属线程，在那之前已经被删除的就不加了
+        Timer* timer = this;
+        m_reactor->addTask([timer, event, need_reset](){
+            if(!event->m_is_cancled)
+            {
+                timer->addTimerEvent(event, need_reset);
+            }
+        });
+        return;
+    }
 
-    if(m_pending_events.empty())
+    if(event->m_slot != -1)
     {
-        is_reset = true;
+        unlink(event.get());
     }
-    else
+    if(m_count == 0)
     {
-        auto it = m_pending_events.begin();
-        // 之前的到达时间小于最小的到达时间，
-        if(event->m_arrive_time < (*it).second->m_arrive_time)
-            is_reset = true;
+        // 空的时间轮直接跳到现在，不用一个一个tick走过去
+        m_next_tick = std::max(m_next_tick, Clock::nowMs());
     }
-    // 加入到达时间和事件
-    m_pending_events.emplace(event->m_arrive_time, event);
-    lock.unlock();
-    
+    link(event);
 
-    if(is_reset && need_reset)
+    // 比timerfd已经设好的时间早才需要重设
+    if(need_reset && event->m_arrive_time < m_armed_tick)
     {
         DebugLog << "need reset timer";
-        resetArriveTime();
+        arm(event->m_arrive_time);
     }
 }
 
 void Timer::delTimerEvent(TimerEvent::ptr event)
 {
-    event->m_is_cancled = true; // 取消
+    event->m_is_cancled = true; // 取消，已经投递的加入和到期都会跳过
 
-    RWMutex::WriteLock lock(m_event_mutex);
+    if(!isOwnerThread())
+    {
+        Timer* timer = this;
+        m_reactor->addTask([timer, event](){
+            if(event->m_slot != -1)
+            {
+                timer->unlink(event.get());
+            }
+        }, false);
+        return;
+    }
 
-    // 找全部到时的任务, 
-    auto begin = m_pending_events.lower_bound(event->m_arrive_time);
-    auto end = m_pending_events.upper_bound(event->m_arrive_time);
-    auto it = begin;
+    if(event->m_slot != -1)
+    {
+        unlink(event.get());
+    }
+    // timerfd不改，多醒一次没有关系
+    DebugLog << "del timer event succ, origin arrvite time=" << event->m_arrive_time;
+}
 
-    for(it = begin; it != end; ++it)
+void Timer::link(TimerEvent::ptr event)
+{
+    int64_t expire = event->m_arrive_time;
+    int64_t delta = expire - m_next_tick;
+    int slot = 0;
+    if(delta < 0)
+    {
+        // 已经到期的放到下一个要处理的槽
+        slot = m_next_tick & (ROOT_SIZE - 1);
+    }
+    else if(delta < ROOT_SIZE)
+    {
+        slot = expire & (ROOT_SIZE - 1);
+    }
+    else
     {
-        // 找到对应的event跳出
-        if(it->second == event)
+        const int64_t max_delta = (1LL << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+        if(delta > max_delta)
         {
-            DebugLog << "find timer event, now delete it. src arrive time=" << event->m_arrive_time;
-            break;
+            expire = m_next_tick + max_delta;
+            delta = max_delta;
+        }
+        int level = 1;
+        while(delta >= (1LL << (ROOT_BITS + level * LEVEL_BITS)))
+        {
+            ++level;
         }
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        slot = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((expire >> shift) & (LEVEL_SIZE - 1));
     }
-    // 时间对了，对应事件删除
-    if(it != m_pending_events.end())
+
+    TimerEvent* raw = event.get();
+    raw->m_self = event;
+    raw->m_slot = slot;
+    raw->m_prev = nullptr;
+    raw->m_next = m_slots[slot];
+    if(raw->m_next)
     {
-        m_pending_events.erase(it);
+        raw->m_next->m_prev = raw;
     }
-    lock.unlock();
+    m_slots[slot] = raw;
+    m_bitmap[slot >> 6] |= 1ULL << (slot & 63);
+    ++m_count;
+}
 
-    DebugLog << "del timer event succ, origin arrvite time=" << event->m_arrive_time;
-};
+void Timer::unlink(TimerEvent* event)
+{
+    int slot = event->m_slot;
+    if(event->m_prev)
+    {
+        event->m_prev->m_next = event->m_next;
+    }
+    else
+    {
+        m_slots[slot] = event->m_next;
+        if(!event->m_next)
+        {
+            m_bitmap[slot >> 6] &= ~(1ULL << (slot & 63));
+        }
+    }
+    if(event->m_next)
+    {
+        event->m_next->m_prev = event->m_prev;
+    }
+    event->m_prev = event->m_next = nullptr;
+    event->m_slot = -1;
+    --m_count;
+    // 最后释放，event可能就此析构
+    event->m_self.reset();
+}
 
-// 重新设置定时到达时间
-void Timer::resetArriveTime()
+void Timer::cascade(int level, int index)
 {
-    RWMutex::ReadLock lock(m_event_mutex);
-    std::multimap<int64_t, TimerEvent::ptr> tmp = m_pending_events;
-    lock.unlock();
- 
-    if(tmp.size() == 0)
+    int slot = ROOT_SIZE + (level - 1) * LEVEL_SIZE + index;
+    TimerEvent* event = m_slots[slot];
+    while(event)
     {
-        DebugLog << "no timerevent pending, size = 0";
-        return;
+        TimerEvent* next = event->m_next;
+        TimerEvent::ptr hold = event->m_self;
+        unlink(event);
+        link(hold);
+        event = next;
     }
+}
 
-    int64_t now = getNowMs();
-    auto it = tmp.rbegin(); 
-    if((*it).first < now) // 所有的定时器事件都发生了，没有事件能被重置了
-    {   
-        DebugLog << "all timer events has already expire";
-        return;
+int Timer::findRootSlot(int from, int to) const
+{
+    while(from <= to)
+    {
+        int word = from >> 6;
+        uint64_t bits = m_bitmap[word] >> (from & 63);
+        if(bits)
+        {
+            int slot = from + __builtin_ctzll(bits);
+            return slot <= to ? slot : -1;
+        }
+        from = (word + 1) << 6;
     }
+    return -1;
+}
 
-    int64_t interval = (*it).first - now;
+void Timer::advance(int64_t now, std::vector<TimerEvent::ptr>& expired)
+{
+    while(m_next_tick <= now)
+    {
+        if(m_count == 0)
+        {
+            m_next_tick = now + 1;
+            break;
+        }
 
-    itimerspec new_value; // 定时器类型，有开始和间隔
-    memset(&new_value, 0, sizeof(new_value));
+        int index = m_next_tick & (ROOT_SIZE - 1);
+        if(index == 0)
+        {
+            // 第0层转完一圈，上层的槽依次往下放，上层也转完一圈再往上
+            for(int level = 1; level <= LEVELS; ++level)
+            {
+                int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+                int level_index = (m_next_tick >> shift) & (LEVEL_SIZE - 1);
+                cascade(level, level_index);
+                if(level_index != 0)
+                {
+                    break;
+                }
+            }
+        }
 
-    timespec ts;
-    memset(&ts, 0, sizeof(ts));
-    ts.tv_sec = interval / 1000;
-    ts.tv_nsec = (interval % 1000) * 1000000;
-    // 设置开始时间
-    new_value.it_value = ts;
-    // 设置定时器，放在m_fd
-    int rt = timerfd_settime(m_fd, 0, &new_value, nullptr);
+        if(!m_slots[index])
+        {
+            // 跳到这一圈里下一个非空槽，最多到这一圈结束或者now
+            int last = static_cast<int>(std::min<int64_t>(ROOT_SIZE - 1, index + (now - m_next_tick)));
+            int slot = findRootSlot(index + 1, last);
+            m_next_tick += (slot == -1 ? last + 1 : slot) - index;
+            continue;
+        }
 
-    if(rt != 0)
+        while(m_slots[index])
+        {
+            TimerEvent* event = m_slots[index];
+            expired.emplace_back(event->m_self);
+            unlink(event);
+        }
+        ++m_next_tick;
+    }
+}
+
+int64_t Timer::nextTick() const
+{
+    if(m_count == 0)
+    {
+        return INT64_MAX;
+    }
+
+    int64_t tick = INT64_MAX;
+
+    // 第0层的槽就是到期时间
+    int index = m_next_tick & (ROOT_SIZE - 1);
+    int slot = findRootSlot(index, ROOT_SIZE - 1);
+    if(slot != -1)
     {
-        ErrorLog << "timer_settime error, interval =" << interval;
+        tick = m_next_tick + (slot - index);
     }
     else
     {
+        slot = findRootSlot(0, index - 1);
+        if(slot != -1)
+        {
+            tick = m_next_tick + (ROOT_SIZE - index + slot);
+        }
+    }
 
+    // 上层的槽取cascade的时间，不会比里面的事件晚
+    for(int level = 1; level <= LEVELS; ++level)
+    {
+        uint64_t bits = m_bitmap[ROOT_SIZE / 64 + level - 1];
+        if(!bits)
+        {
+            continue;
+        }
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        int cur = (m_next_tick >> shift) & (LEVEL_SIZE - 1);
+        // 正好在本层的边界上，当前槽还没有cascade
+        bool aligned = (m_next_tick & ((1LL << shift) - 1)) == 0;
+        int64_t distance = LEVEL_SIZE;
+        for(int i = aligned ? 0 : 1; i <= LEVEL_SIZE; ++i)
+        {
+            if(bits & (1ULL << ((cur + i) & (LEVEL_SIZE - 1))))
+            {
+                distance = i;
+                break;
+            }
+        }
+        tick = std::min(tick, ((m_next_tick >> shift) + distance) << shift);
     }
+    return tick;
 }
 
-// 拿出到时的所有定时器，在定时器容器中保存删除，执行
+void Timer::arm(int64_t tick)
+{
+    if(tick == INT64_MAX || tick == m_armed_tick)
+    {
+        return;
+    }
+
+    // 绝对时间，已经过去的马上触发
+    itimerspec new_value; // 定时器类型，有开始和间隔
+    memset(&new_value, 0, sizeof(new_value));
+    new_value.it_value.tv_sec = tick / 1000;
+    new_value.it_value.tv_nsec = (tick % 1000) * 1000000;
+    if(new_value.it_value.tv_sec == 0 && new_value.it_value.tv_nsec == 0)
+    {
+        new_value.it_value.tv_nsec = 1;  // 全0是停止定时器
+    }
+
+    int rt = timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &new_value, nullptr);
+    if(rt != 0)
+    {
+        ErrorLog << "timer_settime error, tick =" << tick;
+        return;
+    }
+    m_armed_tick = tick;
+}
+
+// 重新设置定时到达时间
+void Timer::resetArriveTime()
+{
+    if(m_count == 0)
+    {
+        DebugLog << "no timerevent pending, size = 0";
+        return;
+    }
+    arm(nextTick());
+}
+
+// 拿出到时的所有定时器，从时间轮删除，执行
 void Timer::onTimer()
 {
     char buf[8];
@@ -172,55 +375,33 @@ void Timer::onTimer()
         if((g_sys_read_fun(m_fd, buf, 8) == -1) && errno == EAGAIN)
             break;
     }
+    // 一次性的timerfd已经触发过了
+    m_armed_tick = INT64_MAX;
 
-    int64_t now = getNowMs();
-    RWMutex::WriteLock lock(m_event_mutex);
-
-    auto it = m_pending_events.begin();
-    // 1. 拿出到时的事件
+    // 1. 拿出到时的事件，已经从时间轮删除
     std::vector<TimerEvent::ptr> tmps;
-    std::vector<std::pair<int64_t, std::function<void()>>> tasks;
+    advance(Clock::nowMs(), tmps);
 
-    // std::multimap<int64_t, TimerEvent::ptr> m_pending_events;
-    for(it; it != m_pending_events.end(); ++it)
+    for(size_t i = 0; i < tmps.size(); ++i)
     {
-        // 判断到时任务,并且没有被取消的任务
-        if((*it).first <= now && !((*it).second->m_is_cancled))
+        TimerEvent::ptr event = tmps[i];
+        // 前面的任务可能删除了后面的事件
+        if(event->m_is_cancled)
+            continue;
+
+        // 2. 重复的事件先加回去，任务里可以删除它
+        if(event->m_is_repeated && event->m_slot == -1)
         {
-            // 保存到时的TimerEvent
-            tmps.emplace_back((*it).second);
-            // 保存到时的时间和任务
-            tasks.emplace_back(std::make_pair((*it).second->m_arrive_time, (*it).second->m_task));
+            event->resetTime();
+            addTimerEvent(event, false);
         }
-        else
-            break;  // 用的事multimap， 根据时间排序的，到某个时间不符合后面肯定也不符合
-    }
-
-    // 2. 删除到时的事件
-    m_pending_events.erase(m_pending_events.begin(), it);
-    
-    lock.unlock();// 后面没有写行为，解锁
 
-    // 3. 判断任务是否要再重复加入定时器定时执行, 是就再加入定时器事件
-    for(auto it : tmps)
-    {
-        if(it->m_is_repeated)
-            it->resetTime();
-        
-        addTimerEvent(it, false);
+        // 3.执行到时任务
+        event->m_task();
     }
 
-    resetArriveTime(); // 
-
-    // 4.执行到时任务
-    for(auto it : tasks)
-    {
-        it.second();
-    }
+    resetArriveTime();
 }
 
-
-
-
   
 }; // namespace tinyrp
@@ -2,13 +2,15 @@
 #define SRC_NET_TIMER_H
 
 #include <time.h>
+#include <stdint.h>
 #include <memory>
-#include <map>
+#include <atomic>
+#include <vector>
 #include <functional>
-#include "src/net/mutex.h"
 #include "src/net/reactor.h"
 #include "src/net/fd_event.h"
 #include "src/comm/log.h"
+#include "src/comm/clock.h"
 
 /*
 
@@ -18,13 +20,17 @@
 
     设置一个timerFd，注册到epoll。每次有定时事件加入就设置timerFd事件。一个Timerfd可以设置多个事件
     每次检查定时到期就删除这些定时事件，通过一个m_pending_events进行保存。通过epoll不断唤醒定时事件。
+
+    分层时间轮，精度1ms，用Clock::nowMs()的单调时钟(reactor线程里是本轮循环缓存的值)：
+    1. 第0层256个槽，每槽1ms；第1到4层各64个槽，每槽是下一层一整圈，一共覆盖2^32ms(约49天)，更远的按最远算
+    2. 槽是侵入式双向链表，TimerEvent自己记录前后节点和所在的槽，加入和删除都是O(1)
+    3. 第0层转完一圈，把上一层的下一个槽拆下来重新按剩余时间放到下面的层(cascade)
+    4. timerfd只设成最近一个要处理的tick(绝对时间)，新事件比已经设好的时间晚就不用系统调用
+    5. 时间轮只在所属reactor线程访问，不加锁；其他线程的加入和删除作为任务投递到reactor
 */
 
 
 namespace tinyrpc{
-    
-// signed long
-int64_t getNowMs();
 
 class TimerEvent{
 public:
@@ -38,14 +44,14 @@ public:
       m_task(task)
     {
         // 设置一个间隔
-        m_arrive_time = getNowMs() + m_interval;
+        m_arrive_time = Clock::nowMs() + m_interval;
         DebugLog << "timeevent will occur at " << m_arrive_time;
     }
 
     // 重新设置任务发生时间
     void resetTime()
     {
-        m_arrive_time = getNowMs() + m_interval;
+        m_arrive_time = Clock::nowMs() + m_interval;
         m_is_cancled = false;
     }
 
@@ -66,12 +72,21 @@ public:
     }
 
 public:
-    int64_t m_arrive_time; // 任务执行的时间点 = 现在时间 + 任务间隔, ms
+    int64_t m_arrive_time; // 任务执行的时间点 = 现在时间(单调时钟) + 任务间隔, ms
     int64_t m_interval;  // 两个任务间隔时间, ms
     bool m_is_repeated {false};  // 任务是否重复
-    bool m_is_cancled {false};  // 任务是否已经取消
+    std::atomic<bool> m_is_cancled {false};  // 任务是否已经取消，其他线程删除的时候也会设置
  
     std::function<void()> m_task;  // 任务
+
+private:
+    friend class Timer;
+
+    // 时间轮的链表节点，只在定时器所属reactor线程访问
+    TimerEvent* m_prev {nullptr};
+    TimerEvent* m_next {nullptr};
+    int m_slot {-1};          // 所在的槽，-1表示不在时间轮中
+    TimerEvent::ptr m_self;   // 在时间轮中的时候持有自己，离开时间轮的时候释放
 };
 
 class FdEvent;
@@ -87,11 +102,11 @@ public:
     ~Timer();
 
 public:
-    // 添加timerEvent
+    // 添加timerEvent，可以在任意线程调用
     void addTimerEvent(TimerEvent::ptr event, bool need_reset = true);
-    // 删除
+    // 删除，可以在任意线程调用
     void delTimerEvent(TimerEvent::ptr event);
-    // 重设任务定时时间
+    // 按最近要处理的tick重设timerfd
     void resetArriveTime();
     // 定时器开始
     void onTimer();
@@ -110,8 +125,34 @@ private:
 
   Coroutine* m_coroutine {nullptr};
     */
-    std::multimap<int64_t, TimerEvent::ptr> m_pending_events; // 定时器事件，时间和事件pair
-    RWMutex m_event_mutex;
+    static const int ROOT_BITS = 8;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;   // 第0层槽数
+    static const int LEVEL_BITS = 6;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS; // 第1到4层每层槽数
+    static const int LEVELS = 4;
+    static const int SLOT_COUNT = ROOT_SIZE + LEVELS * LEVEL_SIZE;
+
+    bool isOwnerThread() const;
+    // 放到到期时间对应的槽
+    void link(TimerEvent::ptr event);
+    void unlink(TimerEvent* event);
+    // 把第level层的index槽拆下来重新放
+    void cascade(int level, int index);
+    // 处理到now为止的所有tick，到期的事件放到expired
+    void advance(int64_t now, std::vector<TimerEvent::ptr>& expired);
+    // 最近一个需要处理的tick，可能只是一次cascade，没有事件返回INT64_MAX
+    int64_t nextTick() const;
+    void arm(int64_t tick);
+    // 第0层[from, to]中第一个非空槽，没有返回-1
+    int findRootSlot(int from, int to) const;
+
+    pid_t m_tid {0};
+    // 第0层是m_slots[0, 256)，第level层(1到4)是m_slots[256 + (level - 1) * 64, +64)
+    TimerEvent* m_slots[SLOT_COUNT];
+    uint64_t m_bitmap[SLOT_COUNT / 64];   // 非空槽的位图，第0层4个字，每个上层1个字
+    int64_t m_next_tick {0};              // 下一个还没处理的tick(ms)
+    int64_t m_armed_tick {INT64_MAX};     // timerfd已经设好的tick
+    size_t m_count {0};                   // 时间轮中的事件数
 };
 
 } // namespace tinyrpc
@@ -6,23 +6,38 @@
 #include <memory>
 #include <cstring>
 #include <arpa/inet.h> // htonl
+#include <google/protobuf/message.h>
 #include "src/net/tinypb/tinypb_codec.h"
 #include "src/comm/log.h"
 #include "src/net/abstract_data.h"
 #include "src/net/tinypb/tinypb_data.h"
 #include "tinypb_codec.h"
 #include "src/comm/msg_req.h"
+#include "src/comm/config.h"
+#include "src/comm/crc32c.h"
 #include <iostream>
 
 namespace tinyrpc{
 
+extern tinyrpc::Config::ptr gRpcConfig;
+
 static const char PB_START = 0x02; // 协议包开始标志
 static const char PB_END = 0x03; // 结束标志
 static const int MSG_REQ_LEN = 20; // request和respone的默认长度
+static const int32_t LEGACY_CHECK_NUM = 1; // 老版本不计算校验和，固定填1
+
+// 校验和覆盖的范围：从msg_req_len开始到pb_data结束，也就是去掉开始标志、包长度、校验和、结束标志
+static const int CHECKSUM_BEGIN = sizeof(char) + sizeof(int32_t);
+static const int CHECKSUM_TAIL = sizeof(int32_t) + sizeof(char);
+// 最小包大小 开始标志 + 包长 + 4个长度/错误码字段 + 校验和 + 结束标志
+static const int32_t MIN_PK_LEN = sizeof(char) + sizeof(int32_t) * 6 + sizeof(char);
 
 TinyPbCodeC::TinyPbCodeC()
 {
-
+    if(gRpcConfig)
+    {
+        m_checksum_enable = gRpcConfig->m_checksum_enable;
+    }
 }
 
 TinyPbCodeC::~TinyPbCodeC()
@@ -30,6 +45,8 @@ TinyPbCodeC::~TinyPbCodeC()
 
 }
 
+// 编码一次完成：先算出包长度，在buf中预留pk_len的连续空间，直接在里面写包头和pb_data
+// 没有临时buffer，也没有再拷贝一次到buf
 void TinyPbCodeC::encode(TcpBuffer *buf, AbstractData *data)
 {
     if(!buf || !data)
@@ -40,43 +57,42 @@ void TinyPbCodeC::encode(TcpBuffer *buf, AbstractData *data)
     
     // 动态转换为子类，父类到子类的转换才会触发动态检查机制
     TinyPbStruct* tmp = dynamic_cast<TinyPbStruct*>(data);
-    
 
-    int len = 0;
-    const char* re = encodePbData(tmp, len);
+    int32_t len = getPkLen(tmp);
 
     // 1. 编码错误，没有编码长度
-    if(re == nullptr || len == 0 || !tmp->encode_succ)
+    if(len <= 0)
     {
         ErrorLog << "encode error!";
         data->encode_succ = false; // 设置编码状态标志
         return;
     }
-    // 2. 编码成功
-    DebugLog << "encode package len = " << len;
-    if(buf != nullptr)
+
+    // 2. 预留空间直接编码
+    char* re = buf->reserveWrite(len);
+    if(!encodePbData(tmp, re, len))
     {
-        buf->writeToBuffer(re, len); // 编码成功加入到需要发送也就是写buffer
-        DebugLog << "succ encode and write to buffer, writeindex=" << buf->writeIndex();
+        ErrorLog << "encode error!";
+        data->encode_succ = false;
+        return;
     }
+
+    // 3. 编码成功，确认写入
+    DebugLog << "encode package len = " << len;
+    buf->recucleWrite(len); // 编码成功加入到需要发送也就是写buffer
+    DebugLog << "succ encode and write to buffer, readable=" << buf->readAble();
     data = tmp;  //data转换回去
-    // 释放空间
-    if(re)
-    {
-        free((void*)re);  // 全部以void*作为中间类型
-        re = NULL;
-    }
 }
 
-// 进行PB协议数据的编码，TinyPbStruct -> net bytes
-const char *TinyPbCodeC::encodePbData(TinyPbStruct *data, int &len)
+// 计算整个包的长度，pb_message不为空的时候使用它序列化之后的大小
+int32_t TinyPbCodeC::getPkLen(TinyPbStruct *data)
 {
     // 1. 服务名判断。服务名错误整个服务调用就错误了
     if(data->service_full_name.empty())
     {
         ErrorLog << "parse error, service_full_name is empty!";
         data->encode_succ = false;
-        return nullptr;
+        return -1;
     }
 
     // 2.请求或者回应消息体为空，生成随机序列填补，可以没有请求消息 
@@ -87,15 +103,33 @@ const char *TinyPbCodeC::encodePbData(TinyPbStruct *data, int &len)
         DebugLog << "generate msgno = " << data->msg_req;
     }
 
-    // 3.写入结构体中对应的各项数据到一个buf中。
-        //3.1 总协议报文包长度,其中两个char是开头和结尾的两个字符长度
-    int32_t pk_len = 2 * sizeof(char) + 6 * sizeof(int32_t)
-                    + data->pb_data.length() + data->service_full_name.length()
+    // 3. pb_data长度，ByteSizeLong会缓存大小，后面序列化直接使用
+    size_t pb_data_len = data->pb_data.length();
+    if(data->pb_message)
+    {
+        pb_data_len = data->pb_message->ByteSizeLong();
+    }
+
+    // 总协议报文包长度,其中两个char是开头和结尾的两个字符长度
+    size_t pk_len = 2 * sizeof(char) + 6 * sizeof(int32_t)
+                    + pb_data_len + data->service_full_name.length()
                     + data->err_info.length() + data->msg_req.length();
 
+    if(pk_len > INT32_MAX)
+    {
+        ErrorLog << "encode error, package too large, len = " << pk_len;
+        data->encode_succ = false;
+        return -1;
+    }
+
     DebugLog << "encoder package len = " << pk_len;
-        // 3.2 使用一个tmp字节指针指向buf，字节复制
-    char* buf = reinterpret_cast<char*>(malloc(pk_len)); // 字节端转换
+    return static_cast<int32_t>(pk_len);
+}
+
+// 进行PB协议数据的编码，TinyPbStruct -> net bytes，buf是预留好的pk_len大小的空间
+bool TinyPbCodeC::encodePbData(TinyPbStruct *data, char* buf, int32_t pk_len)
+{
+    // 使用一个tmp字节指针指向buf，字节复制
     char* tmp = buf;
         // 3.3 加入开头标志
     *tmp = PB_START;
@@ -145,14 +179,35 @@ const char *TinyPbCodeC::encodePbData(TinyPbStruct *data, int &len)
         tmp+= err_info_len;
     }
 
-        // 3.9 加入pb_data
-    int32_t pb_data_len = data->pb_data.length();
+        // 3.9 加入pb_data，有pb_message就直接序列化到预留的空间中，不经过中间的string
+    int32_t pb_data_len = pk_len - (tmp - buf) - sizeof(int32_t) - sizeof(char);
     DebugLog << "pb_data_len = " << pb_data_len;
-    memcpy(tmp, &(data->pb_data[0]), pb_data_len);
+    if(data->pb_message)
+    {
+        uint8_t* end = data->pb_message->SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(tmp));
+        if(end != reinterpret_cast<uint8_t*>(tmp) + pb_data_len)
+        {
+            ErrorLog << "serialize pb_message error, expect len = " << pb_data_len;
+            data->encode_succ = false;
+            return false;
+        }
+    }
+    else if(pb_data_len != 0)
+    {
+        memcpy(tmp, &(data->pb_data[0]), pb_data_len);
+    }
     tmp += pb_data_len;
 
-        //3.10 加入检验和，这里只是考虑了检验和，没有实现
-    int32_t checksum = 1;
+        //3.10 加入检验和，对端协商过才计算CRC32C，否则填1兼容老版本
+    int32_t checksum = LEGACY_CHECK_NUM;
+    if(m_checksum_enable && data->use_checksum)
+    {
+        checksum = static_cast<int32_t>(Crc32cUtil::crc32c(buf + CHECKSUM_BEGIN, pk_len - CHECKSUM_BEGIN - CHECKSUM_TAIL));
+    }
+    else
+    {
+        data->use_checksum = false;
+    }
     int32_t checksum_net = htonl(checksum);
     memcpy(tmp, &checksum_net, sizeof(int32_t));
     tmp += sizeof(int32_t);
@@ -169,9 +224,7 @@ const char *TinyPbCodeC::encodePbData(TinyPbStruct *data, int &len)
     data->check_num = checksum;
     data->encode_succ = true;
 
-    len = pk_len;
-
-    return buf;
+    return true;
 }
 
 int32_t getInt32FromNetByte(const char* buf)
@@ -181,7 +234,43 @@ int32_t getInt32FromNetByte(const char* buf)
     return ntohl(tmp);
 }
 
+// 从视图中读取一个网络字节序的int32，越界返回false
+static bool getInt32FromView(const TcpBufferView& view, int index, int32_t& value)
+{
+    char tmp[sizeof(int32_t)];
+    if(view.peek(index, tmp, sizeof(int32_t)) != sizeof(int32_t))
+    {
+        return false;
+    }
+    value = getInt32FromNetByte(tmp);
+    return true;
+}
+
+// 计算视图中数据的CRC32C，数据可能跨多个slab，分段计算
+static uint32_t getCrc32cFromView(const TcpBufferView& view)
+{
+    static const int MAX_VEC_COUNT = 16;
+    struct iovec vecs[MAX_VEC_COUNT];
+    uint32_t crc = 0;
+    int offset = 0;
+    while(offset < view.size())
+    {
+        int count = view.subView(offset, view.size() - offset).getVecs(vecs, MAX_VEC_COUNT);
+        if(count <= 0)
+        {
+            break;
+        }
+        for(int i = 0; i < count; ++i)
+        {
+            crc = Crc32cUtil::crc32c(vecs[i].iov_base, vecs[i].iov_len, crc);
+            offset += vecs[i].iov_len;
+        }
+    }
+    return crc;
+}
+
 // 对编码的字节流进行解码
+// 直接在buffer的可读区域上查找和解析，不再拷贝整个buffer，只有落到TinyPbStruct的字段才拷贝一次
 void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
 {
     if(!buf || !data)
@@ -191,47 +280,38 @@ void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
         return;
     }
 
-    // 获取读取到的buf内容
-    std::vector<char> tmp = buf->getBufferVector();
-    // buf不止读取一次服务内容，所以从可读位置读取
-    int start_index = buf->readIndex();
-    int end_index = -1;
+    int buf_end = buf->readAble();
+    int start_index = -1;
     int32_t pk_len = -1;
 
     bool parse_full_pack = false;
 
     // 检查开头标志和结尾标志，没有开头标志，或者有开头没结尾的缓冲区溢出问题
-    for(int i = start_index; i < buf->writeIndex(); ++i)
+    int i = buf->find(PB_START);
+    while(i != -1)
     {
-        // 开头标志
-        if(tmp[i] == PB_START)
+        char len_buf[sizeof(int32_t)];
+        // 判断溢出，第一个字段是包大小
+        if(buf->peek(i + 1, len_buf, sizeof(int32_t)) == sizeof(int32_t))
         {
-            // 判断溢出
-            if(i + 1 < buf->writeIndex())
+            pk_len = getInt32FromNetByte(len_buf);
+            DebugLog << "prase pk_len =" << pk_len;
+            // pk_len是对端发来的，先限定范围再算结尾位置，不然i + pk_len会溢出
+            // 比最小包还小的不可能是合法包；超出可读区域的表示没有读完，都跳过继续找
+            if(pk_len >= MIN_PK_LEN && pk_len <= buf_end - i)
             {
-                // 第一个字段是包大小
-                pk_len = getInt32FromNetByte(&tmp[i+1]);
-                DebugLog << "prase pk_len =" << pk_len;
-                // 计算整个包的最后位置，判断溢出
                 int j = i + pk_len - 1;
                 DebugLog << "package end = " << j << "package start = " << i;
-
-                if(j >= buf->writeIndex())  // 超出了，表示没有读完，跳过继续读写
-                {
-                    continue;
-                }
-
-                // 没有超出，判断结尾是否接收了整个包
-                if(tmp[j] == PB_END)
+                if(buf->at(j) == PB_END)
                 {
                     start_index = i;
-                    end_index = j;
                     DebugLog << "package recrive correct!";
                     parse_full_pack = true;
                     break;
                 }
             }
         }
+        i = buf->find(PB_START, i + 1);
     }
 
     if (!parse_full_pack) 
@@ -240,25 +320,37 @@ void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
         return;
     }
 
-    // 开始解析包
-    buf->recycleRead(end_index + 1 - start_index); // 将read_index之前的空白消除，往前滚动
-    DebugLog << "m_read_buffer size=" << buf->getBufferVector().size() << "readIndex=" << buf->readIndex() << "writeIndex=" << buf->writeIndex();
+    // 整个包的视图，后面的下标都是相对包开头的
+    TcpBufferView pack(buf, start_index, pk_len);
+    int end_index = pk_len - 1;
 
     // 创建结构体作为解析标准格式载体
     TinyPbStruct* pb_struct = dynamic_cast<TinyPbStruct*>(data);
 
     pb_struct->decode_succ = false;// 最后完成再设置回来
     pb_struct->pk_len = pk_len;  // 包大小
+
+    // 解析完成之后，包和包前面的无效字节一起消费掉，解析失败的包也丢弃
+    // 视图在消费之后就失效了，所以放在最后
+    struct RecycleGuard{
+        TcpBuffer* m_buf;
+        int m_len;
+        ~RecycleGuard()
+        {
+            m_buf->recycleRead(m_len);
+            DebugLog << "m_read_buffer readable=" << m_buf->readAble();
+        }
+    } guard {buf, start_index + pk_len};
+
         // msg_req_len
-    int msg_req_len_index = start_index + sizeof(char) + sizeof(int32_t); // msg_req_len位置，开头去掉开始标志char，和包大小数据长度int32_t
+    int msg_req_len_index = sizeof(char) + sizeof(int32_t); // msg_req_len位置，开头去掉开始标志char，和包大小数据长度int32_t
     DebugLog << "msg_req_len_index= " << msg_req_len_index;
-    if(msg_req_len_index >= end_index)
+    if(msg_req_len_index >= end_index || !getInt32FromView(pack, msg_req_len_index, pb_struct->msg_req_len))
     {
         ErrorLog << "parse error, msg_req_len_index[" << msg_req_len_index << "] >= end_index[" << end_index << "]";
         return;
     }
-    pb_struct->msg_req_len = getInt32FromNetByte(&tmp[msg_req_len_index]);
-    if(pb_struct->msg_req_len == 0)
+    if(pb_struct->msg_req_len <= 0)
     {
         ErrorLog << "prase error, msg_req empty！";
         return;
@@ -266,11 +358,14 @@ void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
     DebugLog << "msg_req_len= " << pb_struct->msg_req_len;
 
         //msg_req
-    char msg_req[50] = {0};// 此时结构体内的string还没有创建，要使用一个临时对象
     int msg_req_index = msg_req_len_index + sizeof(int32_t);
     DebugLog << "msg_req_index= " << msg_req_index;
-    memcpy(&msg_req[0], &tmp[msg_req_index], pb_struct->msg_req_len); 
-    pb_struct->msg_req = std::string(msg_req);    
+    if(pb_struct->msg_req_len > end_index - msg_req_index)
+    {
+        ErrorLog << "parse error, msg_req_len[" << pb_struct->msg_req_len << "] out of package";
+        return;
+    }
+    pack.subView(msg_req_index, pb_struct->msg_req_len).copyTo(pb_struct->msg_req);
 
         // service_name_len
     int service_name_len_index = msg_req_index + pb_struct->msg_req_len;
@@ -291,23 +386,24 @@ void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
         return;
     }
 
-    pb_struct->service_name_len = getInt32FromNetByte(&tmp[service_name_len_index]);
+    getInt32FromView(pack, service_name_len_index, pb_struct->service_name_len);
 
-    if (pb_struct->service_name_len > pk_len) 
+    if (pb_struct->service_name_len < 0 || pb_struct->service_name_len > end_index - service_name_index) 
     {
         ErrorLog << "parse error, service_name_len[" << pb_struct->service_name_len << "] >= pk_len [" << pk_len << "]";
         return;
     }
     DebugLog << "service_name_len = " << pb_struct->service_name_len;
 
-    char service_name[512] = {0};
-
-    memcpy(&service_name[0], &tmp[service_name_index], pb_struct->service_name_len);
-    pb_struct->service_full_name = std::string(service_name);
+    pack.subView(service_name_index, pb_struct->service_name_len).copyTo(pb_struct->service_full_name);
     DebugLog << "service_name = " << pb_struct->service_full_name;
 
     int err_code_index = service_name_index + pb_struct->service_name_len;
-    pb_struct->err_code = getInt32FromNetByte(&tmp[err_code_index]);
+    if(!getInt32FromView(pack, err_code_index, pb_struct->err_code))
+    {
+        ErrorLog << "parse error, err_code_index[" << err_code_index << "] >= end_index[" << end_index << "]";
+        return;
+    }
 
     int err_info_len_index = err_code_index + sizeof(int32_t);
 
@@ -317,14 +413,16 @@ void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
         // drop this error package
         return;
     }
-    pb_struct->err_info_len = getInt32FromNetByte(&tmp[err_info_len_index]);
+    getInt32FromView(pack, err_info_len_index, pb_struct->err_info_len);
     DebugLog << "err_info_len = " << pb_struct->err_info_len;
     int err_info_index = err_info_len_index + sizeof(int32_t);
 
-    char err_info[512] = {0};
-
-    memcpy(&err_info[0], &tmp[err_info_index], pb_struct->err_info_len);
-    pb_struct->err_info = std::string(err_info); 
+    if (pb_struct->err_info_len < 0 || pb_struct->err_info_len > end_index - err_info_index)
+    {
+        ErrorLog << "parse error, err_info_len[" << pb_struct->err_info_len << "] out of package";
+        return;
+    }
+    pack.subView(err_info_index, pb_struct->err_info_len).copyTo(pb_struct->err_info);
 
     int pb_data_len = pb_struct->pk_len 
                         - pb_struct->service_name_len - pb_struct->msg_req_len - pb_struct->err_info_len
@@ -333,15 +431,36 @@ void TinyPbCodeC::decode(TcpBuffer *buf, AbstractData *data)
     int pb_data_index = err_info_index + pb_struct->err_info_len;
     DebugLog << "pb_data_len= " << pb_data_len << ", pb_index = " << pb_data_index;
 
-    if (pb_data_index >= end_index) 
+    if (pb_data_len < 0 || pb_data_index >= end_index) 
     {
         ErrorLog << "parse error, pb_data_index[" << pb_data_index << "] >= end_index[" << end_index << "]";
         return;
     }
-    // DebugLog << "pb_data_index = " << pb_data_index << ", pb_data.length = " << pb_data_len;
 
-    std::string pb_data_str(&tmp[pb_data_index], pb_data_len);
-    pb_struct->pb_data = pb_data_str;
+    pack.subView(pb_data_index, pb_data_len).copyTo(pb_struct->pb_data);
+
+    int check_num_index = pb_data_index + pb_data_len;
+    getInt32FromView(pack, check_num_index, pb_struct->check_num);
+
+    // 校验和：启用了校验才计算
+    // 1. 校验通过，说明对端支持CRC32C，之后这个连接的包都必须校验通过
+    // 2. 连接还没协商过，对端填的是1，认为是老版本，不校验
+    // 3. 其他情况都认为包损坏，丢弃
+    bool negotiated = pb_struct->use_checksum;
+    pb_struct->use_checksum = false;
+    if(m_checksum_enable)
+    {
+        uint32_t crc = getCrc32cFromView(pack.subView(CHECKSUM_BEGIN, check_num_index - CHECKSUM_BEGIN));
+        if(static_cast<uint32_t>(pb_struct->check_num) == crc)
+        {
+            pb_struct->use_checksum = true;
+        }
+        else if(negotiated || pb_struct->check_num != LEGACY_CHECK_NUM)
+        {
+            ErrorLog << pb_struct->msg_req << "|checksum error, check_num = " << static_cast<uint32_t>(pb_struct->check_num) << ", crc32c = " << crc;
+            return;
+        }
+    }
 
     // DebugLog << "decode succ,  pk_len = " << pk_len << ", service_name = " << pb_struct->service_full_name; 
 
@@ -355,4 +474,14 @@ ProtocalType TinyPbCodeC::getProtocalType()
     return TinyPb_Protocal;
 }
 
+void TinyPbCodeC::setChecksumEnable(bool enable)
+{
+    m_checksum_enable = enable;
+}
+
+bool TinyPbCodeC::getChecksumEnable()
+{
+    return m_checksum_enable;
+}
+
 }
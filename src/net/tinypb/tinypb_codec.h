@@ -24,7 +24,18 @@ public:
     // 再继承定义
     virtual ProtocalType getProtocalType();
     
-    const char* encodePbData(TinyPbStruct* data, int& len);
+    // 包总长度，出错返回-1
+    int32_t getPkLen(TinyPbStruct* data);
+
+    // 编码到buf中，buf是预留好的pk_len大小的连续空间
+    bool encodePbData(TinyPbStruct* data, char* buf, int32_t pk_len);
+
+    // 是否启用CRC32C校验，默认读取配置文件中的checksum
+    void setChecksumEnable(bool enable);
+    bool getChecksumEnable();
+
+private:
+    bool m_checksum_enable {false};
 
 };
    
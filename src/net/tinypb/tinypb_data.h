@@ -9,6 +9,12 @@
 #include "src/net/abstract_data.h"
 #include "src/comm/log.h"
 
+namespace google{
+namespace protobuf{
+class Message;
+}
+}
+
 namespace tinyrpc{
 
 class TinyPbStruct : public AbstractData{
@@ -42,8 +48,16 @@ public:
 
     std::string pb_data; // protobuf数据，protobuf序列化后得到
 
+    // 编码时使用，不为空就直接序列化到发送buffer中，不再经过pb_data，不拥有这个对象
+    const google::protobuf::Message* pb_message {nullptr};
+
     int32_t check_num {0}; // 包的校验和，检验包损坏。
 
+    // 校验和是否是CRC32C，老版本固定填1，不校验
+    // 编码时：为true才计算CRC32C，否则填1
+    // 解码时：传入true表示这个连接已经协商过，必须校验通过；解码之后表示这个包是否通过了CRC32C校验
+    bool use_checksum {false};
+
 };
 
 }
@@ -0,0 +1,582 @@
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <sstream>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <google/protobuf/service.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.h>
+#include "src/comm/log.h"
+#include "src/comm/error_code.h"
+#include "src/coroutine/coroutine_hook.h"
+#include "src/net/tinypb/tinypb_rpc_async_channel.h"
+#include "src/net/tinypb/tinypb_rpc_controller.h"
+
+// 连接的读写都在reactor回调中，不在协程中，直接使用系统函数，不能走hook
+extern readv_fun_ptr_t g_sys_readv_fun;
+extern writev_fun_ptr_t g_sys_writev_fun;
+extern connect_fun_ptr_t g_sys_connect_fun;
+
+namespace tinyrpc {
+
+static const int MAX_IOVEC_COUNT = 64;
+static const int MSG_PREFIX_LEN = 8;                 // msg_req中通道号的位数
+static const int MSG_SEQ_LEN = 12;                   // msg_req中seq的位数
+static const uint64_t MAX_MSG_SEQ = 999999999999;    // 12位，seq在[1, MAX_MSG_SEQ]中循环
+
+static std::atomic<unsigned int> g_async_channel_id {0};
+
+TinyPbRpcAsyncChannel::TinyPbRpcAsyncChannel(NetAddress::ptr addr, Reactor* reactor, int max_inflight)
+: m_addr(addr), m_reactor(reactor), m_read_buffer(128), m_write_buffer(128)
+{
+    if(!m_reactor)
+    {
+        m_reactor = Reactor::getReactor();
+    }
+
+    uint64_t size = 1;
+    while(size < static_cast<uint64_t>(max_inflight))
+    {
+        size <<= 1;
+    }
+    m_slots = new InflightSlot[size];
+    m_slot_mask = size - 1;
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%08u", g_async_channel_id.fetch_add(1) % 100000000);
+    m_msg_prefix = buf;
+
+    DebugLog << "create async channel to " << m_addr->toString() << ", msg prefix=" << m_msg_prefix << ", slots=" << size;
+}
+
+TinyPbRpcAsyncChannel::~TinyPbRpcAsyncChannel()
+{
+    // 任务中持有shared_ptr，走到这里说明没有还没开始的调用了，剩下的都是在等回复
+    std::vector<AsyncCall*> calls;
+    for(uint64_t i = 0; i <= m_slot_mask; ++i)
+    {
+        uint64_t seq = m_slots[i].m_seq.load(std::memory_order_acquire);
+        if(seq == 0)
+        {
+            continue;
+        }
+        AsyncCall* call = releaseSlot(seq);
+        if(call)
+        {
+            calls.push_back(call);
+        }
+    }
+    delete[] m_slots;
+
+    if(m_fd == -1 && calls.empty())
+    {
+        return;
+    }
+
+    // 最后一个引用可能在任意线程释放，关连接和done->Run()都要回到reactor线程，不能再用this
+    Reactor* reactor = m_reactor;
+    int fd = m_fd;
+    FdEvent::ptr fd_event = m_fd_event;
+    auto cleanup = [reactor, fd, fd_event, calls]() {
+        if(fd != -1)
+        {
+            fd_event->unregisterFromReactor();
+            close(fd);
+        }
+        for(size_t i = 0; i < calls.size(); ++i)
+        {
+            completeCall(reactor, calls[i], ERROR_PEER_CLOSED, "async channel destroyed");
+        }
+    };
+
+    if(m_reactor->getTid() == gettid())
+    {
+        cleanup();
+    }
+    else
+    {
+        m_reactor->addTask(cleanup);
+    }
+}
+
+void TinyPbRpcAsyncChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
+                google::protobuf::RpcController* controller,
+                const google::protobuf::Message* request,
+                google::protobuf::Message* response,
+                google::protobuf::Closure* done)
+{
+    TinyPbRpcController* rpc_controller = dynamic_cast<TinyPbRpcController*>(controller);
+    if(!rpc_controller)
+    {
+        ErrorLog << "call failed. falid to dynamic cast TinyPbRpcController";
+        return;
+    }
+    rpc_controller->SetPeerAddr(m_addr);
+
+    AsyncCall* call = new AsyncCall();
+    call->method = method;
+    call->controller = rpc_controller;
+    call->request = request;
+    call->response = response;
+    call->done = done;
+
+    ptr self = shared_from_this();
+
+    // 出错也要在reactor线程中执行done
+    if(!request->IsInitialized())
+    {
+        ErrorLog << "serialize send package error";
+        m_reactor->addTask([self, call]() {
+            self->finishCall(call, ERROR_FAILED_SERIALIZE, "request is not initialized");
+        });
+        return;
+    }
+
+    if(!acquireSlot(call))
+    {
+        ErrorLog << "too many inflight calls, inflight count=" << m_inflight_count.load();
+        m_reactor->addTask([self, call]() {
+            self->finishCall(call, ERROR_CHANNEL_FULL, "too many inflight calls");
+        });
+        return;
+    }
+    rpc_controller->SetMsgReq(genMsgReq(call->seq));
+
+    m_reactor->addTask([self, call]() {
+        self->startCall(call);
+    });
+}
+
+int TinyPbRpcAsyncChannel::getInflightCount() const
+{
+    return m_inflight_count.load(std::memory_order_relaxed);
+}
+
+Reactor* TinyPbRpcAsyncChannel::getReactor() const
+{
+    return m_reactor;
+}
+
+// 编码到发送buffer，同一轮loop中的调用合并成一次writev
+void TinyPbRpcAsyncChannel::startCall(AsyncCall* call)
+{
+    call->started = true;
+
+    TinyPbStruct pb_struct;
+    pb_struct.msg_req = call->controller->MsgSeq();
+    pb_struct.service_full_name = call->method->full_name();
+    pb_struct.pb_message = call->request;
+    pb_struct.use_checksum = true;
+
+    m_codec.encode(&m_write_buffer, &pb_struct);
+    if(!pb_struct.encode_succ)
+    {
+        releaseSlot(call->seq);
+        finishCall(call, ERROR_FAILED_ENCODE, "encode tinypb data error");
+        return;
+    }
+    DebugLog << pb_struct.msg_req << "|" << m_addr->toString() << "|send request, inflight=" << getInflightCount();
+
+    if(call->controller->Timeout() > 0)
+    {
+        std::weak_ptr<TinyPbRpcAsyncChannel> weak = shared_from_this();
+        uint64_t seq = call->seq;
+        call->timer_event = std::make_shared<TimerEvent>(call->controller->Timeout(), false, [weak, seq]() {
+            ptr self = weak.lock();
+            if(self)
+            {
+                self->onTimeout(seq);
+            }
+        });
+        m_reactor->getTimer()->addTimerEvent(call->timer_event);
+    }
+
+    if(m_state == Disconnected)
+    {
+        connect();
+    }
+    else if(m_state == Connected)
+    {
+        scheduleFlush();
+    }
+}
+
+void TinyPbRpcAsyncChannel::connect()
+{
+    m_fd = socket(m_addr->getFamily(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(m_fd == -1)
+    {
+        closeConnection(ERROR_CONNECT_SYS_ERR, std::string("call socket error, sys error=") + strerror(errno));
+        return;
+    }
+    int flag = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    std::weak_ptr<TinyPbRpcAsyncChannel> weak = shared_from_this();
+    m_fd_event = FdEventContainer::getFdContainer()->getFdEvent(m_fd);
+    m_fd_event->setReactor(m_reactor);
+    m_fd_event->clearCoroutine();
+    m_fd_event->setCallBack(READ, [weak]() {
+        ptr self = weak.lock();
+        if(self)
+        {
+            self->onRead();
+        }
+    });
+    m_fd_event->setCallBack(WRITE, [weak]() {
+        ptr self = weak.lock();
+        if(!self)
+        {
+            return;
+        }
+        if(self->m_state == Connecting)
+        {
+            self->onConnected();
+        }
+        else
+        {
+            self->flush();
+        }
+    });
+
+    m_state = Connecting;
+    int rt = g_sys_connect_fun(m_fd, m_addr->getSockAddr(), m_addr->getSockLen());
+    if(rt == 0)
+    {
+        onConnected();
+    }
+    else if(errno == EINPROGRESS)
+    {
+        DebugLog << "connect " << m_addr->toString() << " in progress, fd=" << m_fd;
+        m_fd_event->addListenEvents(WRITE);
+    }
+    else
+    {
+        closeConnection(ERROR_FAILED_CONNECT, std::string("connect error, sys error=") + strerror(errno));
+    }
+}
+
+void TinyPbRpcAsyncChannel::onConnected()
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if(getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+    {
+        std::stringstream ss;
+        ss << "connect peer addr[" << m_addr->toString() << "] error. sys error=" << strerror(err);
+        closeConnection(ERROR_FAILED_CONNECT, ss.str());
+        return;
+    }
+
+    InfoLog << "async channel connect " << m_addr->toString() << " succ, fd=" << m_fd;
+    m_state = Connected;
+    m_fd_event->addListenEvents(READ);
+    flush();
+}
+
+void TinyPbRpcAsyncChannel::scheduleFlush()
+{
+    if(m_flush_scheduled)
+    {
+        return;
+    }
+    m_flush_scheduled = true;
+    ptr self = shared_from_this();
+    m_reactor->addTask([self]() {
+        self->flush();
+    });
+}
+
+void TinyPbRpcAsyncChannel::flush()
+{
+    m_flush_scheduled = false;
+    if(m_state != Connected)
+    {
+        return;
+    }
+
+    while(m_write_buffer.readAble() > 0)
+    {
+        struct iovec vecs[MAX_IOVEC_COUNT];
+        int vec_count = m_write_buffer.getReadVecs(vecs, MAX_IOVEC_COUNT);
+        ssize_t rt = g_sys_writev_fun(m_fd, vecs, vec_count);
+        if(rt > 0)
+        {
+            m_write_buffer.recycleRead(rt);
+            continue;
+        }
+        if(rt < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // socket发送缓冲区满了，等可写再发
+            m_fd_event->addListenEvents(WRITE);
+            return;
+        }
+        closeConnection(ERROR_PEER_CLOSED, std::string("write error, sys error=") + strerror(errno));
+        return;
+    }
+
+    if(m_fd_event->getListenEvents() & WRITE)
+    {
+        m_fd_event->delListenEvents(WRITE);
+    }
+}
+
+void TinyPbRpcAsyncChannel::onRead()
+{
+    if(m_state != Connected)
+    {
+        return;
+    }
+
+    bool peer_close = false;
+    while(true)
+    {
+        struct iovec vecs[MAX_IOVEC_COUNT];
+        int vec_count = m_read_buffer.getWriteVecs(vecs, MAX_IOVEC_COUNT, TcpBuffer::SLAB_SIZE);
+        ssize_t read_count = 0;
+        for(int i = 0; i < vec_count; ++i)
+        {
+            read_count += vecs[i].iov_len;
+        }
+
+        ssize_t rt = g_sys_readv_fun(m_fd, vecs, vec_count);
+        if(rt > 0)
+        {
+            m_read_buffer.recucleWrite(rt);
+            if(rt < read_count)
+            {
+                break;
+            }
+            continue;
+        }
+        if(rt < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        peer_close = true;
+        break;
+    }
+
+    // 解码所有完整的回复
+    while(m_read_buffer.readAble() > 0)
+    {
+        TinyPbStruct reply;
+        reply.use_checksum = m_checksum_negotiated;
+        int readable = m_read_buffer.readAble();
+        m_codec.decode(&m_read_buffer, &reply);
+        if(!reply.decode_succ)
+        {
+            if(m_read_buffer.readAble() < readable)
+            {
+                continue;
+            }
+            break;
+        }
+        if(reply.use_checksum)
+        {
+            m_checksum_negotiated = true;
+        }
+        onReply(&reply);
+    }
+
+    if(peer_close)
+    {
+        closeConnection(ERROR_PEER_CLOSED, "peer closed [" + m_addr->toString() + "]");
+    }
+}
+
+void TinyPbRpcAsyncChannel::onReply(TinyPbStruct* reply)
+{
+    uint64_t seq = 0;
+    if(!parseMsgReq(reply->msg_req, seq))
+    {
+        ErrorLog << reply->msg_req << "|unknown msg_req, drop reply";
+        return;
+    }
+
+    AsyncCall* call = releaseSlot(seq);
+    if(!call)
+    {
+        // 已经超时了
+        DebugLog << reply->msg_req << "|no inflight call, maybe timeout, drop reply";
+        return;
+    }
+
+    if(reply->err_code != 0)
+    {
+        ErrorLog << reply->msg_req << "|server reply error_code=" << reply->err_code << ", err_info=" << reply->err_info;
+        finishCall(call, reply->err_code, reply->err_info);
+        return;
+    }
+
+    if(!call->response->ParseFromString(reply->pb_data))
+    {
+        ErrorLog << reply->msg_req << "|failed to deserialize data";
+        finishCall(call, ERROR_FAILED_DESERIALIZE, "failed to deserialize data from server");
+        return;
+    }
+
+    DebugLog << reply->msg_req << "|call rpc server [" << reply->service_full_name << "] succ";
+    finishCall(call, 0, "");
+}
+
+void TinyPbRpcAsyncChannel::onTimeout(uint64_t seq)
+{
+    AsyncCall* call = releaseSlot(seq);
+    if(!call)
+    {
+        return;
+    }
+    call->timer_event.reset();  // 已经触发了，不需要再删除
+
+    std::stringstream ss;
+    ss << "call rpc falied , over " << call->controller->Timeout() << "ms";
+    ErrorLog << call->controller->MsgSeq() << "|" << ss.str();
+    finishCall(call, ERROR_RPC_CALL_TIMEOUT, ss.str());
+}
+
+// 连接出错，所有已经发出的调用都失败，下一次调用重新连接
+void TinyPbRpcAsyncChannel::closeConnection(int err_code, const std::string& err_info)
+{
+    ErrorLog << "async channel to " << m_addr->toString() << " closed, err_info=" << err_info;
+
+    if(m_fd != -1)
+    {
+        m_fd_event->unregisterFromReactor();
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_state = Disconnected;
+    m_read_buffer.clearBuffer();
+    m_write_buffer.clearBuffer();
+    m_checksum_negotiated = false;
+
+    for(uint64_t i = 0; i <= m_slot_mask; ++i)
+    {
+        uint64_t seq = m_slots[i].m_seq.load(std::memory_order_acquire);
+        if(seq == 0)
+        {
+            continue;
+        }
+        // 还没开始的调用在后面的任务中重新连接
+        AsyncCall* call = m_slots[i].m_call.load(std::memory_order_acquire);
+        if(!call || !call->started)
+        {
+            continue;
+        }
+        releaseSlot(seq);
+        finishCall(call, err_code, err_info);
+    }
+}
+
+bool TinyPbRpcAsyncChannel::acquireSlot(AsyncCall* call)
+{
+    // 先占一个名额，名额够说明一定还有空槽位，满了直接失败
+    uint64_t capacity = m_slot_mask + 1;
+    int count = m_inflight_count.load(std::memory_order_relaxed);
+    do
+    {
+        if(static_cast<uint64_t>(count) >= capacity)
+        {
+            return false;
+        }
+    } while(!m_inflight_count.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+
+    // 慢调用占着的槽位跳过，换下一个seq，最多把整个环找两遍(seq回绕的时候槽位不连续)
+    for(uint64_t i = 0; i < capacity * 2; ++i)
+    {
+        uint64_t seq = m_next_seq.fetch_add(1, std::memory_order_relaxed) % MAX_MSG_SEQ + 1;
+        InflightSlot& slot = m_slots[seq & m_slot_mask];
+
+        uint64_t expect = 0;
+        if(slot.m_seq.compare_exchange_strong(expect, seq, std::memory_order_acq_rel))
+        {
+            call->seq = seq;
+            slot.m_call.store(call, std::memory_order_release);
+            return true;
+        }
+    }
+    m_inflight_count.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+// 只在reactor线程中调用，所以回复和超时只有一个能拿到调用
+TinyPbRpcAsyncChannel::AsyncCall* TinyPbRpcAsyncChannel::releaseSlot(uint64_t seq)
+{
+    InflightSlot& slot = m_slots[seq & m_slot_mask];
+    if(slot.m_seq.load(std::memory_order_acquire) != seq)
+    {
+        return nullptr;
+    }
+
+    AsyncCall* call = slot.m_call.exchange(nullptr, std::memory_order_acq_rel);
+    slot.m_seq.store(0, std::memory_order_release);
+    m_inflight_count.fetch_sub(1, std::memory_order_relaxed);
+    return call;
+}
+
+void TinyPbRpcAsyncChannel::finishCall(AsyncCall* call, int err_code, const std::string& err_info)
+{
+    completeCall(m_reactor, call, err_code, err_info);
+}
+
+void TinyPbRpcAsyncChannel::completeCall(Reactor* reactor, AsyncCall* call, int err_code, const std::string& err_info)
+{
+    if(call->timer_event)
+    {
+        reactor->getTimer()->delTimerEvent(call->timer_event);
+    }
+    if(err_code != 0)
+    {
+        call->controller->SetError(err_code, err_info);
+    }
+
+    google::protobuf::Closure* done = call->done;
+    delete call;
+
+    if(done)
+    {
+        done->Run();
+    }
+}
+
+std::string TinyPbRpcAsyncChannel::genMsgReq(uint64_t seq) const
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%012llu", static_cast<unsigned long long>(seq));
+    return m_msg_prefix + buf;
+}
+
+bool TinyPbRpcAsyncChannel::parseMsgReq(const std::string& msg_req, uint64_t& seq) const
+{
+    if(msg_req.length() != MSG_PREFIX_LEN + MSG_SEQ_LEN || msg_req.compare(0, MSG_PREFIX_LEN, m_msg_prefix) != 0)
+    {
+        return false;
+    }
+
+    seq = 0;
+    for(int i = MSG_PREFIX_LEN; i < MSG_PREFIX_LEN + MSG_SEQ_LEN; ++i)
+    {
+        if(msg_req[i] < '0' || msg_req[i] > '9')
+        {
+            return false;
+        }
+        seq = seq * 10 + (msg_req[i] - '0');
+    }
+    return seq != 0;
+}
+
+} // namespace tinyrpc
@@ -0,0 +1,136 @@
+// 异步多路复用通道：一个连接上同时进行多个rpc调用，通过msg_req匹配回复
+
+#ifndef SRC_NET_TINYPB_TINYPB_RPC_ASYNC_CHANNEL_H
+#define SRC_NET_TINYPB_TINYPB_RPC_ASYNC_CHANNEL_H
+
+#include <stdint.h>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <google/protobuf/service.h>
+#include "src/net/net_address.h"
+#include "src/net/reactor.h"
+#include "src/net/fd_event.h"
+#include "src/net/timer.h"
+#include "src/net/tcp/tcp_buffer.h"
+#include "src/net/tinypb/tinypb_codec.h"
+#include "src/net/tinypb/tinypb_data.h"
+
+/*
+
+    TinyPbRpcChannel每次调用都新建一个TcpClient，连接、发送、同步等待回复
+    TinyPbRpcAsyncChannel保持一个长连接，CallMethod不阻塞，可以同时发起很多调用：
+    1. 每个调用分配一个递增的seq，编码到msg_req中(8位通道号 + 12位seq)，回复包原样带回msg_req
+    2. 在途调用保存在固定大小的槽位表中，下标是seq & mask，CAS占用槽位，不加锁
+    3. 连接的读写、编解码、超时都在绑定的reactor线程中完成，基于FdEvent回调，不使用协程
+    4. 调用完成(成功、出错、超时)都在reactor线程中执行done->Run()
+
+    使用要求：
+    1. 必须通过std::make_shared创建，CallMethod中会用到shared_from_this
+    2. controller必须是TinyPbRpcController，request、response、controller在done执行之前都要有效
+    3. 绑定的reactor需要在loop中，默认是创建channel的线程的reactor
+    4. channel析构的时候还没完成的调用直接失败，可以在任意线程析构，关连接和done->Run()会投递到reactor线程执行
+       所以析构之后reactor还要继续loop，否则这些done不会执行
+
+*/
+
+namespace tinyrpc {
+
+class TinyPbRpcController;
+
+class TinyPbRpcAsyncChannel : public google::protobuf::RpcChannel, public std::enable_shared_from_this<TinyPbRpcAsyncChannel> {
+
+public:
+    typedef std::shared_ptr<TinyPbRpcAsyncChannel> ptr;
+
+public:
+    // max_inflight: 同时在途的调用上限，向上取整到2的幂，超过的调用以ERROR_CHANNEL_FULL失败
+    TinyPbRpcAsyncChannel(NetAddress::ptr addr, Reactor* reactor = nullptr, int max_inflight = 1024);
+    ~TinyPbRpcAsyncChannel();
+
+    // 可以在任意线程调用，立即返回
+    void CallMethod(const google::protobuf::MethodDescriptor* method,
+    google::protobuf::RpcController* controller,
+    const google::protobuf::Message* request,
+    google::protobuf::Message* response,
+    google::protobuf::Closure* done) override;
+
+    int getInflightCount() const;
+
+    Reactor* getReactor() const;
+
+private:
+    // 一次在途调用
+    struct AsyncCall{
+        uint64_t seq {0};
+        const google::protobuf::MethodDescriptor* method {nullptr};
+        TinyPbRpcController* controller {nullptr};
+        const google::protobuf::Message* request {nullptr};
+        google::protobuf::Message* response {nullptr};
+        google::protobuf::Closure* done {nullptr};
+        TimerEvent::ptr timer_event;
+        bool started {false};   // 已经在reactor线程中编码发送，只有这样的调用才会被超时和断连处理
+    };
+
+    // 槽位，m_seq为0表示空闲
+    struct InflightSlot{
+        std::atomic<uint64_t> m_seq {0};
+        std::atomic<AsyncCall*> m_call {nullptr};
+    };
+
+private:
+    // 下面的函数都只在reactor线程中执行
+    void startCall(AsyncCall* call);
+    void connect();
+    void onConnected();
+    void onRead();
+    void flush();
+    void scheduleFlush();
+    void onTimeout(uint64_t seq);
+    void onReply(TinyPbStruct* reply);
+    void closeConnection(int err_code, const std::string& err_info);
+
+    // 占用/释放在途槽位
+    bool acquireSlot(AsyncCall* call);
+    AsyncCall* releaseSlot(uint64_t seq);
+
+    void finishCall(AsyncCall* call, int err_code, const std::string& err_info);
+    // 不依赖channel对象，析构之后在reactor线程中收尾用
+    static void completeCall(Reactor* reactor, AsyncCall* call, int err_code, const std::string& err_info);
+
+    std::string genMsgReq(uint64_t seq) const;
+    bool parseMsgReq(const std::string& msg_req, uint64_t& seq) const;
+
+private:
+    enum ConnState{
+        Disconnected = 0,
+        Connecting = 1,
+        Connected = 2
+    };
+
+    NetAddress::ptr m_addr;
+    Reactor* m_reactor {nullptr};
+
+    std::string m_msg_prefix;   // msg_req前缀，区分不同的channel
+
+    // 在途调用表
+    InflightSlot* m_slots {nullptr};
+    uint64_t m_slot_mask {0};
+    std::atomic<uint64_t> m_next_seq {0};
+    std::atomic<int> m_inflight_count {0};
+
+    // 以下只在reactor线程中访问
+    int m_fd {-1};
+    ConnState m_state {Disconnected};
+    FdEvent::ptr m_fd_event;
+    TcpBuffer m_read_buffer;
+    TcpBuffer m_write_buffer;
+    TinyPbCodeC m_codec;
+    bool m_flush_scheduled {false};
+    bool m_checksum_negotiated {false};
+};
+
+} // namespace tinyrpc
+
+
+#endif
@@ -7,6 +7,7 @@
 #include "src/net/net_address.h"
 #include "src/comm/error_code.h"
 #include "src/net/tcp/tcp_client.h"
+#include "src/net/tcp/tcp_client_pool.h"
 #include "src/net/tinypb/tinypb_rpc_channel.h"
 #include "src/net/tinypb/tinypb_rpc_controller.h"
 #include "src/net/tinypb/tinypb_codec.h"
@@ -17,6 +18,20 @@
 
 namespace tinyrpc{
 
+// 连接用完归还连接池，只有调用成功的连接才能复用
+// 失败的连接里面可能还有没读完的回复或者已经断开，直接关闭
+struct ClientLeaseGuard{
+    TcpClient::ptr client;
+    bool reusable {false};
+
+    ClientLeaseGuard(TcpClient::ptr c) : client(c) {}
+
+    ~ClientLeaseGuard()
+    {
+        getTcpClientPool()->release(client, reusable);
+    }
+};
+
 
 TinyPbRpcChannel::TinyPbRpcChannel(NetAddress::ptr addr)
 : m_addr(addr)
@@ -38,8 +53,9 @@ void TinyPbRpcChannel::CallMethod(const google::protobuf::MethodDescriptor *meth
         return;
     }
 
-    // 设置客户端信息
-    TcpClient::ptr m_client = std::make_shared<TcpClient>(m_addr);
+    // 设置客户端信息，从当前线程的连接池拿，有空闲连接就不用重新connect
+    TcpClient::ptr m_client = getTcpClientPool()->lease(m_addr);
+    ClientLeaseGuard lease_guard(m_client);
     rpc_controller->SetLocalAddr(m_client->getLocalAddr());
     rpc_controller->SetPeerAddr(m_client->getPeerAddr());
 
@@ -49,11 +65,14 @@ void TinyPbRpcChannel::CallMethod(const google::protobuf::MethodDescriptor *meth
 
     // 序列化客户端要发送的包
     // 内容就是proto定义的request的请求函数字段，就是要调用那个message，然后服务器处理填充这些字段进行返回
-    if(!request->SerializeToString(&pb_struct.pb_data))
+    // 编码的时候直接序列化到发送buffer中
+    if(!request->IsInitialized())
     {
         ErrorLog << "serialize send package error";
         return;
     }
+    pb_struct.pb_message = request;
+    pb_struct.use_checksum = true; // 配置启用了校验才会真正计算，对端是老版本也能正常解析
 
     // 消息序列是空的就随机生成
     if(!rpc_controller->MsgSeq().empty())
@@ -106,6 +125,7 @@ void TinyPbRpcChannel::CallMethod(const google::protobuf::MethodDescriptor *meth
             << rt << ", error_info = " << m_client->getErrInfo();
         return;
     }
+    lease_guard.reusable = true; // 收到了完整的回复，连接上没有残留数据
 
     // 拿到回复的数据包，进行字符串->proto的反序列化解析，保存到response中
     if(!response->ParseFromString(res_data->pb_data))
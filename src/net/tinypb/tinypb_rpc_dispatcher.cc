@@ -44,6 +44,7 @@ void TinyPbRpcDispacther::dispatcher(AbstractData *data, TcpConnection *conn)
     TinyPbStruct reply_pk;
     reply_pk.service_full_name = tmp->service_full_name;
     reply_pk.msg_req = tmp->msg_req;
+    reply_pk.use_checksum = tmp->use_checksum; // 请求通过了CRC32C校验，回复也带上校验
         // 如果request是空的，产生随机数填充
     if(reply_pk.msg_req.empty())
     {
@@ -86,7 +87,7 @@ void TinyPbRpcDispacther::dispatcher(AbstractData *data, TcpConnection *conn)
     service_ptr service = (*it).second; // 这个service类是通过注册得到的，是通过继承proto编译之后的h文件创建的一个Queryservice创建的类，定义了自己的使用方法
 
         // 通过descriptorPool和Method工厂类获取MethodDescriptor类
-    const google::protobuf::MethodDescriptor* method = service->GetDescriptor()->FindMethodByName(service_name);
+    const google::protobuf::MethodDescriptor* method = service->GetDescriptor()->FindMethodByName(method_name);
     if(!method)
     {
         // 方法名查找失败，设置错误码
@@ -123,50 +124,69 @@ void TinyPbRpcDispacther::dispatcher(AbstractData *data, TcpConnection *conn)
     google::protobuf::Message* response = service->GetResponsePrototype(method).New();
     DebugLog << reply_pk.msg_req << "|response.name = " << response->GetDescriptor()->full_name();
 
-    // 6. 为调用CallMethod准备google::protobuf::RpcControllel
-    TinyPbRpcController rpc_controller;
-    rpc_controller.SetMsgReq(reply_pk.msg_req);
-    rpc_controller.SetMethodName(method_name);
-    rpc_controller.SetMethodFullName(tmp->service_full_name);
+    // 6. 为调用CallMethod准备google::protobuf::RpcControllel，两种执行方式放的地方不一样，在下面分别创建
 
     // 7. 定义RpcClosure, 返回需要
     // 用户把 done 保存下来，在服务回调之后的某事件发生时再调用，即实现异步 Service
     // 这个函数在调用done->Run()是被执行
         // 设置要执行的函数，这里什么都不执行，只是应付调用
     std::function<void()> reply_package_func = [](){};
-    TinyPbRpcClosure closure(reply_package_func);
 
     // 8. 调用service->CallMethod方法，这个方法调用子类的，需要重载RpcChannel的CallMethod方法
         // 作用就是将requset的请求内容执行，然后返回信息放到response中
         // 这个service是继承了QueryService的子类QueryServiceIml，但是没有重载CallMethod
         // 所以这里调用的是QueryService的CallMethod,里面实现的是通过method的序号判断使用哪个函数
         // 之后调用这个函数，而这个函数是子类重载了的，所以调用子类的函数，达到目的
-    service->CallMethod(method, &rpc_controller, request, response, &closure);
+    if(m_worker_pool && m_worker_methods.find(tmp->service_full_name) != m_worker_methods.end())
+    {
+        // 交给工作线程执行，协程挂起，执行完回到本io线程编码回复
+        // 协程挂起的时候共享栈会被别的协程覆盖，工作线程用到的controller和closure放在堆上
+        std::shared_ptr<TinyPbRpcController> rpc_controller = std::make_shared<TinyPbRpcController>();
+        rpc_controller->SetMsgReq(reply_pk.msg_req);
+        rpc_controller->SetMethodName(method_name);
+        rpc_controller->SetMethodFullName(tmp->service_full_name);
+        std::shared_ptr<TinyPbRpcClosure> closure = std::make_shared<TinyPbRpcClosure>(reply_package_func);
+
+        m_worker_pool->runAndWait([service, method, rpc_controller, request, response, closure]()
+        {
+            service->CallMethod(method, rpc_controller.get(), request, response, closure.get());
+        });
+    }
+    else
+    {
+        TinyPbRpcController rpc_controller;
+        rpc_controller.SetMsgReq(reply_pk.msg_req);
+        rpc_controller.SetMethodName(method_name);
+        rpc_controller.SetMethodFullName(tmp->service_full_name);
+        TinyPbRpcClosure closure(reply_package_func);
+
+        service->CallMethod(method, &rpc_controller, request, response, &closure);
+    }
     InfoLog << "Call [" << reply_pk.service_full_name << "] succ, now send reply package";
 
-    // 9. response结构进行序列化到String，放入reply_pk.pb_data中进行传输
-        // request是反序列化string到proto
-    if(!(response->SerializeToString(&(reply_pk.pb_data))))
+    // 9. response不再序列化到reply_pk.pb_data，编码的时候直接序列化到发送buffer中
+        // 只有缺少required字段的时候序列化才会失败
+    if(!response->IsInitialized())
     {
-        reply_pk.pb_data = "";
         ErrorLog << reply_pk.msg_req << "|reply error! encode reply package error";
         reply_pk.err_code = ERROR_FAILED_SERIALIZE;
         reply_pk.err_info = "failed to serilize relpy data";
     }
     else
     {
+        reply_pk.pb_message = response;
         InfoLog << "============================================================";
         InfoLog << reply_pk.msg_req << "|Set server response data:" << response->ShortDebugString();
         InfoLog << "============================================================";
     }
 
-    // 结束删除反射的实例
-    delete request;
-    delete response;
-    
     // 进行最后的tcp发送
     conn->getCodec()->encode(conn->getOutBuffer(), dynamic_cast<AbstractData*>(&reply_pk));
 
+    // 编码完成之后才能删除反射的实例
+    delete request;
+    delete response;
+
 }
 
 bool TinyPbRpcDispacther::parseServiceFullName(const std::string &full_name, std::string &service_name, std::string &method_name)
@@ -194,11 +214,36 @@ bool TinyPbRpcDispacther::parseServiceFullName(const std::string &full_name, std
 }
 
 // 使用时调用注册，就是加入到map中
-void TinyPbRpcDispacther::registerService(service_ptr service)
+bool TinyPbRpcDispacther::registerService(service_ptr service, const std::vector<std::string>& worker_methods /*= std::vector<std::string>()*/)
 {
     std::string service_name = service->GetDescriptor()->full_name();
+    for(size_t i = 0; i < worker_methods.size(); ++i)
+    {
+        if(!service->GetDescriptor()->FindMethodByName(worker_methods[i]))
+        {
+            ErrorLog << "register service[" << service_name << "] error, not found worker method[" << worker_methods[i] << "]";
+            return false;
+        }
+    }
+
     m_service_map[service_name] = service;
+    for(size_t i = 0; i < worker_methods.size(); ++i)
+    {
+        m_worker_methods.insert(service_name + "." + worker_methods[i]);
+        InfoLog << "method[" << service_name << "." << worker_methods[i] << "] will run in worker thread";
+    }
     InfoLog << "succ register service[" << service_name << "]!"; 
+    return true;
+}
+
+bool TinyPbRpcDispacther::hasWorkerMethod() const
+{
+    return !m_worker_methods.empty();
+}
+
+void TinyPbRpcDispacther::setWorkerThreadPool(WorkerThreadPool::ptr pool)
+{
+    m_worker_pool = pool;
 }
 
 } // namespace tinyrpc
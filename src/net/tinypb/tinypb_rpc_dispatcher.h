@@ -5,10 +5,14 @@
 #include <google/protobuf/service.h>
 #include <google/protobuf/descriptor.h>
 #include <map>
+#include <set>
+#include <vector>
+#include <string>
 #include <memory>
 
 #include "src/net/abstract_dispatcher.h"
 #include "src/net/tinypb/tinypb_data.h"
+#include "src/net/tcp/worker_thread_pool.h"
 
 namespace tinyrpc{
 
@@ -25,13 +29,25 @@ public:
 
     bool parseServiceFullName(const std::string& full_name, std::string& service_name, std::string& method_name);  // 解析服务名和方法
 
-    void registerService(service_ptr service);  // 注册到map
+    // 注册到map，worker_methods里的方法(只写方法名)在工作线程执行，方法不存在返回false
+    // 工作线程不在协程里：hook的io和sleep直接调用系统函数，CoroutineMutex和co_sync里的原语阻塞工作线程等待
+    bool registerService(service_ptr service, const std::vector<std::string>& worker_methods = std::vector<std::string>());
+
+    bool hasWorkerMethod() const;
+
+    // 没有设置的时候注册成在工作线程执行的方法也在io协程里执行
+    void setWorkerThreadPool(WorkerThreadPool::ptr pool);
 
 public:
     // 程序开始之前，所有的服务都应该注册在这个map中
    // key: service_name
     std::map<std::string, service_ptr> m_service_map;
 
+    // 在工作线程执行的方法，key: service_name.method_name
+    std::set<std::string> m_worker_methods;
+
+    WorkerThreadPool::ptr m_worker_pool;
+
 };
 
     
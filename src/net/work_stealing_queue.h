@@ -0,0 +1,186 @@
+#ifndef SRC_NET_WORK_STEALING_QUEUE_H
+#define SRC_NET_WORK_STEALING_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/*
+
+    Chase-Lev工作窃取双端队列，无锁
+    1. 只有所属线程调用push/pop，在底部操作，后进先出
+    2. 其他线程调用steal，在顶部操作，先进先出，和所属线程只在剩最后一个元素的时候竞争top的CAS
+    3. 满了就扩容成两倍，旧数组可能还有窃取线程在读，不马上释放，析构的时候一起释放
+
+    内存序参考 Le, Pop, Cohen, Zappa Nardelli. Correct and Efficient Work-Stealing for Weak Memory Models. PPoPP 2013
+    T必须是可以放进std::atomic的类型，这里只用来放指针
+
+*/
+
+namespace tinyrpc{
+
+template<class T>
+class WorkStealingQueue{
+
+public:
+    // capacity向上取整到2的幂
+    explicit WorkStealingQueue(int64_t capacity = 256)
+    {
+        int64_t cap = 1;
+        while(cap < capacity)
+        {
+            cap <<= 1;
+        }
+        m_top.store(0, std::memory_order_relaxed);
+        m_bottom.store(0, std::memory_order_relaxed);
+        m_array.store(new Array(cap), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingQueue()
+    {
+        for(size_t i = 0; i < m_garbage.size(); ++i)
+        {
+            delete m_garbage[i];
+        }
+        delete m_array.load(std::memory_order_relaxed);
+    }
+
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+public:
+    // 所属线程调用
+    void push(T item)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+
+        if(b - t > a->m_cap - 1)
+        {
+            Array* bigger = a->grow(b, t);
+            m_garbage.push_back(a);
+            a = bigger;
+            m_array.store(a, std::memory_order_release);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // 所属线程调用，空的时候返回false
+    bool pop(T& item)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if(t > b)
+        {
+            // 已经空了，恢复bottom
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = a->get(b);
+        if(t == b)
+        {
+            // 最后一个元素，和窃取线程抢top
+            bool succ = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return succ;
+        }
+        return true;
+    }
+
+    // 任意线程调用，空的或者和别的线程竞争失败返回false
+    bool steal(T& item)
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+
+        if(t >= b)
+        {
+            return false;
+        }
+
+        Array* a = m_array.load(std::memory_order_acquire);
+        T x = a->get(t);
+        if(!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        item = x;
+        return true;
+    }
+
+    // 近似值，只用于统计和判断是否值得窃取
+    int64_t size() const
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    struct Array{
+        int64_t m_cap;
+        int64_t m_mask;
+        std::atomic<T>* m_buf;
+
+        explicit Array(int64_t cap)
+        : m_cap(cap), m_mask(cap - 1), m_buf(new std::atomic<T>[cap])
+        {
+        }
+
+        ~Array()
+        {
+            delete[] m_buf;
+        }
+
+        T get(int64_t i)
+        {
+            return m_buf[i & m_mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T x)
+        {
+            m_buf[i & m_mask].store(x, std::memory_order_relaxed);
+        }
+
+        Array* grow(int64_t b, int64_t t)
+        {
+            Array* a = new Array(m_cap * 2);
+            for(int64_t i = t; i < b; ++i)
+            {
+                a->put(i, get(i));
+            }
+            return a;
+        }
+    };
+
+    // top和bottom分别被窃取线程和所属线程频繁修改，分开放在不同的cache line
+    // 用填充隔开而不是alignas，C++11的new不保证超过默认对齐的对齐，填充不管怎么分配都有效
+    char m_pad0[64];
+    std::atomic<int64_t> m_top;
+    char m_pad1[64];
+    std::atomic<int64_t> m_bottom;
+    char m_pad2[64];
+    std::atomic<Array*> m_array;
+    char m_pad3[64];
+
+    std::vector<Array*> m_garbage;  // 扩容替换下来的旧数组，只有所属线程访问
+};
+
+} // namespace tinyrpc
+
+
+#endif
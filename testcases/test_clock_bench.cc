@@ -0,0 +1,80 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "src/comm/clock.h"
+
+// 取一次时间的开销，ns
+// gettimeofday/clock_gettime是原来定时器和日志的做法，cached是reactor循环里Clock::nowMs()的做法
+// precise/cycles是Clock的高精度时钟，tsc表示有没有用rdtsc
+// ./test_clock_bench [calls]
+
+namespace {
+
+template <class Read>
+double run(int64_t calls, Read read) {
+  int64_t sum = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < calls; ++i) {
+    sum += read();
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  if (sum == 42) {
+    std::cout << "";
+  }
+  return cost / calls;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int64_t calls = 10000000;
+  if (argc > 1) {
+    calls = std::atoll(argv[1]);
+  }
+
+  double t_gettimeofday = run(calls, []() {
+    timeval val;
+    gettimeofday(&val, nullptr);
+    return static_cast<int64_t>(val.tv_usec);
+  });
+  double t_clock_gettime = run(calls, []() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_nsec);
+  });
+  double t_uncached = run(calls, []() { return tinyrpc::Clock::nowMs(); });
+  tinyrpc::Clock::refresh();
+  double t_cached = run(calls, []() { return tinyrpc::Clock::nowMs(); });
+  tinyrpc::Clock::stopCache();
+  double t_precise = run(calls, []() { return tinyrpc::Clock::preciseNs(); });
+  double t_cycles = run(calls, []() { return static_cast<int64_t>(tinyrpc::Clock::cycles()); });
+
+  // 高精度时钟和单调时钟对比，看校准误差
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  int64_t begin_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  int64_t begin_precise = tinyrpc::Clock::preciseNs();
+  int64_t end_ns = begin_ns;
+  while (end_ns - begin_ns < 200000000) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    end_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+  int64_t end_precise = tinyrpc::Clock::preciseNs();
+
+  std::cout << "calls: " << calls << ", tsc: " << (tinyrpc::Clock::isTscSupport() ? "yes" : "no") << ", ns per call" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << std::left << std::setw(16) << "gettimeofday" << t_gettimeofday << std::endl;
+  std::cout << std::left << std::setw(16) << "clock_gettime" << t_clock_gettime << std::endl;
+  std::cout << std::left << std::setw(16) << "nowMs uncached" << t_uncached << std::endl;
+  std::cout << std::left << std::setw(16) << "nowMs cached" << t_cached << std::endl;
+  std::cout << std::left << std::setw(16) << "preciseNs" << t_precise << std::endl;
+  std::cout << std::left << std::setw(16) << "cycles" << t_cycles << std::endl;
+  std::cout << "precise clock error over 200ms: " << (end_precise - begin_precise) - (end_ns - begin_ns) << " ns" << std::endl;
+  return 0;
+}
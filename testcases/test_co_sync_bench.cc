@@ -0,0 +1,240 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include "src/coroutine/coroutine.h"
+#include "src/net/reactor.h"
+#include "src/net/mutex.h"
+#include "src/net/co_sync.h"
+
+// 协程同步原语和pthread版本的竞争对比
+// 1. 锁：threads个reactor线程，每个线程cors个协程，每个协程 加锁 -> 计数加1 -> 空转work次 -> 解锁 -> 让出一次，共ops次
+//    pthread的Mutex拿不到锁会阻塞整个io线程，CoroutineMutex只挂起协程
+//    "yield in lock" 是拿着锁让出(比如锁里调了别的rpc)，pthread锁这样用同一个线程的下一个协程就死锁了，只有协程锁能跑
+// 2. 通道：一个线程cors个协程往CoChannel放msgs个数，另一个线程cors个协程取，对比两个线程用std::mutex + condition_variable的有界队列
+// ./test_co_sync_bench [threads] [cors] [ops] [work] [msgs] [capacity]
+
+static const int STACK_SIZE = 128 * 1024;
+
+struct Options {
+  int threads {4};
+  int cors {8};
+  int ops {20000};
+  int work {200};
+  int msgs {200000};
+  int capacity {64};
+};
+
+static Options g_opt;
+
+static void spin(int n) {
+  for (volatile int i = 0; i < n; ++i) {
+  }
+}
+
+// 放到本线程reactor的任务队列末尾，让同线程的其他协程先跑
+static void reschedule() {
+  tinyrpc::Coroutine* cur = tinyrpc::Coroutine::getCurrentCoroutine();
+  tinyrpc::Reactor::getReactor()->addCoroutine(cur->shared_from_this());
+  tinyrpc::Coroutine::Yield();
+}
+
+// threads个reactor线程，第i个线程跑cors个body(i)，全部协程结束之后停掉所有reactor，返回耗时秒数
+static double runOnReactors(int threads, int cors, std::function<void(int)> body) {
+  std::vector<tinyrpc::Reactor*> reactors(threads, nullptr);
+  std::atomic<int> ready(0);
+  std::atomic<int> running(threads * cors);
+  std::atomic<bool> start(false);
+
+  auto stop_all = [&]() {
+    for (size_t i = 0; i < reactors.size(); ++i) {
+      reactors[i]->stop();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      tinyrpc::Coroutine::getCurrentCoroutine();
+      tinyrpc::Reactor reactor;
+      reactors[t] = &reactor;
+
+      std::vector<tinyrpc::Coroutine::ptr> cors_of_thread;
+      std::vector<std::vector<char>> stacks(cors, std::vector<char>(STACK_SIZE));
+      for (int i = 0; i < cors; ++i) {
+        cors_of_thread.push_back(std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, &stacks[i][0], [&, t]() {
+          body(t);
+          if (--running == 0) {
+            stop_all();
+          }
+        }));
+        reactor.addCoroutine(cors_of_thread.back(), false);
+      }
+
+      ++ready;
+      while (!start) {
+        std::this_thread::yield();
+      }
+      reactor.loop();
+    });
+  }
+
+  while (ready < threads) {
+    std::this_thread::yield();
+  }
+  auto begin = std::chrono::steady_clock::now();
+  start = true;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+template <class Lock>
+static void lockLoop(Lock& mutex, long& counter, bool yield_in_lock) {
+  for (int i = 0; i < g_opt.ops; ++i) {
+    mutex.lock();
+    ++counter;
+    spin(g_opt.work);
+    if (yield_in_lock) {
+      reschedule();
+    }
+    mutex.unlock();
+    reschedule();
+  }
+}
+
+static void report(const std::string& name, double seconds, long done, long expect, const std::string& unit) {
+  std::cout << std::left << std::setw(24) << name << std::right << std::setw(14) << static_cast<long>(done / seconds)
+            << " " << std::setw(10) << unit << std::fixed << std::setprecision(3) << std::setw(10) << seconds << " s"
+            << (done == expect ? "" : "  WRONG RESULT") << std::endl;
+}
+
+static void benchMutex() {
+  long expect = static_cast<long>(g_opt.threads) * g_opt.cors * g_opt.ops;
+
+  tinyrpc::Mutex pthread_mutex;
+  long counter = 0;
+  double t = runOnReactors(g_opt.threads, g_opt.cors, [&](int) { lockLoop(pthread_mutex, counter, false); });
+  report("pthread Mutex", t, counter, expect, "ops/s");
+
+  tinyrpc::CoroutineMutex co_mutex;
+  counter = 0;
+  t = runOnReactors(g_opt.threads, g_opt.cors, [&](int) { lockLoop(co_mutex, counter, false); });
+  report("CoroutineMutex", t, counter, expect, "ops/s");
+
+  counter = 0;
+  t = runOnReactors(g_opt.threads, g_opt.cors, [&](int) { lockLoop(co_mutex, counter, true); });
+  report("CoroutineMutex yield", t, counter, expect, "ops/s");
+}
+
+// 两个线程之间的有界队列，pthread的对照组
+class BlockingQueue {
+ public:
+  explicit BlockingQueue(size_t capacity) : m_capacity(capacity) {}
+
+  void push(long v) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_full.wait(lock, [this]() { return m_queue.size() < m_capacity; });
+    m_queue.push_back(v);
+    m_not_empty.notify_one();
+  }
+
+  long pop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_empty.wait(lock, [this]() { return !m_queue.empty(); });
+    long v = m_queue.front();
+    m_queue.pop_front();
+    m_not_full.notify_one();
+    return v;
+  }
+
+ private:
+  size_t m_capacity;
+  std::mutex m_mutex;
+  std::condition_variable m_not_full;
+  std::condition_variable m_not_empty;
+  std::deque<long> m_queue;
+};
+
+static void benchChannel() {
+  long msgs = g_opt.msgs / g_opt.cors * g_opt.cors;
+  long expect = msgs * (msgs - 1) / 2;
+
+  BlockingQueue queue(g_opt.capacity);
+  long sum = 0;
+  auto begin = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    for (long i = 0; i < msgs; ++i) {
+      queue.push(i);
+    }
+  });
+  std::thread consumer([&]() {
+    for (long i = 0; i < msgs; ++i) {
+      sum += queue.pop();
+    }
+  });
+  producer.join();
+  consumer.join();
+  double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  report("pthread queue", t, sum == expect ? msgs : 0, msgs, "msgs/s");
+
+  tinyrpc::CoChannel<long> channel(g_opt.capacity);
+  std::atomic<long> co_sum(0);
+  std::atomic<int> producers(g_opt.cors);
+  std::atomic<long> next(0);
+  t = runOnReactors(2, g_opt.cors, [&](int thread) {
+    if (thread == 0) {
+      long v = 0;
+      while ((v = next++) < msgs) {
+        channel.push(v);
+      }
+      if (--producers == 0) {
+        channel.close();
+      }
+    } else {
+      long v = 0;
+      long local = 0;
+      while (channel.pop(&v)) {
+        local += v;
+      }
+      co_sum += local;
+    }
+  });
+  report("CoChannel", t, co_sum == expect ? msgs : 0, msgs, "msgs/s");
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    g_opt.threads = std::atoi(argv[1]);
+  }
+  if (argc > 2) {
+    g_opt.cors = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    g_opt.ops = std::atoi(argv[3]);
+  }
+  if (argc > 4) {
+    g_opt.work = std::atoi(argv[4]);
+  }
+  if (argc > 5) {
+    g_opt.msgs = std::atoi(argv[5]);
+  }
+  if (argc > 6) {
+    g_opt.capacity = std::atoi(argv[6]);
+  }
+
+  std::cout << "threads=" << g_opt.threads << " cors=" << g_opt.cors << " ops=" << g_opt.ops << " work=" << g_opt.work
+            << " msgs=" << g_opt.msgs << " capacity=" << g_opt.capacity << std::endl;
+  benchMutex();
+  benchChannel();
+  return 0;
+}
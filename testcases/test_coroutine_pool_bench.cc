@@ -0,0 +1,228 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "src/coroutine/coroutine.h"
+#include "src/coroutine/coroutine_pool.h"
+#include "src/net/mutex.h"
+
+// 协程池取还的开销：先拿走held个常驻协程(相当于held个长连接)，再由threads个线程不停地 取一个 -> 还回去
+// legacy: 原来的实现，加锁从头扫描m_free_cors找没有被使用的协程，扩展的内存用vector<bool>加锁扫描
+// pool:   现在的实现，空闲下标的无锁栈
+// 最后看栈的物理内存：所有常驻协程各用掉一段栈之后全部归还，RSS应该只剩warm_stacks个栈
+// ./test_coroutine_pool_bench [ops_per_thread] [held]
+
+namespace {
+
+const int POOL_SIZE = 1000;
+const int STACK_SIZE = 128 * 1024;
+
+// 原来的Memory
+class LegacyMemory {
+ public:
+  LegacyMemory(int block_size, int block_count) : m_block_size(block_size), m_blocks(block_count, false) {
+    m_start = static_cast<char*>(malloc(static_cast<size_t>(block_size) * block_count));
+    m_end = m_start + static_cast<size_t>(block_size) * block_count - 1;
+  }
+
+  ~LegacyMemory() { free(m_start); }
+
+  char* getBlock() {
+    int t = -1;
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+      if (m_blocks[i] == false) {
+        m_blocks[i] = true;
+        t = i;
+        break;
+      }
+    }
+    lock.unlock();
+    if (t == -1) {
+      return nullptr;
+    }
+    return m_start + (t * m_block_size);
+  }
+
+  void backBlock(char* s) {
+    int i = (s - m_start) / m_block_size;
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    m_blocks[i] = false;
+  }
+
+  bool hasBlock(char* s) { return s >= m_start && s <= m_end; }
+
+ private:
+  int m_block_size;
+  char* m_start;
+  char* m_end;
+  std::vector<bool> m_blocks;
+  tinyrpc::Mutex m_mutex;
+};
+
+// 原来的CoroutinePool
+class LegacyPool {
+ public:
+  LegacyPool(int pool_size, int stack_size) : m_pool_size(pool_size), m_stack_size(stack_size) {
+    m_memory_pool.push_back(std::make_shared<LegacyMemory>(stack_size, pool_size));
+    for (int i = 0; i < pool_size; ++i) {
+      tinyrpc::Coroutine::ptr cor = std::make_shared<tinyrpc::Coroutine>(stack_size, m_memory_pool[0]->getBlock());
+      cor->setIndex(i);
+      m_free_cors.push_back(std::make_pair(cor, false));
+    }
+  }
+
+  tinyrpc::Coroutine::ptr getCoroutineInstanse() {
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    for (int i = 0; i < m_pool_size; ++i) {
+      if (!m_free_cors[i].first->getIsInCoFunc() && !m_free_cors[i].second) {
+        m_free_cors[i].second = true;
+        tinyrpc::Coroutine::ptr cor = m_free_cors[i].first;
+        lock.unlock();
+        return cor;
+      }
+    }
+    for (size_t i = 1; i < m_memory_pool.size(); ++i) {
+      char* tmp = m_memory_pool[i]->getBlock();
+      if (tmp) {
+        return std::make_shared<tinyrpc::Coroutine>(m_stack_size, tmp);
+      }
+    }
+    m_memory_pool.push_back(std::make_shared<LegacyMemory>(m_stack_size, m_pool_size));
+    return std::make_shared<tinyrpc::Coroutine>(m_stack_size, m_memory_pool.back()->getBlock());
+  }
+
+  void returnCoroutine(tinyrpc::Coroutine::ptr cor) {
+    int i = cor->getIndex();
+    if (i >= 0 && i < m_pool_size) {
+      m_free_cors[i].second = false;
+    } else {
+      for (size_t i = 1; i < m_memory_pool.size(); ++i) {
+        if (m_memory_pool[i]->hasBlock(cor->getStackPtr())) {
+          m_memory_pool[i]->backBlock(cor->getStackPtr());
+        }
+      }
+    }
+  }
+
+ private:
+  int m_pool_size;
+  int m_stack_size;
+  std::vector<std::pair<tinyrpc::Coroutine::ptr, bool>> m_free_cors;
+  tinyrpc::Mutex m_mutex;
+  std::vector<std::shared_ptr<LegacyMemory>> m_memory_pool;
+};
+
+const int RSS_STACK_SIZE = 256 * 1024;
+const int RSS_TOUCH_SIZE = 64 * 1024;
+const int RSS_WARM_STACKS = 64;
+
+// 当前进程的RSS，MB
+double rssMb() {
+  std::ifstream statm("/proc/self/statm");
+  long size = 0;
+  long resident = 0;
+  statm >> size >> resident;
+  return static_cast<double>(resident) * sysconf(_SC_PAGESIZE) / 1024 / 1024;
+}
+
+// 用掉RSS_TOUCH_SIZE的栈
+void touchStack() {
+  volatile char buf[RSS_TOUCH_SIZE];
+  for (int i = 0; i < RSS_TOUCH_SIZE; i += 1024) {
+    buf[i] = 1;
+  }
+}
+
+template <class Pool>
+double run(Pool* pool, int threads, int64_t ops) {
+  std::atomic<int> ready {0};
+  std::atomic<bool> go {false};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      ++ready;
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (int64_t i = 0; i < ops; ++i) {
+        tinyrpc::Coroutine::ptr cor = pool->getCoroutineInstanse();
+        pool->returnCoroutine(cor);
+      }
+    });
+  }
+  while (ready.load() < threads) {
+  }
+  auto begin = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  return cost / (static_cast<double>(ops) * threads);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int64_t ops = 100000;
+  int held = 900;
+  if (argc > 1) {
+    ops = std::atoll(argv[1]);
+  }
+  if (argc > 2) {
+    held = std::atoi(argv[2]);
+  }
+
+  tinyrpc::Coroutine::getCurrentCoroutine();
+  LegacyPool legacy(POOL_SIZE, STACK_SIZE);
+  tinyrpc::CoroutinePool pool(POOL_SIZE, STACK_SIZE);
+
+  std::vector<tinyrpc::Coroutine::ptr> legacy_held;
+  std::vector<tinyrpc::Coroutine::ptr> pool_held;
+  for (int i = 0; i < held; ++i) {
+    legacy_held.push_back(legacy.getCoroutineInstanse());
+    pool_held.push_back(pool.getCoroutineInstanse());
+  }
+
+  std::cout << "pool size: " << POOL_SIZE << ", held: " << held << ", ops per thread: " << ops
+            << ", ns per get + return" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "legacy" << std::setw(12) << "pool" << std::endl;
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    double t_legacy = run(&legacy, threads, ops);
+    double t_pool = run(&pool, threads, ops);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(1)
+              << std::setw(12) << t_legacy << std::setw(12) << t_pool << std::endl;
+  }
+
+  tinyrpc::CoroutinePool::Stats stats = pool.getStats();
+  std::cout << "pool stats: hits " << stats.hits << ", misses " << stats.misses
+            << ", expansions " << stats.expansions << ", idle " << stats.idle << std::endl;
+
+  tinyrpc::CoroutinePool rss_pool(POOL_SIZE, RSS_STACK_SIZE, RSS_WARM_STACKS);
+  double rss_before = rssMb();
+  std::vector<tinyrpc::Coroutine::ptr> live;
+  for (int i = 0; i < POOL_SIZE; ++i) {
+    tinyrpc::Coroutine::ptr cor = rss_pool.getCoroutineInstanse();
+    cor->setCallBack(touchStack);
+    tinyrpc::Coroutine::Resume(cor.get());
+    live.push_back(cor);
+  }
+  double rss_live = rssMb();
+  for (size_t i = 0; i < live.size(); ++i) {
+    rss_pool.returnCoroutine(live[i]);
+  }
+  live.clear();
+  double rss_idle = rssMb();
+  stats = rss_pool.getStats();
+  std::cout << "stack rss: " << POOL_SIZE << " coroutines x " << RSS_TOUCH_SIZE / 1024 << " KB touched, warm "
+            << RSS_WARM_STACKS << ", before " << rss_before << " MB, all live " << rss_live << " MB, all returned "
+            << rss_idle << " MB (warm " << stats.warm << ")" << std::endl;
+  return 0;
+}
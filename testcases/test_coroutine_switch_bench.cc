@@ -0,0 +1,105 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#include "src/coroutine/coroutine.h"
+#include "src/coroutine/coctx.h"
+
+// 协程切换开销，每一轮都是 唤醒 + 挂起 一对，报告每对的纳秒数，取几轮里最快的一次
+// 1. Resume/Yield：协程类的完整切换，包括当前协程、RunTime这些线程局部变量的维护
+// 2. coctx_swap：只有汇编的两次上下文切换，看寄存器保存恢复本身的开销
+// ./test_coroutine_switch_bench [pairs] [rounds]
+
+namespace {
+
+const int STACK_SIZE = 128 * 1024;
+
+tinyrpc::coctx g_main_ctx;
+tinyrpc::coctx g_raw_ctx;
+
+void pingPong() {
+  while (true) {
+    tinyrpc::Coroutine::Yield();
+  }
+}
+
+// 直接用coctx_swap切回去，不经过Coroutine
+void rawPingPong(void*) {
+  while (true) {
+    tinyrpc::coctx_swap(&g_raw_ctx, &g_main_ctx);
+  }
+}
+
+double resumeYield(tinyrpc::Coroutine* cor, int64_t pairs) {
+  auto begin = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < pairs; ++i) {
+    tinyrpc::Coroutine::Resume(cor);
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  return cost / pairs;
+}
+
+double rawSwap(int64_t pairs) {
+  auto begin = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < pairs; ++i) {
+    tinyrpc::coctx_swap(&g_main_ctx, &g_raw_ctx);
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  return cost / pairs;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int64_t pairs = 1000000;
+  int rounds = 5;
+  if (argc > 1) {
+    pairs = std::atoll(argv[1]);
+  }
+  if (argc > 2) {
+    rounds = std::atoi(argv[2]);
+  }
+
+  tinyrpc::Coroutine::getCurrentCoroutine();
+
+  std::vector<char> stack(STACK_SIZE);
+  tinyrpc::Coroutine::ptr cor = std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, &stack[0]);
+  cor->setCallBack(pingPong);
+
+  // 和Coroutine::initContext一样准备第一次切进去的上下文
+  std::vector<char> raw_stack(STACK_SIZE);
+  char* top = &raw_stack[0] + STACK_SIZE - sizeof(void*);
+  top = reinterpret_cast<char*>(reinterpret_cast<unsigned long>(top) & -16LL);
+  memset(&g_raw_ctx, 0, sizeof(g_raw_ctx));
+  g_raw_ctx.regs[tinyrpc::kRSP] = top;
+  g_raw_ctx.regs[tinyrpc::kRBP] = top;
+  g_raw_ctx.regs[tinyrpc::kRETAddr] = reinterpret_cast<char*>(rawPingPong);
+  g_raw_ctx.regs[tinyrpc::kFPUCW] = reinterpret_cast<void*>(tinyrpc::kDefaultFPUCW);
+
+  // 先各切一次，第一次进入协程函数不算
+  tinyrpc::Coroutine::Resume(cor.get());
+  tinyrpc::coctx_swap(&g_main_ctx, &g_raw_ctx);
+
+  double best_cor = 0;
+  double best_raw = 0;
+  std::cout << "pairs: " << pairs << ", rounds: " << rounds << ", ns per resume + yield" << std::endl;
+  std::cout << std::setw(8) << "round" << std::setw(16) << "Resume/Yield" << std::setw(16) << "coctx_swap" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  for (int i = 0; i < rounds; ++i) {
+    double t_cor = resumeYield(cor.get(), pairs);
+    double t_raw = rawSwap(pairs);
+    if (i == 0 || t_cor < best_cor) {
+      best_cor = t_cor;
+    }
+    if (i == 0 || t_raw < best_raw) {
+      best_raw = t_raw;
+    }
+    std::cout << std::setw(8) << i << std::setw(16) << t_cor << std::setw(16) << t_raw << std::endl;
+  }
+  std::cout << std::setw(8) << "best" << std::setw(16) << best_cor << std::setw(16) << best_raw << std::endl;
+  return 0;
+}
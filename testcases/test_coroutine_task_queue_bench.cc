@@ -0,0 +1,141 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#include "src/net/reactor.h"
+#include "src/net/mutex.h"
+
+// 协程任务队列扩展性基准：1到64个线程，比较原来的全局加锁队列和每线程工作窃取队列
+// balanced: 每个线程都push一批再取空，模拟每个io线程都有就绪连接
+// skewed:   只有一个线程push，其他线程全靠窃取，模拟连接集中在一个io线程
+// ./test_coroutine_task_queue_bench [items_per_thread]
+
+namespace {
+
+// 原来的实现：所有线程共用一个std::queue + Mutex
+class MutexTaskQueue {
+ public:
+  void push(tinyrpc::FdEvent* fd) {
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    m_task.push(fd);
+  }
+
+  tinyrpc::FdEvent* pop() {
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    if (m_task.empty()) {
+      return nullptr;
+    }
+    tinyrpc::FdEvent* re = m_task.front();
+    m_task.pop();
+    return re;
+  }
+
+ private:
+  std::queue<tinyrpc::FdEvent*> m_task;
+  tinyrpc::Mutex m_mutex;
+};
+
+class StealingTaskQueue {
+ public:
+  void push(tinyrpc::FdEvent* fd) {
+    tinyrpc::CoroutineTaskQueue::getCoroutineTaskQueue()->push(fd);
+  }
+
+  tinyrpc::FdEvent* pop() {
+    return tinyrpc::CoroutineTaskQueue::getCoroutineTaskQueue()->pop();
+  }
+};
+
+const int BATCH = 32;
+
+// 只当作不为空的指针使用，不会解引用
+tinyrpc::FdEvent* fakeEvent(int64_t i) {
+  return reinterpret_cast<tinyrpc::FdEvent*>(static_cast<intptr_t>(i + 1));
+}
+
+template <class Queue>
+double runOnce(Queue& queue, int thread_num, int64_t items_per_thread, bool skewed) {
+  int64_t total = items_per_thread * thread_num;
+  std::atomic<int64_t> consumed(0);
+  std::atomic<bool> start(false);
+
+  auto worker = [&](int id) {
+    while (!start.load(std::memory_order_acquire)) {
+    }
+    // skewed模式下0号线程生产全部任务
+    int64_t to_produce = skewed ? (id == 0 ? total : 0) : items_per_thread;
+    int64_t produced = 0;
+    int64_t local_consumed = 0;
+
+    while (produced < to_produce) {
+      for (int i = 0; i < BATCH && produced < to_produce; ++i) {
+        queue.push(fakeEvent(produced++));
+      }
+      // 和reactor一样，取到空为止
+      while (queue.pop() != nullptr) {
+        ++local_consumed;
+      }
+      consumed.fetch_add(local_consumed, std::memory_order_relaxed);
+      local_consumed = 0;
+    }
+
+    // 自己的生产完了，帮别的线程取
+    while (consumed.load(std::memory_order_relaxed) < total) {
+      if (queue.pop() != nullptr) {
+        consumed.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.emplace_back(worker, i);
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  for (auto& t : threads) {
+    t.join();
+  }
+  int64_t cost_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+  return (double)total * 1000 / cost_ns; // M items/s
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int64_t items_per_thread = 1 << 18;
+  if (argc > 1) {
+    items_per_thread = std::atoll(argv[1]);
+  }
+
+  std::cout << "items per thread " << items_per_thread << ", batch " << BATCH << ", unit: M items/s" << std::endl;
+  std::cout << std::setw(10) << "threads"
+            << std::setw(16) << "mutex/bal" << std::setw(16) << "steal/bal"
+            << std::setw(16) << "mutex/skew" << std::setw(16) << "steal/skew" << std::endl;
+
+  for (int thread_num = 1; thread_num <= 64; thread_num *= 2) {
+    MutexTaskQueue mutex_queue;
+    StealingTaskQueue steal_queue;
+
+    double mutex_bal = runOnce(mutex_queue, thread_num, items_per_thread, false);
+    double steal_bal = runOnce(steal_queue, thread_num, items_per_thread, false);
+    double mutex_skew = runOnce(mutex_queue, thread_num, items_per_thread, true);
+    double steal_skew = runOnce(steal_queue, thread_num, items_per_thread, true);
+
+    std::cout << std::setw(10) << thread_num << std::fixed << std::setprecision(2)
+              << std::setw(16) << mutex_bal << std::setw(16) << steal_bal
+              << std::setw(16) << mutex_skew << std::setw(16) << steal_skew << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <stdint.h>
+
+#include "src/net/fd_event.h"
+#include "src/net/mutex.h"
+
+// hook查找FdEvent的开销：1到64个线程同时按fd查找，每次查找之后读一下FdEvent(和hook一样取reactor)
+// legacy: 原来的实现，RWMutex读锁 + vector<shared_ptr>，返回shared_ptr
+// shared: 分页表，返回shared_ptr，只剩引用计数
+// raw:    分页表，返回裸指针，hook现在用的方式
+// 所有线程查同一批fd，和很多协程读写同一批连接一样，引用计数所在的缓存行会在核之间来回
+// ./test_fd_event_container_bench [lookups_per_thread]
+
+namespace {
+
+const int FD_COUNT = 256;
+
+// 原来的实现
+class LegacyContainer {
+ public:
+  explicit LegacyContainer(int size) {
+    for (int i = 0; i < size; ++i) {
+      m_fds.emplace_back(std::make_shared<tinyrpc::FdEvent>(i));
+    }
+  }
+
+  tinyrpc::FdEvent::ptr getFdEvent(int fd) {
+    tinyrpc::RWMutex::ReadLock rlock(m_mutex);
+    if (fd < static_cast<int>(m_fds.size())) {
+      tinyrpc::FdEvent::ptr re = m_fds[fd];
+      rlock.unlock();
+      return re;
+    }
+    rlock.unlock();
+
+    tinyrpc::RWMutex::WriteLock wlock(m_mutex);
+    int n = static_cast<int>(fd * 1.5);
+    for (int i = static_cast<int>(m_fds.size()); i < n; ++i) {
+      m_fds.emplace_back(std::make_shared<tinyrpc::FdEvent>(i));
+    }
+    tinyrpc::FdEvent::ptr re = m_fds[fd];
+    wlock.unlock();
+    return re;
+  }
+
+ private:
+  tinyrpc::RWMutex m_mutex;
+  std::vector<tinyrpc::FdEvent::ptr> m_fds;
+};
+
+template <class Lookup>
+double run(int threads, int64_t lookups, Lookup lookup) {
+  std::atomic<int> ready {0};
+  std::atomic<bool> go {false};
+  std::atomic<int64_t> sink {0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      ++ready;
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      int64_t sum = 0;
+      int fd = t % FD_COUNT;
+      for (int64_t i = 0; i < lookups; ++i) {
+        sum += lookup(fd);
+        fd = (fd + 1) % FD_COUNT;
+      }
+      sink += sum;
+    });
+  }
+  while (ready.load() < threads) {
+  }
+  auto begin = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  double cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  if (sink.load() == -1) {
+    std::cout << "";
+  }
+  return cost * 1e9 / (static_cast<double>(lookups) * threads);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int64_t lookups = 1000000;
+  if (argc > 1) {
+    lookups = std::atoll(argv[1]);
+  }
+
+  LegacyContainer legacy(1000);
+  tinyrpc::FdEventContainer* container = tinyrpc::FdEventContainer::getFdContainer();
+
+  std::cout << "lookups per thread: " << lookups << ", fds: " << FD_COUNT << ", ns per lookup" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "legacy" << std::setw(12) << "shared" << std::setw(12) << "raw" << std::endl;
+
+  for (int threads = 1; threads <= 64; threads *= 2) {
+    double t_legacy = run(threads, lookups, [&](int fd) {
+      tinyrpc::FdEvent::ptr fd_event = legacy.getFdEvent(fd);
+      return fd_event->getReactor() == nullptr ? fd_event->getFd() : 0;
+    });
+    double t_shared = run(threads, lookups, [&](int fd) {
+      tinyrpc::FdEvent::ptr fd_event = container->getFdEvent(fd);
+      return fd_event->getReactor() == nullptr ? fd_event->getFd() : 0;
+    });
+    double t_raw = run(threads, lookups, [&](int fd) {
+      tinyrpc::FdEvent* fd_event = container->getRawFdEvent(fd);
+      return fd_event->getReactor() == nullptr ? fd_event->getFd() : 0;
+    });
+
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+              << std::setw(12) << t_legacy << std::setw(12) << t_shared << std::setw(12) << t_raw << std::endl;
+  }
+  return 0;
+}
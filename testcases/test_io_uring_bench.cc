@@ -0,0 +1,184 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "src/coroutine/coroutine.h"
+#include "src/coroutine/coroutine_hook.h"
+#include "src/net/reactor.h"
+#include "src/net/fd_event.h"
+#include "src/net/timer.h"
+
+// epoll和io_uring后端的对比基准：同一个reactor线程里跑conns对回环TCP连接的echo乒乓
+// 客户端协程写msg_size字节再读回来，服务端协程读到就原样写回，都用hook的read/write
+// 统计每秒往返次数和每次往返的耗时，epoll用边缘触发模式
+// ./test_io_uring_bench [seconds] [conns] [msg_size]
+
+static const int STACK_SIZE = 128 * 1024;
+
+struct Pair {
+  int client;
+  int server;
+};
+
+static std::vector<Pair> makePairs(int count) {
+  std::vector<Pair> pairs;
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(listen_fd, count) != 0
+      || getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    std::cout << "listen on loopback failed: " << strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  for (int i = 0; i < count; ++i) {
+    Pair pair;
+    pair.client = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(pair.client, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+      std::cout << "connect loopback failed: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    pair.server = accept(listen_fd, nullptr, nullptr);
+    int flag = 1;
+    setsockopt(pair.client, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    setsockopt(pair.server, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    pairs.push_back(pair);
+  }
+  close(listen_fd);
+  return pairs;
+}
+
+static bool readFull(int fd, char* buf, int size) {
+  int got = 0;
+  while (got < size) {
+    ssize_t n = tinyrpc::read_hook(fd, buf + got, size - got);
+    if (n <= 0) {
+      return false;
+    }
+    got += n;
+  }
+  return true;
+}
+
+static bool writeFull(int fd, const char* buf, int size) {
+  int sent = 0;
+  while (sent < size) {
+    ssize_t n = tinyrpc::write_hook(fd, buf + sent, size - sent);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+struct Result {
+  bool ok {false};
+  long round_trips {0};
+  double seconds {0};
+};
+
+// 在新线程里建一个reactor跑seconds秒，协程不会跑完，到时间直接停掉loop
+static Result runBackend(bool use_io_uring, const std::vector<Pair>& pairs, int seconds, int msg_size) {
+  Result result;
+  std::thread thread([&]() {
+    tinyrpc::Reactor reactor;
+    if (use_io_uring && !reactor.enableIoUring(256, 1024, 4096)) {
+      return;
+    }
+    result.ok = true;
+
+    bool stop = false;
+    std::vector<tinyrpc::Coroutine::ptr> cors;
+    std::vector<char*> stacks;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      Pair pair = pairs[i];
+
+      char* stack = static_cast<char*>(malloc(STACK_SIZE));
+      stacks.push_back(stack);
+      cors.push_back(std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, stack, [pair, msg_size, &stop]() {
+        std::vector<char> buf(msg_size);
+        while (!stop) {
+          ssize_t n = tinyrpc::read_hook(pair.server, &buf[0], msg_size);
+          if (n <= 0 || !writeFull(pair.server, &buf[0], n)) {
+            return;
+          }
+        }
+      }));
+
+      stack = static_cast<char*>(malloc(STACK_SIZE));
+      stacks.push_back(stack);
+      cors.push_back(std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, stack, [pair, msg_size, &stop, &result]() {
+        std::vector<char> buf(msg_size, 'x');
+        while (!stop) {
+          if (!writeFull(pair.client, &buf[0], msg_size) || !readFull(pair.client, &buf[0], msg_size)) {
+            return;
+          }
+          ++result.round_trips;
+        }
+      }));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    tinyrpc::TimerEvent::ptr event = std::make_shared<tinyrpc::TimerEvent>(seconds * 1000, false, [&]() {
+      stop = true;
+      result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      // 取消fd在reactor和ring上的注册，下一个后端用新的连接
+      for (size_t i = 0; i < pairs.size(); ++i) {
+        tinyrpc::FdEventContainer::getFdContainer()->getFdEvent(pairs[i].client)->unregisterFromReactor();
+        tinyrpc::FdEventContainer::getFdContainer()->getFdEvent(pairs[i].server)->unregisterFromReactor();
+      }
+      reactor.stop();
+    });
+    reactor.getTimer()->addTimerEvent(event);
+
+    for (size_t i = 0; i < cors.size(); ++i) {
+      reactor.addCoroutine(cors[i], false);
+    }
+    reactor.loop();
+
+    // 挂起的协程不会再恢复，栈不释放，进程马上退出
+  });
+  thread.join();
+  return result;
+}
+
+static void report(const std::string& name, const Result& result) {
+  if (!result.ok) {
+    std::cout << std::left << std::setw(10) << name << "not supported" << std::endl;
+    return;
+  }
+  double rps = result.round_trips / result.seconds;
+  std::cout << std::left << std::setw(10) << name
+            << std::setw(16) << static_cast<long>(rps)
+            << std::fixed << std::setprecision(2) << 1000000.0 / rps << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 3;
+  int conns = argc > 2 ? atoi(argv[2]) : 8;
+  int msg_size = argc > 3 ? atoi(argv[3]) : 64;
+
+  std::cout << "seconds=" << seconds << " conns=" << conns << " msg_size=" << msg_size << std::endl;
+  std::cout << std::left << std::setw(10) << "backend" << std::setw(16) << "round_trips/s" << "us/round_trip" << std::endl;
+
+  tinyrpc::setEdgeTriggered(true);
+  report("epoll", runBackend(false, makePairs(conns), seconds, msg_size));
+
+  tinyrpc::setEdgeTriggered(false);
+  report("io_uring", runBackend(true, makePairs(conns), seconds, msg_size));
+  return 0;
+}
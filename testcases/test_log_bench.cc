@@ -0,0 +1,146 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "src/comm/start.h"
+#include "src/comm/log.h"
+#include "src/comm/config.h"
+#include "src/net/mutex.h"
+
+// INFO日志的开销：threads个线程同时写日志，每个线程lines条，统计每条日志的平均耗时
+// legacy: 原来的实现，每条new一个带stringstream的LogEvent，格式化时间，加锁push到vector<string>，后台线程定时换出来写文件
+// ring:   现在的实现，InfoLog写本线程的格式化缓冲，拷贝到本线程的环形缓冲，异步线程writev
+// app:    AppInfoLog，printf格式，和ring一样的路径
+// 都写到配置文件的日志目录，log_format配置成binary再跑一次对比二进制日志
+// ./test_log_bench ../conf/test_tinypb_server.xml [lines]
+
+namespace {
+
+// 原来的实现，去掉了协程信息
+class LegacyLogger {
+ public:
+  explicit LegacyLogger(const std::string& file) {
+    m_file = fopen(file.c_str(), "a");
+    m_thread = std::thread([this]() {
+      while (!m_stop.load()) {
+        usleep(500000);
+        writeOut();
+      }
+      writeOut();
+    });
+  }
+
+  ~LegacyLogger() {
+    m_stop = true;
+    m_thread.join();
+    if (m_file) {
+      fclose(m_file);
+    }
+  }
+
+  void log(const char* file_name, int line, int64_t i) {
+    std::unique_ptr<std::stringstream> ss(new std::stringstream());
+    timeval val;
+    gettimeofday(&val, nullptr);
+    struct tm time;
+    localtime_r(&val.tv_sec, &time);
+    char buf[128];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &time);
+    *ss << "[" << buf << "." << val.tv_usec << "]\t"
+        << "[INFO]\t[" << getpid() << "]\t[" << tinyrpc::gettid() << "]\t[0]\t[" << file_name << ":" << line << "]\t"
+        << "bench log line " << i << ", value " << i * 3 << "\n";
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    m_buffer.emplace_back(ss->str());
+  }
+
+ private:
+  void writeOut() {
+    std::vector<std::string> tmp;
+    tinyrpc::Mutex::Lock lock(m_mutex);
+    tmp.swap(m_buffer);
+    lock.unlock();
+    for (size_t i = 0; i < tmp.size() && m_file; ++i) {
+      fwrite(tmp[i].c_str(), 1, tmp[i].size(), m_file);
+    }
+    if (m_file) {
+      fflush(m_file);
+    }
+  }
+
+  FILE* m_file {nullptr};
+  tinyrpc::Mutex m_mutex;
+  std::vector<std::string> m_buffer;
+  std::atomic<bool> m_stop {false};
+  std::thread m_thread;
+};
+
+template <class Log>
+double run(int threads, int64_t lines, Log log) {
+  std::vector<std::thread> workers;
+  auto begin = std::chrono::steady_clock::now();
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      for (int64_t i = 0; i < lines; ++i) {
+        log(i);
+      }
+    });
+  }
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  return cost / (lines * threads);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cout << "usage: ./test_log_bench ../conf/test_tinypb_server.xml [lines]" << std::endl;
+    return 1;
+  }
+  int64_t lines = 200000;
+  if (argc > 2) {
+    lines = std::atoll(argv[2]);
+  }
+
+  tinyrpc::initConfig(argv[1]);
+  tinyrpc::gRpcConfig->m_log_level = tinyrpc::LogLevel::INFO;
+  tinyrpc::gRpcConfig->m_app_log_level = tinyrpc::LogLevel::INFO;
+  std::unique_ptr<LegacyLogger> legacy(new LegacyLogger(tinyrpc::gRpcConfig->m_log_path + tinyrpc::gRpcConfig->m_log_prefix + "_legacy_bench.log"));
+
+  std::cout << "lines per thread: " << lines << ", log format: " << (tinyrpc::gRpcConfig->m_log_binary ? "binary" : "text")
+            << ", ns per log line (wall time / total lines)" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "legacy" << std::setw(12) << "ring" << std::setw(12) << "app" << std::endl;
+  for (int threads = 1; threads <= 8; threads *= 8) {
+    double t_legacy = run(threads, lines, [&](int64_t i) {
+      legacy->log(__FILE__, __LINE__, i);
+    });
+    double t_ring = run(threads, lines, [&](int64_t i) {
+      InfoLog << "bench log line " << i << ", value " << i * 3;
+    });
+    double t_app = run(threads, lines, [&](int64_t i) {
+      AppInfoLog("bench log line %ld, value %ld, %s", static_cast<long>(i), static_cast<long>(i * 3), "done");
+    });
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(1)
+              << std::setw(12) << t_legacy << std::setw(12) << t_ring << std::setw(12) << t_app << std::endl;
+  }
+
+  // 只读了配置没有启动服务，TcpServer析构会一直等下去，日志写完直接退出
+  legacy.reset();
+  tinyrpc::Logger* logger = tinyrpc::Logger::getLogger();
+  logger->flush();
+  pthread_join(logger->getAsyncLogger()->m_thread, NULL);
+  pthread_join(logger->getAsyncAppLogger()->m_thread, NULL);
+  _exit(0);
+}
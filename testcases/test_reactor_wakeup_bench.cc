@@ -0,0 +1,136 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "src/coroutine/coroutine.h"
+#include "src/net/reactor.h"
+
+// 跨线程唤醒reactor的压力测试
+// threads个线程同时往一个reactor addTask(task, true)，每个线程等自己的任务执行完再发下一个，中间随机停一会让loop进到epoll_wait
+// 另外hammers个线程不停地addTask(空任务, true)不等结果，让wakeup和loop读wakeup fd尽量撞在一起
+// 统计从addTask到任务执行的延迟，唤醒丢了的话任务要等到epoll_wait超时(10s)才执行，超过max_ms就算失败
+// ./test_reactor_wakeup_bench [threads] [tasks] [max_ms] [hammers]
+
+struct Options {
+  int threads {4};
+  int tasks {20000};
+  int max_ms {1000};
+  int hammers {4};
+};
+
+static Options g_opt;
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    g_opt.threads = std::atoi(argv[1]);
+  }
+  if (argc > 2) {
+    g_opt.tasks = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    g_opt.max_ms = std::atoi(argv[3]);
+  }
+  if (argc > 4) {
+    g_opt.hammers = std::atoi(argv[4]);
+  }
+  std::cout << "threads=" << g_opt.threads << " tasks=" << g_opt.tasks << " max_ms=" << g_opt.max_ms
+            << " hammers=" << g_opt.hammers << std::endl;
+
+  std::atomic<tinyrpc::Reactor*> reactor(nullptr);
+  std::thread loop_thread([&]() {
+    tinyrpc::Coroutine::getCurrentCoroutine();
+    tinyrpc::Reactor r;
+    // 在loop里面执行的时候才发布出去，之后的wakeup都是有效的
+    r.addTask([&]() { reactor = &r; }, false);
+    r.loop();
+  });
+  while (!reactor) {
+    std::this_thread::yield();
+  }
+
+  std::vector<std::vector<int64_t>> latencies(g_opt.threads);
+  std::atomic<bool> failed(false);
+  std::atomic<bool> stop_hammer(false);
+  std::atomic<long> hammered(0);
+  auto begin = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> hammers;
+  for (int t = 0; t < g_opt.hammers; ++t) {
+    hammers.emplace_back([&]() {
+      while (!stop_hammer) {
+        reactor.load()->addTask([&hammered]() { ++hammered; }, true);
+        std::this_thread::yield();
+      }
+    });
+  }
+
+  std::vector<std::thread> posters;
+  for (int t = 0; t < g_opt.threads; ++t) {
+    posters.emplace_back([&, t]() {
+      unsigned int seed = static_cast<unsigned int>(t + 1);
+      latencies[t].reserve(g_opt.tasks);
+      for (int i = 0; i < g_opt.tasks && !failed; ++i) {
+        std::atomic<bool> done(false);
+        int64_t post = nowNs();
+        reactor.load()->addTask([&done]() { done.store(true, std::memory_order_release); }, true);
+        while (!done.load(std::memory_order_acquire)) {
+          if (nowNs() - post > g_opt.max_ms * 1000000LL) {
+            std::cout << "thread " << t << " task " << i << " not run after " << g_opt.max_ms << " ms, wakeup lost"
+                      << std::endl;
+            failed = true;
+            // 等它执行完，done在栈上
+            while (!done.load(std::memory_order_acquire)) {
+              usleep(1000);
+            }
+            break;
+          }
+          std::this_thread::yield();
+        }
+        latencies[t].push_back(nowNs() - post);
+        if (rand_r(&seed) % 4 == 0) {
+          usleep(rand_r(&seed) % 50);
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < posters.size(); ++i) {
+    posters[i].join();
+  }
+  stop_hammer = true;
+  for (size_t i = 0; i < hammers.size(); ++i) {
+    hammers[i].join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+  reactor.load()->stop();
+  loop_thread.join();
+
+  std::vector<int64_t> all;
+  for (size_t i = 0; i < latencies.size(); ++i) {
+    all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+  }
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) -> double {
+    if (all.empty()) {
+      return 0;
+    }
+    return all[std::min(all.size() - 1, static_cast<size_t>(all.size() * p))] / 1000.0;
+  };
+  std::cout << all.size() << " tasks in " << std::fixed << std::setprecision(3) << seconds << " s, latency p50 "
+            << std::setprecision(1) << pct(0.5) << " us  p99 " << pct(0.99) << " us  max " << pct(1.0) << " us"
+            << std::endl;
+  std::cout << "hammer tasks " << hammered << std::endl;
+  std::cout << (failed ? "FAIL" : "OK") << std::endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+#include <alloca.h>
+
+#include "src/coroutine/coroutine.h"
+#include "src/coroutine/memory.h"
+#include "src/coroutine/share_stack.h"
+
+// 共享栈和独占栈的对比
+// 1. 每个空闲连接的内存：conns个协程各用掉depth字节的栈之后挂起(相当于等数据的长连接)，看地址空间和RSS平均每个协程多少
+// 2. 切换开销：两个协程轮流 唤醒 -> 挂起，共享栈只有一个的时候每次切换都要换出换入
+// ./test_share_stack_bench [conns] [depth_bytes] [switches]
+
+namespace {
+
+const int STACK_SIZE = 128 * 1024;
+const int SHARE_STACK_COUNT = 4;
+
+int g_depth = 2048;
+
+// 当前进程的地址空间和RSS，KB
+void memKb(double* vsz, double* rss) {
+  std::ifstream statm("/proc/self/statm");
+  long size = 0;
+  long resident = 0;
+  statm >> size >> resident;
+  double page_kb = sysconf(_SC_PAGESIZE) / 1024.0;
+  *vsz = size * page_kb;
+  *rss = resident * page_kb;
+}
+
+// 用掉g_depth字节的栈之后挂起
+void useStackAndYield() {
+  volatile char* buf = static_cast<volatile char*>(alloca(g_depth));
+  for (int i = 0; i < g_depth; i += 64) {
+    buf[i] = 1;
+  }
+  tinyrpc::Coroutine::Yield();
+}
+
+// 挂起之后不再唤醒
+void idleConn() {
+  useStackAndYield();
+}
+
+// 每次唤醒都用一下栈再挂起
+void pingPong() {
+  while (true) {
+    useStackAndYield();
+  }
+}
+
+struct IdleResult {
+  double vsz_kb;
+  double rss_kb;
+  double save_kb;
+};
+
+IdleResult idleDedicated(int conns) {
+  double vsz0, rss0, vsz1, rss1;
+  memKb(&vsz0, &rss0);
+  tinyrpc::Memory memory(STACK_SIZE, conns, 0);
+  std::vector<tinyrpc::Coroutine::ptr> cors;
+  for (int i = 0; i < conns; ++i) {
+    tinyrpc::Coroutine::ptr cor = std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, memory.getBlock());
+    cor->setCallBack(idleConn);
+    tinyrpc::Coroutine::Resume(cor.get());
+    cors.push_back(cor);
+  }
+  memKb(&vsz1, &rss1);
+  IdleResult re = {(vsz1 - vsz0) / conns, (rss1 - rss0) / conns, 0};
+  return re;
+}
+
+IdleResult idleShared(int conns) {
+  double vsz0, rss0, vsz1, rss1;
+  memKb(&vsz0, &rss0);
+  tinyrpc::ShareStack share_stack(STACK_SIZE, SHARE_STACK_COUNT);
+  std::vector<tinyrpc::Coroutine::ptr> cors;
+  for (int i = 0; i < conns; ++i) {
+    tinyrpc::Coroutine::ptr cor = std::make_shared<tinyrpc::Coroutine>(&share_stack);
+    cor->setCallBack(idleConn);
+    tinyrpc::Coroutine::Resume(cor.get());
+    cors.push_back(cor);
+  }
+  memKb(&vsz1, &rss1);
+  double save = 0;
+  for (size_t i = 0; i < cors.size(); ++i) {
+    save += cors[i]->getSaveCapacity();
+  }
+  IdleResult re = {(vsz1 - vsz0) / conns, (rss1 - rss0) / conns, save / 1024 / conns};
+  return re;
+}
+
+// 两个协程轮流唤醒，返回每次 唤醒 + 挂起 的纳秒数
+double switchCost(tinyrpc::Coroutine::ptr a, tinyrpc::Coroutine::ptr b, int64_t switches) {
+  a->setCallBack(pingPong);
+  b->setCallBack(pingPong);
+  tinyrpc::Coroutine::Resume(a.get());
+  tinyrpc::Coroutine::Resume(b.get());
+  auto begin = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < switches; i += 2) {
+    tinyrpc::Coroutine::Resume(a.get());
+    tinyrpc::Coroutine::Resume(b.get());
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  return cost / switches;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int conns = 10000;
+  int64_t switches = 1000000;
+  if (argc > 1) {
+    conns = std::atoi(argv[1]);
+  }
+  if (argc > 2) {
+    g_depth = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    switches = std::atoll(argv[3]);
+  }
+
+  tinyrpc::Coroutine::getCurrentCoroutine();
+
+  std::cout << "idle coroutines: " << conns << ", stack used by each: " << g_depth << " bytes, stack size: "
+            << STACK_SIZE / 1024 << " KB, share stacks: " << SHARE_STACK_COUNT << std::endl;
+  std::cout << std::setw(12) << "mode" << std::setw(16) << "vsz KB/conn" << std::setw(16) << "rss KB/conn"
+            << std::setw(16) << "save KB/conn" << std::endl;
+  IdleResult dedicated = idleDedicated(conns);
+  IdleResult shared = idleShared(conns);
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << std::setw(12) << "dedicated" << std::setw(16) << dedicated.vsz_kb << std::setw(16) << dedicated.rss_kb
+            << std::setw(16) << dedicated.save_kb << std::endl;
+  std::cout << std::setw(12) << "shared" << std::setw(16) << shared.vsz_kb << std::setw(16) << shared.rss_kb
+            << std::setw(16) << shared.save_kb << std::endl;
+
+  std::cout << "switches: " << switches << ", ns per resume + yield" << std::endl;
+  tinyrpc::Memory memory(STACK_SIZE, 2, 2);
+  double t_dedicated = switchCost(std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, memory.getBlock()),
+                                  std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, memory.getBlock()), switches);
+  tinyrpc::ShareStack two_stacks(STACK_SIZE, 2);
+  double t_no_copy = switchCost(std::make_shared<tinyrpc::Coroutine>(&two_stacks),
+                                std::make_shared<tinyrpc::Coroutine>(&two_stacks), switches);
+  tinyrpc::ShareStack one_stack(STACK_SIZE, 1);
+  double t_copy = switchCost(std::make_shared<tinyrpc::Coroutine>(&one_stack),
+                             std::make_shared<tinyrpc::Coroutine>(&one_stack), switches);
+  std::cout << std::setw(24) << "dedicated" << std::setw(12) << t_dedicated << std::endl;
+  std::cout << std::setw(24) << "shared, own stack" << std::setw(12) << t_no_copy << std::endl;
+  std::cout << std::setw(24) << "shared, copy each time" << std::setw(12) << t_copy << std::endl;
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "src/net/tcp/tcp_buffer.h"
+#include "src/net/tinypb/tinypb_codec.h"
+#include "src/net/tinypb/tinypb_data.h"
+
+// 重连风暴基准：threads个线程不停地 新建连接 -> 调一次query_name -> 关闭，统计每秒完成的连接数
+// 对比server.reuse_port打开和关闭时主reactor单点accept的差别
+// 先启动 test_tinypb_server，再运行 ./test_tcp_accept_bench [ip] [port] [seconds] [threads]
+// 关闭的时候发RST，客户端不留TIME_WAIT，否则几秒就把本地端口用完了
+
+static bool oneCall(const sockaddr_in& addr, int64_t msg_no) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  linger lg;
+  lg.l_onoff = 1;
+  lg.l_linger = 0;
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+  int flag = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  tinyrpc::TinyPbCodeC codec;
+  tinyrpc::TcpBuffer out(128);
+  tinyrpc::TinyPbStruct req;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%020ld", static_cast<long>(msg_no));
+  req.msg_req = buf;
+  req.service_full_name = "QueryService.query_name";
+  codec.encode(&out, &req);
+  std::string data = out.getBufferString();
+  if (send(fd, data.c_str(), data.size(), 0) != static_cast<ssize_t>(data.size())) {
+    close(fd);
+    return false;
+  }
+
+  tinyrpc::TcpBuffer in(128);
+  char tmp[4096];
+  bool succ = false;
+  while (true) {
+    ssize_t rt = recv(fd, tmp, sizeof(tmp), 0);
+    if (rt <= 0) {
+      break;
+    }
+    in.writeToBuffer(tmp, rt);
+    tinyrpc::TinyPbStruct reply;
+    codec.decode(&in, &reply);
+    if (reply.decode_succ) {
+      succ = (reply.err_code == 0);
+      break;
+    }
+  }
+  close(fd);
+  return succ;
+}
+
+int main(int argc, char* argv[]) {
+  const char* ip = "127.0.0.1";
+  int port = 20000;
+  int seconds = 3;
+  int threads = 4;
+  if (argc > 1) {
+    ip = argv[1];
+  }
+  if (argc > 2) {
+    port = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    seconds = std::atoi(argv[3]);
+  }
+  if (argc > 4) {
+    threads = std::atoi(argv[4]);
+  }
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, ip, &addr.sin_addr);
+
+  std::atomic<int64_t> succ_count {0};
+  std::atomic<int64_t> fail_count {0};
+  std::atomic<int64_t> msg_no {0};
+
+  auto begin = std::chrono::steady_clock::now();
+  auto deadline = begin + std::chrono::seconds(seconds);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&]() {
+      while (std::chrono::steady_clock::now() < deadline) {
+        if (oneCall(addr, ++msg_no)) {
+          ++succ_count;
+        } else {
+          ++fail_count;
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  double cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+  std::cout << "server " << ip << ":" << port << ", " << threads << " threads, " << seconds << " s" << std::endl;
+  std::cout << "connections succ " << succ_count << ", fail " << fail_count
+            << ", " << std::fixed << std::setprecision(0) << succ_count / cost << " conn/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,200 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "src/net/reactor.h"
+#include "src/net/timer.h"
+#include "src/net/mutex.h"
+
+// 定时器加入和删除的开销，对比原来的multimap实现和分层时间轮
+// bulk:  先加入count个随机超时(1ms到60s)的定时器，再按随机顺序全部删除
+// churn: 保持10000个定时器在等待，循环count次 加入一个定时器 -> 马上删除，和每次rpc调用一个超时定时器一样
+//        原来的实现最多跑10000轮
+// fire:  时间轮加入100000个1ms到1s的定时器，跑reactor直到全部触发，统计延迟(包括加入这些定时器本身的时间)
+// ./test_timer_bench [count]
+
+namespace {
+
+const int BACKGROUND = 10000;
+
+// 原来的实现，去掉了日志，timerfd一样会设置
+class LegacyTimer {
+ public:
+  LegacyTimer() {
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  }
+
+  ~LegacyTimer() {
+    close(m_fd);
+  }
+
+  void addTimerEvent(tinyrpc::TimerEvent::ptr event) {
+    tinyrpc::RWMutex::WriteLock lock(m_event_mutex);
+    bool is_reset = m_pending_events.empty() || event->m_arrive_time < m_pending_events.begin()->second->m_arrive_time;
+    m_pending_events.emplace(event->m_arrive_time, event);
+    lock.unlock();
+    if (is_reset) {
+      resetArriveTime();
+    }
+  }
+
+  void delTimerEvent(tinyrpc::TimerEvent::ptr event) {
+    event->m_is_cancled = true;
+    tinyrpc::RWMutex::WriteLock lock(m_event_mutex);
+    auto begin = m_pending_events.lower_bound(event->m_arrive_time);
+    auto end = m_pending_events.upper_bound(event->m_arrive_time);
+    auto it = begin;
+    for (it = begin; it != end; ++it) {
+      if (it->second == event) {
+        break;
+      }
+    }
+    if (it != m_pending_events.end()) {
+      m_pending_events.erase(it);
+    }
+  }
+
+  void resetArriveTime() {
+    tinyrpc::RWMutex::ReadLock lock(m_event_mutex);
+    std::multimap<int64_t, tinyrpc::TimerEvent::ptr> tmp = m_pending_events;
+    lock.unlock();
+    if (tmp.size() == 0) {
+      return;
+    }
+    int64_t interval = tmp.begin()->first - tinyrpc::Clock::nowMs();
+    if (interval <= 0) {
+      interval = 1;
+    }
+    itimerspec new_value;
+    memset(&new_value, 0, sizeof(new_value));
+    new_value.it_value.tv_sec = interval / 1000;
+    new_value.it_value.tv_nsec = (interval % 1000) * 1000000;
+    timerfd_settime(m_fd, 0, &new_value, nullptr);
+  }
+
+ private:
+  int m_fd {-1};
+  std::multimap<int64_t, tinyrpc::TimerEvent::ptr> m_pending_events;
+  tinyrpc::RWMutex m_event_mutex;
+};
+
+std::vector<tinyrpc::TimerEvent::ptr> makeEvents(int count, int min_ms, int max_ms, std::mt19937& rng) {
+  std::uniform_int_distribution<int> dist(min_ms, max_ms);
+  std::vector<tinyrpc::TimerEvent::ptr> events;
+  events.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    events.push_back(std::make_shared<tinyrpc::TimerEvent>(dist(rng), false, []() {}));
+  }
+  return events;
+}
+
+double nsSince(std::chrono::steady_clock::time_point begin, int64_t ops) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ops;
+}
+
+template <class T>
+void bulk(T* timer, int count, double* add_ns, double* del_ns) {
+  std::mt19937 rng(1);
+  std::vector<tinyrpc::TimerEvent::ptr> events = makeEvents(count, 1, 60000, rng);
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < events.size(); ++i) {
+    timer->addTimerEvent(events[i]);
+  }
+  *add_ns = nsSince(begin, count);
+
+  std::shuffle(events.begin(), events.end(), rng);
+  begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < events.size(); ++i) {
+    timer->delTimerEvent(events[i]);
+  }
+  *del_ns = nsSince(begin, count);
+}
+
+template <class T>
+double churn(T* timer, int count) {
+  std::mt19937 rng(2);
+  std::vector<tinyrpc::TimerEvent::ptr> background = makeEvents(BACKGROUND, 1000, 60000, rng);
+  for (size_t i = 0; i < background.size(); ++i) {
+    timer->addTimerEvent(background[i]);
+  }
+  std::vector<tinyrpc::TimerEvent::ptr> events = makeEvents(count, 100, 5000, rng);
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < events.size(); ++i) {
+    timer->addTimerEvent(events[i]);
+    timer->delTimerEvent(events[i]);
+  }
+  double ns = nsSince(begin, count);
+  for (size_t i = 0; i < background.size(); ++i) {
+    timer->delTimerEvent(background[i]);
+  }
+  return ns;
+}
+
+void fire(tinyrpc::Reactor* reactor, int count) {
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<int> dist(1, 1000);
+  int fired = 0;
+  int64_t max_late = 0;
+  int64_t total_late = 0;
+  std::vector<tinyrpc::TimerEvent::ptr> events;
+  events.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    tinyrpc::TimerEvent::ptr event = std::make_shared<tinyrpc::TimerEvent>(dist(rng), false, [&, reactor, count, i]() {
+      int64_t late = tinyrpc::Clock::nowMs() - events[i]->m_arrive_time;
+      max_late = std::max(max_late, late);
+      total_late += late;
+      if (++fired == count) {
+        reactor->stop();
+      }
+    });
+    events.push_back(event);
+    reactor->getTimer()->addTimerEvent(event);
+  }
+  reactor->loop();
+  std::cout << "fire: " << fired << "/" << count << " fired, late avg " << std::fixed << std::setprecision(3)
+            << static_cast<double>(total_late) / std::max(fired, 1) << " ms, max " << max_late << " ms" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int count = 1000000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  tinyrpc::Reactor reactor;
+  tinyrpc::Timer* wheel = reactor.getTimer();
+  LegacyTimer legacy;
+
+  double legacy_add = 0, legacy_del = 0, wheel_add = 0, wheel_del = 0;
+  bulk(&legacy, count, &legacy_add, &legacy_del);
+  bulk(wheel, count, &wheel_add, &wheel_del);
+  // 原来的实现新定时器最早的时候要拷贝整个multimap，一百万轮要跑好几分钟，少跑一些
+  int legacy_rounds = std::min(count, 10000);
+  double legacy_churn = churn(&legacy, legacy_rounds);
+  double wheel_churn = churn(wheel, count);
+
+  std::cout << "timers: " << count << ", churn rounds: multimap " << legacy_rounds << ", wheel " << count
+            << ", ns per op" << std::endl;
+  std::cout << std::setw(10) << "" << std::setw(12) << "add" << std::setw(12) << "cancel"
+            << std::setw(16) << "add+cancel" << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << std::setw(10) << "multimap" << std::setw(12) << legacy_add << std::setw(12) << legacy_del
+            << std::setw(16) << legacy_churn << std::endl;
+  std::cout << std::setw(10) << "wheel" << std::setw(12) << wheel_add << std::setw(12) << wheel_del
+            << std::setw(16) << wheel_churn << std::endl;
+
+  fire(&reactor, 100000);
+  return 0;
+}
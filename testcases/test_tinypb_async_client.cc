@@ -0,0 +1,67 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "src/net/reactor.h"
+#include "src/net/tinypb/tinypb_rpc_async_channel.h"
+#include "src/net/tinypb/tinypb_rpc_controller.h"
+#include "src/net/tinypb/tinypb_rpc_closure.h"
+#include "src/net/net_address.h"
+#include "test_tinypb_server.pb.h"
+
+// 一个TinyPbRpcAsyncChannel上同时发起count个调用，全部完成之后退出
+// 先启动 test_tinypb_server，再运行 ./test_tinypb_async_client [count]
+
+struct CallContext {
+  tinyrpc::TinyPbRpcController controller;
+  queryNameReq req;
+  queryNameRes res;
+  std::shared_ptr<tinyrpc::TinyPbRpcClosure> closure;
+};
+
+int main(int argc, char* argv[]) {
+  int count = 200;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  // 回调在这个reactor中执行，所以要在当前线程loop
+  tinyrpc::Reactor* reactor = tinyrpc::Reactor::getReactor();
+
+  tinyrpc::IPAddress::ptr addr = std::make_shared<tinyrpc::IPAddress>("127.0.0.1", 20000);
+  tinyrpc::TinyPbRpcAsyncChannel::ptr channel = std::make_shared<tinyrpc::TinyPbRpcAsyncChannel>(addr, reactor);
+  QueryService_Stub stub(channel.get());
+
+  int finish = 0;
+  int succ = 0;
+  std::vector<std::unique_ptr<CallContext>> calls;
+
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; ++i) {
+    calls.emplace_back(new CallContext());
+    CallContext* ctx = calls.back().get();
+    ctx->req.set_id(i);
+    ctx->controller.SetTimeout(5000);
+    ctx->closure = std::make_shared<tinyrpc::TinyPbRpcClosure>([ctx, i, count, reactor, &finish, &succ]() {
+      if (ctx->controller.ErrorCode() != 0) {
+        std::cout << "call " << i << " failed, error code: " << ctx->controller.ErrorCode()
+                  << ", error info: " << ctx->controller.ErrorText() << std::endl;
+      } else if (ctx->res.id() == i) {
+        ++succ;
+      }
+      if (++finish == count) {
+        reactor->stop();
+      }
+    });
+    stub.query_name(&ctx->controller, &ctx->req, &ctx->res, ctx->closure.get());
+  }
+  std::cout << "send " << count << " calls, inflight " << channel->getInflightCount() << std::endl;
+
+  reactor->loop();
+
+  double cost_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << "finish " << finish << " calls, succ " << succ << ", cost " << cost_ms << " ms" << std::endl;
+
+  return succ == count ? 0 : 1;
+}
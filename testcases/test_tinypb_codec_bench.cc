@@ -0,0 +1,69 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "src/net/tcp/tcp_buffer.h"
+#include "src/net/tinypb/tinypb_codec.h"
+#include "src/net/tinypb/tinypb_data.h"
+
+// TinyPB解码微基准：一次read缓冲了N个包，统计每个包的平均解码耗时
+// 解码直接在分段buffer上进行，每个包的耗时应该不随N增长
+// ./test_tinypb_codec_bench [payload_bytes]
+
+static void fillFrames(tinyrpc::TinyPbCodeC& codec, tinyrpc::TcpBuffer& buf, int count, const std::string& payload) {
+  for (int i = 0; i < count; ++i) {
+    tinyrpc::TinyPbStruct pk;
+    pk.msg_req = "12345678901234567890";
+    pk.service_full_name = "QueryService.query_age";
+    pk.pb_data = payload;
+    codec.encode(&buf, &pk);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int payload_size = 128;
+  if (argc > 1) {
+    payload_size = std::atoi(argv[1]);
+  }
+  std::string payload(payload_size, 'x');
+
+  tinyrpc::TinyPbCodeC codec;
+  const int total_frames = 1 << 18;
+
+  std::cout << "payload " << payload_size << " bytes, decode " << total_frames << " frames for each batch size" << std::endl;
+  std::cout << std::setw(16) << "frames/read" << std::setw(16) << "ns/frame" << std::endl;
+
+  for (int batch = 1; batch <= 4096; batch *= 4) {
+    int rounds = total_frames / batch;
+    int64_t cost_ns = 0;
+    int decoded = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+      tinyrpc::TcpBuffer buf(128);
+      fillFrames(codec, buf, batch, payload);
+
+      auto begin = std::chrono::steady_clock::now();
+      // 和TcpConnection::execute一样，一直解码到buffer为空
+      while (buf.readAble() > 0) {
+        tinyrpc::TinyPbStruct pk;
+        codec.decode(&buf, &pk);
+        if (!pk.decode_succ) {
+          break;
+        }
+        ++decoded;
+      }
+      cost_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    if (decoded != rounds * batch) {
+      std::cout << "decode error, expect " << rounds * batch << " frames, got " << decoded << std::endl;
+      return 1;
+    }
+    std::cout << std::setw(16) << batch << std::setw(16) << std::fixed << std::setprecision(1)
+              << (double)cost_ns / decoded << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "src/net/tcp/tcp_buffer.h"
+#include "src/net/tinypb/tinypb_codec.h"
+#include "src/net/tinypb/tinypb_data.h"
+
+// 流水线吞吐基准：一个连接上一次发送depth个请求，再等depth个回复，统计不同depth下的rps
+// 服务端会把一次读到的多个请求的回复合并成一次writev，depth越大rps应该越高
+// 先启动 test_tinypb_server，再运行 ./test_tinypb_pipeline_bench [ip] [port] [seconds] [max_depth]
+// 调用query_name(query_age里面会sleep 1s)，空的queryNameReq序列化之后就是空串，所以这里不需要依赖生成的pb文件
+
+static int connectServer(const char* ip, int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, ip, &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int flag = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  return fd;
+}
+
+static bool sendAll(int fd, tinyrpc::TcpBuffer& buf) {
+  while (buf.readAble() > 0) {
+    struct iovec vecs[64];
+    int count = buf.getReadVecs(vecs, 64);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vecs;
+    msg.msg_iovlen = count;
+    ssize_t rt = sendmsg(fd, &msg, 0);
+    if (rt <= 0) {
+      return false;
+    }
+    buf.recycleRead(rt);
+  }
+  return true;
+}
+
+// 读回复直到解出count个包
+static bool recvReplies(int fd, tinyrpc::TinyPbCodeC& codec, tinyrpc::TcpBuffer& buf, int count) {
+  char tmp[64 * 1024];
+  while (count > 0) {
+    while (buf.readAble() > 0 && count > 0) {
+      tinyrpc::TinyPbStruct pk;
+      codec.decode(&buf, &pk);
+      if (!pk.decode_succ) {
+        break;
+      }
+      if (pk.err_code != 0) {
+        std::cout << "server reply error_code=" << pk.err_code << ", err_info=" << pk.err_info << std::endl;
+        return false;
+      }
+      --count;
+    }
+    if (count == 0) {
+      break;
+    }
+    ssize_t rt = recv(fd, tmp, sizeof(tmp), 0);
+    if (rt <= 0) {
+      return false;
+    }
+    buf.writeToBuffer(tmp, rt);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const char* ip = "127.0.0.1";
+  int port = 20000;
+  int seconds = 2;
+  if (argc > 1) {
+    ip = argv[1];
+  }
+  if (argc > 2) {
+    port = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    seconds = std::atoi(argv[3]);
+  }
+  int max_depth = 256;
+  if (argc > 4) {
+    max_depth = std::atoi(argv[4]);
+  }
+
+  int fd = connectServer(ip, port);
+  if (fd < 0) {
+    std::cout << "connect " << ip << ":" << port << " error, start test_tinypb_server first" << std::endl;
+    return 1;
+  }
+
+  tinyrpc::TinyPbCodeC codec;
+  int64_t msg_no = 0;
+
+  std::cout << "server " << ip << ":" << port << ", " << seconds << " s for each depth" << std::endl;
+  std::cout << std::setw(10) << "depth" << std::setw(16) << "requests" << std::setw(16) << "rps" << std::endl;
+
+  for (int depth = 1; depth <= max_depth; depth *= 2) {
+    tinyrpc::TcpBuffer out(128);
+    tinyrpc::TcpBuffer in(128);
+    int64_t done = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+      for (int i = 0; i < depth; ++i) {
+        tinyrpc::TinyPbStruct pk;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%020ld", static_cast<long>(++msg_no));
+        pk.msg_req = buf;
+        pk.service_full_name = "QueryService.query_name";
+        codec.encode(&out, &pk);
+      }
+      if (!sendAll(fd, out) || !recvReplies(fd, codec, in, depth)) {
+        std::cout << "connection error at depth " << depth << std::endl;
+        close(fd);
+        return 1;
+      }
+      done += depth;
+    }
+    double cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << std::setw(10) << depth << std::setw(16) << done
+              << std::setw(16) << std::fixed << std::setprecision(0) << done / cost << std::endl;
+  }
+
+  close(fd);
+  return 0;
+}
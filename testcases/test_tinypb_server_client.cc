@@ -5,11 +5,14 @@
 #include "src/net/tinypb/tinypb_rpc_controller.h"
 #include "src/net/tinypb/tinypb_rpc_closure.h"
 #include "src/net/net_address.h"
+#include "src/net/tcp/tcp_client_pool.h"
 #include "test_tinypb_server.pb.h"
 
 void test_client() {
 
   tinyrpc::IPAddress::ptr addr = std::make_shared<tinyrpc::IPAddress>("127.0.0.1", 20000);
+  // 预先建立连接，channel调用的时候直接从连接池拿
+  tinyrpc::getTcpClientPool()->warmUp(addr, 1);
 
   tinyrpc::TinyPbRpcChannel channel(addr);
   QueryService_Stub stub(&channel);
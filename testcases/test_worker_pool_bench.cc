@@ -0,0 +1,283 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include "src/coroutine/coroutine.h"
+#include "src/net/reactor.h"
+#include "src/net/tcp/worker_thread_pool.h"
+
+// 工作线程池的收益和开销
+// 1. 一个reactor线程里heavy个协程反复执行work_us的CPU任务，另一个light协程不停让出，统计light两次被调度的间隔
+//    inline是任务直接在io协程里跑，offload是交给工作线程池，io协程挂起
+//    间隔代表同一个io线程上其他连接要等多久才能被处理
+// 2. 空任务的runAndWait来回一次的耗时，就是交给工作线程再回到io线程的开销
+// 3. 压力：io_threads个reactor线程，每个stress_cors个协程同时runAndWait，每次调用都要在max_ms内回来
+//    工作线程跨线程唤醒io线程，唤醒丢了的话要等到epoll_wait超时(10s)，超过就失败，进程返回1
+// ./test_worker_pool_bench [workers] [heavy] [work_us] [tasks] [roundtrips] [io_threads] [stress_cors] [stress_calls] [max_ms]
+
+static const int STACK_SIZE = 128 * 1024;
+
+struct Options {
+  int workers {4};
+  int heavy {4};
+  int work_us {500};
+  int tasks {200};
+  int roundtrips {20000};
+  int io_threads {4};
+  int stress_cors {16};
+  int stress_calls {500};
+  int max_ms {1000};
+};
+
+static Options g_opt;
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void burn(int us) {
+  int64_t end = nowNs() + us * 1000LL;
+  while (nowNs() < end) {
+  }
+}
+
+// 放到本线程reactor的任务队列末尾，让同线程的其他协程先跑
+static void reschedule() {
+  tinyrpc::Coroutine* cur = tinyrpc::Coroutine::getCurrentCoroutine();
+  tinyrpc::Reactor::getReactor()->addCoroutine(cur->shared_from_this());
+  tinyrpc::Coroutine::Yield();
+}
+
+// 一个reactor线程跑bodies里的协程，全部结束之后停掉reactor，返回耗时秒数
+static double runOnReactor(const std::vector<std::function<void()>>& bodies) {
+  double seconds = 0;
+  std::thread thread([&]() {
+    tinyrpc::Coroutine::getCurrentCoroutine();
+    tinyrpc::Reactor reactor;
+    int running = static_cast<int>(bodies.size());
+
+    std::vector<tinyrpc::Coroutine::ptr> cors;
+    std::vector<std::vector<char>> stacks(bodies.size(), std::vector<char>(STACK_SIZE));
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      cors.push_back(std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, &stacks[i][0], [&, i]() {
+        bodies[i]();
+        if (--running == 0) {
+          reactor.stop();
+        }
+      }));
+      reactor.addCoroutine(cors.back(), false);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    reactor.loop();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  });
+  thread.join();
+  return seconds;
+}
+
+// threads个reactor线程，每个线程跑cors个body，全部结束之后停掉所有reactor，返回耗时秒数
+static double runOnReactors(int threads, int cors, std::function<void()> body) {
+  std::vector<tinyrpc::Reactor*> reactors(threads, nullptr);
+  std::atomic<int> ready(0);
+  std::atomic<int> running(threads * cors);
+  std::atomic<bool> start(false);
+
+  std::vector<std::thread> io_threads;
+  for (int t = 0; t < threads; ++t) {
+    io_threads.emplace_back([&, t]() {
+      tinyrpc::Coroutine::getCurrentCoroutine();
+      tinyrpc::Reactor reactor;
+      reactors[t] = &reactor;
+
+      std::vector<tinyrpc::Coroutine::ptr> cors_of_thread;
+      std::vector<std::vector<char>> stacks(cors, std::vector<char>(STACK_SIZE));
+      for (int i = 0; i < cors; ++i) {
+        cors_of_thread.push_back(std::make_shared<tinyrpc::Coroutine>(STACK_SIZE, &stacks[i][0], [&]() {
+          body();
+          if (--running == 0) {
+            for (size_t j = 0; j < reactors.size(); ++j) {
+              reactors[j]->stop();
+            }
+          }
+        }));
+        reactor.addCoroutine(cors_of_thread.back(), false);
+      }
+
+      ++ready;
+      while (!start) {
+        std::this_thread::yield();
+      }
+      reactor.loop();
+    });
+  }
+
+  while (ready < threads) {
+    std::this_thread::yield();
+  }
+  auto begin = std::chrono::steady_clock::now();
+  start = true;
+  for (size_t i = 0; i < io_threads.size(); ++i) {
+    io_threads[i].join();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void latencyBench(const std::string& name, tinyrpc::WorkerThreadPool* pool) {
+  std::atomic<int> heavy_running(g_opt.heavy);
+  std::vector<int64_t> gaps;
+
+  std::vector<std::function<void()>> bodies;
+  for (int i = 0; i < g_opt.heavy; ++i) {
+    bodies.push_back([&]() {
+      for (int n = 0; n < g_opt.tasks; ++n) {
+        if (pool) {
+          pool->runAndWait([]() { burn(g_opt.work_us); });
+        } else {
+          burn(g_opt.work_us);
+          reschedule();
+        }
+      }
+      --heavy_running;
+    });
+  }
+  bodies.push_back([&]() {
+    int64_t last = nowNs();
+    while (heavy_running > 0) {
+      reschedule();
+      int64_t now = nowNs();
+      gaps.push_back(now - last);
+      last = now;
+    }
+  });
+
+  double t = runOnReactor(bodies);
+
+  std::sort(gaps.begin(), gaps.end());
+  auto pct = [&](double p) -> double {
+    if (gaps.empty()) {
+      return 0;
+    }
+    return gaps[std::min(gaps.size() - 1, static_cast<size_t>(gaps.size() * p))] / 1000.0;
+  };
+  long tasks = static_cast<long>(g_opt.heavy) * g_opt.tasks;
+  std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(3) << std::setw(8) << t
+            << " s" << std::setw(10) << static_cast<long>(tasks / t) << " tasks/s" << std::setprecision(1)
+            << "   io gap p50 " << std::setw(8) << pct(0.5) << " us  p99 " << std::setw(8) << pct(0.99) << " us  max "
+            << std::setw(8) << pct(1.0) << " us" << std::endl;
+}
+
+static void roundTripBench(tinyrpc::WorkerThreadPool* pool) {
+  std::vector<std::function<void()>> bodies;
+  bodies.push_back([&]() {
+    for (int i = 0; i < g_opt.roundtrips; ++i) {
+      pool->runAndWait([]() {});
+    }
+  });
+  double t = runOnReactor(bodies);
+  std::cout << "offload round trip " << std::fixed << std::setprecision(2) << t * 1e9 / g_opt.roundtrips / 1000.0
+            << " us" << std::endl;
+}
+
+// 返回是否所有调用都在max_ms之内
+static bool stressBench(tinyrpc::WorkerThreadPool* pool) {
+  std::mutex mutex;
+  std::vector<int64_t> all;
+  std::atomic<long> slow(0);
+  int64_t bound = g_opt.max_ms * 1000000LL;
+
+  double t = runOnReactors(g_opt.io_threads, g_opt.stress_cors, [&]() {
+    std::vector<int64_t> local;
+    local.reserve(g_opt.stress_calls);
+    for (int i = 0; i < g_opt.stress_calls; ++i) {
+      int64_t begin = nowNs();
+      pool->runAndWait([]() { burn(20); });
+      int64_t cost = nowNs() - begin;
+      if (cost > bound) {
+        ++slow;
+      }
+      local.push_back(cost);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    all.insert(all.end(), local.begin(), local.end());
+  });
+
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) -> double {
+    if (all.empty()) {
+      return 0;
+    }
+    return all[std::min(all.size() - 1, static_cast<size_t>(all.size() * p))] / 1000.0;
+  };
+  std::cout << "stress " << g_opt.io_threads << " io threads x " << g_opt.stress_cors << " cors: " << all.size()
+            << " calls in " << std::fixed << std::setprecision(3) << t << " s, call p50 " << std::setprecision(1)
+            << pct(0.5) << " us  p99 " << pct(0.99) << " us  max " << pct(1.0) << " us, over " << g_opt.max_ms
+            << " ms: " << slow << std::endl;
+  return slow == 0;
+}
+
+static void printStats(tinyrpc::WorkerThreadPool* pool) {
+  tinyrpc::WorkerThreadPool::Stats stats = pool->getStats(true);
+  int64_t tasks = static_cast<int64_t>(std::max<uint64_t>(stats.tasks, 1));
+  std::cout << "pool stats: tasks=" << stats.tasks << " max_queue_depth=" << stats.max_queue_depth << std::fixed
+            << std::setprecision(1) << " avg_wait=" << stats.total_wait_ns / tasks / 1000.0
+            << " us max_wait=" << stats.max_wait_ns / 1000.0 << " us avg_run=" << stats.total_run_ns / tasks / 1000.0
+            << " us" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    g_opt.workers = std::atoi(argv[1]);
+  }
+  if (argc > 2) {
+    g_opt.heavy = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    g_opt.work_us = std::atoi(argv[3]);
+  }
+  if (argc > 4) {
+    g_opt.tasks = std::atoi(argv[4]);
+  }
+  if (argc > 5) {
+    g_opt.roundtrips = std::atoi(argv[5]);
+  }
+  if (argc > 6) {
+    g_opt.io_threads = std::atoi(argv[6]);
+  }
+  if (argc > 7) {
+    g_opt.stress_cors = std::atoi(argv[7]);
+  }
+  if (argc > 8) {
+    g_opt.stress_calls = std::atoi(argv[8]);
+  }
+  if (argc > 9) {
+    g_opt.max_ms = std::atoi(argv[9]);
+  }
+
+  std::cout << "workers=" << g_opt.workers << " heavy=" << g_opt.heavy << " work_us=" << g_opt.work_us
+            << " tasks=" << g_opt.tasks << " roundtrips=" << g_opt.roundtrips << std::endl;
+
+  latencyBench("inline", nullptr);
+
+  tinyrpc::WorkerThreadPool pool(g_opt.workers);
+  pool.start();
+  latencyBench("offload", &pool);
+  printStats(&pool);
+
+  roundTripBench(&pool);
+  printStats(&pool);
+
+  bool ok = stressBench(&pool);
+  printStats(&pool);
+  pool.stop();
+  std::cout << (ok ? "OK" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,425 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+
+#include "src/comm/log_binary.h"
+
+// 把二进制日志(log.log_format配置为binary)还原成和文本日志一样的格式，输出到标准输出
+// ./tinyrpc_logcat test_tinypb_server_20230101_rpc_0.blog [more.blog ...]
+// 不带文件的时候读标准输入，比如 cat *.blog | ./tinyrpc_logcat
+
+namespace {
+
+struct Site {
+  uint8_t level {0};
+  uint8_t type {0};
+  uint8_t kind {0};
+  uint32_t line {0};
+  std::string file_name;
+  std::string fmt;
+};
+
+struct Arg {
+  uint8_t type {0};
+  int64_t i {0};
+  uint64_t u {0};
+  double d {0};
+  std::string s;
+};
+
+const char* levelToString(uint8_t level) {
+  switch (level) {
+    case 1:
+      return "DEBUG";
+    case 2:
+      return "INFO";
+    case 3:
+      return "WARN";
+    case 4:
+      return "ERROR";
+    default:
+      return "NONE";
+  }
+}
+
+// 按边界读，越界返回false
+class Reader {
+ public:
+  Reader(const char* p, const char* end) : m_p(p), m_end(end) {}
+
+  template <typename T>
+  bool get(T* v) {
+    if (m_end - m_p < static_cast<long>(sizeof(T))) {
+      return false;
+    }
+    m_p = tinyrpc::logGet<T>(m_p, v);
+    return true;
+  }
+
+  bool getBytes(size_t len, std::string* out) {
+    if (static_cast<size_t>(m_end - m_p) < len) {
+      return false;
+    }
+    out->assign(m_p, len);
+    m_p += len;
+    return true;
+  }
+
+  bool getStr16(std::string* out) {
+    uint16_t len = 0;
+    return get(&len) && getBytes(len, out);
+  }
+
+  bool getArg(Arg* arg) {
+    if (!get(&arg->type)) {
+      return false;
+    }
+    switch (arg->type) {
+      case tinyrpc::LOG_ARG_INT:
+        return get(&arg->i);
+      case tinyrpc::LOG_ARG_UINT:
+      case tinyrpc::LOG_ARG_PTR:
+        return get(&arg->u);
+      case tinyrpc::LOG_ARG_DOUBLE:
+        return get(&arg->d);
+      case tinyrpc::LOG_ARG_STR: {
+        uint32_t len = 0;
+        return get(&len) && getBytes(len, &arg->s);
+      }
+      default:
+        return false;
+    }
+  }
+
+  const char* pos() const { return m_p; }
+  const char* end() const { return m_end; }
+
+ private:
+  const char* m_p;
+  const char* m_end;
+};
+
+int64_t argToInt(const Arg& arg) {
+  switch (arg.type) {
+    case tinyrpc::LOG_ARG_INT:
+      return arg.i;
+    case tinyrpc::LOG_ARG_DOUBLE:
+      return static_cast<int64_t>(arg.d);
+    default:
+      return static_cast<int64_t>(arg.u);
+  }
+}
+
+double argToDouble(const Arg& arg) {
+  switch (arg.type) {
+    case tinyrpc::LOG_ARG_DOUBLE:
+      return arg.d;
+    case tinyrpc::LOG_ARG_INT:
+      return static_cast<double>(arg.i);
+    default:
+      return static_cast<double>(arg.u);
+  }
+}
+
+template <typename T>
+void appendf(std::string* out, const std::string& spec, T value) {
+  char buf[256];
+  int size = snprintf(buf, sizeof(buf), spec.c_str(), value);
+  if (size < 0) {
+    return;
+  }
+  if (size < static_cast<int>(sizeof(buf))) {
+    out->append(buf, size);
+    return;
+  }
+  std::string tmp(size + 1, '\0');
+  snprintf(&tmp[0], size + 1, spec.c_str(), value);
+  out->append(tmp.c_str(), size);
+}
+
+// 按格式串把参数一个个交给snprintf，整数统一按ll输出(h、hh先截断)，参数不够的地方输出<missing>
+std::string formatArgs(const std::string& fmt, Reader* reader) {
+  std::string out;
+  size_t n = fmt.size();
+  for (size_t i = 0; i < n; ++i) {
+    if (fmt[i] != '%') {
+      out += fmt[i];
+      continue;
+    }
+    if (i + 1 < n && fmt[i + 1] == '%') {
+      out += '%';
+      ++i;
+      continue;
+    }
+
+    std::string spec = "%";
+    ++i;
+    while (i < n && strchr("-+ #0'", fmt[i])) {
+      spec += fmt[i++];
+    }
+    for (int part = 0; part < 2; ++part) {
+      // 第一次是宽度，第二次是精度
+      if (part == 1) {
+        if (i >= n || fmt[i] != '.') {
+          break;
+        }
+        spec += fmt[i++];
+      }
+      if (i < n && fmt[i] == '*') {
+        Arg arg;
+        spec += reader->getArg(&arg) ? std::to_string(argToInt(arg)) : "0";
+        ++i;
+      }
+      while (i < n && fmt[i] >= '0' && fmt[i] <= '9') {
+        spec += fmt[i++];
+      }
+    }
+    int short_len = 0;  // h的个数
+    while (i < n && strchr("hlLqjzt", fmt[i])) {
+      if (fmt[i] == 'h') {
+        ++short_len;
+      }
+      ++i;
+    }
+    if (i >= n) {
+      break;
+    }
+
+    char conv = fmt[i];
+    if (conv == 'n') {
+      continue;
+    }
+    if (!strchr("diouxXeEfFgGaAcsp", conv)) {
+      out += spec;
+      out += conv;
+      continue;
+    }
+    Arg arg;
+    if (!reader->getArg(&arg)) {
+      out += "<missing>";
+      continue;
+    }
+    switch (conv) {
+      case 'd':
+      case 'i': {
+        long long v = argToInt(arg);
+        if (short_len == 1) {
+          v = static_cast<short>(v);
+        } else if (short_len >= 2) {
+          v = static_cast<signed char>(v);
+        }
+        appendf(&out, spec + "ll" + conv, v);
+        break;
+      }
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X': {
+        unsigned long long v = argToInt(arg);
+        if (short_len == 1) {
+          v = static_cast<unsigned short>(v);
+        } else if (short_len >= 2) {
+          v = static_cast<unsigned char>(v);
+        }
+        appendf(&out, spec + "ll" + conv, v);
+        break;
+      }
+      case 'c':
+        appendf(&out, spec + conv, static_cast<int>(argToInt(arg)));
+        break;
+      case 's':
+        if (arg.type == tinyrpc::LOG_ARG_STR) {
+          appendf(&out, spec + conv, arg.s.c_str());
+        } else {
+          out += "<bad arg>";
+        }
+        break;
+      case 'p':
+        appendf(&out, spec + conv, reinterpret_cast<void*>(static_cast<uintptr_t>(argToInt(arg))));
+        break;
+      default:
+        appendf(&out, spec + conv, argToDouble(arg));
+        break;
+    }
+  }
+  return out;
+}
+
+class Decoder {
+ public:
+  // 解码一个文件的全部内容，格式不对返回false
+  bool decode(const std::string& data, const std::string& name) {
+    const char* p = data.data();
+    const char* end = p + data.size();
+    bool first = true;
+    while (p < end) {
+      uint32_t len = 0;
+      uint8_t type = 0;
+      if (end - p < static_cast<long>(tinyrpc::LOG_RECORD_HEADER_SIZE)) {
+        break;
+      }
+      tinyrpc::logGet<uint8_t>(tinyrpc::logGet<uint32_t>(p, &len), &type);
+      if (len == 0) {
+        // log_mmap的进程异常退出，后面是没写过的预分配部分
+        p = end;
+        break;
+      }
+      if (len < tinyrpc::LOG_RECORD_HEADER_SIZE || static_cast<size_t>(end - p) < len) {
+        break;
+      }
+      if (first && type != tinyrpc::LOG_RECORD_HEAD) {
+        std::cerr << name << ": not a tinyrpc binary log" << std::endl;
+        return false;
+      }
+      first = false;
+
+      Reader reader(p + tinyrpc::LOG_RECORD_HEADER_SIZE, p + len);
+      bool ok = true;
+      switch (type) {
+        case tinyrpc::LOG_RECORD_HEAD:
+          ok = onHead(&reader);
+          break;
+        case tinyrpc::LOG_RECORD_SITE:
+          ok = onSite(&reader);
+          break;
+        case tinyrpc::LOG_RECORD_EVENT:
+          ok = onEvent(&reader);
+          break;
+        case tinyrpc::LOG_RECORD_DROPPED: {
+          uint64_t dropped = 0;
+          ok = reader.get(&dropped);
+          std::cout << "[log ring full, dropped " << dropped << " log lines]\n";
+          break;
+        }
+        default:
+          // 新版本的记录，跳过
+          break;
+      }
+      if (!ok) {
+        std::cerr << name << ": bad record at offset " << (p - data.data()) << std::endl;
+      }
+      p += len;
+    }
+    if (p != end) {
+      std::cerr << name << ": truncated record at offset " << (p - data.data()) << std::endl;
+    }
+    return true;
+  }
+
+ private:
+  bool onHead(Reader* reader) {
+    std::string magic;
+    uint32_t version = 0;
+    if (!reader->getBytes(sizeof(tinyrpc::LOG_BINARY_MAGIC), &magic) || magic.compare(0, magic.size(), tinyrpc::LOG_BINARY_MAGIC, sizeof(tinyrpc::LOG_BINARY_MAGIC)) != 0) {
+      return false;
+    }
+    if (!reader->get(&version) || !reader->get(&m_pid) || !reader->get(&m_gmtoff)) {
+      return false;
+    }
+    // 新的进程打开文件，调用点重新编号
+    m_sites.clear();
+    m_format_sec = -1;
+    return true;
+  }
+
+  bool onSite(Reader* reader) {
+    uint32_t id = 0;
+    Site site;
+    if (!reader->get(&id) || !reader->get(&site.level) || !reader->get(&site.type) || !reader->get(&site.kind)
+        || !reader->get(&site.line) || !reader->getStr16(&site.file_name) || !reader->getStr16(&site.fmt)) {
+      return false;
+    }
+    m_sites[id] = site;
+    return true;
+  }
+
+  bool onEvent(Reader* reader) {
+    uint32_t id = 0;
+    int64_t now_us = 0;
+    uint32_t tid = 0;
+    int32_t cor_id = 0;
+    std::string msgno;
+    std::string interface_name;
+    if (!reader->get(&id) || !reader->get(&now_us) || !reader->get(&tid) || !reader->get(&cor_id)
+        || !reader->getStr16(&msgno) || !reader->getStr16(&interface_name)) {
+      return false;
+    }
+
+    std::map<uint32_t, Site>::iterator it = m_sites.find(id);
+    if (it == m_sites.end()) {
+      std::cout << "[unknown log site " << id << "]\n";
+      return true;
+    }
+    const Site& site = it->second;
+
+    // 和文本日志一样的日志头
+    int64_t sec = now_us / 1000000;
+    if (sec != m_format_sec) {
+      time_t local_sec = static_cast<time_t>(sec + m_gmtoff);
+      struct tm time;
+      gmtime_r(&local_sec, &time);
+      strftime(m_format_buf, sizeof(m_format_buf), "%Y-%m-%d %H:%M:%S", &time);
+      m_format_sec = sec;
+    }
+    std::ostringstream ss;
+    ss << "[" << m_format_buf << "." << now_us % 1000000 << "]\t"
+       << "[" << levelToString(site.level) << "]\t"
+       << "[" << m_pid << "]\t"
+       << "[" << tid << "]\t"
+       << "[" << cor_id << "]\t"
+       << "[" << site.file_name << ":" << site.line << "]\t";
+    if (!msgno.empty()) {
+      ss << "[" << msgno << "]\t";
+    }
+    if (!interface_name.empty()) {
+      ss << "[" << interface_name << "]\t";
+    }
+
+    if (site.kind == tinyrpc::LOG_SITE_PRINTF) {
+      ss << "[" << site.file_name << ":" << site.line << "]\t" << formatArgs(site.fmt, reader);
+    } else {
+      ss.write(reader->pos(), reader->end() - reader->pos());
+    }
+    ss << "\n";
+    std::cout << ss.str();
+    return true;
+  }
+
+  std::map<uint32_t, Site> m_sites;
+  uint32_t m_pid {0};
+  int32_t m_gmtoff {0};
+  int64_t m_format_sec {-1};
+  char m_format_buf[64] {0};
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Decoder decoder;
+  int rt = 0;
+  if (argc < 2) {
+    std::stringstream ss;
+    ss << std::cin.rdbuf();
+    return decoder.decode(ss.str(), "stdin") ? 0 : 1;
+  }
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+      std::cerr << argv[i] << ": open failed" << std::endl;
+      rt = 1;
+      continue;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    if (!decoder.decode(ss.str(), argv[i])) {
+      rt = 1;
+    }
+  }
+  return rt;
+}